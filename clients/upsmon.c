@@ -2731,6 +2731,7 @@ static void parse_status(utype_t *ups, char *status, char *buzzword, char *buzzw
 	char	*statword, *ptr, other_stat_words[SMALLBUF];
 	int	handled_stat_words = 0, changed_other_stat_words = 0,
 		is_eco_buzzword = 0;
+	unsigned long	status_bits;
 	st_tree_timespec_t	st_start;
 
 	clear_alarm();
@@ -2745,26 +2746,30 @@ static void parse_status(utype_t *ups, char *status, char *buzzword, char *buzzw
 
 	ups_is_alive(ups);
 
+	/* Standard tokens are looked up once into a bit mask; this also
+	 * avoids substring false positives (e.g. "OFF" in "OFFLINE") */
+	status_bits = state_status_parse(status, NULL, 0);
+
 	/* clear these out early if they disappear */
-	if (!strstr(status, "LB"))
+	if (!(status_bits & ST_STATUS_LB))
 		clearflag(&ups->status, ST_LOWBATT);
-	if (!strstr(status, "FSD"))
+	if (!(status_bits & ST_STATUS_FSD))
 		clearflag(&ups->status, ST_FSD);
 
 	/* similar to above - clear these flags and send notifications */
-	if (!strstr(status, "CAL"))
+	if (!(status_bits & ST_STATUS_CAL))
 		ups_is_notcal(ups);
-	if (!strstr(status, "OFF"))
+	if (!(status_bits & ST_STATUS_OFF))
 		ups_is_notoff(ups);
-	if (!strstr(status, "BYPASS"))
+	if (!(status_bits & ST_STATUS_BYPASS))
 		ups_is_notbypass(ups);
-	if (!strstr(status, "ALARM"))
+	if (!(status_bits & ST_STATUS_ALARM))
 		ups_is_notalarm(ups);
-	if (!strstr(status, "OVER"))
+	if (!(status_bits & ST_STATUS_OVER))
 		ups_is_notover(ups);
-	if (!strstr(status, "TRIM"))
+	if (!(status_bits & ST_STATUS_TRIM))
 		ups_is_nottrim(ups);
-	if (!strstr(status, "BOOST"))
+	if (!(status_bits & ST_STATUS_BOOST))
 		ups_is_notboost(ups);
 
 	/* NOTE: ECO Should not be happening as a status or alarm anymore
@@ -2786,7 +2791,7 @@ static void parse_status(utype_t *ups, char *status, char *buzzword, char *buzzw
 		is_eco_buzzword = 1;
 	}
 
-	if (!strstr(status, "ECO") && !is_eco_buzzword) {
+	if (!(status_bits & ST_STATUS_ECO) && !is_eco_buzzword) {
 		ups_is_noteco(ups);
 	} else if (is_eco_buzzword) {
 		ups_is_eco(ups);
@@ -2809,73 +2814,71 @@ static void parse_status(utype_t *ups, char *status, char *buzzword, char *buzzw
 		handled_stat_words++;
 
 		/* Keep in sync with "Status data" chapter of docs/new-drivers.txt */
-		if (!strcasecmp(statword, "OL")) {
-			ups_on_line(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "OB")) {
-			ups_on_batt(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "LB")) {
-			ups_low_batt(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "RB")) {
-			upsreplbatt(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "CAL")) {
-			ups_is_cal(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "OFF")) {
-			ups_is_off(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "BYPASS")) {
-			ups_is_bypass(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "ECO")) {
-			/* NOTE: ECO Should not be happening
-			 * as a status or alarm anymore */
-			ups_is_eco(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "ALARM")) {
-			ups_is_alarm(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "OVER")) {
-			ups_is_over(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "TRIM")) {
-			ups_is_trim(ups);
-			handled++;
-		}
-		else if (!strcasecmp(statword, "BOOST")) {
-			ups_is_boost(ups);
-			handled++;
-		}
-		/* do it last to override any possible OL */
-		else if (!strcasecmp(statword, "FSD")) {
-			ups_fsd(ups);
-			handled++;
-		}
-		/* Known standard status tokens, some being obsoleted, no upsmon reaction assigned */
-		else if (
-		    !strcasecmp(statword, "HB")
-		 || !strcasecmp(statword, "CHRG")
-		 || !strcasecmp(statword, "DISCHRG")
-		 || !strcasecmp(statword, "OVER")
-		 || !strcasecmp(statword, "TRIM")
-		 || !strcasecmp(statword, "BOOST")
-		) {
-			/* FIXME: Do we want these logged similar to OTHERs? */
-			upsdebugx(4, "Known and ignored status token: [%s]", statword);
-			handled++;
+		switch (state_status_token_bit(statword)) {
+			case ST_STATUS_OL:
+				ups_on_line(ups);
+				handled++;
+				break;
+			case ST_STATUS_OB:
+				ups_on_batt(ups);
+				handled++;
+				break;
+			case ST_STATUS_LB:
+				ups_low_batt(ups);
+				handled++;
+				break;
+			case ST_STATUS_RB:
+				upsreplbatt(ups);
+				handled++;
+				break;
+			case ST_STATUS_CAL:
+				ups_is_cal(ups);
+				handled++;
+				break;
+			case ST_STATUS_OFF:
+				ups_is_off(ups);
+				handled++;
+				break;
+			case ST_STATUS_BYPASS:
+				ups_is_bypass(ups);
+				handled++;
+				break;
+			case ST_STATUS_ECO:
+				/* NOTE: ECO Should not be happening
+				 * as a status or alarm anymore */
+				ups_is_eco(ups);
+				handled++;
+				break;
+			case ST_STATUS_ALARM:
+				ups_is_alarm(ups);
+				handled++;
+				break;
+			case ST_STATUS_OVER:
+				ups_is_over(ups);
+				handled++;
+				break;
+			case ST_STATUS_TRIM:
+				ups_is_trim(ups);
+				handled++;
+				break;
+			case ST_STATUS_BOOST:
+				ups_is_boost(ups);
+				handled++;
+				break;
+			case ST_STATUS_FSD:
+				ups_fsd(ups);
+				handled++;
+				break;
+			/* Known standard status tokens, some being obsoleted, no upsmon reaction assigned */
+			case ST_STATUS_HB:
+			case ST_STATUS_CHRG:
+			case ST_STATUS_DISCHRG:
+				/* FIXME: Do we want these logged similar to OTHERs? */
+				upsdebugx(4, "Known and ignored status token: [%s]", statword);
+				handled++;
+				break;
+			default:
+				break;
 		}
 
 		if (!handled) {
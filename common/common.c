@@ -1629,6 +1629,46 @@ void writepid(const char *name)
 #endif	/* WIN32 */
 }
 
+/* create a new file to write the next contents of fn into, to be renamed
+ * over it once complete; see common.h for details */
+FILE *fopen_tmp_sibling(const char *fn, char *tmpfn, size_t tmpfnlen, mode_t mode)
+{
+	int	fd, ret;
+	FILE	*f;
+
+#ifndef WIN32
+	ret = snprintf(tmpfn, tmpfnlen, "%s.XXXXXX", fn);
+#else	/* WIN32 */
+	ret = snprintf(tmpfn, tmpfnlen, "%s.%ld", fn, (long)getpid());
+#endif	/* WIN32 */
+	if (ret < 0 || (size_t)ret >= tmpfnlen) {
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+
+#ifndef WIN32
+	/* never an existing file nor a symlink planted there */
+	if ((fd = mkstemp(tmpfn)) < 0)
+		return NULL;
+
+	if (fchmod(fd, mode) != 0) {
+		upsdebug_with_errno(1, "%s: can't set the mode of %s", __func__, tmpfn);
+	}
+#else	/* WIN32 */
+	if ((fd = open(tmpfn, O_WRONLY | O_CREAT | O_EXCL, mode)) < 0)
+		return NULL;
+#endif	/* WIN32 */
+
+	if ((f = fdopen(fd, "w")) == NULL) {
+		ret = errno;
+		close(fd);
+		unlink(tmpfn);
+		errno = ret;
+	}
+
+	return f;
+}
+
 /* send sig to pid, returns -1 for error, or
  * zero for a successfully sent signal
  */
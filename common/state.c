@@ -270,6 +270,38 @@ int state_delinfo_olderthan(st_tree_t **nptr, const char *var, const st_tree_tim
 	return 0;	/* not found */
 }
 
+/* update the value of an already known node, e.g. one found by
+ * state_tree_find() earlier; same return codes as state_setinfo() */
+int state_setinfo_node(st_tree_t *node, const char *val)
+{
+	/* refresh even if "skip-writing" same info value */
+	st_tree_node_refresh_timestamp(node);
+
+	/* updating an existing entry */
+	if (!strcasecmp(node->raw, val)) {
+		return 0;	/* no change */
+	}
+
+	/* changes should be ignored */
+	if (node->flags & ST_FLAG_IMMUTABLE) {
+		upsdebugx(6, "%s: not changing immutable variable [%s]", __func__, node->var);
+		return 0;	/* no change */
+	}
+
+	/* expand the buffer if the value grows */
+	if (node->rawsize < (strlen(val) + 1)) {
+		node->rawsize = strlen(val) + 1;
+		node->raw = xrealloc(node->raw, node->rawsize);
+	}
+
+	/* store the literal value for later comparisons */
+	snprintf(node->raw, node->rawsize, "%s", val);
+
+	val_escape(node);
+
+	return 1;	/* changed */
+}
+
 int state_setinfo(st_tree_t **nptr, const char *var, const char *val)
 {
 	while (*nptr) {
@@ -286,32 +318,7 @@ int state_setinfo(st_tree_t **nptr, const char *var, const char *val)
 			continue;
 		}
 
-		/* refresh even if "skip-writing" same info value */
-		st_tree_node_refresh_timestamp(node);
-
-		/* updating an existing entry */
-		if (!strcasecmp(node->raw, val)) {
-			return 0;	/* no change */
-		}
-
-		/* changes should be ignored */
-		if (node->flags & ST_FLAG_IMMUTABLE) {
-			upsdebugx(6, "%s: not changing immutable variable [%s]", __func__, var);
-			return 0;	/* no change */
-		}
-
-		/* expand the buffer if the value grows */
-		if (node->rawsize < (strlen(val) + 1)) {
-			node->rawsize = strlen(val) + 1;
-			node->raw = xrealloc(node->raw, node->rawsize);
-		}
-
-		/* store the literal value for later comparisons */
-		snprintf(node->raw, node->rawsize, "%s", val);
-
-		val_escape(node);
-
-		return 1;	/* changed */
+		return state_setinfo_node(node, val);
 	}
 
 	*nptr = xcalloc(1, sizeof(**nptr));
@@ -733,3 +740,98 @@ st_tree_t *state_tree_find(st_tree_t *node, const char *var)
 
 	return node;
 }
+
+/* Standard ups.status tokens, in the order of docs/new-drivers.txt */
+static const struct {
+	const char	*name;
+	size_t	len;
+	unsigned long	bit;
+} state_status_tokens[] = {
+	{ "OL",		2, ST_STATUS_OL },
+	{ "OB",		2, ST_STATUS_OB },
+	{ "LB",		2, ST_STATUS_LB },
+	{ "HB",		2, ST_STATUS_HB },
+	{ "RB",		2, ST_STATUS_RB },
+	{ "CHRG",	4, ST_STATUS_CHRG },
+	{ "DISCHRG",	7, ST_STATUS_DISCHRG },
+	{ "BYPASS",	6, ST_STATUS_BYPASS },
+	{ "CAL",	3, ST_STATUS_CAL },
+	{ "OFF",	3, ST_STATUS_OFF },
+	{ "OVER",	4, ST_STATUS_OVER },
+	{ "TRIM",	4, ST_STATUS_TRIM },
+	{ "BOOST",	5, ST_STATUS_BOOST },
+	{ "FSD",	3, ST_STATUS_FSD },
+	{ "ALARM",	5, ST_STATUS_ALARM },
+	{ "ECO",	3, ST_STATUS_ECO },
+	{ NULL,		0, 0 }
+};
+
+/* look up "len" characters at "token" (not necessarily NUL-terminated) */
+static unsigned long state_status_token_bit_len(const char *token, size_t len)
+{
+	size_t	i;
+
+	for (i = 0; state_status_tokens[i].name; i++) {
+		if (state_status_tokens[i].len == len
+		 && !strncasecmp(state_status_tokens[i].name, token, len)
+		) {
+			return state_status_tokens[i].bit;
+		}
+	}
+
+	return 0;
+}
+
+unsigned long state_status_token_bit(const char *token)
+{
+	if (!token || !*token)
+		return 0;
+
+	return state_status_token_bit_len(token, strlen(token));
+}
+
+const char *state_status_bit_token(unsigned long bit)
+{
+	size_t	i;
+
+	for (i = 0; state_status_tokens[i].name; i++) {
+		if (state_status_tokens[i].bit == bit)
+			return state_status_tokens[i].name;
+	}
+
+	return NULL;
+}
+
+unsigned long state_status_parse(const char *status, char *other, size_t othersize)
+{
+	unsigned long	bits = 0, bit;
+	const char	*s = status;
+	size_t	len;
+
+	if (other && othersize > 0)
+		*other = '\0';
+
+	if (!status)
+		return 0;
+
+	while (*s) {
+		if (*s == ' ') {
+			s++;
+			continue;
+		}
+
+		len = strcspn(s, " ");
+		bit = state_status_token_bit_len(s, len);
+
+		if (bit) {
+			bits |= bit;
+		} else if (other && othersize > 0) {
+			snprintfcat(other, othersize, "%s%.*s",
+				*other ? " " : "", (int)len, s);
+		}
+
+		s += len;
+	}
+
+	return bits;
+}
@@ -628,6 +628,24 @@ int str_ends_with(const char *s, const char *suff) {
 	return (slen >= sufflen) && (!memcmp(s + slen - sufflen, suff, sufflen));
 }
 
+size_t str_hash(const char *s, int nocase) {
+	size_t	hash = 5381;
+
+	for (; *s; s++)
+		hash = hash * 33 + (unsigned char)(nocase ? tolower((unsigned char)*s) : *s);
+
+	return hash;
+}
+
+size_t hash_table_size(size_t count) {
+	size_t	size = 16;
+
+	while (size < count * 2)
+		size *= 2;
+
+	return size;
+}
+
 #ifndef HAVE_STRTOF
 # include <errno.h>
 # include <stdio.h>
@@ -37,7 +37,7 @@
 #endif	/* WIN32 */
 
 #define DRIVER_NAME	"Megatec/Q1 protocol USB driver"
-#define DRIVER_VERSION	"0.23"
+#define DRIVER_VERSION	"0.24"
 
 /* driver description structure */
 upsdrv_info_t upsdrv_info = {
@@ -449,6 +449,11 @@ ssize_t blazer_command(const char *cmd, char *buf, size_t buflen)
 	ssize_t	ret;
 
 	if (udev == NULL) {
+		/* no use scanning the buses while the device is away */
+		if (!nut_libusb_reopen_due()) {
+			return LIBUSB_ERROR_NO_DEVICE;
+		}
+
 		dstate_setinfo("driver.state", "reconnect.trying");
 
 		ret = usb->open_dev(&udev, &usbdevice, reopen_matcher, NULL);
@@ -34,6 +34,7 @@
 # include <sys/un.h>
 #else	/* WIN32 */
 # include <strings.h>
+# include <sys/stat.h>
 # include "wincompat.h"
 #endif	/* WIN32 */
 
@@ -53,12 +54,72 @@
 #endif	/* WIN32 */
 	static int	stale = 1, alarm_active = 0, alarm_status = 0, ignorelb = 0,
 				alarm_legacy_status = 0;
+	/* ST_STATUS_* bits of the standard tokens now in status_buf */
+	static unsigned long	status_bits = 0;
+	/* warm start: nodes and commands loaded from a snapshot file
+	 * are served until the first live update replaces them */
+	static int	snapshot_warming = 0;
+	static st_tree_timespec_t	snapshot_loaded;
+	static time_t	snapshot_expires = 0;	/* when its data gets too old */
+	static cmdlist_t	*snapshot_cmds = NULL;
 	static char	status_buf[ST_MAX_VALUE_LEN], alarm_buf[ST_MAX_VALUE_LEN],
 			buzzmode_buf[ST_MAX_VALUE_LEN];
 	static conn_t	*connhead = NULL;
 	static st_tree_t	*dtree_root = NULL;
 	static cmdlist_t	*cmdhead = NULL;
 
+	/* Bumped when dtree nodes are freed, to invalidate node handles
+	 * cached by the typed (numeric) dstate_setinfo_*() fast path */
+	static unsigned long	dtree_generation = 0;
+
+/* Growing buffer for the text of DUMPALL replies and snapshot files */
+typedef struct {
+	char	*buf;
+	size_t	len;
+	size_t	size;
+} dumpbuf_t;
+
+	/* Body of the DUMPALL reply, valid until the next broadcast */
+	static dumpbuf_t	dump_cache = { NULL, 0, 0 };
+	static int	dump_cache_valid = 0;
+
+	/* Sequence numbers of broadcasts, and the recent broadcast lines
+	 * (only kept after a client asked for "DUMPALL SEQ" once) */
+#define DSTATE_SEQ_HISTORY	256
+	static char	seq_epoch[SMALLBUF] = "";
+	static unsigned long	seq_current = 0;
+	static char	**seq_history = NULL;
+	static unsigned long	seq_history_count = 0;
+
+static void seq_history_add(const char *line);
+static void snapshot_check_expired(void);
+
+/* Descriptors of libraries' event sources watched along with the
+ * driver sockets, see dstate_add_poll_fd() */
+#define DSTATE_POLL_FDS_MAX	16
+static struct {
+	TYPE_FD	fd;
+	int	events;
+} poll_fds[DSTATE_POLL_FDS_MAX];
+static size_t	poll_fds_count = 0;
+
+/* Typed numeric fast path: remember the last published binary value
+ * per variable with a direct handle to its dtree node, so re-publishing
+ * the same value skips formatting, tree lookup and string comparison */
+typedef struct dstate_numinfo_s {
+	char	*var;		/* NULL for an unused slot */
+	char	*fmt;		/* validated formatting string */
+	int	is_double;	/* which of the values below is used */
+	double	dval;
+	long	lval;
+	char	text[ST_MAX_VALUE_LEN];	/* last value we formatted */
+	st_tree_t	*node;	/* valid while generation matches */
+	unsigned long	generation;
+} dstate_numinfo_t;
+
+	static dstate_numinfo_t	*numinfo = NULL;
+	static size_t	numinfo_size = 0, numinfo_used = 0;
+
 	struct ups_handler	upsh;
 
 #ifndef WIN32
@@ -265,8 +326,9 @@ static void sock_disconnect(conn_t *conn)
 static void send_to_all(const char *fmt, ...)
 {
 	ssize_t	ret;
-	char	buf[ST_SOCK_BUF_LEN];
-	size_t	buflen;
+	char	buf[ST_SOCK_BUF_LEN], seqbuf[ST_SOCK_BUF_LEN + 32];
+	const char	*out;
+	size_t	buflen, seqbuflen = 0, outlen;
 	va_list	ap;
 	conn_t	*conn, *cnext;
 
@@ -305,18 +367,35 @@ static void send_to_all(const char *fmt, ...)
 		return;
 	}
 
+	/* Something changed, so the cached DUMPALL reply is outdated */
+	dump_cache_valid = 0;
+	seq_history_add(buf);
+
 	for (conn = connhead; conn; conn = cnext) {
 		cnext = conn->next;
 		if (conn->nobroadcast)
 			continue;
 
+		/* Clients which track sequence numbers get them as a prefix */
+		if (conn->seqmode) {
+			if (!seqbuflen) {
+				snprintf(seqbuf, sizeof(seqbuf), "SEQ %lu %s", seq_current, buf);
+				seqbuflen = strlen(seqbuf);
+			}
+			out = seqbuf;
+			outlen = seqbuflen;
+		} else {
+			out = buf;
+			outlen = buflen;
+		}
+
 #ifndef WIN32
-		ret = write(conn->fd, buf, buflen);
+		ret = write(conn->fd, out, outlen);
 #else	/* WIN32 */
 		DWORD bytesWritten = 0;
 		BOOL  result = FALSE;
 
-		result = WriteFile (conn->fd, buf, buflen, &bytesWritten, NULL);
+		result = WriteFile (conn->fd, out, outlen, &bytesWritten, NULL);
 		if( result == 0 ) {
 			upsdebugx(2, "%s: write failed on handle %p, disconnecting", __func__, conn->fd);
 			sock_disconnect(conn);
@@ -327,17 +406,17 @@ static void send_to_all(const char *fmt, ...)
 		}
 #endif	/* WIN32 */
 
-		if ((ret < 1) || (ret != (ssize_t)buflen)) {
+		if ((ret < 1) || (ret != (ssize_t)outlen)) {
 #ifndef WIN32
 			upsdebug_with_errno(0, "WARNING: %s: write %" PRIuSIZE " bytes to "
 				"socket %d failed (ret=%" PRIiSIZE "), disconnecting.",
-				__func__, buflen, (int)conn->fd, ret);
+				__func__, outlen, (int)conn->fd, ret);
 #else	/* WIN32 */
 			upsdebug_with_errno(0, "WARNING: %s: write %" PRIuSIZE " bytes to "
 				"handle %p failed (ret=%" PRIiSIZE "), disconnecting.",
-				__func__, buflen, conn->fd, ret);
+				__func__, outlen, conn->fd, ret);
 #endif	/* WIN32 */
-			upsdebugx(6, "%s: failed write: %s", __func__, buf);
+			upsdebugx(6, "%s: failed write: %s", __func__, out);
 
 			sock_disconnect(conn);
 
@@ -354,93 +433,39 @@ static void send_to_all(const char *fmt, ...)
 		} else {
 			upsdebugx(6, "%s: write %" PRIuSIZE " bytes to socket %d succeeded "
 				"(ret=%" PRIiSIZE "): %s",
-				__func__, buflen, conn->fd, ret, buf);
+				__func__, outlen, conn->fd, ret, out);
 		}
 	}
 }
 
-static int send_to_one(conn_t *conn, const char *fmt, ...)
+/* write a ready buffer (maybe a cached DUMPALL reply, much larger than
+ * the socket buffer) to one connection, continuing after partial writes */
+static int send_buf_to_one(conn_t *conn, const char *buf, size_t buflen)
 {
-	ssize_t	ret;
-	va_list	ap;
-	char	buf[ST_SOCK_BUF_LEN];
-	size_t	buflen;
+	ssize_t	ret = 0;
+	size_t	done = 0;
+	int	throttled = 0;
 #ifdef WIN32
 	DWORD bytesWritten = 0;
 	BOOL  result = FALSE;
 #endif	/* WIN32 */
 
-	va_start(ap, fmt);
-#ifdef HAVE_PRAGMAS_FOR_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
-#pragma GCC diagnostic push
-#endif
-#ifdef HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
-#pragma GCC diagnostic ignored "-Wformat-nonliteral"
-#endif
-#ifdef HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_FORMAT_SECURITY
-#pragma GCC diagnostic ignored "-Wformat-security"
-#endif
-	/* Note: this code intentionally uses a caller-provided
-	 * format string (we should not get it from configs etc.
-	 * or the calling methods should check it against their
-	 * "fmt_dynamic" expectations). */
-	ret = vsnprintf(buf, sizeof(buf), fmt, ap);
-#ifdef HAVE_PRAGMAS_FOR_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
-#pragma GCC diagnostic pop
-#endif
-	va_end(ap);
-
-	upsdebugx(2, "%s: sending %.*s", __func__, (int)strcspn(buf, "\n"), buf);
-	if (ret < 1) {
-		upsdebugx(2, "%s: nothing to write", __func__);
-		return 1;
-	}
-
-	buflen = strlen(buf);
 	if (buflen >= SSIZE_MAX) {
-		/* Can't compare buflen to ret... though should not happen with ST_SOCK_BUF_LEN */
+		/* Can't compare buflen to ret... */
 		upslog_with_errno(LOG_NOTICE, "%s failed: buffered message too large", __func__);
 		return 0;	/* failed */
 	}
 
-	if (ret <= INT_MAX)
-		upsdebugx(5, "%s: %.*s", __func__, (int)(ret-1), buf);
-
 /*
 	upsdebugx(0, "%s: writing %" PRIiSIZE " bytes to socket %d: %s",
 		__func__, buflen, conn->fd, buf);
 */
 
+	while (done < buflen) {
 #ifndef WIN32
-	ret = write(conn->fd, buf, buflen);
-#else	/* WIN32 */
-	result = WriteFile (conn->fd, buf, buflen, &bytesWritten, NULL);
-	if( result == 0 ) {
-		ret = 0;
-	}
-	else  {
-		ret = (ssize_t)bytesWritten;
-	}
-#endif	/* WIN32 */
-
-	if (ret < 0) {
-		/* Hacky bugfix: throttle down for upsd to read that */
-#ifndef WIN32
-		upsdebug_with_errno(1, "%s: had to throttle down to retry "
-			"writing %" PRIuSIZE " bytes to socket %d (ret=%" PRIiSIZE ") : %s",
-			__func__, buflen, (int)conn->fd, ret, buf);
-#else	/* WIN32 */
-		upsdebug_with_errno(1, "%s: had to throttle down to retry "
-			"writing %" PRIuSIZE " bytes to handle %p (ret=%" PRIiSIZE ") : %s",
-			__func__, buflen, conn->fd, ret, buf);
-#endif	/* WIN32 */
-
-		usleep(200);
-
-#ifndef WIN32
-		ret = write(conn->fd, buf, buflen);
+		ret = write(conn->fd, buf + done, buflen - done);
 #else	/* WIN32 */
-		result = WriteFile (conn->fd, buf, buflen, &bytesWritten, NULL);
+		result = WriteFile (conn->fd, buf + done, buflen - done, &bytesWritten, NULL);
 		if( result == 0 ) {
 			ret = 0;
 		}
@@ -448,22 +473,47 @@ static int send_to_one(conn_t *conn, const char *fmt, ...)
 			ret = (ssize_t)bytesWritten;
 		}
 #endif	/* WIN32 */
-		if (ret == (ssize_t)buflen) {
-			upsdebugx(1, "%s: throttling down helped", __func__);
+
+		if (ret > 0) {
+			if (throttled) {
+				upsdebugx(1, "%s: throttling down helped", __func__);
+			}
+			done += (size_t)ret;
+			throttled = 0;
+			continue;
+		}
+
+		if (ret < 0 && !throttled) {
+			/* Hacky bugfix: throttle down for upsd to read that */
+#ifndef WIN32
+			upsdebug_with_errno(1, "%s: had to throttle down to retry "
+				"writing %" PRIuSIZE " bytes to socket %d (ret=%" PRIiSIZE ") : %s",
+				__func__, buflen - done, (int)conn->fd, ret, buf + done);
+#else	/* WIN32 */
+			upsdebug_with_errno(1, "%s: had to throttle down to retry "
+				"writing %" PRIuSIZE " bytes to handle %p (ret=%" PRIiSIZE ") : %s",
+				__func__, buflen - done, conn->fd, ret, buf + done);
+#endif	/* WIN32 */
+
+			usleep(200);
+			throttled = 1;
+			continue;
 		}
+
+		break;
 	}
 
-	if ((ret < 1) || (ret != (ssize_t)buflen)) {
+	if (done != buflen) {
 #ifndef WIN32
 		upsdebug_with_errno(0, "WARNING: %s: write %" PRIuSIZE " bytes to "
 			"socket %d failed (ret=%" PRIiSIZE "), disconnecting.",
-			__func__, buflen, (int)conn->fd, ret);
+			__func__, buflen - done, (int)conn->fd, ret);
 #else	/* WIN32 */
 		upsdebug_with_errno(0, "WARNING: %s: write %" PRIuSIZE " bytes to "
 			"handle %p failed (ret=%" PRIiSIZE "), disconnecting.",
-			__func__, buflen, conn->fd, ret);
+			__func__, buflen - done, conn->fd, ret);
 #endif	/* WIN32 */
-		upsdebugx(6, "%s: failed write: %s", __func__, buf);
+		upsdebugx(6, "%s: failed write: %s", __func__, buf + done);
 		sock_disconnect(conn);
 
 		/* TOTHINK: Maybe fallback elsewhere in other cases? */
@@ -480,19 +530,54 @@ static int send_to_one(conn_t *conn, const char *fmt, ...)
 		return 0;	/* failed */
 	} else {
 #ifndef WIN32
-		upsdebugx(6, "%s: write %" PRIuSIZE " bytes to socket %d succeeded "
-			"(ret=%" PRIiSIZE "): %s",
-			__func__, buflen, conn->fd, ret, buf);
+		upsdebugx(6, "%s: write %" PRIuSIZE " bytes to socket %d succeeded: %s",
+			__func__, buflen, conn->fd, buf);
 #else	/* WIN32 */
-		upsdebugx(6, "%s: write %" PRIuSIZE " bytes to handle %p succeeded "
-			"(ret=%" PRIiSIZE "): %s",
-			__func__, buflen, conn->fd, ret, buf);
+		upsdebugx(6, "%s: write %" PRIuSIZE " bytes to handle %p succeeded: %s",
+			__func__, buflen, conn->fd, buf);
 #endif	/* WIN32 */
 	}
 
 	return 1;	/* OK */
 }
 
+static int send_to_one(conn_t *conn, const char *fmt, ...)
+{
+	int	ret;
+	va_list	ap;
+	char	buf[ST_SOCK_BUF_LEN];
+
+	va_start(ap, fmt);
+#ifdef HAVE_PRAGMAS_FOR_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
+#pragma GCC diagnostic push
+#endif
+#ifdef HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+#ifdef HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_FORMAT_SECURITY
+#pragma GCC diagnostic ignored "-Wformat-security"
+#endif
+	/* Note: this code intentionally uses a caller-provided
+	 * format string (we should not get it from configs etc.
+	 * or the calling methods should check it against their
+	 * "fmt_dynamic" expectations). */
+	ret = vsnprintf(buf, sizeof(buf), fmt, ap);
+#ifdef HAVE_PRAGMAS_FOR_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
+#pragma GCC diagnostic pop
+#endif
+	va_end(ap);
+
+	upsdebugx(2, "%s: sending %.*s", __func__, (int)strcspn(buf, "\n"), buf);
+	if (ret < 1) {
+		upsdebugx(2, "%s: nothing to write", __func__);
+		return 1;
+	}
+
+	upsdebugx(5, "%s: %.*s", __func__, ret - 1, buf);
+
+	return send_buf_to_one(conn, buf, strlen(buf));
+}
+
 static void sock_connect(TYPE_FD sock)
 {
 	conn_t	*conn;
@@ -625,93 +710,186 @@ static void sock_connect(TYPE_FD sock)
 
 }
 
-static int st_tree_dump_conn_one_node(st_tree_t *node, conn_t *conn)
+static void dumpbuf_add(dumpbuf_t *db, const char *fmt, ...)
+	__attribute__ ((__format__ (__printf__, 2, 3)));
+
+/* append one protocol line (limited like send_to_one() ones) */
+static void dumpbuf_add(dumpbuf_t *db, const char *fmt, ...)
+{
+	char	line[ST_SOCK_BUF_LEN];
+	va_list	ap;
+	int	ret;
+	size_t	len;
+
+	va_start(ap, fmt);
+	ret = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+
+	if (ret < 1) {
+		return;
+	}
+
+	len = strlen(line);
+	if (db->len + len + 1 > db->size) {
+		db->size = (db->size ? db->size * 2 : 4096);
+		if (db->size < db->len + len + 1) {
+			db->size = db->len + len + 1;
+		}
+		db->buf = xrealloc(db->buf, db->size);
+	}
+
+	memcpy(db->buf + db->len, line, len + 1);
+	db->len += len;
+}
+
+static void dumpbuf_node(dumpbuf_t *db, st_tree_t *node)
 {
 	enum_t	*etmp;
 	range_t	*rtmp;
 
-	if (!send_to_one(conn, "SETINFO %s \"%s\"\n", node->var, node->val)) {
-		return 0;	/* write failed, bail out */
-	}
+	dumpbuf_add(db, "SETINFO %s \"%s\"\n", node->var, node->val);
 
 	/* send any enums */
 	for (etmp = node->enum_list; etmp; etmp = etmp->next) {
-		if (!send_to_one(conn, "ADDENUM %s \"%s\"\n", node->var, etmp->val)) {
-			return 0;
-		}
+		dumpbuf_add(db, "ADDENUM %s \"%s\"\n", node->var, etmp->val);
 	}
 
 	/* send any ranges */
 	for (rtmp = node->range_list; rtmp; rtmp = rtmp->next) {
-		if (!send_to_one(conn, "ADDRANGE %s %i %i\n", node->var, rtmp->min, rtmp->max)) {
-			return 0;
-		}
+		dumpbuf_add(db, "ADDRANGE %s %i %i\n", node->var, rtmp->min, rtmp->max);
 	}
 
 	/* provide any auxiliary data */
 	if (node->aux) {
-		if (!send_to_one(conn, "SETAUX %s %ld\n", node->var, node->aux)) {
-			return 0;
-		}
+		dumpbuf_add(db, "SETAUX %s %ld\n", node->var, node->aux);
 	}
 
 	/* finally report any flags */
 	if (node->flags) {
-		char	flist[SMALLBUF];
+		dumpbuf_add(db, "SETFLAGS %s%s%s%s\n", node->var,
+			(node->flags & ST_FLAG_RW) ? " RW" : "",
+			(node->flags & ST_FLAG_STRING) ? " STRING" : "",
+			(node->flags & ST_FLAG_NUMBER) ? " NUMBER" : "");
+	}
+}
 
-		/* build the list */
-		snprintf(flist, sizeof(flist), "%s", node->var);
+/* The "driver.*" data describes the current driver run, so it is not
+ * saved into warm start snapshots; neither are the ups.status and
+ * ups.alarm values, so that no client (like upsmon) acts upon a power
+ * state of the previous run before the device was read again */
+static int snapshot_skip_var(const char *var)
+{
+	return (!var || !strncasecmp(var, "driver.", 7)
+		|| !strcasecmp(var, "ups.status") || !strcasecmp(var, "ups.alarm"));
+}
 
-		if (node->flags & ST_FLAG_RW) {
-			snprintfcat(flist, sizeof(flist), " RW");
-		}
-		if (node->flags & ST_FLAG_STRING) {
-			snprintfcat(flist, sizeof(flist), " STRING");
-		}
-		if (node->flags & ST_FLAG_NUMBER) {
-			snprintfcat(flist, sizeof(flist), " NUMBER");
+static void dumpbuf_tree(dumpbuf_t *db, st_tree_t *node, int for_snapshot)
+{
+	if (!node) {
+		return;
+	}
+
+	dumpbuf_tree(db, node->left, for_snapshot);
+
+	if (!for_snapshot || !snapshot_skip_var(node->var)) {
+		dumpbuf_node(db, node);
+	}
+
+	dumpbuf_tree(db, node->right, for_snapshot);
+}
+
+static void dumpbuf_cmds(dumpbuf_t *db, int for_snapshot)
+{
+	cmdlist_t	*cmd;
+
+	for (cmd = cmdhead; cmd; cmd = cmd->next) {
+		if (!for_snapshot || !snapshot_skip_var(cmd->name)) {
+			dumpbuf_add(db, "ADDCMD %s\n", cmd->name);
 		}
+	}
+}
 
-		if (!send_to_one(conn, "SETFLAGS %s\n", flist)) {
-			return 0;
+/* The body of a DUMPALL reply is kept until something changes, so that
+ * (re-)connections of upsd do not walk and format the whole tree again */
+static const dumpbuf_t *dump_cache_get(void)
+{
+	if (!dump_cache_valid) {
+		dump_cache.len = 0;
+		if (dump_cache.buf) {
+			*dump_cache.buf = '\0';
 		}
+		dumpbuf_tree(&dump_cache, dtree_root, 0);
+		dumpbuf_cmds(&dump_cache, 0);
+		dump_cache_valid = 1;
+		upsdebugx(5, "%s: rebuilt DUMPALL cache: %" PRIuSIZE " bytes",
+			__func__, dump_cache.len);
 	}
 
-	return 1;	/* everything's OK here ... */
+	return &dump_cache;
 }
 
-static int st_tree_dump_conn(st_tree_t *node, conn_t *conn)
+/* Sequence numbers of broadcasts: the recent ones are kept, so that
+ * a reconnecting upsd can ask (with DUMPALL SEQ <epoch> <seq>) for just
+ * the updates it missed, or gets a full dump if those are not known */
+static const char *seq_get_epoch(void)
 {
-	int	ret;
-
-	if (!node) {
-		return 1;	/* not an error */
+	if (!*seq_epoch) {
+		/* Unique enough to tell apart driver runs */
+		snprintf(seq_epoch, sizeof(seq_epoch), "%" PRIdMAX ".%" PRIiMAX,
+			(intmax_t)time(NULL), (intmax_t)getpid());
 	}
 
-	if (node->left) {
-		ret = st_tree_dump_conn(node->left, conn);
+	return seq_epoch;
+}
 
-		if (!ret) {
-			return 0;	/* write failed in the child */
-		}
+static void seq_history_add(const char *line)
+{
+	char	**slot;
+
+	seq_current++;
+
+	if (!seq_history) {
+		return;	/* nobody asked for it yet */
+	}
+
+	slot = &seq_history[seq_current % DSTATE_SEQ_HISTORY];
+	free(*slot);
+	*slot = xstrdup(line);
+	if (seq_history_count < DSTATE_SEQ_HISTORY) {
+		seq_history_count++;
 	}
+}
 
-	if (!st_tree_dump_conn_one_node(node, conn))
-		return 0;	/* one of writes failed, bail out */
+/* can we replay everything after "since" from the history? */
+static int seq_history_covers(const char *epoch, const char *since, unsigned long *psince)
+{
+	unsigned long	val;
+	char	*end = NULL;
 
-	if (node->right) {
-		return st_tree_dump_conn(node->right, conn);
+	if (!seq_history || strcmp(epoch, seq_get_epoch())) {
+		return 0;
 	}
 
-	return 1;	/* everything's OK here ... */
+	errno = 0;
+	val = strtoul(since, &end, 10);
+	if (errno || !end || *end || val > seq_current
+	 || seq_current - val > seq_history_count
+	) {
+		return 0;
+	}
+
+	*psince = val;
+	return 1;
 }
 
-static int cmd_dump_conn(conn_t *conn)
+static int seq_history_replay(conn_t *conn, unsigned long since)
 {
-	cmdlist_t	*cmd;
+	unsigned long	i;
+	const char	*line;
 
-	for (cmd = cmdhead; cmd; cmd = cmd->next) {
-		if (!send_to_one(conn, "ADDCMD %s\n", cmd->name)) {
+	for (i = since + 1; i <= seq_current; i++) {
+		line = seq_history[i % DSTATE_SEQ_HISTORY];
+		if (line && !send_buf_to_one(conn, line, strlen(line))) {
 			return 0;
 		}
 	}
@@ -719,7 +897,6 @@ static int cmd_dump_conn(conn_t *conn)
 	return 1;
 }
 
-
 static void send_tracking(conn_t *conn, const char *id, int value)
 {
 	send_to_one(conn, "TRACKING %s %i\n", id, value);
@@ -760,17 +937,46 @@ static int sock_arg(conn_t *conn, size_t numarg, char **arg)
 	}
 
 	if (!strcasecmp(arg[0], "DUMPALL") || !strcasecmp(arg[0], "DUMPSTATUS") || (!strcasecmp(arg[0], "DUMPVALUE") && numarg > 1)) {
+		int	delta = 0;
+		unsigned long	since = 0;
+
+		/* DUMPALL SEQ [<epoch> <seq>]: the client tracks sequence
+		 * numbers of broadcasts, and may only need those it missed
+		 * (older drivers ignore the extra arguments) */
+		if (!strcasecmp(arg[0], "DUMPALL") && numarg > 1 && !strcasecmp(arg[1], "SEQ")) {
+			if (!seq_history) {
+				seq_history = xcalloc(DSTATE_SEQ_HISTORY, sizeof(char *));
+			}
+			conn->seqmode = 1;
+
+			if (numarg > 3) {
+				delta = seq_history_covers(arg[2], arg[3], &since);
+			}
+
+			upsdebugx(2, "%s: %s dump requested, current sequence %s %lu",
+				__func__, delta ? "incremental" : "full",
+				seq_get_epoch(), seq_current);
+
+			if (!send_to_one(conn, "DUMPBEGIN %s %lu %s\n",
+				seq_get_epoch(), seq_current, delta ? "DELTA" : "FULL")
+			) {
+				return 1;
+			}
+		}
+
 		/* first thing: the staleness flag (see also below) */
 		if ((stale == 1) && !send_to_one(conn, "DATASTALE\n")) {
 			return 1;
 		}
 
-		if (!strcasecmp(arg[0], "DUMPALL")) {
-			if (!st_tree_dump_conn(dtree_root, conn)) {
+		if (delta) {
+			if (!seq_history_replay(conn, since)) {
 				return 1;
 			}
+		} else if (!strcasecmp(arg[0], "DUMPALL")) {
+			const dumpbuf_t	*db = dump_cache_get();
 
-			if (!cmd_dump_conn(conn)) {
+			if (db->len && !send_buf_to_one(conn, db->buf, db->len)) {
 				return 1;
 			}
 		} else {
@@ -782,7 +988,13 @@ static int sock_arg(conn_t *conn, size_t numarg, char **arg)
 				upsdebugx(1, "%s: %s was requested but currently no %s is known",
 					__func__, arg[0], NUT_STRARG(varname));
 			} else {
-				if (!st_tree_dump_conn_one_node(sttmp, conn))
+				dumpbuf_t	db = { NULL, 0, 0 };
+				int	ret;
+
+				dumpbuf_node(&db, sttmp);
+				ret = send_buf_to_one(conn, db.buf, db.len);
+				free(db.buf);
+				if (!ret)
 					return 1;
 			}
 		}
@@ -838,6 +1050,22 @@ static int sock_arg(conn_t *conn, size_t numarg, char **arg)
 		return 0;
 	}
 
+	/* The driver (and device) are not initialized yet,
+	 * only the data from a snapshot file is served */
+	if (snapshot_warming
+	 && (!strcasecmp(arg[0], "INSTCMD") || !strcasecmp(arg[0], "SET"))
+	) {
+		upslogx(LOG_NOTICE, "Got %s '%s' while warming up from a snapshot, rejected",
+			arg[0], arg[1]);
+
+		if (numarg > 3 && !strcasecmp(arg[numarg - 2], "TRACKING")) {
+			send_tracking(conn, arg[numarg - 1],
+				!strcasecmp(arg[0], "SET") ? STAT_SET_FAILED : STAT_INSTCMD_FAILED);
+		}
+
+		return 1;
+	}
+
 	/* INSTCMD <cmdname> [<cmdparam>] [TRACKING <id>] */
 	if (!strcasecmp(arg[0], "INSTCMD")) {
 		int ret;
@@ -1140,10 +1368,13 @@ char * dstate_init(const char *prog, const char *devname)
 #else	/* WIN32 */
 	/* upsname (and so devname) is now mandatory so no need to test it */
 	snprintf(sockname, sizeof(sockname), "\\\\.\\pipe\\%s-%s", prog, devname);
-	pipename = xstrdup(sockname);
+	if (!pipename)
+		pipename = xstrdup(sockname);
 #endif	/* WIN32 */
 
-	sockfd = sock_open(sockname);
+	/* May have been opened early, to serve a warm start snapshot */
+	if (INVALID_FD(sockfd))
+		sockfd = sock_open(sockname);
 
 #ifndef WIN32
 	upsdebugx(2, "%s: sock %s open on fd %d", __func__, sockname, sockfd);
@@ -1155,7 +1386,65 @@ char * dstate_init(const char *prog, const char *devname)
 	return xstrdup(sockname);
 }
 
-/* returns 1 if timeout expired or data is available on UPS fd, 0 otherwise */
+/* Service the socket without waiting, e.g. between slow driver
+ * initialization steps so upsd gets its DUMPALL of a warm start
+ * snapshot answered: a few passes to accept a connection and
+ * to read its requests */
+void dstate_poll_pending(void)
+{
+	struct timeval	now;
+	int	i;
+
+	snapshot_check_expired();
+
+	if (INVALID_FD(sockfd))
+		return;
+
+	for (i = 0; i < 3; i++) {
+		gettimeofday(&now, NULL);
+		dstate_poll_fds(now, ERROR_FD);
+	}
+}
+
+/* watch fd (for DSTATE_POLL_READ and/or DSTATE_POLL_WRITE events)
+ * in dstate_poll_fds() too, returns -1 if there is no room left */
+int dstate_add_poll_fd(TYPE_FD fd, int events)
+{
+	size_t	i;
+
+	for (i = 0; i < poll_fds_count; i++) {
+		if (poll_fds[i].fd == fd) {
+			poll_fds[i].events = events;
+			return 0;
+		}
+	}
+
+	if (poll_fds_count >= DSTATE_POLL_FDS_MAX) {
+		upslogx(LOG_WARNING, "%s: too many descriptors to watch", __func__);
+		return -1;
+	}
+
+	poll_fds[poll_fds_count].fd = fd;
+	poll_fds[poll_fds_count].events = events;
+	poll_fds_count++;
+
+	return 0;
+}
+
+void dstate_del_poll_fd(TYPE_FD fd)
+{
+	size_t	i;
+
+	for (i = 0; i < poll_fds_count; i++) {
+		if (poll_fds[i].fd == fd) {
+			poll_fds[i] = poll_fds[--poll_fds_count];
+			return;
+		}
+	}
+}
+
+/* returns 1 if timeout expired or data is available on UPS fd
+ * (or on one added with dstate_add_poll_fd()), 0 otherwise */
 int dstate_poll_fds(struct timeval timeout, TYPE_FD arg_extrafd)
 {
 	int	maxfd = 0; /* Unidiomatic use vs. "sockfd" below, which is "int" on non-WIN32 */
@@ -1165,9 +1454,11 @@ int dstate_poll_fds(struct timeval timeout, TYPE_FD arg_extrafd)
 
 #ifndef WIN32
 	int	ret;
-	fd_set	rfds;
+	size_t	i;
+	fd_set	rfds, wfds;
 
 	FD_ZERO(&rfds);
+	FD_ZERO(&wfds);
 	FD_SET(sockfd, &rfds);
 
 	maxfd = sockfd;
@@ -1180,6 +1471,20 @@ int dstate_poll_fds(struct timeval timeout, TYPE_FD arg_extrafd)
 		}
 	}
 
+	for (i = 0; i < poll_fds_count; i++) {
+		if (poll_fds[i].events & DSTATE_POLL_READ) {
+			FD_SET(poll_fds[i].fd, &rfds);
+		}
+
+		if (poll_fds[i].events & DSTATE_POLL_WRITE) {
+			FD_SET(poll_fds[i].fd, &wfds);
+		}
+
+		if (poll_fds[i].fd > maxfd) {
+			maxfd = poll_fds[i].fd;
+		}
+	}
+
 	for (conn = connhead; conn; conn = conn->next) {
 		FD_SET(conn->fd, &rfds);
 
@@ -1205,7 +1510,7 @@ int dstate_poll_fds(struct timeval timeout, TYPE_FD arg_extrafd)
 		timeout.tv_usec -= now.tv_usec;
 	}
 
-	ret = select(maxfd + 1, &rfds, NULL, NULL, &timeout);
+	ret = select(maxfd + 1, &rfds, poll_fds_count ? &wfds : NULL, NULL, &timeout);
 
 	if (ret == 0) {
 		return 1;	/* timer expired */
@@ -1251,6 +1556,13 @@ int dstate_poll_fds(struct timeval timeout, TYPE_FD arg_extrafd)
 		return 1;
 	}
 
+	/* or one of the library event sources, for it to handle them */
+	for (i = 0; i < poll_fds_count; i++) {
+		if (FD_ISSET(poll_fds[i].fd, &rfds) || FD_ISSET(poll_fds[i].fd, &wfds)) {
+			return 1;
+		}
+	}
+
 #else /* WIN32 */
 
 	DWORD	ret;
@@ -1441,6 +1753,162 @@ int dstate_setinfo_dynamic(const char *var, const char *fmt_dynamic, const char
 	}
 }
 
+/* numinfo slots live in an open-addressing hash table keyed by
+ * variable name, kept at most half full */
+static size_t numinfo_hash(const char *var)
+{
+	/* FNV-1a */
+	size_t	h = 2166136261U;
+
+	for (; *var; var++) {
+		h ^= (unsigned char)*var;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static dstate_numinfo_t *numinfo_slot(dstate_numinfo_t *table, size_t size, const char *var)
+{
+	size_t	i = numinfo_hash(var) & (size - 1);
+
+	while (table[i].var && strcmp(table[i].var, var)) {
+		i = (i + 1) & (size - 1);
+	}
+
+	return &table[i];
+}
+
+static dstate_numinfo_t *numinfo_get(const char *var)
+{
+	dstate_numinfo_t	*ni;
+
+	if ((numinfo_used + 1) * 2 > numinfo_size) {
+		dstate_numinfo_t	*table;
+		size_t	i, size = (numinfo_size ? numinfo_size * 2 : 64);
+
+		table = (dstate_numinfo_t *)xcalloc(size, sizeof(*table));
+
+		for (i = 0; i < numinfo_size; i++) {
+			if (numinfo[i].var) {
+				*numinfo_slot(table, size, numinfo[i].var) = numinfo[i];
+			}
+		}
+
+		free(numinfo);
+		numinfo = table;
+		numinfo_size = size;
+	}
+
+	ni = numinfo_slot(numinfo, numinfo_size, var);
+
+	if (!ni->var) {
+		ni->var = xstrdup(var);
+		numinfo_used++;
+	}
+
+	return ni;
+}
+
+static void numinfo_free(void)
+{
+	size_t	i;
+
+	for (i = 0; i < numinfo_size; i++) {
+		free(numinfo[i].var);
+		free(numinfo[i].fmt);
+	}
+
+	free(numinfo);
+	numinfo = NULL;
+	numinfo_size = 0;
+	numinfo_used = 0;
+}
+
+static int dstate_setinfo_numeric(const char *var, const char *fmt,
+	int is_double, double dval, long lval)
+{
+	dstate_numinfo_t	*ni;
+	int	ret;
+
+	if (!var || !fmt) {
+		return -1;
+	}
+
+	ni = numinfo_get(var);
+
+	if (!ni->fmt || strcmp(ni->fmt, fmt) || ni->is_double != is_double) {
+		/* new variable, or a different kind of value for it */
+		if (validate_formatting_string(fmt, (is_double ? "%f" : "%ld"),
+			NUT_DYNAMICFORMATTING_DEBUG_LEVEL) < 0
+		) {
+			return -1;
+		}
+
+		free(ni->fmt);
+		ni->fmt = xstrdup(fmt);
+		ni->is_double = is_double;
+		ni->node = NULL;
+	} else if (ni->node && ni->generation == dtree_generation
+		&& (is_double
+			? !memcmp(&ni->dval, &dval, sizeof(dval))
+			: (ni->lval == lval))
+		&& !strcmp(ni->node->raw, ni->text)
+	) {
+		/* same value as we last published, and nobody else
+		 * changed it since: only refresh the timestamp, like
+		 * state_setinfo() does when "skip-writing" a value */
+		state_get_timestamp(&ni->node->lastset);
+		return 0;	/* no change */
+	}
+
+#ifdef HAVE_PRAGMAS_FOR_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
+#pragma GCC diagnostic push
+#endif
+#ifdef HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+#ifdef HAVE_PRAGMA_GCC_DIAGNOSTIC_IGNORED_FORMAT_SECURITY
+#pragma GCC diagnostic ignored "-Wformat-security"
+#endif
+	/* Using validated formatting string here */
+	if (is_double) {
+		snprintf(ni->text, sizeof(ni->text), ni->fmt, dval);
+	} else {
+		snprintf(ni->text, sizeof(ni->text), ni->fmt, lval);
+	}
+#ifdef HAVE_PRAGMAS_FOR_GCC_DIAGNOSTIC_IGNORED_FORMAT_NONLITERAL
+#pragma GCC diagnostic pop
+#endif
+
+	ni->dval = dval;
+	ni->lval = lval;
+
+	if (ni->node && ni->generation == dtree_generation) {
+		ret = state_setinfo_node(ni->node, ni->text);
+	} else {
+		ret = state_setinfo(&dtree_root, var, ni->text);
+		ni->node = state_tree_find(dtree_root, var);
+		ni->generation = dtree_generation;
+	}
+
+	if (ret == 1) {
+		send_to_all("SETINFO %s \"%s\"\n", var, ni->text);
+	}
+
+	return ret;
+}
+
+int dstate_setinfo_double(const char *var, const char *fmt, double value)
+{
+	return dstate_setinfo_numeric(var, fmt, 1, value, 0);
+}
+
+int dstate_setinfo_long(const char *var, const char *fmt, long value)
+{
+	return dstate_setinfo_numeric(var, fmt, 0, 0.0, value);
+}
+
 int vdstate_addenum(const char *var, const char *fmt, va_list ap)
 {
 	int	ret;
@@ -1648,9 +2116,23 @@ void dstate_setaux(const char *var, long aux)
 	send_to_all("SETAUX %s %ld\n", var, aux);
 }
 
+/* While warming up from a snapshot, values only served from it (not set
+ * again by the driver since it was loaded) are not returned, so that the
+ * drivers checking whether a variable is already provided set it anew */
 const char *dstate_getinfo(const char *var)
 {
-	return state_getinfo(dtree_root, var);
+	st_tree_t	*node;
+
+	if (!snapshot_warming) {
+		return state_getinfo(dtree_root, var);
+	}
+
+	node = state_tree_find(dtree_root, var);
+	if (!node || st_tree_node_compare_timestamp(node, &snapshot_loaded) <= 0) {
+		return NULL;
+	}
+
+	return node->val;
 }
 
 void dstate_addcmd(const char *cmdname)
@@ -1659,6 +2141,11 @@ void dstate_addcmd(const char *cmdname)
 
 	ret = state_addcmd(&cmdhead, cmdname);
 
+	/* re-added by the live driver, so keep it after warm-up */
+	if (snapshot_cmds) {
+		state_delcmd(&snapshot_cmds, cmdname);
+	}
+
 	/* update listeners */
 	if (ret == 1) {
 		send_to_all("ADDCMD %s\n", cmdname);
@@ -1673,6 +2160,7 @@ int dstate_delinfo(const char *var)
 
 	/* update listeners */
 	if (ret == 1) {
+		dtree_generation++;
 		send_to_all("DELINFO %s\n", var);
 	}
 
@@ -1687,6 +2175,7 @@ int dstate_delinfo_olderthan(const char *var, const st_tree_timespec_t *cutoff)
 
 	/* update listeners */
 	if (ret == 1) {
+		dtree_generation++;
 		send_to_all("DELINFO %s\n", var);
 	}
 
@@ -1739,13 +2228,281 @@ void dstate_free(void)
 {
 	state_infofree(dtree_root);
 	dtree_root = NULL;
+	dtree_generation++;
+	numinfo_free();
 
 	state_cmdfree(cmdhead);
 	cmdhead = NULL;
 
+	state_cmdfree(snapshot_cmds);
+	snapshot_cmds = NULL;
+	snapshot_warming = 0;
+	snapshot_expires = 0;
+
+	free(dump_cache.buf);
+	dump_cache.buf = NULL;
+	dump_cache.len = 0;
+	dump_cache.size = 0;
+	dump_cache_valid = 0;
+
+	if (seq_history) {
+		size_t	i;
+
+		for (i = 0; i < DSTATE_SEQ_HISTORY; i++) {
+			free(seq_history[i]);
+		}
+		free(seq_history);
+		seq_history = NULL;
+		seq_history_count = 0;
+	}
+
 	sock_close();
 }
 
+/* Warm start snapshots use the same line format as a DUMPALL reply,
+ * so the values are already escaped for parseconf to read back in. */
+int dstate_snapshot_save(const char *fn)
+{
+	char	tmpfn[NUT_PATH_MAX + 16];
+	FILE	*f;
+	dumpbuf_t	db = { NULL, 0, 0 };
+	int	ok = 1;
+
+	if (snapshot_warming) {
+		upsdebugx(2, "%s: still serving a loaded snapshot, not saving it back", __func__);
+		return 0;
+	}
+
+	f = fopen_tmp_sibling(fn, tmpfn, sizeof(tmpfn), 0600);
+	if (!f) {
+		upslog_with_errno(LOG_WARNING, "%s: can't create a temporary file for %s", __func__, fn);
+		return -1;
+	}
+
+	dumpbuf_add(&db, "SNAPSHOT 1\n");
+	dumpbuf_tree(&db, dtree_root, 1);
+	dumpbuf_cmds(&db, 1);
+
+	if (fwrite(db.buf, 1, db.len, f) != db.len) {
+		ok = 0;
+	}
+	free(db.buf);
+
+	if (fclose(f) != 0) {
+		ok = 0;
+	}
+
+	if (!ok) {
+		upslog_with_errno(LOG_WARNING, "%s: can't write %s", __func__, tmpfn);
+		unlink(tmpfn);
+		return -1;
+	}
+
+#ifdef WIN32
+	/* rename() does not replace an existing file here */
+	unlink(fn);
+#endif	/* WIN32 */
+
+	if (rename(tmpfn, fn) != 0) {
+		upslog_with_errno(LOG_WARNING, "%s: can't rename %s to %s", __func__, tmpfn, fn);
+		unlink(tmpfn);
+		return -1;
+	}
+
+	upsdebugx(2, "%s: saved %s", __func__, fn);
+	return 1;
+}
+
+/* apply one line of a snapshot file; returns 0 to abort loading */
+static int snapshot_parse_arg(size_t numarg, char **arg)
+{
+	if (numarg < 2) {
+		return 1;	/* ignore */
+	}
+
+	if (!strcasecmp(arg[0], "SNAPSHOT")) {
+		/* only one format version so far */
+		return !strcmp(arg[1], "1");
+	}
+
+	if (snapshot_skip_var(arg[1])) {
+		return 1;
+	}
+
+	if (!strcasecmp(arg[0], "ADDCMD")) {
+		state_addcmd(&cmdhead, arg[1]);
+		state_addcmd(&snapshot_cmds, arg[1]);
+		return 1;
+	}
+
+	if (numarg < 3) {
+		return 1;
+	}
+
+	if (!strcasecmp(arg[0], "SETINFO")) {
+		state_setinfo(&dtree_root, arg[1], arg[2]);
+	} else if (!strcasecmp(arg[0], "ADDENUM")) {
+		state_addenum(dtree_root, arg[1], arg[2]);
+	} else if (!strcasecmp(arg[0], "SETAUX")) {
+		state_setaux(dtree_root, arg[1], arg[2]);
+	} else if (!strcasecmp(arg[0], "SETFLAGS")) {
+		state_setflags(dtree_root, arg[1], numarg - 2, &arg[2]);
+	} else if (!strcasecmp(arg[0], "ADDRANGE") && numarg > 3) {
+		int	min, max;
+
+		if (str_to_int(arg[2], &min, 10) && str_to_int(arg[3], &max, 10)) {
+			state_addrange(dtree_root, arg[1], min, max);
+		}
+	}
+
+	return 1;
+}
+
+int dstate_snapshot_load(const char *fn, time_t maxage)
+{
+	PCONF_CTX_t	ctx;
+	struct stat	st;
+	time_t	now, age;
+	int	ok = 1;
+
+	if (stat(fn, &st) != 0) {
+		upsdebugx(1, "%s: no snapshot %s to load", __func__, fn);
+		return 0;
+	}
+
+	time(&now);
+	age = now - st.st_mtime;
+	if (age < 0 || (maxage > 0 && age > maxage)) {
+		upslogx(LOG_INFO, "Ignoring snapshot %s: %" PRIdMAX " seconds old",
+			fn, (intmax_t)age);
+		return 0;
+	}
+
+	pconf_init(&ctx, NULL);
+
+	if (!pconf_file_begin(&ctx, fn)) {
+		pconf_finish(&ctx);
+		upslogx(LOG_WARNING, "%s", ctx.errmsg);
+		return -1;
+	}
+
+	while (ok && pconf_file_next(&ctx)) {
+		if (pconf_parse_error(&ctx)) {
+			upslogx(LOG_ERR, "Parse error: %s:%d: %s",
+				fn, ctx.linenum, ctx.errmsg);
+			continue;
+		}
+
+		ok = snapshot_parse_arg(ctx.numargs, ctx.arglist);
+	}
+
+	pconf_finish(&ctx);
+
+	/* the tree was changed directly, without broadcasts */
+	dump_cache_valid = 0;
+
+	if (!ok) {
+		upslogx(LOG_WARNING, "Ignoring snapshot %s: unsupported format", fn);
+		state_infofree(dtree_root);
+		dtree_root = NULL;
+		dtree_generation++;
+		state_cmdfree(cmdhead);
+		cmdhead = NULL;
+		state_cmdfree(snapshot_cmds);
+		snapshot_cmds = NULL;
+		return -1;
+	}
+
+	state_get_timestamp(&snapshot_loaded);
+	snapshot_warming = 1;
+	snapshot_expires = (maxage > 0) ? st.st_mtime + maxage : 0;
+	dstate_setinfo("driver.snapshot.warming", "%" PRIdMAX, (intmax_t)age);
+
+	upslogx(LOG_INFO, "Loaded snapshot %s (%" PRIdMAX " seconds old), "
+		"serving it until the device is initialized", fn, (intmax_t)age);
+
+	return 1;
+}
+
+int dstate_snapshot_is_warming(void)
+{
+	return snapshot_warming;
+}
+
+/* collect the names of nodes not refreshed since the snapshot was loaded */
+static void snapshot_collect_stale(st_tree_t *node, char ***list, size_t *count)
+{
+	if (!node) {
+		return;
+	}
+
+	snapshot_collect_stale(node->left, list, count);
+
+	if (!snapshot_skip_var(node->var)
+	 && st_tree_node_compare_timestamp(node, &snapshot_loaded) <= 0
+	) {
+		*list = xrealloc(*list, (*count + 1) * sizeof(char *));
+		(*list)[(*count)++] = xstrdup(node->var);
+	}
+
+	snapshot_collect_stale(node->right, list, count);
+}
+
+/* drop whatever the live driver did not report again since the load */
+static void snapshot_drop_stale(void)
+{
+	char	**list = NULL;
+	size_t	i, count = 0;
+	cmdlist_t	*cmd;
+
+	snapshot_collect_stale(dtree_root, &list, &count);
+	for (i = 0; i < count; i++) {
+		upsdebugx(2, "%s: dropping %s not refreshed by the driver", __func__, list[i]);
+		dstate_delinfo(list[i]);
+		free(list[i]);
+	}
+	free(list);
+
+	for (cmd = snapshot_cmds; cmd; cmd = cmd->next) {
+		upsdebugx(2, "%s: dropping command %s not registered by the driver", __func__, cmd->name);
+		dstate_delcmd(cmd->name);
+	}
+	state_cmdfree(snapshot_cmds);
+	snapshot_cmds = NULL;
+
+	dstate_delinfo("driver.snapshot.warming");
+}
+
+/* The snapshot data is not served for longer than the warm start
+ * allows (e.g. if the device initialization takes too long): then it
+ * is dropped, and the data is stale until the first live update */
+static void snapshot_check_expired(void)
+{
+	if (!snapshot_warming || snapshot_expires == 0 || time(NULL) < snapshot_expires) {
+		return;
+	}
+
+	upslogx(LOG_WARNING, "The device is still not initialized, "
+		"the loaded snapshot is too old to serve any longer");
+
+	snapshot_expires = 0;
+	snapshot_drop_stale();
+	dstate_datastale();
+}
+
+void dstate_snapshot_warmed(void)
+{
+	if (!snapshot_warming) {
+		return;
+	}
+
+	snapshot_warming = 0;
+	snapshot_expires = 0;
+
+	snapshot_drop_stale();
+	upsdebugx(1, "%s: live data replaced the loaded snapshot", __func__);
+}
+
 const st_tree_t *dstate_getroot(void)
 {
 	return dtree_root;
@@ -1786,6 +2543,7 @@ void status_init(void)
 	ignorelb = (dstate_getinfo("driver.flag.ignorelb") ? 1 : 0);
 
 	memset(status_buf, 0, sizeof(status_buf));
+	status_bits = 0;
 	alarm_status = 0;
 	alarm_legacy_status = 0;
 }
@@ -1794,6 +2552,12 @@ void status_init(void)
  * (considering a whole-word token in temporary status_buf) */
 int status_get(const char *buf)
 {
+	unsigned long	bit = state_status_token_bit(buf);
+
+	/* standard tokens are tracked as bits, no need to scan the string */
+	if (bit)
+		return (status_bits & bit) ? 1 : 0;
+
 	return str_contains_token(status_buf, buf);
 }
 
@@ -1836,10 +2600,28 @@ static int status_set_callback(char *tgt, size_t tgtsize, const char *token)
 
 void status_set(const char *buf)
 {
+	unsigned long	bit;
+	int	ret;
+
 #ifdef DEBUG
 	upsdebugx(3, "%s: '%s'\n", __func__, buf);
 #endif
-	str_add_unique_token(status_buf, sizeof(status_buf), buf, status_set_callback, NULL);
+
+	/* Drivers re-set the same few standard tokens on every poll;
+	 * skip the string scan if this one is already there */
+	bit = state_status_token_bit(buf);
+	if (bit && (status_bits & bit))
+		return;
+
+	ret = str_add_unique_token(status_buf, sizeof(status_buf), buf, status_set_callback, NULL);
+
+	/* Only account for the tokens actually appended (not those
+	 * rejected, e.g. for lack of room in status_buf) */
+	if (strchr(buf, ' ')) {
+		status_bits = state_status_parse(status_buf, NULL, 0);
+	} else if (bit && ret > 0) {
+		status_bits |= bit;
+	}
 }
 
 /* write the status_buf into the externally visible dstate storage */
@@ -1853,6 +2635,7 @@ void status_commit(void)
 
 		if (val && low && (strtol(val, NULL, 10) < strtol(low, NULL, 10))) {
 			snprintfcat(status_buf, sizeof(status_buf), " LB");
+			status_bits |= ST_STATUS_LB;
 			upsdebugx(2, "%s: appending LB flag [charge '%s' below '%s']", __func__, val, low);
 			break;
 		}
@@ -1862,6 +2645,7 @@ void status_commit(void)
 
 		if (val && low && (strtol(val, NULL, 10) < strtol(low, NULL, 10))) {
 			snprintfcat(status_buf, sizeof(status_buf), " LB");
+			status_bits |= ST_STATUS_LB;
 			upsdebugx(2, "%s: appending LB flag [runtime '%s' below '%s']", __func__, val, low);
 			break;
 		}
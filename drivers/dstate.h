@@ -53,6 +53,7 @@ typedef struct conn_s {
 	struct conn_s	*prev;
 	struct conn_s	*next;
 	int	nobroadcast;	/* connections can request to ignore send_to_all() updates */
+	int	seqmode;	/* connection asked for "DUMPALL SEQ", so send_to_all() updates get a "SEQ <n>" prefix */
 	int	readzero;	/* how many times in a row we had zero bytes read; see DSTATE_CONN_READZERO_THROTTLE_USEC and DSTATE_CONN_READZERO_THROTTLE_MAX */
 	int	closing;	/* raised during LOGOUT processing, to close the socket when time is right */
 } conn_t;
@@ -73,11 +74,26 @@ typedef struct conn_s {
 
 char * dstate_init(const char *prog, const char *devname);
 int dstate_poll_fds(struct timeval timeout, TYPE_FD extrafd);
+/* more descriptors for dstate_poll_fds() to watch, e.g. those of a
+ * library event loop (ignored on WIN32) */
+#define DSTATE_POLL_READ	1
+#define DSTATE_POLL_WRITE	2
+int dstate_add_poll_fd(TYPE_FD fd, int events);
+void dstate_del_poll_fd(TYPE_FD fd);
+void dstate_poll_pending(void);
 int vdstate_setinfo(const char *var, const char *fmt, va_list ap);
 int dstate_setinfo(const char *var, const char *fmt, ...)
 	__attribute__ ((__format__ (__printf__, 2, 3)));
 int dstate_setinfo_dynamic(const char *var, const char *fmt_dynamic, const char *fmt_reference, ...)
 	__attribute__ ((__format__ (__printf__, 3, 4)));
+/* Typed versions for numeric values which are re-published often: the
+ * "fmt" must take exactly one double (e.g. "%.1f") or long (e.g. "%ld")
+ * argument, and is validated like dstate_setinfo_dynamic() would do.
+ * If the binary value did not change since the last such call for this
+ * "var", the formatting and tree lookup are skipped. Return codes are
+ * the same as for dstate_setinfo(), or -1 for an unsuitable "fmt". */
+int dstate_setinfo_double(const char *var, const char *fmt, double value);
+int dstate_setinfo_long(const char *var, const char *fmt, long value);
 int vdstate_addenum(const char *var, const char *fmt, va_list ap);
 int dstate_addenum(const char *var, const char *fmt, ...)
 	__attribute__ ((__format__ (__printf__, 2, 3)));
@@ -104,6 +120,18 @@ void dstate_datastale(void);
 
 int dstate_is_stale(void);
 
+/* Warm start: save the data tree (but ups.status and ups.alarm) and command
+ * list into a snapshot file, or load one (ignored if older than "maxage"
+ * seconds, if positive) to serve with a "driver.snapshot.warming" flag until
+ * dstate_snapshot_warmed() drops whatever the live driver did not refresh
+ * since then. Should the snapshot get older than "maxage" before that, the
+ * dstate_poll_pending() calls drop it and mark the data stale. Load and save
+ * return 1 if done, 0 if skipped, or -1 on errors. */
+int dstate_snapshot_save(const char *fn);
+int dstate_snapshot_load(const char *fn, time_t maxage);
+int dstate_snapshot_is_warming(void);
+void dstate_snapshot_warmed(void);
+
 /* clean out the temp space for a new pass */
 void status_init(void);
 
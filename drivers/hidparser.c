@@ -482,10 +482,92 @@ int FindObject(HIDDesc_t *pDesc_arg, HIDData_t *pData)
  * FindObject_with_Path
  * Get pData item with given Path and Type. Return NULL if not found.
  * -------------------------------------------------------------------------- */
+/* The index of descriptor items for FindObject_with_Path() holds, for
+ * each item type and each path prefix (of up to PATH_SIZE nodes, as
+ * compared by the scan below), the first item matching it; see
+ * hash_table_size() */
+static size_t path_hash(uint8_t Type, const HIDNode_t *Node, uint8_t depth)
+{
+	size_t	hash = 2166136261U ^ Type;
+	uint8_t	i;
+
+	for (i = 0; i < depth; i++) {
+		hash = (hash ^ Node[i]) * 16777619U;
+	}
+
+	return hash ^ depth;
+}
+
+static void Build_PathIndex(HIDDesc_t *pDesc_arg)
+{
+	size_t	i, j, size;
+	uint8_t	depth;
+
+	pDesc_arg->path_index = NULL;
+	pDesc_arg->path_index_size = 0;
+
+	/* otherwise FindObject_with_Path() will scan the items */
+	if (pDesc_arg->nitems >= UINT32_MAX)
+		return;
+
+	size = hash_table_size(pDesc_arg->nitems * PATH_SIZE);
+
+	pDesc_arg->path_index = calloc(size, sizeof(*pDesc_arg->path_index));
+	if (!pDesc_arg->path_index)
+		return;
+	pDesc_arg->path_index_size = size;
+
+	for (i = 0; i < pDesc_arg->nitems; i++) {
+		HIDData_t	*pData = &pDesc_arg->item[i];
+
+		for (depth = 1; depth <= PATH_SIZE; depth++) {
+			j = path_hash(pData->Type, pData->Path.Node, depth) & (size - 1);
+
+			while (pDesc_arg->path_index[j].item) {
+				HIDPathIndex_t	*entry = &pDesc_arg->path_index[j];
+				HIDData_t	*pFirst = &pDesc_arg->item[entry->item - 1];
+
+				if (entry->depth == depth
+				&&  pFirst->Type == pData->Type
+				&&  !memcmp(pFirst->Path.Node, pData->Path.Node, depth * sizeof(HIDNode_t))
+				) {
+					break;
+				}
+				j = (j + 1) & (size - 1);
+			}
+
+			/* the first item for this prefix wins */
+			if (!pDesc_arg->path_index[j].item) {
+				pDesc_arg->path_index[j].item = (uint32_t)(i + 1);
+				pDesc_arg->path_index[j].depth = depth;
+			}
+		}
+	}
+}
+
 HIDData_t *FindObject_with_Path(HIDDesc_t *pDesc_arg, HIDPath_t *Path, uint8_t Type)
 {
 	size_t	i;
 
+	if (pDesc_arg->path_index_size && Path->Size > 0 && Path->Size <= PATH_SIZE) {
+		i = path_hash(Type, Path->Node, Path->Size) & (pDesc_arg->path_index_size - 1);
+
+		while (pDesc_arg->path_index[i].item) {
+			HIDPathIndex_t	*entry = &pDesc_arg->path_index[i];
+			HIDData_t	*pData = &pDesc_arg->item[entry->item - 1];
+
+			if (entry->depth == Path->Size
+			&&  pData->Type == Type
+			&&  !memcmp(pData->Path.Node, Path->Node, (Path->Size) * sizeof(HIDNode_t))
+			) {
+				return pData;
+			}
+			i = (i + 1) & (pDesc_arg->path_index_size - 1);
+		}
+
+		return NULL;
+	}
+
 	for (i = 0; i < pDesc_arg->nitems; i++) {
 		HIDData_t *pData = &pDesc_arg->item[i];
 
@@ -563,12 +645,12 @@ HIDData_t *FindObject_with_ID_Node(HIDDesc_t *pDesc_arg, uint8_t ReportID, HIDNo
 }
 
 /*
- * GetValue
- * Extract data from a report stored in Buf.
- * Use Offset, Size, LogMin, and LogMax of pData.
- * Return response in *pValue.
+ * CompileValueDecoder
+ * Work out where GetValue() finds the value of pData in a report, and
+ * how it maps into LogMin..LogMax, from Offset, Size, LogMin and LogMax.
+ * Must be called again if any of these change (see Compile_ReportDesc).
  * -------------------------------------------------------------------------- */
-void GetValue(const unsigned char *Buf, HIDData_t *pData, long *pValue)
+void CompileValueDecoder(HIDData_t *pData)
 {
 	/* Note:  https://github.com/networkupstools/nut/issues/1023
 	   This conversion code can easily be sensitive to 32- vs. 64- bit
@@ -578,18 +660,22 @@ void GetValue(const unsigned char *Buf, HIDData_t *pData, long *pValue)
 	   Test carefully in both environments if changing any declarations.
 	*/
 
-	int	Weight, Bit;
-	unsigned long mask, signbit, magMax, magMin;
-	long	value = 0;
-
-	Bit = pData->Offset + 8;	/* First byte of report is report ID */
-
-	for (Weight = 0; Weight < pData->Size; Weight++, Bit++) {
-		int	State = Buf[Bit >> 3] & (1 << (Bit & 7));
-
-		if(State) {
-			value += (1L << Weight);
-		}
+	HIDDecoder_t	*dec = &pData->decoder;
+	unsigned long	magMax, magMin;
+	int	Bit = pData->Offset + 8;	/* First byte of report is report ID */
+
+	dec->byte = (uint8_t)(Bit >> 3);
+	dec->shift = (uint8_t)(Bit & 7);
+
+	/* Values of up to 32 bits are read as a whole (at most 5 bytes),
+	 * wider ones (not seen in practice) bit by bit */
+	if (pData->Size > 0 && pData->Size <= 32) {
+		dec->nbytes = (uint8_t)((dec->shift + pData->Size + 7) >> 3);
+		dec->rawmask = (pData->Size == 32) ? UINT32_MAX
+			: (uint32_t)((1UL << pData->Size) - 1);
+	} else {
+		dec->nbytes = 0;
+		dec->rawmask = 0;
 	}
 
 	/* translate Value into a signed/unsigned value in the range
@@ -619,17 +705,81 @@ void GetValue(const unsigned char *Buf, HIDData_t *pData, long *pValue)
 	magMin = pData->LogMin >= 0 ? (unsigned long)(pData->LogMin) : (unsigned long)(-(pData->LogMin + 1));
 
 	/* calculate where the sign bit will be if needed */
-	signbit = 1L << hibit(magMax > magMin ? magMax : magMin);
+	dec->signbit = 1L << hibit(magMax > magMin ? magMax : magMin);
 
 	/* but only include sign bit in mask if negative numbers are involved */
-	mask = (signbit - 1) | ((pData->LogMin < 0) ? signbit : 0);
+	dec->is_signed = (pData->LogMin < 0);
+	dec->mask = (dec->signbit - 1) | (dec->is_signed ? dec->signbit : 0);
+
+	dec->ready = 1;
+
+	/* scaling depends on fields which may have changed as well */
+	dec->scale_ready = 0;
+}
+
+/*
+ * Compile_ReportDesc
+ * (Re)compile value decoders of all items, e.g. after a subdriver fixed
+ * up the parsed report descriptor.
+ * -------------------------------------------------------------------------- */
+void Compile_ReportDesc(HIDDesc_t *pDesc_arg)
+{
+	size_t	i;
+
+	if (!pDesc_arg)
+		return;
+
+	for (i = 0; i < pDesc_arg->nitems; i++) {
+		CompileValueDecoder(&pDesc_arg->item[i]);
+	}
+}
+
+/*
+ * GetValue
+ * Extract data from a report stored in Buf.
+ * Use the value decoder of pData (compiled from its Offset, Size, LogMin,
+ * and LogMax). Return response in *pValue.
+ * -------------------------------------------------------------------------- */
+void GetValue(const unsigned char *Buf, HIDData_t *pData, long *pValue)
+{
+	const HIDDecoder_t	*dec = &pData->decoder;
+	long	value = 0;
+
+	if (!dec->ready) {
+		CompileValueDecoder(pData);
+	}
+
+	if (dec->nbytes) {
+		/* little-endian: gather the bytes, drop the bits before ours */
+		const unsigned char	*p = Buf + dec->byte;
+		uint64_t	raw = 0;
+		int	i;
+
+		for (i = dec->nbytes - 1; i >= 0; i--) {
+			raw = (raw << 8) | p[i];
+		}
+
+		value = (long)(unsigned long)((uint32_t)(raw >> dec->shift) & dec->rawmask);
+	} else {
+		int	Weight, Bit;
+
+		Bit = pData->Offset + 8;	/* First byte of report is report ID */
+
+		for (Weight = 0; Weight < pData->Size; Weight++, Bit++) {
+			int	State = Buf[Bit >> 3] & (1 << (Bit & 7));
+
+			if(State) {
+				value += (1L << Weight);
+			}
+		}
+	}
 
 	/* throw away excess high order bits (which may contain garbage) */
-	value = (long)((unsigned long)(value) & mask);
+	value = (long)((unsigned long)(value) & dec->mask);
 
 	/* sign-extend it, if appropriate */
-	if (pData->LogMin < 0 && ((unsigned long)(value) & signbit) != 0) {
-		value |= ~mask;
+	if (dec->is_signed && ((unsigned long)(value) & dec->signbit) != 0) {
+		value |= ~dec->mask;
 	}
 
 	/* clamp returned value to range [LogMin..LogMax] */
@@ -764,6 +914,9 @@ HIDDesc_t *Parse_ReportDesc(const usb_ctrl_charbuf ReportDesc, const usb_ctrl_ch
 
 	pDesc_var->item = realloc(pDesc_var->item, pDesc_var->nitems * sizeof(*pDesc_var->item));
 
+	Compile_ReportDesc(pDesc_var);
+	Build_PathIndex(pDesc_var);
+
 	return pDesc_var;
 }
 
@@ -775,5 +928,6 @@ void Free_ReportDesc(HIDDesc_t *pDesc_arg)
 	}
 
 	free(pDesc_arg->item);
+	free(pDesc_arg->path_index);
 	free(pDesc_arg);
 }
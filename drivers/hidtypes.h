@@ -295,6 +295,28 @@ typedef struct {
  *
  * Describe a HID Data with its location in report
  * -------------------------------------------------------------------------- */
+/*
+ * HIDDecoder_t
+ *
+ * What it takes to decode a HID Data from a report, worked out once from
+ * its other fields (see CompileValueDecoder) and not for every read
+ * -------------------------------------------------------------------------- */
+typedef struct {
+	uint8_t		ready;				/* bit extraction fields are valid	*/
+	uint8_t		nbytes;				/* report bytes holding the value, 0 if too wide */
+	uint8_t		byte;				/* first of these (report ID is byte 0)	*/
+	uint8_t		shift;				/* position of the value in that byte	*/
+	uint8_t		is_signed;			/* value is in 2's complement		*/
+	uint32_t	rawmask;			/* Size low bits			*/
+	unsigned long	mask;				/* bits of the value, incl. sign bit	*/
+	unsigned long	signbit;			/* sign bit				*/
+
+	uint8_t		scale_ready;			/* scaling fields are valid (libhid)	*/
+	uint8_t		have_phys;			/* logical to physical conversion?	*/
+	double		factor;				/* physical units per logical unit	*/
+	double		scale;				/* unit exponent multiplier		*/
+} HIDDecoder_t;
+
 typedef struct {
 	HIDPath_t	Path;				/* HID Path				*/
 
@@ -318,8 +340,20 @@ typedef struct {
 	int8_t		have_PhyMax;			/* Physical Max defined?		*/
 
 	bool		mapping_handled;		/* Did any (sub)driver handling loop care about this report? If not, may be a point for improvement... */
+
+	HIDDecoder_t	decoder;			/* cached by Parse_ReportDesc()	*/
 } HIDData_t;
 
+/*
+ * HIDPathIndex_t
+ *
+ * Entry of the index of descriptor items by type and path prefix
+ * -------------------------------------------------------------------------- */
+typedef struct {
+	uint32_t	item;				/* item position + 1, 0 if unused	*/
+	uint8_t		depth;				/* path prefix length			*/
+} HIDPathIndex_t;
+
 /*
  * HIDDesc struct
  *
@@ -329,6 +363,8 @@ typedef struct {
 	size_t		nitems;				/* number of items in descriptor */
 	HIDData_t	*item;				/* list of items			*/
 	size_t		replen[256];		/* list of report lengths, in byte */
+	HIDPathIndex_t	*path_index;			/* see FindObject_with_Path()	*/
+	size_t		path_index_size;		/* power of 2, or 0 if no index	*/
 } HIDDesc_t;
 
 #ifdef __cplusplus
@@ -33,6 +33,7 @@
 #include "config.h" /* must be the first header */
 
 #include <stdio.h>
+#include <ctype.h>	/* for tolower() */
 #ifdef HAVE_STRING_H
 # include <string.h>
 #endif
@@ -56,6 +57,7 @@
 
 /* support functions */
 static double logical_to_physical(HIDData_t *Data, long logical);
+static void compile_scale(HIDData_t *Data);
 static long physical_to_logical(HIDData_t *Data, double physical);
 static const char *hid_lookup_path(const HIDNode_t usage, usage_tables_t *utab);
 static long hid_lookup_usage(const char *name, usage_tables_t *utab);
@@ -165,9 +167,12 @@ static int refresh_report_buffer(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDDa
 	int	ret;
 	size_t	r;
 
-	if (interrupt_only || rbuf->ts[id] + age > time(NULL)) {
+	if (interrupt_only || rbuf->ts[id] + age > time(NULL)
+	 || (rbuf->curcycle && rbuf->cycle[id] == rbuf->curcycle)
+	) {
 		/* buffered report is still good; nothing to do */
 		upsdebug_hex(3, "Report[buf]", rbuf->data[id], rbuf->len[id]);
+		rbuf->cycle[id] = rbuf->curcycle;
 		return 0;
 	}
 
@@ -252,6 +257,8 @@ static int refresh_report_buffer(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDDa
 
 	/* have (valid) report */
 	time(&rbuf->ts[id]);
+	rbuf->cycle[id] = rbuf->curcycle;
+	rbuf->cycle_reports++;
 
 	return 0;
 }
@@ -347,6 +354,7 @@ static int set_item_buffered(reportbuf_t *rbuf, hid_dev_handle_t udev, HIDData_t
 
 	/* expire report */
 	rbuf->ts[id] = 0;
+	rbuf->cycle[id] = 0;
 
 	return 0;
 }
@@ -533,17 +541,78 @@ int HIDGetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double *Value, ti
 		return -errno;
 	}
 
-	*Value = hValue;
-
-	/* Convert Logical Min, Max and Value into Physical */
+	/* Convert Logical Min, Max and Value into Physical, with units */
 	*Value = logical_to_physical(hiddata, hValue);
 
-	/* Process exponents and units */
-	*Value *= exponent(10, get_unit_expo(hiddata));
+	return 1;
+}
+
+/* Make sure the report holding the given HIDData is in the report
+ * buffer, like HIDGetDataValue() does, without decoding anything.
+ * return 1 if OK, 0 on fail, -errno otherwise (ie disconnect).
+ */
+int HIDRefreshReport(hid_dev_handle_t udev, HIDData_t *hiddata, time_t age)
+{
+	if (hiddata == NULL) {
+		return 0;
+	}
+
+	if (refresh_report_buffer(reportbuf, udev, hiddata, age) < 0) {
+		upsdebug_with_errno(1, "Can't retrieve Report %02x", hiddata->ReportID);
+		return -errno;
+	}
+
+	return 1;
+}
+
+/* Return the physical value associated with the given HIDData, as
+ * currently held in the report buffer (see HIDRefreshReport()).
+ * return 1 if OK, 0 on fail.
+ */
+int HIDDecodeDataValue(HIDData_t *hiddata, double *Value)
+{
+	long	hValue;
+
+	if (hiddata == NULL || reportbuf->data[hiddata->ReportID] == NULL) {
+		return 0;
+	}
+
+	GetValue(reportbuf->data[hiddata->ReportID], hiddata, &hValue);
+
+	*Value = logical_to_physical(hiddata, hValue);
 
 	return 1;
 }
 
+/* Within a poll cycle, each report is retrieved from the device at most
+ * once, whatever its age: items sharing a report can not cause repeated
+ * GET_REPORT requests when the clock ticks to the next second meanwhile.
+ * HIDEndPollCycle() returns how many requests the cycle has issued.
+ */
+void HIDStartPollCycle(void)
+{
+	if (!reportbuf)
+		return;
+
+	reportbuf->lastcycle++;
+	if (reportbuf->lastcycle == 0) {
+		/* wrapped around; 0 means "no cycle" */
+		memset(reportbuf->cycle, 0, sizeof(reportbuf->cycle));
+		reportbuf->lastcycle = 1;
+	}
+	reportbuf->curcycle = reportbuf->lastcycle;
+	reportbuf->cycle_reports = 0;
+}
+
+size_t HIDEndPollCycle(void)
+{
+	if (!reportbuf)
+		return 0;
+
+	reportbuf->curcycle = 0;
+	return reportbuf->cycle_reports;
+}
+
 /* Return the physical value associated with the given path.
  * return 1 if OK, 0 on fail, -errno otherwise (ie disconnect).
  */
@@ -664,7 +733,10 @@ int HIDSetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double Value)
 	}
 
 	/* Process exponents and units */
-	Value /= exponent(10, get_unit_expo(hiddata));
+	if (!hiddata->decoder.scale_ready) {
+		compile_scale(hiddata);
+	}
+	Value /= hiddata->decoder.scale;
 
 	/* Convert Physical Min, Max and Value into Logical */
 	hValue = physical_to_logical(hiddata, Value);
@@ -677,6 +749,7 @@ int HIDSetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double Value)
 
 	/* flush the report buffer (data may have changed) */
 	memset(reportbuf->ts, 0, sizeof(reportbuf->ts));
+	memset(reportbuf->cycle, 0, sizeof(reportbuf->cycle));
 
 	upsdebugx(4, "Set report succeeded");
 	return 1;
@@ -809,43 +882,62 @@ int HIDGetEvents(hid_dev_handle_t udev, HIDData_t **event, int eventsize)
  * Support functions
  *******************************************************/
 
-static double logical_to_physical(HIDData_t *Data, long logical)
+/* work out once how logical values of the item convert to physical ones,
+ * in NUT units (see HIDDecoder_t), rather than for every value read */
+static void compile_scale(HIDData_t *Data)
 {
-	double physical;
-	double Factor;
+	HIDDecoder_t	*dec = &Data->decoder;
 
 	upsdebugx(5, "PhyMax = %ld, PhyMin = %ld, LogMax = %ld, LogMin = %ld",
 		Data->PhyMax, Data->PhyMin, Data->LogMax, Data->LogMin);
 
+	dec->have_phys = 0;
+	dec->factor = 1;
+
 	/* HID spec says that if one or both are undefined, or if they are
 	 * both 0, then PhyMin = LogMin, PhyMax = LogMax. */
 	if (!Data->have_PhyMax || !Data->have_PhyMin ||
 		(Data->PhyMax == 0 && Data->PhyMin == 0))
 	{
-		return (double)logical;
+		/* physical value is the logical one */
+	} else if ((Data->PhyMax <= Data->PhyMin) || (Data->LogMax <= Data->LogMin)) {
+		/* Paranoia: this should not really happen */
+		upsdebugx(5, "Max was not greater than Min, using logical value as is");
+	} else {
+		dec->have_phys = 1;
+		dec->factor = (double)(Data->PhyMax - Data->PhyMin) / (Data->LogMax - Data->LogMin);
 	}
 
-	/* Paranoia */
-	if ((Data->PhyMax <= Data->PhyMin) || (Data->LogMax <= Data->LogMin))
-	{
-		/* this should not really happen */
-		upsdebugx(5, "Max was not greater than Min, returning logical value as is");
-		return (double)logical;
-	}
+	/* Process exponents and units */
+	dec->scale = exponent(10, get_unit_expo(Data));
 
-	Factor = (double)(Data->PhyMax - Data->PhyMin) / (Data->LogMax - Data->LogMin);
-	/* Convert Value */
-	physical = (double)((logical - Data->LogMin) * Factor) + Data->PhyMin;
+	dec->scale_ready = 1;
+}
+
+/* convert a logical value of the item to the physical one, with the unit
+ * exponent applied. Factor and exponent are separate multiplications, so
+ * values are the same as when they were computed for every read */
+static double logical_to_physical(HIDData_t *Data, long logical)
+{
+	const HIDDecoder_t	*dec = &Data->decoder;
+	double	physical = (double)logical;
 
-	if (physical > Data->PhyMax) {
-		return Data->PhyMax;
+	if (!dec->scale_ready) {
+		compile_scale(Data);
 	}
 
-	if (physical < Data->PhyMin) {
-		return Data->PhyMin;
+	if (dec->have_phys) {
+		/* Convert Value */
+		physical = (double)((logical - Data->LogMin) * dec->factor) + Data->PhyMin;
+
+		if (physical > Data->PhyMax) {
+			physical = Data->PhyMax;
+		} else if (physical < Data->PhyMin) {
+			physical = Data->PhyMin;
+		}
 	}
 
-	return physical;
+	return physical * dec->scale;
 }
 
 static long physical_to_logical(HIDData_t *Data, double physical)
@@ -1021,23 +1113,109 @@ static int path_to_string(char *string, size_t size, const HIDPath_t *path, usag
 	return i;
 }
 
+/* Usage tables are indexed by name and by code when first looked up,
+ * rather than scanned for each path component (which made resolving
+ * all mapping table paths at init slow with large tables), see
+ * hash_table_size(); in each, the first entry of the table wins as
+ * with a scan */
+typedef struct usage_index_s {
+	const usage_lkp_t	*table;
+	const usage_lkp_t	**by_name;
+	const usage_lkp_t	**by_code;
+	size_t	size;
+	struct usage_index_s	*next;
+} usage_index_t;
+
+#define USAGE_INDEX_HASHSIZE	32
+
+static usage_index_t	*usage_indexes[USAGE_INDEX_HASHSIZE];
+
+static size_t usage_hash_code(HIDNode_t code)
+{
+	/* page in the high half, usage in the low half */
+	return (size_t)(code ^ (code >> 16) * 31);
+}
+
+static usage_index_t *usage_index_get(const usage_lkp_t *table)
+{
+	usage_index_t	**slot = &usage_indexes[((size_t)table / sizeof(usage_lkp_t)) % USAGE_INDEX_HASHSIZE];
+	usage_index_t	*index;
+	const usage_lkp_t	*usage;
+	size_t	count = 0, i;
+
+	for (index = *slot; index != NULL; index = index->next) {
+		if (index->table == table)
+			return index;
+	}
+
+	for (usage = table; usage->usage_name != NULL; usage++)
+		count++;
+
+	index = xcalloc(1, sizeof(*index));
+	index->table = table;
+	index->size = hash_table_size(count);
+	index->by_name = xcalloc(index->size, sizeof(*index->by_name));
+	index->by_code = xcalloc(index->size, sizeof(*index->by_code));
+
+	for (usage = table; usage->usage_name != NULL; usage++) {
+		i = str_hash(usage->usage_name, 1) & (index->size - 1);
+		while (index->by_name[i] != NULL && strcasecmp(index->by_name[i]->usage_name, usage->usage_name))
+			i = (i + 1) & (index->size - 1);
+		if (index->by_name[i] == NULL)
+			index->by_name[i] = usage;
+
+		i = usage_hash_code(usage->usage_code) & (index->size - 1);
+		while (index->by_code[i] != NULL && index->by_code[i]->usage_code != usage->usage_code)
+			i = (i + 1) & (index->size - 1);
+		if (index->by_code[i] == NULL)
+			index->by_code[i] = usage;
+	}
+
+	index->next = *slot;
+	*slot = index;
+
+	return index;
+}
+
+void HIDFreeUsageIndexes(void)
+{
+	usage_index_t	*index, *next;
+	size_t	i;
+
+	for (i = 0; i < USAGE_INDEX_HASHSIZE; i++) {
+		for (index = usage_indexes[i]; index != NULL; index = next) {
+			next = index->next;
+			free(index->by_name);
+			free(index->by_code);
+			free(index);
+		}
+		usage_indexes[i] = NULL;
+	}
+}
+
 /* usage conversion string -> numeric
  * Returns -1 for error, or a (HIDNode_t) ranged code value
  */
 static long hid_lookup_usage(const char *name, usage_tables_t *utab)
 {
-	int i, j;
+	int i;
+	size_t	j;
+	usage_index_t	*index;
+	const usage_lkp_t	*found;
 
 	for (i = 0; utab[i] != NULL; i++)
 	{
-		for (j = 0; utab[i][j].usage_name != NULL; j++)
-		{
-			if (strcasecmp(utab[i][j].usage_name, name))
-				continue;
+		index = usage_index_get(utab[i]);
+		j = str_hash(name, 1) & (index->size - 1);
 
-			/* Note: currently per hidtypes.h, HIDNode_t == uint32_t */
-			upsdebugx(5, "hid_lookup_usage: %s -> %08x", name, (uint32_t)utab[i][j].usage_code);
-			return (long)(utab[i][j].usage_code);
+		while ((found = index->by_name[j]) != NULL)
+		{
+			if (!strcasecmp(found->usage_name, name)) {
+				/* Note: currently per hidtypes.h, HIDNode_t == uint32_t */
+				upsdebugx(5, "hid_lookup_usage: %s -> %08x", name, (uint32_t)found->usage_code);
+				return (long)(found->usage_code);
+			}
+			j = (j + 1) & (index->size - 1);
 		}
 	}
 
@@ -1048,17 +1226,23 @@ static long hid_lookup_usage(const char *name, usage_tables_t *utab)
 /* usage conversion numeric -> string */
 static const char *hid_lookup_path(const HIDNode_t usage, usage_tables_t *utab)
 {
-	int i, j;
+	int i;
+	size_t	j;
+	usage_index_t	*index;
+	const usage_lkp_t	*found;
 
 	for (i = 0; utab[i] != NULL; i++)
 	{
-		for (j = 0; utab[i][j].usage_name != NULL; j++)
-		{
-			if (utab[i][j].usage_code != usage)
-				continue;
+		index = usage_index_get(utab[i]);
+		j = usage_hash_code(usage) & (index->size - 1);
 
-			upsdebugx(5, "hid_lookup_path: %08x -> %s", (unsigned int)usage, utab[i][j].usage_name);
-			return utab[i][j].usage_name;
+		while ((found = index->by_code[j]) != NULL)
+		{
+			if (found->usage_code == usage) {
+				upsdebugx(5, "hid_lookup_path: %08x -> %s", (unsigned int)usage, found->usage_name);
+				return found->usage_name;
+			}
+			j = (j + 1) & (index->size - 1);
 		}
 	}
 
@@ -95,6 +95,10 @@ typedef struct reportbuf_s {
 	time_t	ts[256];			/* timestamp when report was retrieved */
 	size_t	len[256];			/* size of report data */
 	unsigned char	*data[256];		/* report data (allocated) */
+	unsigned long	cycle[256];		/* poll cycle which last refreshed the report */
+	unsigned long	curcycle;		/* current poll cycle, 0 if none is running */
+	unsigned long	lastcycle;		/* number of the latest poll cycle */
+	size_t	cycle_reports;			/* GET_REPORT requests in current poll cycle */
 } reportbuf_t;
 
 extern reportbuf_t	*reportbuf;	/* buffer for most recent reports */
@@ -135,6 +139,22 @@ char *HIDGetDataItem(const HIDData_t *hiddata, usage_tables_t *utab);
  * -------------------------------------------------------------------------- */
 int HIDGetDataValue(hid_dev_handle_t udev, HIDData_t *hiddata, double *Value, time_t age);
 
+/*
+ * HIDRefreshReport
+ * -------------------------------------------------------------------------- */
+int HIDRefreshReport(hid_dev_handle_t udev, HIDData_t *hiddata, time_t age);
+
+/*
+ * HIDDecodeDataValue
+ * -------------------------------------------------------------------------- */
+int HIDDecodeDataValue(HIDData_t *hiddata, double *Value);
+
+/*
+ * HIDStartPollCycle, HIDEndPollCycle
+ * -------------------------------------------------------------------------- */
+void HIDStartPollCycle(void);
+size_t HIDEndPollCycle(void);
+
 /*
  * HIDSetDataValue
  * -------------------------------------------------------------------------- */
@@ -156,6 +176,8 @@ int HIDGetEvents(hid_dev_handle_t udev, HIDData_t **event, int eventlen);
 void HIDDumpTree(hid_dev_handle_t udev, HIDDevice_t *hd, usage_tables_t *utab);
 const char *HIDDataType(const HIDData_t *hiddata);
 
+void HIDFreeUsageIndexes(void);
+
 void free_report_buffer(reportbuf_t *rbuf);
 reportbuf_t *new_report_buffer(HIDDesc_t *pDesc);
 
@@ -31,9 +31,20 @@
 #include "usb-common.h"
 #include "nut_libusb.h"
 #include "nut_stdint.h"
+#include "usb-cache.h"
+
+#ifndef WIN32
+# include <fcntl.h>
+# include <poll.h>
+#endif
+
+/* libusb hotplug API appeared in libusb(x) 1.0.16 */
+#if !(defined WIN32) && ( ((defined LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000102)) || ((defined LIBUSBX_API_VERSION) && (LIBUSBX_API_VERSION >= 0x01000102)) )
+# define NUT_LIBUSB_HOTPLUG	1
+#endif
 
 #define USB_DRIVER_NAME		"USB communication driver (libusb 1.0)"
-#define USB_DRIVER_VERSION	"0.50"
+#define USB_DRIVER_VERSION	"0.53"
 
 /* driver description structure */
 upsdrv_info_t comm_upsdrv_info = {
@@ -47,6 +58,67 @@ upsdrv_info_t comm_upsdrv_info = {
 #define MAX_REPORT_SIZE         0x1800
 
 static void nut_libusb_close(libusb_device_handle *udev);
+#ifdef NUT_LIBUSB_HOTPLUG
+static void nut_libusb_hotplug_disarm(void);
+#endif
+
+/* Location of the device opened last, which the next nut_libusb_open()
+ * tries first: when reconnecting to it, the other devices on the buses
+ * then need not be opened (and their strings read) to find it again */
+typedef struct nut_libusb_location_s {
+	uint16_t	VendorID;
+	uint16_t	ProductID;
+	uint8_t	bus;
+	uint8_t	ports[8];	/* port numbers from the root hub */
+	int	nports;
+} nut_libusb_location_t;
+
+static nut_libusb_location_t	last_location;
+static int	last_location_valid = 0;
+
+static void nut_libusb_get_location(libusb_device *device,
+	const struct libusb_device_descriptor *dev_desc,
+	nut_libusb_location_t *loc)
+{
+	memset(loc, 0, sizeof(*loc));
+	loc->VendorID = dev_desc->idVendor;
+	loc->ProductID = dev_desc->idProduct;
+	loc->bus = libusb_get_bus_number(device);
+#if (defined WITH_USB_BUSPORT) && (WITH_USB_BUSPORT)
+	/* same libusb release as libusb_get_port_number() */
+	loc->nports = libusb_get_port_numbers(device, loc->ports, (int)sizeof(loc->ports));
+	if (loc->nports < 0) {
+		loc->nports = 0;
+	}
+#endif
+}
+
+/* index in devlist of the device at the last location, or 0 */
+static size_t nut_libusb_find_last_location(libusb_device **devlist, ssize_t devcount)
+{
+	struct libusb_device_descriptor	dev_desc;
+	nut_libusb_location_t	loc;
+	size_t	devnum;
+
+	if (!last_location_valid) {
+		return 0;
+	}
+
+	for (devnum = 0; (ssize_t)devnum < devcount; devnum++) {
+		if (libusb_get_device_descriptor(devlist[devnum], &dev_desc) != LIBUSB_SUCCESS) {
+			continue;
+		}
+
+		nut_libusb_get_location(devlist[devnum], &dev_desc, &loc);
+		if (!memcmp(&loc, &last_location, sizeof(loc))) {
+			upsdebugx(2, "%s: trying device %" PRIuSIZE " (%04X/%04X) at the last used location first",
+				__func__, devnum + 1, loc.VendorID, loc.ProductID);
+			return devnum;
+		}
+	}
+
+	return 0;
+}
 
 /*! Add USB-related driver variables with addvar() and dstate_setinfo().
  * This removes some code duplication across the USB drivers.
@@ -166,6 +238,21 @@ static void nut_libusb_subdriver_defaults(usb_communication_subdriver_t *subdriv
 		subdriver->hid_ep_out = LIBUSB_DEFAULT_HID_EP_OUT;
 }
 
+/* Whether a matcher rejects the device as described by its cached
+ * strings (errors are left for the check of the opened device) */
+static int nut_libusb_cache_rejects(USBDeviceMatcher_t *matcher, USBDevice_t *hd)
+{
+	USBDeviceMatcher_t	*m;
+
+	for (m = matcher; m; m = m->next) {
+		if (matches(m, hd) == 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 /* On success, fill in the curDevice structure and return the report
  * descriptor length. On failure, return -1.
  * Note: When callback is not NULL, the report descriptor will be
@@ -189,7 +276,7 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 	USBDeviceMatcher_t *m;
 	libusb_device **devlist;
 	ssize_t	devcount = 0;
-	size_t	devnum;
+	size_t	devnum, step, first;
 	struct libusb_device_descriptor dev_desc;
 	struct libusb_config_descriptor *conf_desc = NULL;
 	const struct libusb_interface_descriptor *if_desc;
@@ -206,6 +293,10 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 	int count_open_EACCESS = 0;
 	int count_open_errors = 0;
 	int count_open_attempts = 0;
+	int count_cache_skipped = 0;
+	int strings_read;
+	nut_usb_cache_t	scan_cache;
+	const nut_usb_cache_entry_t	*cached;
 
 	/* report descriptor */
 	unsigned char	rdbuf[MAX_REPORT_SIZE];
@@ -302,13 +393,22 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 		libusb_close(*udevp);
 #endif
 
+	nut_usb_cache_load(&scan_cache);
+
+rescan:
 	devcount = libusb_get_device_list(NULL, &devlist);
+	first = nut_libusb_find_last_location(devlist, devcount);
 
 	/* devcount may be < 0, loop will get skipped;
-	 * its SSIZE_MAX < SIZE_MAX for devnum */
-	for (devnum = 0; (ssize_t)devnum < devcount; devnum++) {
+	 * its SSIZE_MAX < SIZE_MAX for devnum.
+	 * The devices are checked in the enumeration order,
+	 * except the one at the last location (if any) first. */
+	for (step = 0; (ssize_t)step < devcount; step++) {
 		/* int		if_claimed = 0; */
-		libusb_device	*device = devlist[devnum];
+		libusb_device	*device;
+
+		devnum = (step == 0) ? first : ((step <= first) ? step - 1 : step);
+		device = devlist[devnum];
 
 		count_open_attempts++;
 		libusb_get_device_descriptor(device, &dev_desc);
@@ -318,27 +418,7 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 
 		/* supported vendors are now checked by the supplied matcher */
 
-		/* open the device */
-		ret = libusb_open(device, udevp);
-		if (ret != 0) {
-			upsdebugx(1, "Failed to open device (%04X/%04X), skipping: %s",
-				dev_desc.idVendor,
-				dev_desc.idProduct,
-				libusb_strerror((enum libusb_error)ret));
-			count_open_errors++;
-			if (ret == LIBUSB_ERROR_ACCESS) {
-				count_open_EACCESS++;
-			}
-			continue;
-		}
-		udev = *udevp;
-
-		/* collect the identifying information of this
-		   device. Note that this is safe, because
-		   there's no need to claim an interface for
-		   this (and therefore we do not yet need to
-		   detach any kernel drivers). */
-
+		/* collect the identifying information of this device */
 		free(curDevice->Vendor);
 		free(curDevice->Product);
 		free(curDevice->Serial);
@@ -406,6 +486,54 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 		curDevice->ProductID = dev_desc.idProduct;
 		curDevice->bcdDevice = dev_desc.bcdDevice;
 
+		/* Strings read by a recent scan (of this or another process)
+		 * tell whether the device is of no interest without opening
+		 * it; a device which seems to match is checked for real */
+		cached = nut_usb_cache_find(&scan_cache, bus_num, device_addr,
+			dev_desc.idVendor, dev_desc.idProduct, dev_desc.bcdDevice);
+		if (cached) {
+			int	rejected;
+
+			curDevice->Vendor = cached->Vendor ? xstrdup(cached->Vendor) : NULL;
+			curDevice->Product = cached->Product ? xstrdup(cached->Product) : NULL;
+			curDevice->Serial = cached->Serial ? xstrdup(cached->Serial) : NULL;
+
+			rejected = nut_libusb_cache_rejects(matcher, curDevice);
+			nut_libusb_subdriver_defaults(&usb_subdriver);
+			if (rejected) {
+				upsdebugx(2, "Device does not match by its cached strings - "
+					"skipping without opening it");
+				count_cache_skipped++;
+				continue;
+			}
+
+			free(curDevice->Vendor);
+			free(curDevice->Product);
+			free(curDevice->Serial);
+			curDevice->Vendor = NULL;
+			curDevice->Product = NULL;
+			curDevice->Serial = NULL;
+		}
+
+		/* open the device: reading its strings is safe,
+		   because there's no need to claim an interface
+		   for this (and therefore we do not yet need to
+		   detach any kernel drivers) */
+		ret = libusb_open(device, udevp);
+		if (ret != 0) {
+			upsdebugx(1, "Failed to open device (%04X/%04X), skipping: %s",
+				dev_desc.idVendor,
+				dev_desc.idProduct,
+				libusb_strerror((enum libusb_error)ret));
+			count_open_errors++;
+			if (ret == LIBUSB_ERROR_ACCESS) {
+				count_open_EACCESS++;
+			}
+			continue;
+		}
+		udev = *udevp;
+
+		strings_read = 1;
 		if (dev_desc.iManufacturer) {
 			ret = nut_usb_get_string(udev, dev_desc.iManufacturer,
 				string, sizeof(string));
@@ -417,6 +545,7 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 				}
 			} else {
 				upsdebugx(1, "%s: get Manufacturer string failed", __func__);
+				strings_read = 0;
 			}
 		}
 
@@ -431,6 +560,7 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 				}
 			} else {
 				upsdebugx(1, "%s: get Product string failed", __func__);
+				strings_read = 0;
 			}
 		}
 
@@ -445,9 +575,17 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 				}
 			} else {
 				upsdebugx(1, "%s: get Serial Number string failed", __func__);
+				strings_read = 0;
 			}
 		}
 
+		/* not caching what may be a transient failure */
+		if (strings_read) {
+			nut_usb_cache_update(&scan_cache, bus_num, device_addr,
+				dev_desc.idVendor, dev_desc.idProduct, dev_desc.bcdDevice,
+				curDevice->Vendor, curDevice->Product, curDevice->Serial);
+		}
+
 		upsdebugx(2, "- VendorID: %04x", curDevice->VendorID);
 		upsdebugx(2, "- ProductID: %04x", curDevice->ProductID);
 		upsdebugx(2, "- Manufacturer: %s", curDevice->Vendor ? curDevice->Vendor : "unknown");
@@ -611,6 +749,13 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 		 * by several sub-drivers, differing by vendor/model strings)?
 		 */
 		if (!callback) {
+			nut_libusb_get_location(device, &dev_desc, &last_location);
+			last_location_valid = 1;
+#ifdef NUT_LIBUSB_HOTPLUG
+			nut_libusb_hotplug_disarm();
+#endif
+			nut_usb_cache_save(&scan_cache);
+			nut_usb_cache_free(&scan_cache);
 			libusb_free_config_descriptor(conf_desc);
 			libusb_free_device_list(devlist, 1);
 			return 1;
@@ -800,7 +945,14 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 			usb_subdriver.hid_ep_out
 			);
 
+		nut_libusb_get_location(device, &dev_desc, &last_location);
+		last_location_valid = 1;
+#ifdef NUT_LIBUSB_HOTPLUG
+		nut_libusb_hotplug_disarm();
+#endif
 		fflush(stdout);
+		nut_usb_cache_save(&scan_cache);
+		nut_usb_cache_free(&scan_cache);
 		libusb_free_device_list(devlist, 1);
 
 		return rdlen;
@@ -818,6 +970,23 @@ static int nut_libusb_open(libusb_device_handle **udevp,
 	/* If we got here, we did not return a successfully chosen device above */
 	*udevp = NULL;
 	libusb_free_device_list(devlist, 1);
+
+	if (count_cache_skipped > 0) {
+		/* The devices skipped by their cached strings may have
+		 * changed since, check them for real before giving up */
+		upsdebugx(2, "libusb1: No appropriate HID device found, "
+			"checking again the %d devices skipped by their cached strings",
+			count_cache_skipped);
+		scan_cache.use = 0;
+		count_cache_skipped = 0;
+		count_open_EACCESS = 0;
+		count_open_errors = 0;
+		count_open_attempts = 0;
+		goto rescan;
+	}
+
+	nut_usb_cache_save(&scan_cache);
+	nut_usb_cache_free(&scan_cache);
 	upsdebugx(2, "libusb1: No appropriate HID device found");
 	fflush(stdout);
 
@@ -1055,6 +1224,506 @@ static int nut_libusb_get_string(
 	return nut_libusb_strerror(ret, __func__);
 }
 
+#ifndef WIN32
+/* The libusb event sources are watched by dstate_poll_fds() while either
+ * an asynchronous interrupt transfer or the hotplug callback need them */
+static int	pollfds_users = 0;
+
+static void LIBUSB_CALL nut_libusb_pollfd_added(int fd, short events, void *user_data)
+{
+	NUT_UNUSED_VARIABLE(user_data);
+
+	dstate_add_poll_fd(fd,
+		((events & POLLIN) ? DSTATE_POLL_READ : 0)
+		| ((events & POLLOUT) ? DSTATE_POLL_WRITE : 0));
+}
+
+static void LIBUSB_CALL nut_libusb_pollfd_removed(int fd, void *user_data)
+{
+	NUT_UNUSED_VARIABLE(user_data);
+
+	dstate_del_poll_fd(fd);
+}
+
+static void nut_libusb_watch_pollfds(void)
+{
+	const struct libusb_pollfd	**pollfds;
+	int	i;
+
+	if (pollfds_users++ > 0) {
+		return;
+	}
+
+	pollfds = libusb_get_pollfds(NULL);
+	if (pollfds) {
+		for (i = 0; pollfds[i] != NULL; i++) {
+			nut_libusb_pollfd_added(pollfds[i]->fd, pollfds[i]->events, NULL);
+		}
+#if (defined LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000104)
+		libusb_free_pollfds(pollfds);
+#else
+		free((void *)pollfds);
+#endif
+	}
+	libusb_set_pollfd_notifiers(NULL, nut_libusb_pollfd_added, nut_libusb_pollfd_removed, NULL);
+}
+
+static void nut_libusb_unwatch_pollfds(void)
+{
+	const struct libusb_pollfd	**pollfds;
+	int	i;
+
+	if (pollfds_users == 0 || --pollfds_users > 0) {
+		return;
+	}
+
+	libusb_set_pollfd_notifiers(NULL, NULL, NULL, NULL);
+	pollfds = libusb_get_pollfds(NULL);
+	if (pollfds) {
+		for (i = 0; pollfds[i] != NULL; i++) {
+			dstate_del_poll_fd(pollfds[i]->fd);
+		}
+#if (defined LIBUSB_API_VERSION) && (LIBUSB_API_VERSION >= 0x01000104)
+		libusb_free_pollfds(pollfds);
+#else
+		free((void *)pollfds);
+#endif
+	}
+}
+
+/* Asynchronous interrupt transfers: once enabled by the driver, a transfer
+ * stays submitted on the interrupt endpoint, and the reports it receives
+ * are queued for nut_libusb_get_interrupt() to hand out without waiting.
+ * The libusb event sources, and a pipe signalling queued reports (which
+ * may also be received while libusb runs synchronous transfers), wake up
+ * the driver loop as they come.
+ */
+#define INTERRUPT_QUEUE_LEN	16
+
+static int	interrupt_async = 0;	/* enabled by the driver */
+static libusb_device_handle	*interrupt_udev = NULL;
+static struct libusb_transfer	*interrupt_transfer = NULL;
+static int	interrupt_submitted = 0;	/* until its callback ran */
+static int	interrupt_status = LIBUSB_SUCCESS;	/* failure to report */
+static int	interrupt_size = 0;
+static unsigned char	*interrupt_queue = NULL;	/* INTERRUPT_QUEUE_LEN reports */
+static int	interrupt_queue_len[INTERRUPT_QUEUE_LEN];
+static size_t	interrupt_queue_head = 0, interrupt_queue_count = 0;
+static int	interrupt_pipe[2] = { -1, -1 };
+
+void nut_libusb_interrupt_async(int enable)
+{
+	interrupt_async = enable;
+}
+
+int nut_libusb_interrupt_pending(void)
+{
+	return interrupt_async ? (int)interrupt_queue_count : 0;
+}
+
+static void interrupt_wakeup(void)
+{
+	char	c = 0;
+
+	if (write(interrupt_pipe[1], &c, 1) < 0 && errno != EAGAIN) {
+		upsdebug_with_errno(1, "%s: write to pipe failed", __func__);
+	}
+}
+
+static void interrupt_wakeup_clear(void)
+{
+	char	buf[64];
+
+	while (read(interrupt_pipe[0], buf, sizeof(buf)) > 0)
+		;
+}
+
+static void LIBUSB_CALL nut_libusb_interrupt_callback(struct libusb_transfer *transfer)
+{
+	size_t	slot;
+	int	ret;
+
+	switch (transfer->status)
+	{
+	case LIBUSB_TRANSFER_COMPLETED:
+		if (transfer->actual_length <= 0) {
+			break;
+		}
+		if (interrupt_queue_count >= INTERRUPT_QUEUE_LEN) {
+			upsdebugx(1, "%s: report queue full, dropping the oldest one", __func__);
+			interrupt_queue_head = (interrupt_queue_head + 1) % INTERRUPT_QUEUE_LEN;
+			interrupt_queue_count--;
+		}
+		slot = (interrupt_queue_head + interrupt_queue_count) % INTERRUPT_QUEUE_LEN;
+		memcpy(interrupt_queue + slot * (size_t)interrupt_size,
+			transfer->buffer, (size_t)transfer->actual_length);
+		interrupt_queue_len[slot] = transfer->actual_length;
+		if (interrupt_queue_count++ == 0) {
+			interrupt_wakeup();
+		}
+		break;
+
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		break;
+
+	case LIBUSB_TRANSFER_OVERFLOW:
+		/* as with synchronous transfers, only note it */
+		upsdebugx(2, "%s: %s", __func__, libusb_strerror(LIBUSB_ERROR_OVERFLOW));
+		break;
+
+	case LIBUSB_TRANSFER_CANCELLED:
+		interrupt_submitted = 0;
+		return;
+
+	case LIBUSB_TRANSFER_STALL:
+		interrupt_status = LIBUSB_ERROR_PIPE;
+		goto failed;
+
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		interrupt_status = LIBUSB_ERROR_NO_DEVICE;
+		goto failed;
+
+	case LIBUSB_TRANSFER_ERROR:
+	default:
+		interrupt_status = LIBUSB_ERROR_IO;
+		goto failed;
+	}
+
+	ret = libusb_submit_transfer(transfer);
+	if (ret == LIBUSB_SUCCESS) {
+		return;
+	}
+	interrupt_status = ret;
+
+failed:
+	/* let nut_libusb_get_interrupt() report it */
+	interrupt_submitted = 0;
+	interrupt_wakeup();
+}
+
+static void nut_libusb_interrupt_stop(void)
+{
+	struct timeval	tv;
+	int	i;
+
+	if (!interrupt_transfer) {
+		return;
+	}
+
+	/* the transfer can only be freed once its callback ran */
+	if (interrupt_submitted
+	 && libusb_cancel_transfer(interrupt_transfer) == LIBUSB_SUCCESS
+	) {
+		for (i = 0; interrupt_submitted && i < 10; i++) {
+			tv.tv_sec = 0;
+			tv.tv_usec = 100000;
+			libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+		}
+	}
+
+	if (interrupt_submitted) {
+		upsdebugx(1, "%s: interrupt transfer not cancelled, leaking it", __func__);
+	} else {
+		libusb_free_transfer(interrupt_transfer);
+	}
+
+	interrupt_transfer = NULL;
+	interrupt_submitted = 0;
+	interrupt_udev = NULL;
+	interrupt_status = LIBUSB_SUCCESS;
+	interrupt_queue_head = 0;
+	interrupt_queue_count = 0;
+
+	nut_libusb_unwatch_pollfds();
+	dstate_del_poll_fd(interrupt_pipe[0]);
+	interrupt_wakeup_clear();
+
+	upsdebugx(2, "%s: stopped asynchronous interrupt transfers", __func__);
+}
+
+static int nut_libusb_interrupt_start(libusb_device_handle *udev, int size)
+{
+	unsigned char	*buf;
+	int	ret;
+
+	if (interrupt_pipe[0] < 0) {
+		if (pipe(interrupt_pipe) < 0
+		 || fcntl(interrupt_pipe[0], F_SETFL, O_NONBLOCK) < 0
+		 || fcntl(interrupt_pipe[1], F_SETFL, O_NONBLOCK) < 0
+		) {
+			upslog_with_errno(LOG_WARNING, "%s: could not set up a pipe, "
+				"using synchronous interrupt transfers", __func__);
+			interrupt_async = 0;
+			return LIBUSB_ERROR_OTHER;
+		}
+	}
+
+	if (size != interrupt_size) {
+		free(interrupt_queue);
+		interrupt_queue = xcalloc(INTERRUPT_QUEUE_LEN, (size_t)size);
+		interrupt_size = size;
+	}
+
+	interrupt_transfer = libusb_alloc_transfer(0);
+	if (!interrupt_transfer) {
+		upslogx(LOG_WARNING, "%s: could not allocate a transfer, "
+			"using synchronous interrupt transfers", __func__);
+		interrupt_async = 0;
+		return LIBUSB_ERROR_NO_MEM;
+	}
+
+	/* Interrupt EP is LIBUSB_ENDPOINT_IN with offset defined in hid_ep_in,
+	 * as for synchronous transfers; no timeout */
+	buf = xcalloc(1, (size_t)size);
+	libusb_fill_interrupt_transfer(interrupt_transfer, udev,
+		LIBUSB_ENDPOINT_IN + usb_subdriver.hid_ep_in, buf, size,
+		nut_libusb_interrupt_callback, NULL, 0);
+	interrupt_transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+
+	ret = libusb_submit_transfer(interrupt_transfer);
+	if (ret != LIBUSB_SUCCESS) {
+		libusb_free_transfer(interrupt_transfer);
+		interrupt_transfer = NULL;
+		if (ret == LIBUSB_ERROR_NOT_SUPPORTED) {
+			upslogx(LOG_WARNING, "%s: asynchronous transfers not supported, "
+				"using synchronous interrupt transfers", __func__);
+			interrupt_async = 0;
+		}
+		return ret;
+	}
+
+	interrupt_submitted = 1;
+	interrupt_udev = udev;
+
+	dstate_add_poll_fd(interrupt_pipe[0], DSTATE_POLL_READ);
+	nut_libusb_watch_pollfds();
+
+	upsdebugx(2, "%s: submitted an asynchronous interrupt transfer of %d bytes",
+		__func__, size);
+
+	return LIBUSB_SUCCESS;
+}
+
+/* Returns the size of a queued report, 0 if none, or a libusb error code */
+static int nut_libusb_get_interrupt_async(
+	libusb_device_handle *udev,
+	unsigned char *buf,
+	int bufsize)
+{
+	struct timeval	tv;
+	int	ret;
+
+	if (interrupt_transfer
+	 && (udev != interrupt_udev || bufsize != interrupt_size)
+	) {
+		nut_libusb_interrupt_stop();
+	}
+
+	if (!interrupt_transfer) {
+		ret = nut_libusb_interrupt_start(udev, bufsize);
+		if (ret != LIBUSB_SUCCESS) {
+			return ret;
+		}
+	}
+
+	/* run callbacks of completed transfers, without waiting */
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+
+	if (interrupt_queue_count > 0) {
+		ret = interrupt_queue_len[interrupt_queue_head];
+		memcpy(buf, interrupt_queue + interrupt_queue_head * (size_t)interrupt_size, (size_t)ret);
+		interrupt_queue_head = (interrupt_queue_head + 1) % INTERRUPT_QUEUE_LEN;
+		interrupt_queue_count--;
+		return ret;
+	}
+
+	interrupt_wakeup_clear();
+
+	if (interrupt_status == LIBUSB_SUCCESS) {
+		return 0;
+	}
+
+	ret = interrupt_status;
+	interrupt_status = LIBUSB_SUCCESS;
+
+	/* Clear stall condition, and carry on */
+	if (ret == LIBUSB_ERROR_PIPE) {
+		ret = libusb_clear_halt(udev, LIBUSB_ENDPOINT_IN + usb_subdriver.hid_ep_in);
+		if (ret == LIBUSB_SUCCESS) {
+			ret = libusb_submit_transfer(interrupt_transfer);
+			if (ret == LIBUSB_SUCCESS) {
+				interrupt_submitted = 1;
+				return 0;
+			}
+		}
+	}
+
+	/* Let the driver decide about reconnecting, any later
+	 * call will submit a new transfer */
+	nut_libusb_interrupt_stop();
+
+	return ret;
+}
+#ifdef NUT_LIBUSB_HOTPLUG
+/* Hotplug: once the device was lost, rather than scan the buses for it
+ * every poll_interval, a callback counts the devices with its IDs which
+ * are attached (and notes those arriving), with the libusb event sources
+ * waking up the driver loop as they come and go. While none is attached,
+ * a reopen is only tried every HOTPLUG_RESCAN_INTERVAL seconds, in case
+ * an event was missed.
+ */
+#define HOTPLUG_RESCAN_INTERVAL	60
+
+static int	hotplug_armed = 0;
+static int	hotplug_unsupported = 0;
+static libusb_hotplug_callback_handle	hotplug_handle;
+static int	hotplug_present = 0;	/* devices with the IDs attached */
+static int	hotplug_arrived = 0;	/* since the last nut_libusb_reopen_due() */
+static time_t	hotplug_rescan = 0;
+
+static int LIBUSB_CALL nut_libusb_hotplug_callback(libusb_context *ctx,
+	libusb_device *device, libusb_hotplug_event event, void *user_data)
+{
+	NUT_UNUSED_VARIABLE(ctx);
+	NUT_UNUSED_VARIABLE(device);
+	NUT_UNUSED_VARIABLE(user_data);
+
+	if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+		upsdebugx(2, "%s: a %04X/%04X device arrived", __func__,
+			last_location.VendorID, last_location.ProductID);
+		hotplug_present++;
+		hotplug_arrived = 1;
+	} else if (hotplug_present > 0) {
+		upsdebugx(2, "%s: a %04X/%04X device left", __func__,
+			last_location.VendorID, last_location.ProductID);
+		hotplug_present--;
+	}
+
+	/* stay registered */
+	return 0;
+}
+
+static int nut_libusb_hotplug_arm(void)
+{
+	int	ret;
+
+	if (hotplug_unsupported || !last_location_valid) {
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+	}
+
+	/* keep the context across nut_libusb_close() and the next
+	 * nut_libusb_open() calls */
+	if (libusb_init(NULL) < 0) {
+		return LIBUSB_ERROR_OTHER;
+	}
+
+	if (!libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+		upsdebugx(1, "%s: no hotplug support in libusb here, "
+			"will look for the device every poll interval", __func__);
+		hotplug_unsupported = 1;
+		libusb_exit(NULL);
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+	}
+
+	/* devices already attached are reported as arrived during
+	 * the registration */
+	hotplug_present = 0;
+	hotplug_arrived = 0;
+	ret = libusb_hotplug_register_callback(NULL,
+		(libusb_hotplug_event)(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+		(libusb_hotplug_flag)LIBUSB_HOTPLUG_ENUMERATE,
+		last_location.VendorID, last_location.ProductID,
+		LIBUSB_HOTPLUG_MATCH_ANY,
+		nut_libusb_hotplug_callback, NULL, &hotplug_handle);
+	if (ret != LIBUSB_SUCCESS) {
+		upsdebugx(1, "%s: could not register a hotplug callback (%s), "
+			"will look for the device every poll interval",
+			__func__, libusb_strerror((enum libusb_error)ret));
+		hotplug_unsupported = 1;
+		libusb_exit(NULL);
+		return ret;
+	}
+
+	hotplug_armed = 1;
+	hotplug_rescan = time(NULL) + HOTPLUG_RESCAN_INTERVAL;
+	nut_libusb_watch_pollfds();
+
+	upsdebugx(2, "%s: watching for %04X/%04X devices, %d attached now",
+		__func__, last_location.VendorID, last_location.ProductID,
+		hotplug_present);
+
+	return LIBUSB_SUCCESS;
+}
+
+static void nut_libusb_hotplug_disarm(void)
+{
+	if (!hotplug_armed) {
+		return;
+	}
+
+	libusb_hotplug_deregister_callback(NULL, hotplug_handle);
+	nut_libusb_unwatch_pollfds();
+	libusb_exit(NULL);
+	hotplug_armed = 0;
+
+	upsdebugx(2, "%s: stopped watching for devices", __func__);
+}
+#endif	/* NUT_LIBUSB_HOTPLUG */
+
+int nut_libusb_reopen_due(void)
+{
+#ifdef NUT_LIBUSB_HOTPLUG
+	struct timeval	tv;
+	time_t	now;
+#endif	/* NUT_LIBUSB_HOTPLUG */
+
+	/* The driver lost the device (maybe after a failed control transfer)
+	 * while an interrupt transfer may still be submitted: its completion
+	 * would keep signalling the wakeup pipe which nobody drains until the
+	 * device is reopened, and spin the driver loop meanwhile */
+	if (interrupt_transfer) {
+		nut_libusb_interrupt_stop();
+#ifdef NUT_LIBUSB_HOTPLUG
+		if (hotplug_armed) {
+			nut_libusb_watch_pollfds();
+		}
+#endif	/* NUT_LIBUSB_HOTPLUG */
+	}
+
+#ifdef NUT_LIBUSB_HOTPLUG
+	if (!hotplug_armed && nut_libusb_hotplug_arm() != LIBUSB_SUCCESS) {
+		return 1;
+	}
+
+	/* run the hotplug callback for events so far, without waiting */
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+
+	if (hotplug_arrived) {
+		hotplug_arrived = 0;
+		return 2;
+	}
+
+	if (hotplug_present > 0) {
+		return 1;
+	}
+
+	now = time(NULL);
+	if (now >= hotplug_rescan) {
+		hotplug_rescan = now + HOTPLUG_RESCAN_INTERVAL;
+		return 1;
+	}
+
+	return 0;
+#else	/* !NUT_LIBUSB_HOTPLUG */
+	return 1;
+#endif	/* !NUT_LIBUSB_HOTPLUG */
+}
+#endif	/* !WIN32 */
+
 /* Expected evaluated types for the API:
  * static int nut_libusb_get_interrupt(libusb_device_handle *udev,
  *	unsigned char *buf, int bufsize, int timeout)
@@ -1096,6 +1765,17 @@ static int nut_libusb_get_interrupt(
 	 */
 	tmpbufsize = (int)bufsize;
 
+#ifndef WIN32
+	if (interrupt_async) {
+		ret = nut_libusb_get_interrupt_async(udev, (unsigned char *)buf, tmpbufsize);
+
+		/* unless it just fell back to synchronous transfers */
+		if (interrupt_async) {
+			return (ret < 0) ? nut_libusb_strerror(ret, __func__) : ret;
+		}
+	}
+#endif	/* !WIN32 */
+
 	/* FIXME: hardcoded interrupt EP => need to get EP descr for IF descr */
 	/* ret = libusb_interrupt_transfer(udev, 0x81, buf, bufsize, &bufsize, timeout); */
 	/* libusb0: ret = usb_interrupt_read(udev, USB_ENDPOINT_IN + usb_subdriver.hid_ep_in, (char *)buf, bufsize, timeout); */
@@ -1132,6 +1812,9 @@ static void nut_libusb_close(libusb_device_handle *udev)
 	 * into uninterruptible sleep.  So don't do it.
 	 */
 	/* libusb_release_interface(udev, usb_subdriver.hid_rep_index); */
+#ifndef WIN32
+	nut_libusb_interrupt_stop();
+#endif
 	libusb_close(udev);
 	libusb_exit(NULL);
 }
@@ -30,6 +30,7 @@
 
 #ifndef WIN32
 # include <grp.h>
+# include <sys/wait.h>
 #endif	/* !WIN32 */
 #include <fcntl.h>
 #include <sys/types.h>
@@ -66,6 +67,10 @@ static HANDLE	mutex = INVALID_HANDLE_VALUE;
  */
 int	handling_upsdrv_shutdown = 0;
 
+/* set by -k: the driver only runs to kill the power and then exits,
+ * so it should not set up anything long-lived (e.g. listeners) */
+int	do_forceshutdown = 0;
+
 /* for ser_open */
 int	do_lock_port = 1;
 
@@ -76,6 +81,28 @@ int	do_synchronous = -1;
 /* for detecting -a values that don't match anything */
 static	int	upsname_found = 0;
 
+#ifndef DRIVERS_MAIN_WITHOUT_MAIN
+/* Host mode: several "-a id" options let one started driver program
+ * serve many ups.conf sections. Each section is handled by its own
+ * forked instance process (with its own socket, PID file and dstate
+ * tree, so upsd sees no difference), see host_instances() below.
+ * The host_upsnames[] point into argv[], only the array is allocated.
+ */
+static	const char	**host_upsnames = NULL;
+static	size_t	host_upsnames_count = 0;
+/* In a forked instance: the one section it should handle, else NULL */
+static	const char	*hosted_upsname = NULL;
+
+/* Warm start: file with the data snapshot of the previous run, when it
+ * was last saved, and whether this run got live data to save at all */
+static	char	*warmstart_fn = NULL;
+static	time_t	warmstart_saved = 0;
+static	int	warmstart_live = 0;
+#endif	/* DRIVERS_MAIN_WITHOUT_MAIN */
+
+/* Maximum age (seconds) of a warm start snapshot to load, 0 to disable */
+static	time_t	warmstart_maxage = 0;
+
 # ifndef DRIVERS_MAIN_WITHOUT_MAIN
 static
 # endif /* DRIVERS_MAIN_WITHOUT_MAIN */
@@ -223,7 +250,13 @@ static void help_msg(void)
 	printf("\nusage: %s (-a <id>|-s <id>) [OPTIONS]\n", progname);
 
 	printf("  -a <id>        - autoconfig using ups.conf section <id>\n");
-	printf("                 - note: -x after -a overrides ups.conf settings\n\n");
+	printf("                 - note: -x after -a overrides ups.conf settings\n");
+# ifndef WIN32
+	printf("                 - note: can be repeated to host several sections of\n");
+	printf("                   ups.conf (served by forked instances of this program);\n");
+	printf("                   any -x options then apply to all of them\n");
+# endif	/* !WIN32 */
+	printf("\n");
 
 	printf("  -s <id>        - configure directly from cmd line arguments\n");
 	printf("                 - note: must specify all driver parameters with successive -x\n");
@@ -1311,6 +1344,24 @@ static int main_arg(char *var, char *val)
 		return 1;	/* handled */
 	}
 
+	/* Only applied at start-up, when the snapshot is loaded */
+	if (!strcmp(var, "warmstart")) {
+		char buf[SMALLBUF];
+
+		snprintf(buf, sizeof(buf), "%" PRIdMAX, (intmax_t)warmstart_maxage);
+		if (testval_reloadable(var, buf, val, 0) > 0) {
+			int ipv = atoi(val);
+			if (ipv >= 0) {
+				warmstart_maxage = (time_t)ipv;
+			} else {
+				fatalx(EXIT_FAILURE, "Error: UPS [%s]: invalid warmstart: %d",
+					NUT_STRARG(upsname), ipv);
+			}
+		}
+
+		return 1;	/* handled */
+	}
+
 	/* only for upsdrvctl - ignored here */
 	if (!strcmp(var, "sdorder"))
 		return 1;	/* handled */
@@ -1878,12 +1929,21 @@ static void exit_cleanup(void)
 	free(device_path);
 	free(user);
 	free(group);
+	free(host_upsnames);
 
 	if (pidfn) {
 		unlink(pidfn);
 		free(pidfn);
 	}
 
+	if (warmstart_fn) {
+		/* Only save what we got from the device ourselves */
+		if (warmstart_live && !dstate_is_stale())
+			dstate_snapshot_save(warmstart_fn);
+		free(warmstart_fn);
+		warmstart_fn = NULL;
+	}
+
 	dstate_free();
 	vartab_free();
 
@@ -2026,6 +2086,135 @@ void setup_signals(void)
 }
 #endif /* !WIN32*/
 
+#if (!defined DRIVERS_MAIN_WITHOUT_MAIN) && (!defined WIN32)
+/* Host mode supervisor bits: the host process only relays signals
+ * to the instances it has forked, and waits for them to finish */
+static volatile sig_atomic_t	host_signal = 0;
+
+static void host_set_signal(int sig)
+{
+	host_signal = sig;
+}
+
+static void host_signal_setup(void (*handler)(int))
+{
+	struct sigaction	sa;
+
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	sa.sa_handler = handler;
+
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGQUIT, &sa, NULL);
+	sigaction(SIGCMD_RELOAD, &sa, NULL);	/* SIGHUP */
+	sigaction(SIGCMD_RELOAD_OR_EXIT, &sa, NULL);	/* SIGUSR1 */
+}
+
+/* Fork one driver instance per ups.conf section named by "-a" options.
+ * Returns in each forked instance (with hosted_upsname set), so it can
+ * proceed exactly like a driver started for that one section. Does not
+ * return in the host process: it waits for all instances to exit.
+ * Data which is loaded once before the fork (program text, relocated
+ * mapping tables, parsed variable table) stays shared copy-on-write.
+ */
+static void host_instances(int do_background)
+{
+	pid_t	*pids;
+	size_t	i, running = 0;
+	int	failed = 0;
+
+	upslogx(LOG_INFO, "Hosting %" PRIuSIZE " device instances in this %s program",
+		host_upsnames_count, progname);
+
+	/* Detach once here; instances skip their own background() call */
+	if (do_background)
+		background();
+
+	pids = (pid_t *)xcalloc(host_upsnames_count, sizeof(pid_t));
+
+	/* Set up before forking, to not lose early signals */
+	host_signal_setup(host_set_signal);
+
+	for (i = 0; i < host_upsnames_count; i++) {
+		pid_t	pid = fork();
+
+		if (pid < 0) {
+			upslog_with_errno(LOG_ERR, "Can't fork driver instance for UPS [%s]",
+				host_upsnames[i]);
+			failed++;
+			continue;
+		}
+
+		if (pid == 0) {
+			/* Instance: setup_signals() will take over later */
+			host_signal_setup(SIG_DFL);
+			free(pids);
+			hosted_upsname = host_upsnames[i];
+			return;
+		}
+
+		upsdebugx(1, "%s: started instance for UPS [%s] as PID %" PRIiMAX,
+			__func__, host_upsnames[i], (intmax_t)pid);
+		pids[i] = pid;
+		running++;
+	}
+
+	while (running > 0) {
+		int	status = 0;
+		pid_t	pid;
+
+		if (host_signal) {
+			/* Relay reloads as is, anything else means exit */
+			int	sig = host_signal;
+
+			if (sig != SIGCMD_RELOAD && sig != SIGCMD_RELOAD_OR_EXIT)
+				sig = SIGTERM;
+
+			upsdebugx(1, "%s: relaying signal %d to driver instances", __func__, sig);
+			for (i = 0; i < host_upsnames_count; i++) {
+				if (pids[i] > 0)
+					kill(pids[i], sig);
+			}
+			host_signal = 0;
+		}
+
+		pid = waitpid(-1, &status, 0);
+
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+
+			upslog_with_errno(LOG_ERR, "%s: waitpid failed", __func__);
+			break;
+		}
+
+		for (i = 0; i < host_upsnames_count; i++) {
+			if (pids[i] != pid)
+				continue;
+
+			if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+				upslogx(LOG_INFO, "Driver instance for UPS [%s] has exited",
+					host_upsnames[i]);
+			} else {
+				upslogx(LOG_ERR, "Driver instance for UPS [%s] has failed (%s %d)",
+					host_upsnames[i],
+					WIFEXITED(status) ? "exit code" : "signal",
+					WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status));
+				failed++;
+			}
+
+			pids[i] = 0;
+			running--;
+			break;
+		}
+	}
+
+	free(pids);
+	exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+#endif	/* !DRIVERS_MAIN_WITHOUT_MAIN && !WIN32 */
+
 /* This source file is used in some unit tests to mock realistic driver
  * behavior - using a production driver skeleton, but their own main().
  */
@@ -2033,8 +2222,10 @@ void setup_signals(void)
 int main(int argc, char **argv)
 {
 	struct	passwd	*new_uid = NULL;
-	int	i, do_forceshutdown = 0;
+	int	i;
 	int	update_count = 0;
+	int	host_oneshot = 0;	/* an option not suited for host mode */
+	int	host_foreground = -1;	/* -F/-B seen early, for host mode */
 
 #ifndef WIN32
 	int	cmd = 0;
@@ -2072,6 +2263,22 @@ int main(int argc, char **argv)
 				/* Avoid notification at exit */
 				help_only = 1;
 				break;
+			case 'a':
+				/* Collected for host mode, applied in the loop below */
+				host_upsnames = (const char **)xrealloc(host_upsnames,
+					(host_upsnames_count + 1) * sizeof(*host_upsnames));
+				host_upsnames[host_upsnames_count++] = optarg;
+				break;
+			case 'c':
+			case 'k':
+				host_oneshot = i;
+				break;
+			case 'F':
+				host_foreground = 1;
+				break;
+			case 'B':
+				host_foreground = 0;
+				break;
 			default:
 				break;
 		}
@@ -2157,12 +2364,36 @@ int main(int argc, char **argv)
 	/* build the driver's extra (-x) variable table */
 	upsdrv_makevartable();
 
+	if (host_upsnames_count > 1 && !help_only) {
+#ifndef WIN32
+		if (host_oneshot || dump_data) {
+			fatalx(EXIT_FAILURE, "Error: option -%c is not supported "
+				"with several '-a id' options.",
+				host_oneshot ? (char)host_oneshot : 'd');
+		}
+
+		/* Does not return in the host process */
+		host_instances(host_foreground < 0 ? !foreground : !host_foreground);
+#else	/* WIN32 */
+		/* FIXME NUT_WIN32_INCOMPLETE : no fork() to host instances */
+		NUT_UNUSED_VARIABLE(host_oneshot);
+		NUT_UNUSED_VARIABLE(host_foreground);
+		fatalx(EXIT_FAILURE, "Error: several '-a id' options "
+			"are not supported on this platform.");
+#endif	/* WIN32 */
+	}
+
 	while ((i = getopt(argc, argv, optstring)) != -1) {
 		switch (i) {
 			case 'a':
+				if (hosted_upsname && strcmp(optarg, hosted_upsname)) {
+					/* Served by a sibling instance in host mode */
+					break;
+				}
+
 				if (upsname)
 					fatalx(EXIT_FAILURE, "Error: options '-a id' and '-s id' "
-						"are mutually exclusive and single-use only.");
+						"are mutually exclusive (and '-s id' is single-use).");
 
 				upsname = optarg;
 
@@ -2826,6 +3057,24 @@ int main(int argc, char **argv)
 	/* Restore the signal errors verbosity */
 	nut_sendsignal_debug_level = NUT_SENDSIGNAL_DEBUG_LEVEL_DEFAULT;
 
+	/* Serve the data saved by the previous run (typically as it exited
+	 * just above) while the device gets initialized, flagged by the
+	 * "driver.snapshot.warming" value until the first live update */
+	if (warmstart_maxage > 0 && !dump_data && !do_forceshutdown) {
+		char	fnbuf[NUT_PATH_MAX + 1];
+
+		snprintf(fnbuf, sizeof(fnbuf), "%s/%s-%s.snapshot",
+			dflt_statepath(), progname, upsname);
+		warmstart_fn = xstrdup(fnbuf);
+
+		if (dstate_snapshot_load(warmstart_fn, warmstart_maxage) > 0) {
+			/* Socket permissions are adjusted later, as usual */
+			free(dstate_init(progname, upsname));
+			dstate_dataok();
+			dstate_poll_pending();
+		}
+	}
+
 	/* clear out callback handler data */
 	memset(&upsh, '\0', sizeof(upsh));
 
@@ -2836,6 +3085,7 @@ int main(int argc, char **argv)
 	dstate_setinfo("driver.state", "init.device");
 	upsdrv_initups();
 	dstate_setinfo("driver.state", "init.quiet");
+	dstate_poll_pending();
 
 	/* UPS is detected now, cleanup upon exit */
 	atexit(exit_upsdrv_cleanup);
@@ -2861,6 +3111,7 @@ int main(int argc, char **argv)
 	/* get the base data established before allowing connections */
 	dstate_setinfo("driver.state", "init.info");
 	upsdrv_initinfo();
+	dstate_poll_pending();
 
 	/* Register a way to call upsdrv_shutdown() among `sdcommands` */
 	dstate_addcmd("shutdown.default");
@@ -3016,6 +3267,9 @@ sockname_ownership_finished:
 	/* The poll_interval may have been changed from the default */
 	dstate_setinfo("driver.parameter.pollinterval", "%" PRIdMAX, (intmax_t)poll_interval);
 
+	if (warmstart_maxage > 0)
+		dstate_setinfo("driver.parameter.warmstart", "%" PRIdMAX, (intmax_t)warmstart_maxage);
+
 	/* The synchronous option may have been changed from the default */
 	dstate_setinfo("driver.parameter.synchronous", "%s",
 		(do_synchronous==1)?"yes":((do_synchronous==0)?"no":"auto"));
@@ -3028,9 +3282,15 @@ sockname_ownership_finished:
 	if (dstate_getinfo("ups.serial") != NULL)
 		dstate_setinfo("device.serial", "%s", dstate_getinfo("ups.serial"));
 
+	/* The live data replaces the snapshot (if any) from now on */
+	dstate_snapshot_warmed();
+	warmstart_live = 1;
+
 	switch (foreground) {
 		case 0:
-			background();
+			/* In host mode, the host process has detached already */
+			if (!hosted_upsname)
+				background();
 			/* We had saved a PID before backgrounding, but
 			 * it changes when backgrounding - so save again
 			 */
@@ -3100,6 +3360,15 @@ sockname_ownership_finished:
 		upsdrv_updateinfo();
 		dstate_setinfo("driver.state", "quiet");
 
+		/* Refresh the warm start snapshot, in case we do not exit cleanly
+		 * (every half of its maximum age, but not more than once a second) */
+		if (warmstart_fn && !dstate_is_stale()
+		 && timeout.tv_sec - warmstart_saved >= (warmstart_maxage > 2 ? warmstart_maxage / 2 : 1)
+		) {
+			if (dstate_snapshot_save(warmstart_fn) > 0)
+				warmstart_saved = timeout.tv_sec;
+		}
+
 		/* Dump the data tree (in upsc-like format) to stdout and exit */
 		if (dump_data) {
 			/* Wait for 'dump_data' update loops to ensure data completion */
@@ -14,7 +14,8 @@
 extern const char	*progname, *upsname, *device_name;
 extern char		*device_path, *device_sdcommands;
 extern int		broken_driver, experimental_driver,
-			do_lock_port, exit_flag, handling_upsdrv_shutdown;
+			do_lock_port, exit_flag, handling_upsdrv_shutdown,
+			do_forceshutdown;
 extern TYPE_FD		upsfd, extrafd;
 extern time_t		poll_interval;
 
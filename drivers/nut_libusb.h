@@ -118,4 +118,22 @@ typedef struct usb_communication_subdriver_s {
 
 extern usb_communication_subdriver_t	usb_subdriver;
 
+#if WITH_LIBUSB_1_0 && !(defined WIN32)
+/* Have get_interrupt() hand out reports received by a transfer kept
+ * submitted on the interrupt endpoint, rather than wait for one, with
+ * dstate_poll_fds() waking up the driver loop as they come (see libusb1.c) */
+# define NUT_LIBUSB_HAVE_INTERRUPT_ASYNC	1
+void nut_libusb_interrupt_async(int enable);
+/* How many received reports are queued for get_interrupt() to hand out */
+int nut_libusb_interrupt_pending(void);
+
+/* Whether reopening the device lost by the driver is worth a try now:
+ * with libusb hotplug support, 2 as soon as a device with its IDs
+ * arrived, 0 while none is attached (but for a rare rescan), and 1
+ * otherwise; always 1 without it (see libusb1.c) */
+int nut_libusb_reopen_due(void);
+#else
+# define nut_libusb_reopen_due()	1
+#endif
+
 #endif /* NUT_LIBUSB_H_SEEN */
@@ -58,7 +58,7 @@
 #	define DRIVER_NAME	"Generic Q* Serial driver"
 #endif	/* QX_USB */
 
-#define DRIVER_VERSION	"0.46"
+#define DRIVER_VERSION	"0.48"
 
 #ifdef QX_SERIAL
 #	include "serial.h"
@@ -159,17 +159,30 @@ static int	hunnox_step = 0;
 static int	is_usb = 0;	/* Whether the device is connected through USB (1) or serial (0) */
 #endif	/* QX_USB && QX_SERIAL */
 
+/* Answers got from the UPS during the current walk, so that each distinct
+ * command is sent only once per walk, whatever the order of the items */
+#define QX_ANSWER_MAP_SIZE	32
 static struct {
-	char	command[SMALLBUF];	/* Command sent to the UPS to get answer/to execute an instant command */
-	char	answer[SMALLBUF];	/* Answer from the UPS, filled at runtime */
-} previous_item = { "", "" };	/* Hold the values of the item processed just before the actual one */
+	char	command[SMALLBUF];	/* Command sent to the UPS (after preprocess_command) */
+	size_t	command_len;
+	char	answer[SMALLBUF];	/* Raw answer from the UPS (before preprocess_answer) */
+	size_t	answer_len;
+} answer_map[QX_ANSWER_MAP_SIZE];
+static size_t	answer_map_count = 0;
+
+/* Items polled by the update walks, gathered once after initinfo()
+ * (NULL-terminated, NULL until then) */
+static item_t	**quick_walk_items = NULL;
+static item_t	**full_walk_items = NULL;
 
 
 /* == Support functions == */
 static int	subdriver_matcher(void);
 static ssize_t	qx_command(const char *cmd, size_t cmdlen, char *buf, size_t buflen);
 static int	qx_process_answer(item_t *item, const size_t len); /* returns just 0 or -1 */
+static int	qx_process_item(item_t *item, const char *command, const int use_answer_map);
 static bool_t	qx_ups_walk(walkmode_t mode);
+static item_t	**qx_walk_items(walkmode_t mode);
 static void	ups_status_set(void);
 static void	ups_alarm_set(void);
 static void	qx_set_var(item_t *item);
@@ -3405,6 +3418,12 @@ void	upsdrv_initinfo(void)
 		fatalx(EXIT_FAILURE, "Can't initialise data from the UPS");
 	}
 
+	/* Gather the items the updates will poll, once and for all */
+	if (!quick_walk_items)
+		quick_walk_items = qx_walk_items(QX_WALKMODE_QUICK_UPDATE);
+	if (!full_walk_items)
+		full_walk_items = qx_walk_items(QX_WALKMODE_FULL_UPDATE);
+
 	analyze_mapping_usage();
 
 	/* Init battery guesstimation */
@@ -3750,6 +3769,11 @@ void	upsdrv_cleanup(void)
 {
 	upsdebugx(1, "%s...", __func__);
 
+	free(quick_walk_items);
+	quick_walk_items = NULL;
+	free(full_walk_items);
+	full_walk_items = NULL;
+
 #ifndef TESTING
 
 # ifdef QX_SERIAL
@@ -3818,6 +3842,11 @@ static ssize_t	qx_command(const char *cmd, size_t cmdlen, char *buf, size_t bufl
 #  endif	/* QX_SERIAL (&& QX_USB)*/
 
 		if (udev == NULL) {
+			/* no use scanning the buses while the device is away */
+			if (!nut_libusb_reopen_due()) {
+				return LIBUSB_ERROR_NO_DEVICE;
+			}
+
 			dstate_setinfo("driver.state", "reconnect.trying");
 
 			ret = usb->open_dev(&udev, &usbdevice, reopen_matcher, NULL);
@@ -4197,7 +4226,8 @@ static void	qx_set_var(item_t *item)
 /* Walk UPS variables and set elements of the qx2nut array. */
 static bool_t	qx_ups_walk(walkmode_t mode)
 {
-	item_t	*item;
+	item_t	*item, **items = NULL;
+	size_t	i;
 	int	retcode;
 
 	/* Clear batt.{chrg,runt}.act for guesstimation */
@@ -4207,15 +4237,23 @@ static bool_t	qx_ups_walk(walkmode_t mode)
 		battery_voltage_reports_one_pack_considered = 0;
 	}
 
-	/* Clear data from previous_item */
-	memset(previous_item.command, 0, sizeof(previous_item.command));
-	memset(previous_item.answer, 0, sizeof(previous_item.answer));
+	/* Forget the answers of the previous walk */
+	answer_map_count = 0;
 
 	/* 3 modes: QX_WALKMODE_INIT, QX_WALKMODE_QUICK_UPDATE
 	 *      and QX_WALKMODE_FULL_UPDATE */
+	if (mode == QX_WALKMODE_QUICK_UPDATE)
+		items = quick_walk_items;
+	else if (mode == QX_WALKMODE_FULL_UPDATE)
+		items = full_walk_items;
 
-	/* Device data walk */
-	for (item = subdriver->qx2nut; item->info_type != NULL; item++) {
+	/* Device data walk (through the whole qx2nut array, if the items
+	 * of this mode were not gathered yet) */
+	for (i = 0; ; i++) {
+
+		item = items ? items[i] : &subdriver->qx2nut[i];
+		if (item == NULL || item->info_type == NULL)
+			break;
 
 		/* Skip this item */
 		if (item->qxflags & QX_FLAG_SKIP)
@@ -4328,31 +4366,9 @@ static bool_t	qx_ups_walk(walkmode_t mode)
 
 		}
 
-		/* Check whether the previous item uses the same command
-		 * and then use its answer, if available.. */
-		if (strlen(previous_item.command) > 0
-		&&  strlen(previous_item.answer) > 0
-		&&  !strcasecmp(previous_item.command, item->command)
-		) {
-
-			snprintf(item->answer, sizeof(item->answer), "%s",
-				previous_item.answer);
-
-			/* Process the answer */
-			retcode = qx_process_answer(item, strlen(item->answer));
-
-		/* ..otherwise: execute command to get answer from the UPS */
-		} else {
-
-			retcode = qx_process(item, NULL);
-
-		}
-
-		/* Record item as previous_item */
-		snprintf(previous_item.command, sizeof(previous_item.command), "%s",
-			item->command);
-		snprintf(previous_item.answer, sizeof(previous_item.answer), "%s",
-			item->answer);
+		/* Get the answer from the UPS, or the one it already gave
+		 * to the same command during this walk */
+		retcode = qx_process_item(item, NULL, 1);
 
 		if (retcode) {
 
@@ -4567,6 +4583,43 @@ item_t	*find_nut_info(const char *varname, const unsigned long flag, const unsig
 	return NULL;
 }
 
+/* Gather (in a NULL-terminated array) the items the update walk *mode*
+ * may poll, according to their flags that don't change at runtime:
+ * QX_FLAG_SKIP and QX_FLAG_SEMI_STATIC are still checked by qx_ups_walk(). */
+static item_t	**qx_walk_items(walkmode_t mode)
+{
+	item_t	*item, **items;
+	size_t	count = 0;
+
+	for (item = subdriver->qx2nut; item->info_type != NULL; item++)
+		count++;
+
+	items = xcalloc(count + 1, sizeof(*items));
+	count = 0;
+
+	for (item = subdriver->qx2nut; item->info_type != NULL; item++) {
+
+		if (mode == QX_WALKMODE_QUICK_UPDATE
+		&&  !(item->qxflags & QX_FLAG_QUICK_POLL)
+		) {
+			continue;
+		}
+
+		if (mode == QX_WALKMODE_FULL_UPDATE
+		&&  (item->qxflags & (QX_FLAG_ABSENT | QX_FLAG_CMD | QX_FLAG_SETVAR | QX_FLAG_STATIC))
+		) {
+			continue;
+		}
+
+		items[count++] = item;
+	}
+
+	upsdebugx(3, "%s: %" PRIuSIZE " item(s) for %s updates", __func__,
+		count, mode == QX_WALKMODE_QUICK_UPDATE ? "quick" : "full");
+
+	return items;
+}
+
 /* Process the answer we got back from the UPS
  * Return -1 on errors, 0 on success
  * Can set errno, note that EINVAL means unsupported
@@ -4622,25 +4675,79 @@ static int	qx_process_answer(item_t *item, const size_t len)
 	return 0;
 }
 
-/* See header file for details. */
-int	qx_process(item_t *item, const char *command)
+/* Find the answer to the command *cmd* the UPS gave during the current walk */
+static ssize_t	qx_answer_map_find(const char *cmd, const size_t cmdlen)
 {
-	char	buf[sizeof(item->answer) - 1] = "", *cmd;
-	ssize_t	len;
-	size_t	cmdlen = command ?
-		(strlen(command) >= SMALLBUF ? strlen(command) + 1 : SMALLBUF) :
-		(item->command && strlen(item->command) >= SMALLBUF ? strlen(item->command) + 1 : SMALLBUF);
-	size_t	cmdsz = (sizeof(char) * cmdlen); /* in bytes, to be pedantic */
+	size_t	i;
+
+	for (i = 0; i < answer_map_count; i++) {
+		if (answer_map[i].command_len == cmdlen
+		&&  !memcmp(answer_map[i].command, cmd, cmdlen)
+		) {
+			return (ssize_t)i;
+		}
+	}
+
+	return -1;
+}
+
+/* Remember the answer to the command *cmd* for the rest of the current walk */
+static ssize_t	qx_answer_map_add(const char *cmd, const size_t cmdlen, const char *answer, const size_t len)
+{
+	size_t	i = answer_map_count;
+
+	if (i >= QX_ANSWER_MAP_SIZE
+	||  cmdlen >= sizeof(answer_map[i].command)
+	||  len >= sizeof(answer_map[i].answer)
+	) {
+		return -1;
+	}
+
+	memcpy(answer_map[i].command, cmd, cmdlen);
+	answer_map[i].command_len = cmdlen;
+	memcpy(answer_map[i].answer, answer, len);
+	answer_map[i].answer_len = len;
+	answer_map_count++;
+
+	return (ssize_t)i;
+}
+
+/* Forget the answer at index *i*, so that the next items
+ * using the same command send it again */
+static void	qx_answer_map_drop(const ssize_t i)
+{
+	if (i < 0 || (size_t)i >= answer_map_count)
+		return;
+
+	answer_map_count--;
+	if ((size_t)i != answer_map_count)
+		answer_map[i] = answer_map[answer_map_count];
+}
+
+/* Send the command of *item* (or *command*, if not NULL) to the UPS and
+ * process its answer; if *use_answer_map*, reuse the answer the UPS gave
+ * to the very same command during the current walk, if any.
+ * Return -1 on errors, 0 on success. */
+static int	qx_process_item(item_t *item, const char *command, const int use_answer_map)
+{
+	char	buf[sizeof(item->answer) - 1] = "", cmdbuf[SMALLBUF], *cmd = cmdbuf;
+	ssize_t	len, mapped = -1;
+	size_t	cmdsz;
 	int	cmd_len;
 
-	if ( !(cmd = xmalloc(cmdsz)) ) {
-		upslogx(LOG_ERR, "qx_process() failed to allocate buffer");
+	if (!command)
+		command = item->command;
+
+	/* Commands longer than usual need a buffer of their own */
+	cmdsz = strlen(command) >= sizeof(cmdbuf) ? strlen(command) + 1 : sizeof(cmdbuf);
+	if (cmdsz > sizeof(cmdbuf) && !(cmd = xmalloc(cmdsz))) {
+		upslogx(LOG_ERR, "%s() failed to allocate buffer", __func__);
 		return -1;
 	}
 
 	/* Prepare the command to be used */
 	memset(cmd, 0, cmdsz);
-	cmd_len = snprintf(cmd, cmdsz, "%s", command ? command : item->command);
+	cmd_len = snprintf(cmd, cmdsz, "%s", command);
 
 	/* Whether the sub-driver code sets errno or not, so be it;
 	 * note that EINVAL means unsupported parameter value here!
@@ -4653,19 +4760,41 @@ int	qx_process(item_t *item, const char *command)
 	) {
 		upsdebugx(4, "%s: failed to preprocess command [%s]",
 			__func__, item->info_type);
-		free (cmd);
+		if (cmd != cmdbuf)
+			free(cmd);
 		return -1;
 	}
 
-	/* Send the command */
-	len = qx_command(cmd, cmd_len, buf, sizeof(buf));
+	if (use_answer_map && cmd_len > 0)
+		mapped = qx_answer_map_find(cmd, (size_t)cmd_len);
+
+	if (mapped >= 0) {
+
+		/* Already answered during this walk */
+		upsdebugx(5, "%s: reusing answer to the same command [%s]",
+			__func__, item->info_type);
+		len = (ssize_t)answer_map[mapped].answer_len;
+		memcpy(buf, answer_map[mapped].answer, (size_t)len);
+
+	} else {
+
+		/* Send the command */
+		len = qx_command(cmd, cmd_len, buf, sizeof(buf));
+
+		/* Failed or empty answers are not reused, as before */
+		if (use_answer_map && cmd_len > 0 && len > 0 && (size_t)len < sizeof(buf))
+			mapped = qx_answer_map_add(cmd, (size_t)cmd_len, buf, (size_t)len);
+
+	}
+
+	if (cmd != cmdbuf)
+		free(cmd);
 
 	memset(item->answer, 0, sizeof(item->answer));
 
 	if (len < 0 || len > INT_MAX) {
 		upsdebugx(4, "%s: failed to preprocess answer [%s]",
 			__func__, item->info_type);
-		free (cmd);
 		return -1;
 	}
 
@@ -4680,17 +4809,21 @@ int	qx_process(item_t *item, const char *command)
 			/* Clear the failed answer, preventing it from
 			 * being reused by next items with same command */
 			memset(item->answer, 0, sizeof(item->answer));
-			free (cmd);
+			qx_answer_map_drop(mapped);
 			return -1;
 		}
 	}
 
-	free (cmd);
-
 	/* Process the answer to get the value */
 	return qx_process_answer(item, (size_t)len);
 }
 
+/* See header file for details. */
+int	qx_process(item_t *item, const char *command)
+{
+	return qx_process_item(item, command, 0);
+}
+
 /* See header file for details. */
 int	ups_infoval_set(item_t *item)
 {
@@ -36,7 +36,7 @@
 #include "riello.h"
 
 #define DRIVER_NAME	"Riello USB driver"
-#define DRIVER_VERSION	"0.15"
+#define DRIVER_VERSION	"0.16"
 
 #define DEFAULT_OFFDELAY   5  /*!< seconds (max 0xFF) */
 #define DEFAULT_BOOTDELAY  5  /*!< seconds (max 0xFF) */
@@ -359,6 +359,11 @@ static int riello_command(uint8_t *cmd, uint8_t *buf, uint16_t length, uint16_t
 	int ret;
 
 	if (udev == NULL) {
+		/* no use scanning the buses while the device is away */
+		if (!nut_libusb_reopen_due()) {
+			return LIBUSB_ERROR_NO_DEVICE;
+		}
+
 		dstate_setinfo("driver.state", "reconnect.trying");
 
 		ret = usb->open_dev(&udev, &usbdevice, reopen_matcher, &driver_callback);
@@ -40,6 +40,11 @@
 #include "parseconf.h"
 
 #include <ctype.h> /* for isprint() */
+#ifndef WIN32
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <netdb.h> /* for getaddrinfo(), to check the trap sources */
+#endif
 
 /* include all known mib2nut lookup tables */
 #include "apc-mib.h"
@@ -95,57 +100,100 @@
 # endif
 #endif
 
+/* The mapping tables, in the order they are tried with mibs=auto: each
+ * is named by its mib2nut_info_t structure and the *-mib.c file which
+ * defines it (which is also its module name, when the tables are built
+ * as modules loaded on demand, see su_mib_modules_load() below).
+ * Keep vendor specific MIB mappings before IETF, so that if a device
+ * supports both IETF and vendor specific MIB, the vendor specific one
+ * takes precedence (when mibs=auto) */
+#define SU_MIB2NUT_LIST \
+	SU_MIB2NUT(apc_ats,				"apc-ats-mib") \
+	SU_MIB2NUT(apc_pdu_rpdu,		"apc-pdu-mib") \
+	SU_MIB2NUT(apc_pdu_rpdu2,		"apc-pdu-mib") \
+	SU_MIB2NUT(apc_pdu_msp,			"apc-pdu-mib") \
+	SU_MIB2NUT(apc_pdu_epdu,		"apc-epdu-mib") \
+	SU_MIB2NUT(apc,					"apc-mib") \
+	SU_MIB2NUT(baytech,				"baytech-mib") \
+	SU_MIB2NUT(baytech_rpc3nc,		"baytech-rpc3nc-mib") \
+	SU_MIB2NUT(bestpower,			"bestpower-mib") \
+	SU_MIB2NUT(compaq,				"compaq-mib") \
+	SU_MIB2NUT(cyberpower,			"cyberpower-mib") \
+	SU_MIB2NUT(cyberpower2,			"cyberpower-mib") \
+	SU_MIB2NUT(delta_ups,			"delta_ups-mib") \
+	SU_MIB2NUT(eaton_ats16_nmc,		"eaton-ats16-nmc-mib") \
+	SU_MIB2NUT(eaton_ats16_nm2,		"eaton-ats16-nm2-mib") \
+	SU_MIB2NUT(eaton_ats30,			"eaton-ats30-mib") \
+	SU_MIB2NUT(eaton_marlin,		"eaton-pdu-marlin-mib") \
+	SU_MIB2NUT(eaton_pdu_nlogic,	"eaton-pdu-nlogic-mib") \
+	SU_MIB2NUT(eaton_pxg_ups,		"eaton-ups-pxg-mib") \
+	SU_MIB2NUT(eaton_pw_nm2,		"eaton-ups-pwnm2-mib") \
+	SU_MIB2NUT(emerson_avocent_pdu,	"emerson-avocent-pdu-mib") \
+	SU_MIB2NUT(aphel_revelation,	"eaton-pdu-revelation-mib") \
+	SU_MIB2NUT(aphel_genesisII,		"eaton-pdu-genesis2-mib") \
+	SU_MIB2NUT(pulizzi_switched1,	"eaton-pdu-pulizzi-mib") \
+	SU_MIB2NUT(pulizzi_switched2,	"eaton-pdu-pulizzi-mib") \
+	SU_MIB2NUT(hpe_pdu,				"hpe-pdu-mib") \
+	SU_MIB2NUT(hpe_pdu3_cis,		"hpe-pdu3-cis-mib") \
+	SU_MIB2NUT(huawei,				"huawei-mib") \
+	SU_MIB2NUT(mge,					"mge-mib") \
+	SU_MIB2NUT(netvision,			"netvision-mib") \
+	SU_MIB2NUT(raritan,				"raritan-pdu-mib") \
+	SU_MIB2NUT(raritan_px2,			"raritan-px2-mib") \
+	SU_MIB2NUT(xppc,				"xppc-mib") \
+	SU_MIB2NUT(tripplite_ietf,		"ietf-mib") \
+	SU_MIB2NUT(ietf,				"ietf-mib")
+
+#ifndef WITH_SNMP_MIB_MODULES
+# define SU_MIB2NUT(symbol, module)	&symbol,
+
 static mib2nut_info_t *mib2nut[] = {
-	&apc_ats,			/* This struct comes from : apc-ats-mib.c */
-	&apc_pdu_rpdu,		/* This struct comes from : apc-pdu-mib.c */
-	&apc_pdu_rpdu2,		/* This struct comes from : apc-pdu-mib.c */
-	&apc_pdu_msp,		/* This struct comes from : apc-pdu-mib.c */
-	&apc_pdu_epdu,		/* This struct comes from : apc-epdu-mib.c */
-	&apc,				/* This struct comes from : apc-mib.c */
-	&baytech,			/* This struct comes from : baytech-mib.c */
-	&baytech_rpc3nc,		/* This struct comes from : baytech-rpc3nc-mib.c */
-	&bestpower,			/* This struct comes from : bestpower-mib.c */
-	&compaq,			/* This struct comes from : compaq-mib.c */
-	&cyberpower,		/* This struct comes from : cyberpower-mib.c */
-	&cyberpower2,		/* This struct comes from : cyberpower-mib.c */
-	&delta_ups,			/* This struct comes from : delta_ups-mib.c */
-	&eaton_ats16_nmc,		/* This struct comes from : eaton-ats16-nmc-mib.c */
-	&eaton_ats16_nm2,	/* This struct comes from : eaton-ats16-nm2-mib.c */
-	&eaton_ats30,		/* This struct comes from : eaton-ats30-mib.c */
-	&eaton_marlin,		/* This struct comes from : eaton-mib.c */
-	&eaton_pdu_nlogic,	/* This struct comes from : eaton-pdu-nlogic-mib.c */
-	&eaton_pxg_ups,		/* This struct comes from : eaton-ups-pxg-mib.c */
-	&eaton_pw_nm2, 		/* This struct comes from : eaton-ups-pwnm2-mib.c */
-	&emerson_avocent_pdu,	/* This struct comes from : emerson-avocent-pdu-mib.c */
-	&aphel_revelation,	/* This struct comes from : eaton-mib.c */
-	&aphel_genesisII,	/* This struct comes from : eaton-mib.c */
-	&pulizzi_switched1,	/* This struct comes from : eaton-mib.c */
-	&pulizzi_switched2,	/* This struct comes from : eaton-mib.c */
-	&hpe_pdu,			/* This struct comes from : hpe-pdu-mib.c */
-	&hpe_pdu3_cis,		/* This struct comes from : hpe-pdu3-cis-mib.c */
-	&huawei,			/* This struct comes from : huawei-mib.c */
-	&mge,				/* This struct comes from : mge-mib.c */
-	&netvision,			/* This struct comes from : netvision-mib.c */
-	&raritan,			/* This struct comes from : raritan-pdu-mib.c */
-	&raritan_px2,		/* This struct comes from : raritan-px2-mib.c */
-	&xppc,				/* This struct comes from : xppc-mib.c */
-	/*
-	 * Prepend vendor specific MIB mappings before IETF, so that
-	 * if a device supports both IETF and vendor specific MIB,
-	 * the vendor specific one takes precedence (when mibs=auto)
-	 */
-	&tripplite_ietf,	/* This struct comes from : ietf-mib.c */
-	&ietf,				/* This struct comes from : ietf-mib.c */
+	SU_MIB2NUT_LIST
 	/* end of structure. */
 	NULL
 };
 
+# undef SU_MIB2NUT
+#else	/* WITH_SNMP_MIB_MODULES */
+# include <ltdl.h>
+
+/* Where the modules are installed, unless NUT_SNMP_MIBPATH is set */
+# ifndef SNMP_MIB_MODULES_PATH
+#  define SNMP_MIB_MODULES_PATH	"."
+# endif
+
+typedef struct {
+	const char	*symbol;	/* mib2nut_info_t structure name */
+	const char	*module;	/* *-mib.c file (module) defining it */
+	lt_dlhandle	handle;		/* while loaded */
+	mib2nut_info_t	*info;		/* in there */
+} su_mib_module_t;
+
+# define SU_MIB2NUT(symbol, module)	{ #symbol, module, NULL, NULL },
+
+static su_mib_module_t mib2nut_modules[] = {
+	SU_MIB2NUT_LIST
+	{ NULL, NULL, NULL, NULL }
+};
+
+# undef SU_MIB2NUT
+
+/* Filled by su_mib_modules_load() with what could be loaded */
+static mib2nut_info_t *mib2nut[sizeof(mib2nut_modules) / sizeof(mib2nut_modules[0])];
+static int	mib2nut_modules_init = 0;
+#endif	/* WITH_SNMP_MIB_MODULES */
+
 struct snmp_session g_snmp_sess, *g_snmp_sess_p;
 const char *OID_pwr_status;
 int g_pwr_battery;
 int pollfreq; /* polling frequency */
 int semistaticfreq; /* semistatic entry update frequency */
 static int semistatic_countdown = 0;
+int max_varbinds = DEFAULT_MAXVARBINDS; /* batched request size */
+int max_inflight = DEFAULT_MAXINFLIGHT; /* batched requests sent at once */
+int absent_backoff = DEFAULT_ABSENTBACKOFF; /* skip rejected OIDs for so long */
+int max_rate = DEFAULT_MAXRATE; /* requests per second, 0 for no limit */
+int poll_timeout = DEFAULT_POLLTIMEOUT; /* seconds for an update walk, 0 for no limit */
 
 static int quirk_symmetra_threephase = 0;
 
@@ -177,7 +225,7 @@ static const char *mibname;
 static const char *mibvers;
 
 #define DRIVER_NAME	"Generic SNMP UPS driver"
-#define DRIVER_VERSION	"1.38"
+#define DRIVER_VERSION	"1.39"
 
 /* driver description structure */
 upsdrv_info_t	upsdrv_info = {
@@ -197,6 +245,20 @@ upsdrv_info_t	upsdrv_info = {
 
 static time_t lastpoll = 0;
 
+/* SNMP trap listener, see su_trap_open() */
+static netsnmp_session	*trap_sess_p = NULL;
+static int	trap_fd = -1;
+static int	trap_pending = 0;
+static time_t	trap_lastpoll = 0;
+
+/* Update walk cut short by snmp_poll_timeout (the data is stale then),
+ * see snmp_ups_walk() */
+static int	walk_cut_short = 0;
+static int	walk_status_missed = 0;	/* before all of ups.status and ups.alarm */
+#ifndef WIN32
+static struct addrinfo	*trap_agent_ai = NULL;	/* accepted trap sources */
+#endif
+
 /* Communication status handling */
 #define COMM_UNKNOWN 0
 #define COMM_OK      1
@@ -218,6 +280,17 @@ static int device_template_offset = -1;
 
 /* Forward functions declarations */
 static void disable_transfer_oids(void);
+static void su_prefetch_walk(int mode);
+static void su_prefetch_free(void);
+static void su_instances_free(void);
+static void su_oid_cache_free(void);
+static void su_indexes_free(void);
+static void su_absent_publish(void);
+static void su_trap_open(const char *listen);
+static void su_trap_close(void);
+static int su_trap_check(void);
+static bool_t su_trap_poll(void);
+static void su_poll_deadline(int seconds);
 bool_t get_and_process_data(int mode, snmp_info_t *su_info_p);
 int extract_template_number(snmp_info_flags_t template_type, const char* varname);
 snmp_info_flags_t get_template_type(const char* varname);
@@ -444,17 +517,37 @@ void upsdrv_initinfo(void)
 
 void upsdrv_updateinfo(void)
 {
+	bool_t	status;
+
 	upsdebugx(1,"SNMP UPS driver: entering %s()", __func__);
 
+	/* A power event trap may have woken us up before the next walk */
+	if (su_trap_check() && time(NULL) <= (lastpoll + pollfreq)) {
+		if (su_trap_poll() != TRUE)
+			lastpoll = 0;	/* walk everything now */
+	}
+
 	/* only update every pollfreq */
 	/* FIXME: only update status (SU_STATUS_*), à la usbhid-ups, in between */
 	if (time(NULL) > (lastpoll + pollfreq)) {
+		/* covers whatever a trap told */
+		trap_pending = 0;
+
 
 		alarm_init();
 		status_init();
 
-		/* update all dynamic info fields */
-		if (snmp_ups_walk(SU_WALKMODE_UPDATE)) {
+		/* update all dynamic info fields, in the time allowed */
+		su_poll_deadline(poll_timeout);
+		status = snmp_ups_walk(SU_WALKMODE_UPDATE);
+		su_poll_deadline(0);
+
+		if (status && walk_cut_short) {
+			/* The agent answers, but too slowly for a whole walk */
+			upsdebugx(1, "%s: pollfreq: Data STALE (out of time)", __func__);
+			dstate_datastale();
+		}
+		else if (status) {
 			upsdebugx(1, "%s: pollfreq: Data OK", __func__);
 			dstate_dataok();
 			if (comm_status != COMM_OK) {
@@ -478,18 +571,27 @@ void upsdrv_updateinfo(void)
 		/* Commit status first, otherwise in daisychain mode, "device.0" may
 		 * clear the alarm count since it has an empty alarm buffer and if there
 		 * is only one device that has alarms! */
-		if (daisychain_enabled == FALSE)
-			alarm_commit();
-		status_commit();
-		if (daisychain_enabled == TRUE)
-			alarm_commit();
+		if (walk_status_missed) {
+			/* Out of time before all of it was fetched:
+			 * better keep telling the last known status */
+			upsdebugx(1, "%s: status not fetched in time, keeping the last one", __func__);
+		} else {
+			if (daisychain_enabled == FALSE)
+				alarm_commit();
+			status_commit();
+			if (daisychain_enabled == TRUE)
+				alarm_commit();
+		}
+
+		/* Which OIDs were rejected, for diagnostics */
+		su_absent_publish();
 
 		/* store timestamp */
 		lastpoll = time(NULL);
 	}
 	else {
 		/* Just tell the same status to upsd */
-		if (comm_status == COMM_OK)
+		if (comm_status == COMM_OK && !walk_cut_short)
 			dstate_dataok();
 		else
 			dstate_datastale();
@@ -563,6 +665,18 @@ void upsdrv_makevartable(void)
 		"Specifies the number of Net-SNMP retries to be used in the requests (default=5)");
 	addvar(VAR_VALUE, SU_VAR_TIMEOUT,
 		"Specifies the Net-SNMP timeout in seconds between retries (default=1)");
+	addvar(VAR_VALUE, SU_VAR_MAXVARBINDS,
+		"Set the number of OIDs requested at once by batched GET/GETBULK requests, 1 to disable batching (default=16)");
+	addvar(VAR_VALUE, SU_VAR_MAXINFLIGHT,
+		"Set the number of batched requests sent asynchronously before waiting for answers (default=1)");
+	addvar(VAR_VALUE, SU_VAR_ABSENTBACKOFF,
+		"Set how long (in seconds) to stop requesting OIDs the device rejected, 0 to disable (default=0)");
+	addvar(VAR_VALUE, SU_VAR_MAXRATE,
+		"Set the maximum number of requests sent per second, 0 for no limit (default=0)");
+	addvar(VAR_VALUE, SU_VAR_POLLTIMEOUT,
+		"Set how long (in seconds) one poll may take before remaining requests are skipped (marking the data stale), 0 for no limit (default=0)");
+	addvar(VAR_VALUE, SU_VAR_TRAPLISTEN,
+		"Listen for SNMP traps on this UDP port (or Net-SNMP transport address) to poll the status at once on power events");
 	addvar(VAR_FLAG, "notransferoids",
 		"Disable transfer OIDs (use on APCC Symmetras)");
 	addvar(VAR_FLAG, "symmetrathreephase",
@@ -743,6 +857,85 @@ void upsdrv_makevartable(void)
 		"Set delay time before shutdown ");
 }
 
+#ifdef WITH_SNMP_MIB_MODULES
+/* Load all the mapping table modules, to detect which one the device
+ * supports (or just to list them) */
+static void su_mib_modules_load(void)
+{
+	su_mib_module_t	*mod;
+	const char	*path = getenv("NUT_SNMP_MIBPATH");
+	char	buf[NUT_PATH_MAX];
+	size_t	count = 0;
+
+	if (mib2nut[0] != NULL)
+		return;
+
+	if (path == NULL || *path == '\0')
+		path = SNMP_MIB_MODULES_PATH;
+
+	if (lt_dlinit() != 0)
+		fatalx(EXIT_FAILURE, "Can't initialize libltdl: %s", lt_dlerror());
+	mib2nut_modules_init = 1;
+
+	for (mod = mib2nut_modules; mod->symbol != NULL; mod++) {
+		snprintf(buf, sizeof(buf), "%s/%s", path, mod->module);
+
+		if ((mod->handle = lt_dlopenext(buf)) == NULL) {
+			upslogx(LOG_WARNING, "Can't load SNMP mapping module %s: %s",
+				buf, lt_dlerror());
+			continue;
+		}
+
+		if ((mod->info = (mib2nut_info_t *)lt_dlsym(mod->handle, mod->symbol)) == NULL) {
+			upslogx(LOG_WARNING, "Can't find %s in SNMP mapping module %s: %s",
+				mod->symbol, buf, lt_dlerror());
+			lt_dlclose(mod->handle);
+			mod->handle = NULL;
+			continue;
+		}
+
+		mib2nut[count++] = mod->info;
+	}
+
+	mib2nut[count] = NULL;
+
+	upsdebugx(1, "%s: loaded %" PRIuSIZE " mapping tables from %s",
+		__func__, count, path);
+}
+
+/* Unload the modules except the one of the selected mapping table (if
+ * any), so only that one stays resident */
+static void su_mib_modules_unload(const mib2nut_info_t *keep)
+{
+	su_mib_module_t	*mod;
+	int	kept = 0;
+
+	for (mod = mib2nut_modules; mod->symbol != NULL; mod++) {
+		if (mod->handle == NULL)
+			continue;
+
+		/* Other tables from the same module hold their own
+		 * reference to it, which is dropped here all the same */
+		if (mod->info == keep && keep != NULL) {
+			kept = 1;
+			continue;
+		}
+
+		lt_dlclose(mod->handle);
+		mod->handle = NULL;
+		mod->info = NULL;
+	}
+
+	mib2nut[0] = (kept ? (mib2nut_info_t *)keep : NULL);
+	mib2nut[1] = NULL;
+
+	if (!kept && mib2nut_modules_init) {
+		lt_dlexit();
+		mib2nut_modules_init = 0;
+	}
+}
+#endif	/* WITH_SNMP_MIB_MODULES */
+
 void upsdrv_initups(void)
 {
 	snmp_info_t *su_info_p, *cur_info_p;
@@ -758,6 +951,10 @@ void upsdrv_initups(void)
 	if (!strcmp(mibs, "--list")) {
 		int i;
 
+#ifdef WITH_SNMP_MIB_MODULES
+		su_mib_modules_load();
+#endif
+
 		printf("The 'mibs' argument is '%s', so just listing the mappings this driver knows,\n"
 		       "and for 'mibs=auto' these mappings will be tried in the following order until\n"
 		       "the first one matches your device\n\n", mibs);
@@ -788,9 +985,54 @@ void upsdrv_initups(void)
 	 * for devices from companies with a long heritage.
 	 */
 
+	/* init batched request size */
+	if (getval(SU_VAR_MAXVARBINDS))
+		max_varbinds = atoi(getval(SU_VAR_MAXVARBINDS));
+	if (max_varbinds < 1) {
+		upsdebugx(1, "Bad %s value provided, setting to default", SU_VAR_MAXVARBINDS);
+		max_varbinds = DEFAULT_MAXVARBINDS;
+	}
+
+	/* init batched requests pipelining */
+	if (getval(SU_VAR_MAXINFLIGHT))
+		max_inflight = atoi(getval(SU_VAR_MAXINFLIGHT));
+	if (max_inflight < 1) {
+		upsdebugx(1, "Bad %s value provided, setting to default", SU_VAR_MAXINFLIGHT);
+		max_inflight = DEFAULT_MAXINFLIGHT;
+	}
+
+	/* init rejected OIDs back-off */
+	if (getval(SU_VAR_ABSENTBACKOFF))
+		absent_backoff = atoi(getval(SU_VAR_ABSENTBACKOFF));
+	if (absent_backoff < 0) {
+		upsdebugx(1, "Bad %s value provided, setting to default", SU_VAR_ABSENTBACKOFF);
+		absent_backoff = DEFAULT_ABSENTBACKOFF;
+	}
+
+	/* init request pacing */
+	if (getval(SU_VAR_MAXRATE))
+		max_rate = atoi(getval(SU_VAR_MAXRATE));
+	if (max_rate < 0) {
+		upsdebugx(1, "Bad %s value provided, setting to default", SU_VAR_MAXRATE);
+		max_rate = DEFAULT_MAXRATE;
+	}
+
+	/* init the time allowed for a poll */
+	if (getval(SU_VAR_POLLTIMEOUT))
+		poll_timeout = atoi(getval(SU_VAR_POLLTIMEOUT));
+	if (poll_timeout < 0) {
+		upsdebugx(1, "Bad %s value provided, setting to default", SU_VAR_POLLTIMEOUT);
+		poll_timeout = DEFAULT_POLLTIMEOUT;
+	}
+
 	/* Load the SNMP to NUT translation data */
 	load_mib2nut(mibs);
 
+	/* Listen for traps, once we know which ones matter;
+	 * not when we are only here to kill the power (-k) */
+	if (testvar(SU_VAR_TRAPLISTEN) && !do_forceshutdown)
+		su_trap_open(getval(SU_VAR_TRAPLISTEN));
+
 	/* init polling frequency */
 	if (getval(SU_VAR_POLLFREQ))
 		pollfreq = atoi(getval(SU_VAR_POLLFREQ));
@@ -940,8 +1182,18 @@ void upsdrv_cleanup(void)
 	if (daisychain_info)
 		free(daisychain_info);
 
+	su_trap_close();
+	su_prefetch_free();
+	su_instances_free();
+	su_oid_cache_free();
+	su_indexes_free();
+
 	/* Net-SNMP specific cleanup */
 	nut_snmp_cleanup();
+
+#ifdef WITH_SNMP_MIB_MODULES
+	su_mib_modules_unload(NULL);
+#endif
 }
 
 /* -----------------------------------------------------------
@@ -1230,191 +1482,1371 @@ void nut_snmp_cleanup(void)
 	SOCK_CLEANUP; /* wrapper not needed on Unix! */
 }
 
-/* Free a struct snmp_pdu * returned by nut_snmp_walk */
-static void nut_snmp_free(struct snmp_pdu ** array_to_free)
-{
-	struct snmp_pdu ** current_element;
+/* OID strings parsed once: the mapping tables (and their instantiated
+ * templates) use the same few hundreds of OIDs on each walk */
+typedef struct su_oid_cache_s {
+	char	*str;
+	oid	*name;
+	size_t	name_len;
+	time_t	absent_until;	/* see su_absent_mark() */
+	unsigned int	absent_count;
+	int	absent_exempt;	/* a status or alarm OID, see su_absent_exempt() */
+	struct su_oid_cache_s	*next;
+} su_oid_cache_t;
 
-	if (array_to_free != NULL) {
-		current_element = array_to_free;
+#define SU_OID_CACHE_HASHSIZE	1024
 
-		while (*current_element != NULL) {
-			snmp_free_pdu(*current_element);
-			current_element++;
-		}
+static su_oid_cache_t	*su_oid_cache[SU_OID_CACHE_HASHSIZE];
 
-		free( array_to_free );
+static su_oid_cache_t *su_oid_cache_find(const char *OID, size_t *hash_p)
+{
+	su_oid_cache_t	*entry;
+	size_t	hash = str_hash(OID, 0) % SU_OID_CACHE_HASHSIZE;
+
+	if (hash_p)
+		*hash_p = hash;
+
+	for (entry = su_oid_cache[hash]; entry != NULL; entry = entry->next) {
+		if (!strcmp(entry->str, OID))
+			break;
 	}
+
+	return entry;
 }
 
-/* Return a NULL terminated array of snmp_pdu * */
-static struct snmp_pdu **nut_snmp_walk(const char *OID, int max_iteration)
+/* Same as snmp_parse_oid(), remembering the results */
+static oid *su_parse_oid(const char *OID, oid *name, size_t *name_len)
 {
-	int status;
-	struct snmp_pdu *pdu, *response = NULL;
-	oid name[MAX_OID_LEN];
-	size_t name_len = MAX_OID_LEN;
-	oid * current_name;
-	size_t current_name_len;
-	static unsigned int numerr = 0;
-	int nb_iteration = 0;
-	struct snmp_pdu ** ret_array = NULL;
-	int type = SNMP_MSG_GET;
+	su_oid_cache_t	*entry;
+	size_t	hash;
 
-	upsdebugx(3, "%s(%s)", __func__, OID);
-	upsdebugx(4, "%s: max. iteration = %i", __func__, max_iteration);
+	entry = su_oid_cache_find(OID, &hash);
 
-	/* create and send request. */
-	if (!snmp_parse_oid(OID, name, &name_len)) {
-		upsdebugx(2, "[%s] %s: %s: %s",
-			upsname?upsname:device_name, __func__, OID, snmp_api_errstring(snmp_errno));
-		return NULL;
-	}
+	if (entry == NULL) {
+		if (!snmp_parse_oid(OID, name, name_len))
+			return NULL;
 
-	current_name = name;
-	current_name_len = name_len;
+		entry = xcalloc(1, sizeof(*entry));
+		entry->str = xstrdup(OID);
+		entry->name = xcalloc(*name_len, sizeof(oid));
+		memcpy(entry->name, name, *name_len * sizeof(oid));
+		entry->name_len = *name_len;
+		entry->next = su_oid_cache[hash];
+		su_oid_cache[hash] = entry;
+		return name;
+	}
 
-	while( nb_iteration < max_iteration ) {
-		struct snmp_pdu	**new_ret_array;
+	if (entry->name_len > *name_len)
+		return NULL;
 
-		/* Going to a shorter OID means we are outside our sub-tree */
-		if( current_name_len < name_len ) {
-			break;
-		}
+	memcpy(name, entry->name, entry->name_len * sizeof(oid));
+	*name_len = entry->name_len;
 
-		pdu = snmp_pdu_create(type);
+	return name;
+}
 
-		if (pdu == NULL) {
-			fatalx(EXIT_FAILURE, "Not enough memory");
+static void su_oid_cache_free(void)
+{
+	su_oid_cache_t	*entry, *next;
+	size_t	i;
+
+	for (i = 0; i < SU_OID_CACHE_HASHSIZE; i++) {
+		for (entry = su_oid_cache[i]; entry != NULL; entry = next) {
+			next = entry->next;
+			free(entry->str);
+			free(entry->name);
+			free(entry);
 		}
+		su_oid_cache[i] = NULL;
+	}
+}
 
-		snmp_add_null_var(pdu, current_name, current_name_len);
+/* OIDs of the mapping which the agent rejected (noSuchName, noSuchObject
+ * or noSuchInstance) are not requested again for absent_backoff seconds,
+ * doubled each time they are still rejected (up to SU_ABSENT_MAX_SHIFT
+ * times), so steady-state cycles only ask for what returns data. Only
+ * used once a MIB was selected: probes for detection are not remembered */
+#define SU_ABSENT_MAX_SHIFT	4
 
-		status = snmp_synch_response(g_snmp_sess_p, pdu, &response);
+static void su_absent_mark(const char *OID)
+{
+	su_oid_cache_t	*entry;
+	unsigned int	shift;
 
-		if (!response) {
-			break;
-		}
+	if (absent_backoff <= 0 || mibname == NULL
+	||  (entry = su_oid_cache_find(OID, NULL)) == NULL
+	||  entry->absent_exempt
+	)
+		return;
 
-		if (!((status == STAT_SUCCESS) && (response->errstat == SNMP_ERR_NOERROR))) {
-			if (mibname == NULL) {
-				/* We are probing for proper mib - ignore errors */
-				snmp_free_pdu(response);
-				nut_snmp_free(ret_array);
-				return NULL;
-			}
+	shift = (entry->absent_count < SU_ABSENT_MAX_SHIFT ? entry->absent_count : SU_ABSENT_MAX_SHIFT);
+	entry->absent_count++;
+	entry->absent_until = time(NULL) + ((time_t)absent_backoff << shift);
 
-			if (response->errstat == SNMP_ERR_NOSUCHNAME) {
-				upsdebugx(4, "%s: OID does not exist, skipping", __func__);
-				snmp_free_pdu(response);
-				nut_snmp_free(ret_array);
-				return NULL;
-			}
+	upsdebugx(2, "%s: %s rejected by the agent (%u times), not requesting it for %ld seconds",
+		__func__, OID, entry->absent_count, (long)absent_backoff << shift);
+}
 
-			upsdebugx(3, "status = %i, response->errstat = %li", status, response->errstat);
+/* The status and alarm OIDs are requested on every cycle whatever the
+ * agent said before: a transient rejection (e.g. while it reboots during
+ * a power event) must not hide state changes for the back-off period */
+static void su_absent_exempt(const snmp_info_t *su_info_p)
+{
+	su_oid_cache_t	*entry;
+	oid	name[MAX_OID_LEN];
+	size_t	name_len = MAX_OID_LEN;
+	const char	*suffix;
 
-			/* Error throttling otherwise */
-			numerr++;
-			upsdebugx(4, "%s: numerr++ (total=%u)", __func__, numerr);
+	if (absent_backoff <= 0 || su_info_p->OID == NULL || *su_info_p->OID == '\0')
+		return;
 
-			if ((numerr == SU_ERR_LIMIT) || ((numerr % SU_ERR_RATE) == 0)) {
-				upslogx(LOG_WARNING, "[%s] Warning: excessive poll "
-						"failures, limiting error reporting (OID = %s)",
-						upsname?upsname:device_name, OID);
-			}
+	suffix = strrchr(su_info_p->info_type, '.');
+	if (strcasecmp(su_info_p->info_type, "ups.status")
+	&&  strcasecmp(su_info_p->info_type, "ups.alarms")
+	&&  (suffix == NULL || strcmp(suffix, ".alarm"))
+	&&  !(su_info_p->flags & (SU_STATUS_PWR | SU_STATUS_BATT | SU_STATUS_CAL | SU_STATUS_RB))
+	)
+		return;
 
-			if ((numerr < SU_ERR_LIMIT) || ((numerr % SU_ERR_RATE) == 0)) {
-				if (type == SNMP_MSG_GETNEXT) {
-					upsdebugx(2, "=> No more OID, walk complete");
-				}
-				else {
-					nut_snmp_perror(g_snmp_sess_p, status, response,
-							"%s: %s", __func__, OID);
-				}
-			}
+	/* parsing the OID makes sure it has an entry */
+	if ((entry = su_oid_cache_find(su_info_p->OID, NULL)) == NULL
+	&&  su_parse_oid(su_info_p->OID, name, &name_len) != NULL
+	)
+		entry = su_oid_cache_find(su_info_p->OID, NULL);
 
-			snmp_free_pdu(response);
-			break;
-		} else {
-			/* Checked the "type" field of the returned varbind if
-			 * it is a type error exception (only applicable with
-			 * SNMPv2 or SNMPv3 protocol, would not happen with
-			 * SNMPv1). This allows to proceed interpreting large
-			 * responses when one entry in the middle is rejectable.
-			 */
-			if (response->variables->type == SNMP_NOSUCHOBJECT ||
-			    response->variables->type == SNMP_NOSUCHINSTANCE ||
-			    response->variables->type == SNMP_ENDOFMIBVIEW) {
-				upslogx(LOG_WARNING, "[%s] Warning: type error exception (OID = %s)",
-						upsname?upsname:device_name, OID);
-				snmp_free_pdu(response);
-				break;
-			}
-			else {
-				/* no error */
-				numerr = 0;
-			}
-		}
+	if (entry != NULL && !entry->absent_exempt) {
+		entry->absent_exempt = 1;
+		entry->absent_count = 0;
+		entry->absent_until = 0;
+	}
+}
 
-		nb_iteration++;
-		/* +1 is for the terminating NULL */
-		new_ret_array = realloc(
-			ret_array,
-			sizeof(struct snmp_pdu*) * ((size_t)nb_iteration+1)
-			);
-		if (new_ret_array == NULL) {
-			upsdebugx(1, "%s: Failed to realloc thread", __func__);
-			break;
-		}
-		else {
-			ret_array = new_ret_array;
-		}
-		ret_array[nb_iteration-1] = response;
-		ret_array[nb_iteration]=NULL;
+static int su_absent_skip(const char *OID)
+{
+	su_oid_cache_t	*entry;
 
-		current_name = response->variables->name;
-		current_name_len = response->variables->name_length;
+	if (absent_backoff <= 0
+	||  (entry = su_oid_cache_find(OID, NULL)) == NULL
+	||  entry->absent_until == 0
+	)
+		return 0;
 
-		type = SNMP_MSG_GETNEXT;
-	}
+	if (entry->absent_until > time(NULL))
+		return 1;
 
-	return ret_array;
+	/* Time to try again, but keep absent_count for the next back-off
+	 * until the agent answers */
+	entry->absent_until = 0;
+	return 0;
 }
 
-struct snmp_pdu *nut_snmp_get(const char *OID)
+static void su_absent_answered(const char *OID)
 {
-	struct snmp_pdu ** pdu_array;
-	struct snmp_pdu * ret_pdu;
+	su_oid_cache_t	*entry;
 
-	if (OID == NULL)
-		return NULL;
+	if (absent_backoff > 0
+	&&  (entry = su_oid_cache_find(OID, NULL)) != NULL
+	&&  entry->absent_count > 0
+	) {
+		upsdebugx(2, "%s: %s is served by the agent again", __func__, OID);
+		entry->absent_count = 0;
+		entry->absent_until = 0;
+	}
+}
 
-	upsdebugx(3, "%s(%s)", __func__, OID);
+/* Publish how many (and which) OIDs are skipped at the moment */
+static void su_absent_publish(void)
+{
+	su_oid_cache_t	*entry;
+	char	list[ST_MAX_VALUE_LEN];
+	size_t	i, count = 0, len = 0;
+	int	ret, truncated = 0;
+	time_t	now;
 
-	pdu_array = nut_snmp_walk(OID,1);
+	if (absent_backoff <= 0)
+		return;
 
-	if(pdu_array == NULL) {
-		return NULL;
+	now = time(NULL);
+	list[0] = '\0';
+
+	for (i = 0; i < SU_OID_CACHE_HASHSIZE; i++) {
+		for (entry = su_oid_cache[i]; entry != NULL; entry = entry->next) {
+			if (entry->absent_until <= now)
+				continue;
+			count++;
+			if (truncated)
+				continue;
+			/* keep room for a " ..." marker */
+			ret = snprintf(list + len, sizeof(list) - len, "%s%s",
+				len ? " " : "", entry->str);
+			if (ret < 0 || (size_t)ret >= sizeof(list) - len - 5) {
+				list[len] = '\0';
+				truncated = 1;
+			} else {
+				len += (size_t)ret;
+			}
+		}
 	}
 
-	ret_pdu = snmp_clone_pdu(*pdu_array);
+	if (truncated)
+		snprintf(list + len, sizeof(list) - len, "%s...", len ? " " : "");
 
-	nut_snmp_free(pdu_array);
+	dstate_setinfo("driver.snmp.absent", "%" PRIuSIZE, count);
+	if (count)
+		dstate_setinfo("driver.snmp.absent.oids", "%s", list);
+	else
+		dstate_delinfo("driver.snmp.absent.oids");
+}
 
-	return ret_pdu;
+/* Optional listener for SNMP traps (and informs) sent by the device: a
+ * trap about a power event (per the alarms_info table of the mapping,
+ * its status entries, or the standard UPS-MIB traps) wakes the driver
+ * up for an immediate poll of the status data, instead of waiting for
+ * the next pollfreq walk. The trap contents are only a hint: what gets
+ * published is what the poll then reads from the device */
+/* snmpTrapOID.0, and upsTraps from UPS-MIB (RFC 1628) */
+static const oid	su_trap_oid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
+static const oid	su_trap_ietf[] = { 1, 3, 6, 1, 2, 1, 33, 2 };
+
+#define SU_OIDLEN(a)	(sizeof(a) / sizeof(oid))
+
+/* Mapping entries which make up ups.status and ups.alarm */
+static int su_trap_status_entry(const snmp_info_t *su_info_p)
+{
+	const char	*dot = strrchr(su_info_p->info_type, '.');
+
+	return (!strcasecmp(su_info_p->info_type, "ups.status")
+		|| !strcasecmp(su_info_p->info_type, "ups.alarms")
+		|| (dot != NULL && !strcmp(dot, ".alarm")));
 }
 
-static bool_t decode_str(struct snmp_pdu *pdu, char *buf, size_t buf_len, info_lkp_t *oid2info)
+/* Is this one of the alarm OIDs known to the mapping? */
+static int su_trap_alarm_OID(const oid *name, size_t name_len)
 {
-	size_t len = 0;
-	char tmp_buf[SU_LARGEBUF];
+	alarms_info_t	*alarms;
+	oid	alarm[MAX_OID_LEN];
+	size_t	alarm_len;
+
+	for (alarms = alarms_info; alarms != NULL && alarms->OID != NULL; alarms++) {
+		alarm_len = MAX_OID_LEN;
+		if (su_parse_oid(alarms->OID, alarm, &alarm_len)
+		&&  !snmp_oid_compare(alarm, alarm_len, name, name_len)
+		)
+			return 1;
+	}
 
-	/* zero out buffer. */
-	memset(buf, 0, buf_len);
+	return 0;
+}
 
-	switch (pdu->variables->type) {
-	case ASN_OCTET_STR:
-	case ASN_OPAQUE:
+/* Is this a value of one of the status entries of the mapping? */
+static int su_trap_status_OID(const oid *name, size_t name_len)
+{
+	snmp_info_t	*su_info_p;
+	oid	status[MAX_OID_LEN];
+	size_t	status_len;
+
+	for (su_info_p = &snmp_info[0]; su_info_p->info_type != NULL; su_info_p++) {
+		if (su_info_p->OID == NULL
+		||  strchr(su_info_p->OID, '%') != NULL
+		||  !su_trap_status_entry(su_info_p)
+		)
+			continue;
+
+		status_len = MAX_OID_LEN;
+		if (su_parse_oid(su_info_p->OID, status, &status_len)
+		&&  !netsnmp_oid_is_subtree(status, status_len, name, name_len)
+		)
+			return 1;
+	}
+
+	return 0;
+}
+
+static int su_trap_known(const netsnmp_pdu *pdu)
+{
+	netsnmp_variable_list	*var;
+	size_t	len;
+
+	/* SNMPv1 trap of the standard UPS-MIB */
+	if (pdu->command == SNMP_MSG_TRAP && pdu->enterprise != NULL
+	&&  !netsnmp_oid_is_subtree(su_trap_ietf, SU_OIDLEN(su_trap_ietf),
+		pdu->enterprise, pdu->enterprise_length)
+	)
+		return 1;
+
+	for (var = pdu->variables; var != NULL; var = var->next_variable) {
+		if (var->type == ASN_OBJECT_ID && var->val.objid != NULL) {
+			len = var->val_len / sizeof(oid);
+
+			/* SNMPv2 trap of the standard UPS-MIB */
+			if (!snmp_oid_compare(var->name, var->name_length,
+				su_trap_oid, SU_OIDLEN(su_trap_oid))
+			&&  !netsnmp_oid_is_subtree(su_trap_ietf, SU_OIDLEN(su_trap_ietf),
+				var->val.objid, len)
+			)
+				return 1;
+
+			/* Alarm (added or removed) referred to by its OID */
+			if (su_trap_alarm_OID(var->val.objid, len))
+				return 1;
+		}
+
+		if (su_trap_status_OID(var->name, var->name_length))
+			return 1;
+	}
+
+	return 0;
+}
+
+#ifndef WIN32
+/* Resolve the address(es) of the agent (the "port" of the driver: a host
+ * name or address, optionally with a Net-SNMP transport prefix and a port
+ * like "udp6:[fe80::1]:161"), which are the only accepted trap sources */
+static void su_trap_agent_resolve(const char *peername)
+{
+	struct addrinfo	hints;
+	char	host[SMALLBUF], *p;
+	const char	*colon;
+	int	ret;
+
+	/* transport prefix */
+	colon = strchr(peername, ':');
+	if (colon != NULL) {
+		size_t	len = (size_t)(colon - peername);
+
+		if ((len == 3 && (!strncasecmp(peername, "udp", len) || !strncasecmp(peername, "tcp", len)))
+		||  (len == 4 && (!strncasecmp(peername, "udp6", len) || !strncasecmp(peername, "tcp6", len)))
+		||  (len == 6 && (!strncasecmp(peername, "udpv6", len) || !strncasecmp(peername, "tcpv6", len)))
+		)
+			peername = colon + 1;
+	}
+
+	if (*peername == '[') {
+		/* bracketed IPv6 address, maybe with a port */
+		snprintf(host, sizeof(host), "%s", peername + 1);
+		if ((p = strchr(host, ']')) != NULL)
+			*p = '\0';
+	} else {
+		snprintf(host, sizeof(host), "%s", peername);
+		/* strip the port, unless this is a bare IPv6 address */
+		if ((p = strchr(host, ':')) != NULL && strchr(p + 1, ':') == NULL)
+			*p = '\0';
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if ((ret = getaddrinfo(host, NULL, &hints, &trap_agent_ai)) != 0) {
+		trap_agent_ai = NULL;
+		upslogx(LOG_WARNING, "Can't resolve %s (%s), SNMP traps will be ignored",
+			host, gai_strerror(ret));
+	}
+}
+
+/* Whether the trap comes from the agent we poll */
+static int su_trap_from_agent(const netsnmp_pdu *pdu)
+{
+	const struct sockaddr	*sa;
+	const struct addrinfo	*ai;
+
+	/* The UDP transports keep the source address first in there */
+	if (pdu->transport_data == NULL
+	||  pdu->transport_data_length < (int)sizeof(struct sockaddr)
+	)
+		return 0;
+	sa = (const struct sockaddr *)pdu->transport_data;
+
+	for (ai = trap_agent_ai; ai != NULL; ai = ai->ai_next) {
+		if (ai->ai_family != sa->sa_family)
+			continue;
+
+		if (sa->sa_family == AF_INET
+		&&  pdu->transport_data_length >= (int)sizeof(struct sockaddr_in)
+		&&  !memcmp(&((const struct sockaddr_in *)sa)->sin_addr,
+			&((const struct sockaddr_in *)ai->ai_addr)->sin_addr,
+			sizeof(struct in_addr))
+		)
+			return 1;
+
+		if (sa->sa_family == AF_INET6
+		&&  pdu->transport_data_length >= (int)sizeof(struct sockaddr_in6)
+		&&  !memcmp(&((const struct sockaddr_in6 *)sa)->sin6_addr,
+			&((const struct sockaddr_in6 *)ai->ai_addr)->sin6_addr,
+			sizeof(struct in6_addr))
+		)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Whether the trap carries the community configured for the agent
+ * (SNMPv3 traps are authenticated by the library instead) */
+static int su_trap_community(const netsnmp_pdu *pdu)
+{
+	const char	*community;
+
+	if (pdu->version != SNMP_VERSION_1 && pdu->version != SNMP_VERSION_2c)
+		return 1;
+
+	community = testvar(SU_VAR_COMMUNITY) ? getval(SU_VAR_COMMUNITY) : "public";
+
+	return (pdu->community != NULL
+		&& pdu->community_len == strlen(community)
+		&& !memcmp(pdu->community, community, pdu->community_len));
+}
+#endif	/* !WIN32 */
+
+static int su_trap_callback(int operation, netsnmp_session *session,
+	int reqid, netsnmp_pdu *pdu, void *magic)
+{
+	netsnmp_pdu	*reply;
+
+	NUT_UNUSED_VARIABLE(reqid);
+	NUT_UNUSED_VARIABLE(magic);
+
+	if (operation != NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE || pdu == NULL)
+		return 1;
+
+	switch (pdu->command) {
+	case SNMP_MSG_TRAP:
+	case SNMP_MSG_TRAP2:
+	case SNMP_MSG_INFORM:
+		break;
+	default:
+		return 1;
+	}
+
+#ifndef WIN32
+	/* Anybody can send us traps: only believe the agent we poll */
+	if (!su_trap_from_agent(pdu)) {
+		upsdebugx(2, "%s: ignoring a trap from another source than %s",
+			__func__, device_path);
+		return 1;
+	}
+
+	if (!su_trap_community(pdu)) {
+		upsdebugx(2, "%s: ignoring a trap with a wrong community", __func__);
+		return 1;
+	}
+#endif
+
+	if (su_trap_known(pdu)) {
+		upsdebugx(1, "%s: got a power event trap, status poll pending", __func__);
+		trap_pending = 1;
+	} else {
+		upsdebugx(2, "%s: ignoring a trap unknown to the %s mapping",
+			__func__, mibname ? mibname : "current");
+	}
+
+	/* Informs want an acknowledgement */
+	if (pdu->command == SNMP_MSG_INFORM) {
+		if ((reply = snmp_clone_pdu(pdu)) != NULL) {
+			reply->command = SNMP_MSG_RESPONSE;
+			reply->errstat = 0;
+			reply->errindex = 0;
+			if (!snmp_send(session, reply))
+				snmp_free_pdu(reply);
+		}
+	}
+
+	return 1;
+}
+
+/* Start listening for traps: a port number or a Net-SNMP transport
+ * specification (like "udp:192.168.0.1:162" or "udp6:[::]:162") */
+static void su_trap_open(const char *listen)
+{
+#ifndef WIN32
+	netsnmp_session	sess;
+	netsnmp_transport	*transport;
+	char	spec[SMALLBUF];
+
+	if (strspn(listen, "0123456789") == strlen(listen))
+		snprintf(spec, sizeof(spec), "udp:%s", listen);
+	else
+		snprintf(spec, sizeof(spec), "%s", listen);
+
+	transport = netsnmp_transport_open_server("snmptrap", spec);
+	if (transport == NULL)
+		fatalx(EXIT_FAILURE, "Can't listen for SNMP traps on %s", spec);
+
+	snmp_sess_init(&sess);
+	sess.peername = SNMP_DEFAULT_PEERNAME;
+	sess.version = SNMP_DEFAULT_VERSION;
+	sess.community_len = SNMP_DEFAULT_COMMUNITY_LEN;
+	sess.retries = SNMP_DEFAULT_RETRIES;
+	sess.timeout = SNMP_DEFAULT_TIMEOUT;
+	sess.callback = su_trap_callback;
+	sess.callback_magic = NULL;
+	sess.isAuthoritative = SNMP_SESS_UNKNOWNAUTH;
+
+	trap_fd = transport->sock;
+	trap_sess_p = snmp_add(&sess, transport, NULL, NULL);
+	if (trap_sess_p == NULL)
+		fatalx(EXIT_FAILURE, "Can't set up the SNMP trap listener on %s: %s",
+			spec, snmp_api_errstring(snmp_errno));
+
+	/* wake up the main loop when a trap comes */
+	extrafd = trap_fd;
+
+	su_trap_agent_resolve(device_path);
+
+	upslogx(LOG_INFO, "Listening for SNMP traps on %s", spec);
+#else
+	upslogx(LOG_WARNING, "%s is not supported on this platform, ignored: %s",
+		SU_VAR_TRAPLISTEN, listen);
+#endif
+}
+
+static void su_trap_close(void)
+{
+	if (trap_sess_p != NULL) {
+		snmp_close(trap_sess_p);
+		trap_sess_p = NULL;
+		trap_fd = -1;
+	}
+#ifndef WIN32
+	if (trap_agent_ai != NULL) {
+		freeaddrinfo(trap_agent_ai);
+		trap_agent_ai = NULL;
+	}
+#endif
+}
+
+/* Handle the traps received so far, return whether a poll is due */
+static int su_trap_check(void)
+{
+#ifndef WIN32
+	fd_set	fdset;
+	struct timeval	tv;
+	int	i;
+
+	if (trap_sess_p == NULL)
+		return 0;
+
+	/* do not let a flood of traps keep us here */
+	for (i = 0; i < 64; i++) {
+		FD_ZERO(&fdset);
+		FD_SET(trap_fd, &fdset);
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		if (select(trap_fd + 1, &fdset, NULL, NULL, &tv) < 1)
+			break;
+		snmp_read(&fdset);
+	}
+#endif
+
+	/* at most one such poll per second */
+	return (trap_pending && time(NULL) != trap_lastpoll);
+}
+
+/* Poll just the status entries after a trap; return FALSE if it takes
+ * a full walk (daisychain, or alarms of outlets and such templates) */
+static bool_t su_trap_poll(void)
+{
+	snmp_info_t	*su_info_p;
+
+	trap_pending = 0;
+	trap_lastpoll = time(NULL);
+
+	if (daisychain_enabled == TRUE || devices_count > 1)
+		return FALSE;
+
+	for (su_info_p = &snmp_info[0]; su_info_p->info_type != NULL; su_info_p++) {
+		if ((su_info_p->flags & SU_FLAG_OK)
+		&&  (su_info_p->flags & (SU_OUTLET | SU_OUTLET_GROUP | SU_AMBIENT_TEMPLATE))
+		&&  su_trap_status_entry(su_info_p)
+		)
+			return FALSE;
+	}
+
+	upsdebugx(1, "%s: polling the status after a trap", __func__);
+
+	alarm_init();
+	status_init();
+
+	for (su_info_p = &snmp_info[0]; su_info_p->info_type != NULL; su_info_p++) {
+		if (!(su_info_p->flags & SU_FLAG_OK)
+		||  (su_info_p->flags & SU_FLAG_STATIC)
+		||  (SU_TYPE(su_info_p) == SU_TYPE_CMD)
+		||  su_info_p->OID == NULL
+		||  !su_trap_status_entry(su_info_p)
+		)
+			continue;
+
+		get_and_process_data(SU_WALKMODE_UPDATE, su_info_p);
+	}
+
+	alarm_commit();
+	status_commit();
+
+	return TRUE;
+}
+
+/* Request pacing (snmp_max_rate) and the time allowed for one update
+ * walk (snmp_poll_timeout), so that many drivers polling devices on a
+ * shared network or agent do not burst, and one slow agent does not
+ * keep its driver busy for retries * timeout per OID */
+static struct timeval	rate_next = { 0, 0 };
+static time_t	poll_deadline = 0;
+static int	poll_expired_logged = 0;
+
+/* Microseconds to wait before the next request may be sent */
+static long su_rate_delay(void)
+{
+	struct timeval	now;
+	long	delay;
+
+	if (max_rate <= 0)
+		return 0;
+
+	gettimeofday(&now, NULL);
+	delay = (long)(rate_next.tv_sec - now.tv_sec) * 1000000L
+		+ (long)(rate_next.tv_usec - now.tv_usec);
+
+	return (delay > 0) ? delay : 0;
+}
+
+/* Account for a request sent now */
+static void su_rate_sent(void)
+{
+	struct timeval	now;
+
+	if (max_rate <= 0)
+		return;
+
+	gettimeofday(&now, NULL);
+
+	/* no credit is saved up while idle */
+	if (rate_next.tv_sec < now.tv_sec
+	|| (rate_next.tv_sec == now.tv_sec && rate_next.tv_usec < now.tv_usec)
+	) {
+		rate_next = now;
+	}
+
+	rate_next.tv_usec += 1000000L / max_rate;
+	rate_next.tv_sec += rate_next.tv_usec / 1000000L;
+	rate_next.tv_usec %= 1000000L;
+}
+
+/* Wait for our turn before sending a synchronous request */
+static void su_rate_wait(void)
+{
+	long	delay = su_rate_delay();
+
+	if (delay > 0) {
+		upsdebugx(5, "%s: pacing requests, waiting %ld usec", __func__, delay);
+		usleep((useconds_t)delay);
+	}
+
+	su_rate_sent();
+}
+
+/* Start the time allowed for an update walk, or end it with 0 */
+static void su_poll_deadline(int seconds)
+{
+	poll_deadline = (seconds > 0) ? time(NULL) + seconds : 0;
+	poll_expired_logged = 0;
+}
+
+/* Is the time for this update walk over? Then no more requests are
+ * sent, and the data is stale until a walk completes in time */
+static int su_poll_expired(void)
+{
+	if (poll_deadline == 0 || time(NULL) < poll_deadline)
+		return 0;
+
+	if (!poll_expired_logged) {
+		upslogx(LOG_WARNING, "[%s] Warning: polling took more than %d seconds, "
+			"skipping the remaining requests until the next poll "
+			"(the data is stale until then)",
+			upsname?upsname:device_name, poll_timeout);
+		poll_expired_logged = 1;
+	}
+
+	return 1;
+}
+
+/* Free a struct snmp_pdu * returned by nut_snmp_walk */
+static void nut_snmp_free(struct snmp_pdu ** array_to_free)
+{
+	struct snmp_pdu ** current_element;
+
+	if (array_to_free != NULL) {
+		current_element = array_to_free;
+
+		while (*current_element != NULL) {
+			snmp_free_pdu(*current_element);
+			current_element++;
+		}
+
+		free( array_to_free );
+	}
+}
+
+/* Return a NULL terminated array of snmp_pdu * */
+static struct snmp_pdu **nut_snmp_walk(const char *OID, int max_iteration)
+{
+	int status;
+	struct snmp_pdu *pdu, *response = NULL;
+	oid name[MAX_OID_LEN];
+	size_t name_len = MAX_OID_LEN;
+	oid * current_name;
+	size_t current_name_len;
+	static unsigned int numerr = 0;
+	int nb_iteration = 0;
+	struct snmp_pdu ** ret_array = NULL;
+	int type = SNMP_MSG_GET;
+
+	upsdebugx(3, "%s(%s)", __func__, OID);
+	upsdebugx(4, "%s: max. iteration = %i", __func__, max_iteration);
+
+	/* create and send request. */
+	if (!su_parse_oid(OID, name, &name_len)) {
+		upsdebugx(2, "[%s] %s: %s: %s",
+			upsname?upsname:device_name, __func__, OID, snmp_api_errstring(snmp_errno));
+		return NULL;
+	}
+
+	current_name = name;
+	current_name_len = name_len;
+
+	while( nb_iteration < max_iteration ) {
+		struct snmp_pdu	**new_ret_array;
+
+		/* Going to a shorter OID means we are outside our sub-tree */
+		if( current_name_len < name_len ) {
+			break;
+		}
+
+		pdu = snmp_pdu_create(type);
+
+		if (pdu == NULL) {
+			fatalx(EXIT_FAILURE, "Not enough memory");
+		}
+
+		snmp_add_null_var(pdu, current_name, current_name_len);
+
+		if (su_poll_expired()) {
+			snmp_free_pdu(pdu);
+			break;
+		}
+
+		su_rate_wait();
+		status = snmp_synch_response(g_snmp_sess_p, pdu, &response);
+
+		if (!response) {
+			break;
+		}
+
+		if (!((status == STAT_SUCCESS) && (response->errstat == SNMP_ERR_NOERROR))) {
+			if (mibname == NULL) {
+				/* We are probing for proper mib - ignore errors */
+				snmp_free_pdu(response);
+				nut_snmp_free(ret_array);
+				return NULL;
+			}
+
+			if (response->errstat == SNMP_ERR_NOSUCHNAME) {
+				upsdebugx(4, "%s: OID does not exist, skipping", __func__);
+				if (type == SNMP_MSG_GET)
+					su_absent_mark(OID);
+				snmp_free_pdu(response);
+				nut_snmp_free(ret_array);
+				return NULL;
+			}
+
+			upsdebugx(3, "status = %i, response->errstat = %li", status, response->errstat);
+
+			/* Error throttling otherwise */
+			numerr++;
+			upsdebugx(4, "%s: numerr++ (total=%u)", __func__, numerr);
+
+			if ((numerr == SU_ERR_LIMIT) || ((numerr % SU_ERR_RATE) == 0)) {
+				upslogx(LOG_WARNING, "[%s] Warning: excessive poll "
+						"failures, limiting error reporting (OID = %s)",
+						upsname?upsname:device_name, OID);
+			}
+
+			if ((numerr < SU_ERR_LIMIT) || ((numerr % SU_ERR_RATE) == 0)) {
+				if (type == SNMP_MSG_GETNEXT) {
+					upsdebugx(2, "=> No more OID, walk complete");
+				}
+				else {
+					nut_snmp_perror(g_snmp_sess_p, status, response,
+							"%s: %s", __func__, OID);
+				}
+			}
+
+			snmp_free_pdu(response);
+			break;
+		} else {
+			/* Checked the "type" field of the returned varbind if
+			 * it is a type error exception (only applicable with
+			 * SNMPv2 or SNMPv3 protocol, would not happen with
+			 * SNMPv1). This allows to proceed interpreting large
+			 * responses when one entry in the middle is rejectable.
+			 */
+			if (response->variables->type == SNMP_NOSUCHOBJECT ||
+			    response->variables->type == SNMP_NOSUCHINSTANCE ||
+			    response->variables->type == SNMP_ENDOFMIBVIEW) {
+				upslogx(LOG_WARNING, "[%s] Warning: type error exception (OID = %s)",
+						upsname?upsname:device_name, OID);
+				if (type == SNMP_MSG_GET
+				 && response->variables->type != SNMP_ENDOFMIBVIEW)
+					su_absent_mark(OID);
+				snmp_free_pdu(response);
+				break;
+			}
+			else {
+				/* no error */
+				numerr = 0;
+			}
+		}
+
+		nb_iteration++;
+		/* +1 is for the terminating NULL */
+		new_ret_array = realloc(
+			ret_array,
+			sizeof(struct snmp_pdu*) * ((size_t)nb_iteration+1)
+			);
+		if (new_ret_array == NULL) {
+			upsdebugx(1, "%s: Failed to realloc thread", __func__);
+			break;
+		}
+		else {
+			ret_array = new_ret_array;
+		}
+		ret_array[nb_iteration-1] = response;
+		ret_array[nb_iteration]=NULL;
+
+		current_name = response->variables->name;
+		current_name_len = response->variables->name_length;
+
+		type = SNMP_MSG_GETNEXT;
+	}
+
+	return ret_array;
+}
+
+/* Responses fetched in advance for the current walk cycle, batching many
+ * varbinds into each GET (or GETBULK for template tables) request. The
+ * nut_snmp_get() looks there first, and only sends a request of its own
+ * for OIDs which were not planned or whose batch failed. */
+typedef struct {
+	oid	name[MAX_OID_LEN];
+	size_t	name_len;
+	struct snmp_pdu	*pdu;	/* single-varbind response, NULL if absent */
+} su_prefetch_t;
+
+static su_prefetch_t	*prefetch = NULL;
+static size_t	prefetch_count = 0, prefetch_alloc = 0;
+static int	prefetch_sorted = 0;
+/* set when a batched request got no answer: do not try more this cycle */
+static int	prefetch_failed = 0;
+
+/* OIDs planned for the batched GET requests */
+static su_prefetch_t	*prefetch_plan = NULL;
+static size_t	prefetch_plan_count = 0, prefetch_plan_alloc = 0;
+
+/* Table columns planned for GETBULK requests (name is the column,
+ * next/next_len where to continue from, rows how many are still due) */
+typedef struct {
+	oid	name[MAX_OID_LEN];
+	size_t	name_len;
+	oid	next[MAX_OID_LEN];
+	size_t	next_len;
+	int	rows;
+} su_prefetch_column_t;
+
+static su_prefetch_column_t	*prefetch_columns = NULL;
+static size_t	prefetch_columns_count = 0, prefetch_columns_alloc = 0;
+
+/* One request to send: a GET for prefetch_plan[from..from+count-1],
+ * or the next GETBULK for prefetch_columns[column] if column >= 0 */
+typedef struct {
+	size_t	from, count;
+	long	column;
+	unsigned long	generation;	/* of prefetch_generation when sent */
+} su_prefetch_job_t;
+
+static su_prefetch_job_t	*prefetch_jobs = NULL;
+static size_t	prefetch_jobs_count = 0, prefetch_jobs_alloc = 0;
+/* requests sent asynchronously and not answered yet */
+static int	prefetch_inflight = 0;
+/* bumped to abandon the requests in flight when the poll time is over:
+ * their late answers (or timeouts) are then ignored by the callback */
+static unsigned long	prefetch_generation = 0;
+
+static void su_prefetch_free(void)
+{
+	size_t	i;
+
+	for (i = 0; i < prefetch_count; i++) {
+		if (prefetch[i].pdu)
+			snmp_free_pdu(prefetch[i].pdu);
+	}
+
+	free(prefetch);
+	free(prefetch_plan);
+	free(prefetch_columns);
+	free(prefetch_jobs);
+	prefetch = NULL;
+	prefetch_plan = NULL;
+	prefetch_columns = NULL;
+	prefetch_jobs = NULL;
+	prefetch_count = prefetch_alloc = 0;
+	prefetch_plan_count = prefetch_plan_alloc = 0;
+	prefetch_columns_count = prefetch_columns_alloc = 0;
+	prefetch_jobs_count = prefetch_jobs_alloc = 0;
+	prefetch_sorted = 0;
+	prefetch_failed = 0;
+}
+
+static su_prefetch_t *su_prefetch_append(su_prefetch_t **array,
+	size_t *count, size_t *alloc, const oid *name, size_t name_len)
+{
+	su_prefetch_t	*entry;
+
+	if (name_len > MAX_OID_LEN)
+		return NULL;
+
+	if (*count >= *alloc) {
+		*alloc = (*alloc ? *alloc * 2 : 64);
+		*array = xrealloc(*array, *alloc * sizeof(**array));
+	}
+
+	entry = &(*array)[(*count)++];
+	memcpy(entry->name, name, name_len * sizeof(oid));
+	entry->name_len = name_len;
+	entry->pdu = NULL;
+
+	return entry;
+}
+
+/* Remember the response for one varbind (absent if pdu == NULL) */
+static void su_prefetch_store(const oid *name, size_t name_len, struct snmp_pdu *pdu)
+{
+	su_prefetch_t	*entry = su_prefetch_append(&prefetch,
+		&prefetch_count, &prefetch_alloc, name, name_len);
+
+	if (!entry) {
+		if (pdu)
+			snmp_free_pdu(pdu);
+		return;
+	}
+
+	entry->pdu = pdu;
+	prefetch_sorted = 0;
+}
+
+static int su_prefetch_cmp(const void *a, const void *b)
+{
+	const su_prefetch_t	*pa = a, *pb = b;
+
+	return snmp_oid_compare(pa->name, pa->name_len, pb->name, pb->name_len);
+}
+
+static su_prefetch_t *su_prefetch_find(const char *OID)
+{
+	su_prefetch_t	key;
+
+	if (!prefetch_count)
+		return NULL;
+
+	key.name_len = MAX_OID_LEN;
+	if (!su_parse_oid(OID, key.name, &key.name_len))
+		return NULL;
+
+	if (!prefetch_sorted) {
+		qsort(prefetch, prefetch_count, sizeof(*prefetch), su_prefetch_cmp);
+		prefetch_sorted = 1;
+	}
+
+	return bsearch(&key, prefetch, prefetch_count, sizeof(*prefetch), su_prefetch_cmp);
+}
+
+/* Plan an OID for the batched GET requests of this cycle */
+static void su_prefetch_add(const char *OID)
+{
+	oid	name[MAX_OID_LEN];
+	size_t	name_len = MAX_OID_LEN;
+
+	if (su_absent_skip(OID))
+		return;
+
+	if (!su_parse_oid(OID, name, &name_len)) {
+		upsdebugx(3, "%s: %s: %s", __func__, OID, snmp_api_errstring(snmp_errno));
+		return;
+	}
+
+	su_prefetch_append(&prefetch_plan, &prefetch_plan_count,
+		&prefetch_plan_alloc, name, name_len);
+}
+
+static void su_prefetch_job(size_t from, size_t count, long column)
+{
+	su_prefetch_job_t	*job;
+
+	if (count == 0 && column < 0)
+		return;
+
+	if (prefetch_jobs_count >= prefetch_jobs_alloc) {
+		prefetch_jobs_alloc = (prefetch_jobs_alloc ? prefetch_jobs_alloc * 2 : 16);
+		prefetch_jobs = xrealloc(prefetch_jobs, prefetch_jobs_alloc * sizeof(*prefetch_jobs));
+	}
+
+	job = &prefetch_jobs[prefetch_jobs_count++];
+	job->from = from;
+	job->count = count;
+	job->column = column;
+}
+
+/* Plan a table column for GETBULK requests, up to "rows" entries */
+static void su_prefetch_add_column(const char *column_OID, int rows)
+{
+	su_prefetch_column_t	*column;
+
+	if (prefetch_columns_count >= prefetch_columns_alloc) {
+		prefetch_columns_alloc = (prefetch_columns_alloc ? prefetch_columns_alloc * 2 : 16);
+		prefetch_columns = xrealloc(prefetch_columns,
+			prefetch_columns_alloc * sizeof(*prefetch_columns));
+	}
+
+	column = &prefetch_columns[prefetch_columns_count];
+	column->name_len = MAX_OID_LEN;
+	if (!su_parse_oid(column_OID, column->name, &column->name_len)) {
+		upsdebugx(3, "%s: %s: %s", __func__, column_OID, snmp_api_errstring(snmp_errno));
+		return;
+	}
+
+	memcpy(column->next, column->name, column->name_len * sizeof(oid));
+	column->next_len = column->name_len;
+	column->rows = rows;
+
+	su_prefetch_job(0, 0, (long)prefetch_columns_count++);
+}
+
+static struct snmp_pdu *su_prefetch_request(const su_prefetch_job_t *job)
+{
+	struct snmp_pdu	*pdu;
+	size_t	i;
+
+	pdu = snmp_pdu_create(job->column < 0 ? SNMP_MSG_GET : SNMP_MSG_GETBULK);
+	if (pdu == NULL)
+		fatalx(EXIT_FAILURE, "Not enough memory");
+
+	if (job->column < 0) {
+		for (i = job->from; i < job->from + job->count; i++)
+			snmp_add_null_var(pdu, prefetch_plan[i].name, prefetch_plan[i].name_len);
+		upsdebugx(3, "%s: requesting %" PRIuSIZE " OIDs at once", __func__, job->count);
+	} else {
+		su_prefetch_column_t	*column = &prefetch_columns[job->column];
+
+		pdu->non_repeaters = 0;
+		pdu->max_repetitions = (column->rows < max_varbinds ? column->rows : max_varbinds);
+		snmp_add_null_var(pdu, column->next, column->next_len);
+		upsdebugx(3, "%s: requesting %ld rows of table column #%ld",
+			__func__, pdu->max_repetitions, job->column);
+	}
+
+	return pdu;
+}
+
+/* Store the answers to a GET batch. Per-item errors (SNMPv1 noSuchName,
+ * or exceptions in SNMPv2c/v3 varbinds) only concern that item: the
+ * others are planned again without it */
+static void su_prefetch_get_result(const su_prefetch_job_t *job, struct snmp_pdu *response)
+{
+	struct variable_list	*var;
+	size_t	i, bad, from = job->from, count = job->count;
+
+	if (response->errstat == SNMP_ERR_NOERROR) {
+		for (var = response->variables, i = 0; var != NULL; var = var->next_variable, i++) {
+			if (var->type == SNMP_NOSUCHOBJECT
+			 || var->type == SNMP_NOSUCHINSTANCE
+			 || var->type == SNMP_ENDOFMIBVIEW
+			) {
+				upsdebugx(4, "%s: type error exception for an OID, marking absent", __func__);
+				su_prefetch_store(var->name, var->name_length, NULL);
+			} else {
+				su_prefetch_store(var->name, var->name_length,
+					snmp_split_pdu(response, (int)i, 1));
+			}
+		}
+		return;
+	}
+
+	if (response->errstat == SNMP_ERR_TOOBIG && count > 1) {
+		if (max_varbinds > (int)(count / 2))
+			max_varbinds = (int)(count / 2);
+		upsdebugx(1, "%s: response too big, requesting at most %d OIDs at once from now on",
+			__func__, max_varbinds);
+		su_prefetch_job(from, count / 2, -1);
+		su_prefetch_job(from + count / 2, count - count / 2, -1);
+		return;
+	}
+
+	if (response->errindex < 1 || (size_t)response->errindex > count) {
+		upsdebugx(2, "%s: error %ld for a batch of %" PRIuSIZE " OIDs, "
+			"falling back to separate requests", __func__,
+			response->errstat, count);
+		return;
+	}
+
+	/* Only this one failed: a missing OID is known absent, otherwise
+	 * let nut_snmp_get() ask again and report the error properly */
+	bad = from + (size_t)response->errindex - 1;
+	if (response->errstat == SNMP_ERR_NOSUCHNAME) {
+		upsdebugx(4, "%s: OID #%ld of the batch does not exist", __func__, response->errindex);
+		su_prefetch_store(prefetch_plan[bad].name, prefetch_plan[bad].name_len, NULL);
+	}
+
+	su_prefetch_job(from, bad - from, -1);
+	su_prefetch_job(bad + 1, from + count - bad - 1, -1);
+}
+
+/* Store the rows of a table column got by GETBULK, and plan the next
+ * request if more are due */
+static void su_prefetch_bulk_result(const su_prefetch_job_t *job, struct snmp_pdu *response)
+{
+	struct variable_list	*var;
+	su_prefetch_column_t	*column = &prefetch_columns[job->column];
+	int	i;
+
+	if (response->errstat != SNMP_ERR_NOERROR || !response->variables)
+		return;
+
+	for (var = response->variables, i = 0; var != NULL && column->rows > 0; var = var->next_variable, i++) {
+		/* Went past the end of this column? */
+		if (var->type == SNMP_NOSUCHOBJECT
+		 || var->type == SNMP_NOSUCHINSTANCE
+		 || var->type == SNMP_ENDOFMIBVIEW
+		 || netsnmp_oid_is_subtree(column->name, column->name_len, var->name, var->name_length) != 0
+		 || var->name_length > MAX_OID_LEN
+		) {
+			return;
+		}
+
+		su_prefetch_store(var->name, var->name_length, snmp_split_pdu(response, i, 1));
+		memcpy(column->next, var->name, var->name_length * sizeof(oid));
+		column->next_len = var->name_length;
+		column->rows--;
+	}
+
+	if (column->rows > 0)
+		su_prefetch_job(0, 0, job->column);
+}
+
+static void su_prefetch_result(const su_prefetch_job_t *job, int status, struct snmp_pdu *response)
+{
+	if (!response || status != STAT_SUCCESS) {
+		upsdebugx(2, "%s: no answer to a batched request, "
+			"falling back to separate requests", __func__);
+		prefetch_failed = 1;
+		return;
+	}
+
+	if (job->column < 0)
+		su_prefetch_get_result(job, response);
+	else
+		su_prefetch_bulk_result(job, response);
+}
+
+/* Callback for requests sent with snmp_async_send(): the library
+ * frees the response after we return */
+static int su_prefetch_callback(int operation, struct snmp_session *sess,
+	int reqid, struct snmp_pdu *response, void *magic)
+{
+	su_prefetch_job_t	*job = (su_prefetch_job_t *)magic;
+
+	NUT_UNUSED_VARIABLE(sess);
+	NUT_UNUSED_VARIABLE(reqid);
+
+	if (job->generation != prefetch_generation) {
+		upsdebugx(4, "%s: ignoring an abandoned batched request", __func__);
+		free(job);
+		return 1;
+	}
+
+	prefetch_inflight--;
+
+	if (operation == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE) {
+		su_prefetch_result(job, STAT_SUCCESS, response);
+	} else {
+		su_prefetch_result(job, STAT_TIMEOUT, NULL);
+	}
+
+	free(job);
+	return 1;
+}
+
+/* Send the planned requests: one at a time, or with up to max_inflight
+ * sent asynchronously before waiting for the answers (paced by
+ * snmp_max_rate, and given up once the poll time is over) */
+static void su_prefetch_run(void)
+{
+	su_prefetch_job_t	job, *async_job;
+	struct snmp_pdu	*pdu, *response;
+	int	status;
+	long	delay;
+
+	while ((prefetch_jobs_count > 0 && !prefetch_failed) || prefetch_inflight > 0) {
+		if (su_poll_expired()) {
+			/* abandon what is in flight, the library expires it */
+			prefetch_generation++;
+			prefetch_inflight = 0;
+			prefetch_failed = 1;
+			break;
+		}
+
+		delay = 0;
+		while (prefetch_jobs_count > 0 && !prefetch_failed
+		&&  prefetch_inflight < max_inflight
+		) {
+			if (su_poll_expired())
+				break;
+			if (max_inflight >= 2 && (delay = su_rate_delay()) > 0)
+				break;
+
+			/* take the oldest planned job */
+			job = prefetch_jobs[0];
+			memmove(&prefetch_jobs[0], &prefetch_jobs[1],
+				(--prefetch_jobs_count) * sizeof(*prefetch_jobs));
+
+			pdu = su_prefetch_request(&job);
+
+			if (max_inflight < 2) {
+				response = NULL;
+				su_rate_wait();
+				status = snmp_synch_response(g_snmp_sess_p, pdu, &response);
+				su_prefetch_result(&job, status, response);
+				if (response)
+					snmp_free_pdu(response);
+				continue;
+			}
+
+			async_job = xmalloc(sizeof(*async_job));
+			*async_job = job;
+			async_job->generation = prefetch_generation;
+			su_rate_sent();
+			if (!snmp_async_send(g_snmp_sess_p, pdu, su_prefetch_callback, async_job)) {
+				upsdebugx(2, "%s: could not send a batched request", __func__);
+				snmp_free_pdu(pdu);
+				free(async_job);
+				prefetch_failed = 1;
+				break;
+			}
+			prefetch_inflight++;
+		}
+
+		if (prefetch_inflight > 0) {
+			int	numfds = 0, block = 0, count;
+			fd_set	fdset;
+			struct timeval	timeout;
+
+			FD_ZERO(&fdset);
+			timeout.tv_sec = 1;
+			timeout.tv_usec = 0;
+			/* wake up when the pacing lets us send the next one */
+			if (delay > 0 && delay < 1000000L) {
+				timeout.tv_sec = 0;
+				timeout.tv_usec = delay;
+			}
+			snmp_select_info(&numfds, &fdset, &timeout, &block);
+
+			count = select(numfds, &fdset, NULL, NULL, block ? NULL : &timeout);
+			if (count > 0) {
+				snmp_read(&fdset);
+			} else if (count == 0) {
+				snmp_timeout();
+			} else if (errno != EINTR) {
+				upsdebugx(1, "%s: select() failed: %s", __func__, strerror(errno));
+				/* send no more, and let the library expire
+				 * what is pending (so no callbacks come later) */
+				prefetch_failed = 1;
+				snmp_timeout();
+			}
+		} else if (delay > 0) {
+			usleep((useconds_t)delay);
+		}
+	}
+
+	prefetch_jobs_count = 0;
+}
+
+/* Send the batched GET requests for prefetch_plan[from..], keeping what
+ * was fetched before */
+static void su_prefetch_plan_run(size_t from)
+{
+	size_t	i, n;
+
+	prefetch_failed = 0;
+
+	for (i = from; i < prefetch_plan_count; i += n) {
+		n = prefetch_plan_count - i;
+		if (n > (size_t)max_varbinds)
+			n = (size_t)max_varbinds;
+		su_prefetch_job(i, n, -1);
+	}
+
+	su_prefetch_run();
+}
+
+struct snmp_pdu *nut_snmp_get(const char *OID)
+{
+	struct snmp_pdu ** pdu_array;
+	struct snmp_pdu * ret_pdu;
+	su_prefetch_t *prefetched;
+
+	if (OID == NULL)
+		return NULL;
+
+	upsdebugx(3, "%s(%s)", __func__, OID);
+
+	if (su_absent_skip(OID)) {
+		upsdebugx(4, "%s: OID was rejected by the agent recently, skipping", __func__);
+		return NULL;
+	}
+
+	if ((prefetched = su_prefetch_find(OID)) != NULL) {
+		if (prefetched->pdu == NULL) {
+			upsdebugx(4, "%s: OID is absent in batched response, skipping", __func__);
+			su_absent_mark(OID);
+			return NULL;
+		}
+		su_absent_answered(OID);
+		return snmp_clone_pdu(prefetched->pdu);
+	}
+
+	pdu_array = nut_snmp_walk(OID,1);
+
+	if(pdu_array == NULL) {
+		return NULL;
+	}
+
+	su_absent_answered(OID);
+
+	ret_pdu = snmp_clone_pdu(*pdu_array);
+
+	nut_snmp_free(pdu_array);
+
+	return ret_pdu;
+}
+
+static bool_t decode_str(struct snmp_pdu *pdu, char *buf, size_t buf_len, info_lkp_t *oid2info)
+{
+	size_t len = 0;
+	char tmp_buf[SU_LARGEBUF];
+
+	/* zero out buffer. */
+	memset(buf, 0, buf_len);
+
+	switch (pdu->variables->type) {
+	case ASN_OCTET_STR:
+	case ASN_OPAQUE:
 		{ /* scoping */
 			/* Test for hexadecimal values */
 			int hex = 0, x;
@@ -1631,7 +3063,7 @@ bool_t nut_snmp_set(const char *OID, char type, const char *value)
 
 	upsdebugx(1, "entering %s(%s, %c, %s)", __func__, OID, type, value);
 
-	if (!snmp_parse_oid(OID, name, &name_len)) {
+	if (!su_parse_oid(OID, name, &name_len)) {
 		upslogx(LOG_ERR, "[%s] %s: %s: %s",
 			upsname?upsname:device_name, __func__, OID, snmp_api_errstring(snmp_errno));
 		return FALSE;
@@ -1648,6 +3080,7 @@ bool_t nut_snmp_set(const char *OID, char type, const char *value)
 		return FALSE;
 	}
 
+	su_rate_wait();
 	status = snmp_synch_response(g_snmp_sess_p, pdu, &response);
 
 	if ((status == STAT_SUCCESS) && (response->errstat == SNMP_ERR_NOERROR))
@@ -1978,9 +3411,222 @@ void su_alarm_set(snmp_info_t *su_info_p, long value)
 }
 
 /* find info element definition in my info array. */
+/* Hash indexes of the mapping tables, built when first needed (so
+ * after a MIB was selected) instead of scanning them on each lookup,
+ * see hash_table_size() */
+
+/* snmp_info entries by (case-insensitive) info_type: the first entry
+ * wins, as with the scan done before */
+static snmp_info_t	*su_info_index_table = NULL;
+static snmp_info_t	**su_info_index = NULL;
+static size_t	su_info_index_size = 0;
+
+static void su_info_index_build(void)
+{
+	snmp_info_t	*su_info_p;
+	size_t	count = 0, i;
+
+	free(su_info_index);
+
+	for (su_info_p = &snmp_info[0]; su_info_p->info_type != NULL; su_info_p++)
+		count++;
+
+	su_info_index_size = hash_table_size(count);
+	su_info_index = xcalloc(su_info_index_size, sizeof(*su_info_index));
+	su_info_index_table = snmp_info;
+
+	for (su_info_p = &snmp_info[0]; su_info_p->info_type != NULL; su_info_p++) {
+		i = str_hash(su_info_p->info_type, 1) & (su_info_index_size - 1);
+		while (su_info_index[i] != NULL
+		&&  strcasecmp(su_info_index[i]->info_type, su_info_p->info_type)
+		)
+			i = (i + 1) & (su_info_index_size - 1);
+		if (su_info_index[i] == NULL)
+			su_info_index[i] = su_info_p;
+	}
+
+	upsdebugx(2, "%s: indexed %" PRIuSIZE " mapping entries", __func__, count);
+}
+
+/* info_lkp_t tables by numeric and by string value, each built when
+ * the table is first looked up */
+typedef struct su_lkp_index_s {
+	const info_lkp_t	*table;
+	const info_lkp_t	**by_value;
+	const info_lkp_t	**by_name;
+	size_t	size;
+	struct su_lkp_index_s	*next;
+} su_lkp_index_t;
+
+#define SU_LKP_INDEX_HASHSIZE	64
+
+static su_lkp_index_t	*su_lkp_indexes[SU_LKP_INDEX_HASHSIZE];
+
+static su_lkp_index_t *su_lkp_index_get(const info_lkp_t *table)
+{
+	su_lkp_index_t	**slot = &su_lkp_indexes[((size_t)table / sizeof(info_lkp_t)) % SU_LKP_INDEX_HASHSIZE];
+	su_lkp_index_t	*index;
+	const info_lkp_t	*info_lkp;
+	size_t	count = 0, i;
+
+	for (index = *slot; index != NULL; index = index->next) {
+		if (index->table == table)
+			return index;
+	}
+
+	for (info_lkp = table; info_lkp->info_value != NULL
+		&& strcmp(info_lkp->info_value, "NULL"); info_lkp++)
+		count++;
+
+	index = xcalloc(1, sizeof(*index));
+	index->table = table;
+	index->size = hash_table_size(count);
+	index->by_value = xcalloc(index->size, sizeof(*index->by_value));
+	index->by_name = xcalloc(index->size, sizeof(*index->by_name));
+
+	for (info_lkp = table; info_lkp->info_value != NULL
+		&& strcmp(info_lkp->info_value, "NULL"); info_lkp++
+	) {
+		i = (size_t)info_lkp->oid_value & (index->size - 1);
+		while (index->by_value[i] != NULL && index->by_value[i]->oid_value != info_lkp->oid_value)
+			i = (i + 1) & (index->size - 1);
+		if (index->by_value[i] == NULL)
+			index->by_value[i] = info_lkp;
+
+		i = str_hash(info_lkp->info_value, 0) & (index->size - 1);
+		while (index->by_name[i] != NULL && strcmp(index->by_name[i]->info_value, info_lkp->info_value))
+			i = (i + 1) & (index->size - 1);
+		if (index->by_name[i] == NULL)
+			index->by_name[i] = info_lkp;
+	}
+
+	index->next = *slot;
+	*slot = index;
+
+	return index;
+}
+
+/* mib2nut[] entries having a sysOID, sorted by it (and then by their
+ * position in mib2nut[], which is the order to try them in), so that
+ * the candidates for a device sysOID are found without probing the
+ * device for each mapping table in turn */
+typedef struct {
+	oid	name[MAX_OID_LEN];
+	size_t	name_len;
+	int	pos;
+} su_sysoid_index_t;
+
+static su_sysoid_index_t	*su_sysoid_index = NULL;
+static size_t	su_sysoid_index_count = 0;
+
+static int su_sysoid_cmp(const void *a, const void *b)
+{
+	const su_sysoid_index_t	*pa = a, *pb = b;
+
+	return snmp_oid_compare(pa->name, pa->name_len, pb->name, pb->name_len);
+}
+
+static int su_sysoid_index_cmp(const void *a, const void *b)
+{
+	const su_sysoid_index_t	*pa = a, *pb = b;
+	int	ret = su_sysoid_cmp(a, b);
+
+	return ret ? ret : (pa->pos - pb->pos);
+}
+
+static void su_sysoid_index_build(void)
+{
+	su_sysoid_index_t	*entry;
+	int	i;
+
+	for (i = 0; mib2nut[i] != NULL; i++)
+		;
+	su_sysoid_index = xcalloc((size_t)i + 1, sizeof(*su_sysoid_index));
+	su_sysoid_index_count = 0;
+
+	for (i = 0; mib2nut[i] != NULL; i++) {
+		if (mib2nut[i]->sysOID == NULL)
+			continue;
+
+		entry = &su_sysoid_index[su_sysoid_index_count];
+		entry->name_len = MAX_OID_LEN;
+		if (!read_objid(mib2nut[i]->sysOID, entry->name, &entry->name_len)) {
+			upsdebugx(2, "%s: can't build OID %s: %s", __func__,
+				mib2nut[i]->sysOID, snmp_api_errstring(snmp_errno));
+			continue;
+		}
+		entry->pos = i;
+		su_sysoid_index_count++;
+	}
+
+	qsort(su_sysoid_index, su_sysoid_index_count, sizeof(*su_sysoid_index), su_sysoid_index_cmp);
+
+	upsdebugx(2, "%s: indexed %" PRIuSIZE " sysOID values", __func__, su_sysoid_index_count);
+}
+
+/* Fill candidates[] with the positions in mib2nut[] of the entries whose
+ * sysOID is the device one (if exact) or else a strict prefix of it, the
+ * longest (the most specific) first; candidates[] must hold
+ * su_sysoid_index_count items (once su_sysoid_index_build() was called).
+ * Return how many were found */
+static size_t su_sysoid_candidates(const oid *name, size_t name_len, int exact, int *candidates)
+{
+	su_sysoid_index_t	key, *found;
+	size_t	count = 0, len;
+
+	if (name_len == 0)
+		return 0;
+
+	memcpy(key.name, name, name_len * sizeof(oid));
+
+	for (len = exact ? name_len : name_len - 1;
+	     len > 0 && (!exact || len == name_len); len--
+	) {
+		key.name_len = len;
+		found = bsearch(&key, su_sysoid_index, su_sysoid_index_count,
+			sizeof(*su_sysoid_index), su_sysoid_cmp);
+		if (found == NULL)
+			continue;
+
+		/* bsearch() lands on any of the equal entries */
+		while (found > su_sysoid_index && !su_sysoid_cmp(found - 1, &key))
+			found--;
+		for (; found < su_sysoid_index + su_sysoid_index_count
+		    && !su_sysoid_cmp(found, &key); found++)
+			candidates[count++] = found->pos;
+	}
+
+	return count;
+}
+
+static void su_indexes_free(void)
+{
+	su_lkp_index_t	*index, *next;
+	size_t	i;
+
+	free(su_info_index);
+	su_info_index = NULL;
+	su_info_index_table = NULL;
+
+	free(su_sysoid_index);
+	su_sysoid_index = NULL;
+	su_sysoid_index_count = 0;
+
+	for (i = 0; i < SU_LKP_INDEX_HASHSIZE; i++) {
+		for (index = su_lkp_indexes[i]; index != NULL; index = next) {
+			next = index->next;
+			free(index->by_value);
+			free(index->by_name);
+			free(index);
+		}
+		su_lkp_indexes[i] = NULL;
+	}
+}
+
 snmp_info_t *su_find_info(const char *type)
 {
 	snmp_info_t *su_info_p;
+	size_t i;
 
 	if (snmp_info == NULL) {
 		fatalx(EXIT_FAILURE, "%s: snmp_info is not initialized", __func__);
@@ -1990,64 +3636,94 @@ snmp_info_t *su_find_info(const char *type)
 		upsdebugx(1, "%s: WARNING: snmp_info is empty", __func__);
 	}
 
-	for (su_info_p = &snmp_info[0]; (su_info_p != NULL && su_info_p->info_type != NULL) ; su_info_p++)
+	if (su_info_index_table != snmp_info)
+		su_info_index_build();
+
+	i = str_hash(type, 1) & (su_info_index_size - 1);
+	while ((su_info_p = su_info_index[i]) != NULL) {
 		if (!strcasecmp(su_info_p->info_type, type)) {
 			upsdebugx(3, "%s: \"%s\" found", __func__, type);
 			return su_info_p;
 		}
+		i = (i + 1) & (su_info_index_size - 1);
+	}
 
 	upsdebugx(3, "%s: unknown info type (%s)", __func__, type);
 	return NULL;
 }
 
-/* Counter match the sysOID using {device,ups}.model OID
- * Return TRUE if this OID can be retrieved, FALSE otherwise */
-static bool_t match_model_OID(void)
-{
-	bool_t retCode = FALSE;
-	snmp_info_t *su_info_p, *cur_info_p;
-	char testOID_buf[LARGEBUF];
-
-	/* Try to get device.model first */
-	su_info_p = su_find_info("device.model");
-	/* Otherwise, try to get ups.model */
-	if (su_info_p == NULL)
-		su_info_p = su_find_info("ups.model");
-
-	if (su_info_p != NULL) {
-		/* Daisychain specific: we may have a template (including formatting
-		 * string) that needs to be adapted! */
-		if (strchr(su_info_p->OID, '%') != NULL)
-		{
-			upsdebugx(2, "Found template, need to be adapted");
-			cur_info_p = (snmp_info_t *)malloc(sizeof(snmp_info_t));
-			cur_info_p->info_type = (char *)xmalloc(SU_INFOSIZE);
-			cur_info_p->OID = (char *)xmalloc(SU_INFOSIZE);
-			snprintf((char*)cur_info_p->info_type, SU_INFOSIZE, "%s", su_info_p->info_type);
-			/* Use the daisychain master (0) / 1rst device index */
-			snprintf_dynamic((char*)cur_info_p->OID, SU_INFOSIZE, su_info_p->OID, "%i", 0);
-		}
-		else {
-			upsdebugx(2, "Found entry, not a template %s", su_info_p->OID);
-			/* Otherwise, just point at what we found */
-			cur_info_p = su_info_p;
-		}
-
-		upsdebugx(2, "Testing %s using OID %s", cur_info_p->info_type, cur_info_p->OID);
-		retCode = nut_snmp_get_str(cur_info_p->OID, testOID_buf, LARGEBUF, NULL);
+/* Counter match the sysOID using {device,ups}.model OID
+ * Return TRUE if this OID can be retrieved, FALSE otherwise */
+/* Return the OID of {device,ups}.model in a mapping table, adapted for
+ * the daisychain master if it is a template, or NULL if there is none */
+static const char *su_model_OID(const snmp_info_t *table, char *buf, size_t buf_len)
+{
+	const snmp_info_t *su_info_p = NULL, *cur_info_p;
 
-		/* Free our malloc, if it was dynamic */
-		if (strchr(su_info_p->OID, '%') != NULL) {
-			if (cur_info_p->info_type != NULL)
-				free((char*)cur_info_p->info_type);
-			if (cur_info_p->OID != NULL)
-				free((char*)cur_info_p->OID);
-			if (cur_info_p != NULL)
-				free((char*)cur_info_p);
+	/* Try to get device.model first, otherwise ups.model */
+	for (cur_info_p = table; cur_info_p->info_type != NULL; cur_info_p++) {
+		if (!strcasecmp(cur_info_p->info_type, "device.model")) {
+			su_info_p = cur_info_p;
+			break;
 		}
+		if (su_info_p == NULL && !strcasecmp(cur_info_p->info_type, "ups.model"))
+			su_info_p = cur_info_p;
 	}
 
-	return retCode;
+	if (su_info_p == NULL || su_info_p->OID == NULL)
+		return NULL;
+
+	/* Daisychain specific: we may have a template (including formatting
+	 * string) that needs to be adapted! */
+	if (strchr(su_info_p->OID, '%') != NULL) {
+		upsdebugx(2, "Found template, need to be adapted");
+		/* Use the daisychain master (0) / 1rst device index */
+		snprintf_dynamic(buf, buf_len, su_info_p->OID, "%i", 0);
+		return buf;
+	}
+
+	upsdebugx(2, "Found entry, not a template %s", su_info_p->OID);
+	return su_info_p->OID;
+}
+
+/* Plan the {device,ups}.model OIDs of the given mib2nut[] entries (which
+ * were not fetched yet) and get them all in one batched request, so the
+ * match_model_OID() calls which follow are answered locally */
+static void su_prefetch_model_OIDs(const int *positions, size_t count)
+{
+	char	buf[SU_INFOSIZE];
+	const char	*OID;
+	size_t	i, from = prefetch_plan_count;
+
+	if (max_varbinds < 2)
+		return;
+
+	for (i = 0; i < count; i++) {
+		if (mib2nut[positions[i]]->snmp_info == NULL)
+			continue;
+		OID = su_model_OID(mib2nut[positions[i]]->snmp_info, buf, sizeof(buf));
+		if (OID != NULL && su_prefetch_find(OID) == NULL)
+			su_prefetch_add(OID);
+	}
+
+	if (prefetch_plan_count > from) {
+		upsdebugx(2, "%s: probing %" PRIuSIZE " mappings at once",
+			__func__, prefetch_plan_count - from);
+		su_prefetch_plan_run(from);
+	}
+}
+
+static bool_t match_model_OID(void)
+{
+	const char *OID;
+	char OID_buf[SU_INFOSIZE];
+	char testOID_buf[LARGEBUF];
+
+	if ((OID = su_model_OID(snmp_info, OID_buf, sizeof(OID_buf))) == NULL)
+		return FALSE;
+
+	upsdebugx(2, "Testing model using OID %s", OID);
+	return nut_snmp_get_str(OID, testOID_buf, LARGEBUF, NULL);
 }
 
 /* Try to find the MIB using sysOID matching.
@@ -2057,9 +3733,9 @@ static mib2nut_info_t *match_sysoid(void)
 	char sysOID_buf[LARGEBUF];
 	oid device_sysOID[MAX_OID_LEN];
 	size_t device_sysOID_len = MAX_OID_LEN;
-	oid mib2nut_sysOID[MAX_OID_LEN];
-	size_t mib2nut_sysOID_len = MAX_OID_LEN;
-	int i;
+	int *candidates;
+	size_t count, c;
+	int i, exact;
 
 	/* Retrieve sysOID value of this device */
 	if (nut_snmp_get_oid(SYSOID_OID, sysOID_buf, sizeof(sysOID_buf)) != TRUE)
@@ -2083,33 +3759,29 @@ static mib2nut_info_t *match_sysoid(void)
 		return NULL;
 	}
 
-	/* Now, iterate on mib2nut definitions */
-	for (i = 0; mib2nut[i] != NULL; i++)
+	/* Now, look up the mib2nut definitions matching this sysOID: exactly
+	 * first (as done historically), and only if none of those fits the
+	 * device, those with a sysOID which is a prefix of the device one */
+	if (su_sysoid_index == NULL)
+		su_sysoid_index_build();
+	candidates = xcalloc(su_sysoid_index_count + 1, sizeof(*candidates));
+
+	for (exact = 1; exact >= 0; exact--)
 	{
-		upsdebugx(1, "%s: checking MIB %s", __func__, mib2nut[i]->mib_name);
+		count = su_sysoid_candidates(device_sysOID, device_sysOID_len, exact, candidates);
 
-		if (mib2nut[i]->sysOID == NULL)
-			continue;
+		upsdebugx(1, "%s: %" PRIuSIZE " MIB(s) match sysOID %s %s",
+			__func__, count, sysOID_buf, exact ? "exactly" : "by a prefix");
 
-		/* Clear variables */
-		memset(mib2nut_sysOID, 0, sizeof(mib2nut_sysOID));
-		mib2nut_sysOID_len = MAX_OID_LEN;
+		/* Counter verify, using {ups,device}.model of all candidates at once */
+		su_prefetch_model_OIDs(candidates, count);
 
-		if (!read_objid(mib2nut[i]->sysOID, mib2nut_sysOID, &mib2nut_sysOID_len))
+		for (c = 0; c < count; c++)
 		{
-			upsdebugx(2, "%s: can't build OID %s: %s",
-				__func__, sysOID_buf, snmp_api_errstring(snmp_errno));
-
-			/* Try to continue anyway! */
-			continue;
-		}
+			i = candidates[c];
 
-		/* Now compare these */
-		upsdebugx(1, "%s: comparing %s with %s", __func__, sysOID_buf, mib2nut[i]->sysOID);
-		if (!netsnmp_oid_equals(device_sysOID, device_sysOID_len, mib2nut_sysOID, mib2nut_sysOID_len))
-		{
-			upsdebugx(2, "%s: sysOID matches MIB '%s'!", __func__, mib2nut[i]->mib_name);
-			/* Counter verify, using {ups,device}.model */
+			upsdebugx(2, "%s: sysOID matches MIB '%s' (%s)!",
+				__func__, mib2nut[i]->mib_name, mib2nut[i]->sysOID);
 			snmp_info = mib2nut[i]->snmp_info;
 
 			if (snmp_info == NULL) {
@@ -2134,10 +3806,17 @@ static mib2nut_info_t *match_sysoid(void)
 			else
 				upsdebugx(2, "%s: testOID provided and matches MIB '%s'!", __func__, mib2nut[i]->mib_name);
 
+			if (!exact)
+				upslogx(LOG_INFO, "Using MIB '%s' whose sysOID %s is a prefix of the device one %s",
+					mib2nut[i]->mib_name, mib2nut[i]->sysOID, sysOID_buf);
+
+			free(candidates);
 			return mib2nut[i];
 		}
 	}
 
+	free(candidates);
+
 	/* Yell all to call for user report */
 	upslogx(LOG_ERR, "No matching MIB found for sysOID '%s'!\n" \
 		"Please report it to NUT developers, with an 'upsc' output for your device.\n" \
@@ -2163,6 +3842,10 @@ bool_t load_mib2nut(const char *mib)
 		device_path /* the "port" from config section is hostname/IP for networked drivers */
 		);
 
+#ifdef WITH_SNMP_MIB_MODULES
+	su_mib_modules_load();
+#endif
+
 	/* First, try to match against sysOID, if no MIB was provided.
 	 * This should speed up init stage
 	 * (Note: sysOID points the device main MIB entry point) */
@@ -2189,6 +3872,20 @@ bool_t load_mib2nut(const char *mib)
 	/* Otherwise, revert to the classic method */
 	if (m2n == NULL)
 	{
+		if (mibIsAuto) {
+			/* Probe all the mappings in one go, rather than
+			 * one request per mapping table */
+			int	*positions;
+
+			for (i = 0; mib2nut[i] != NULL; i++)
+				;
+			positions = xcalloc((size_t)i + 1, sizeof(*positions));
+			for (i = 0; mib2nut[i] != NULL; i++)
+				positions[i] = i;
+			su_prefetch_model_OIDs(positions, (size_t)i);
+			free(positions);
+		}
+
 		for (i = 0; mib2nut[i] != NULL; i++) {
 			/* Is there already a MIB name provided? */
 			upsdebugx(4, "%s: checking against mapping table entry #%d \"%s\"",
@@ -2244,6 +3941,15 @@ bool_t load_mib2nut(const char *mib)
 		}
 	}
 
+	/* The probes are not needed anymore */
+	su_prefetch_free();
+
+#ifdef WITH_SNMP_MIB_MODULES
+	/* Nor the other mapping tables (nor what was indexed in them) */
+	su_mib_modules_unload(m2n);
+	su_indexes_free();
+#endif
+
 	/* Store the result, if any */
 	if (m2n != NULL)
 	{
@@ -2295,17 +4001,22 @@ bool_t load_mib2nut(const char *mib)
  */
 long su_find_valinfo(info_lkp_t *oid2info, const char* value)
 {
-	info_lkp_t *info_lkp;
-
-	for (info_lkp = oid2info; (info_lkp != NULL) &&
-		(strcmp(info_lkp->info_value, "NULL")); info_lkp++) {
-
-		if (!(strcmp(info_lkp->info_value, value))) {
-			upsdebugx(1, "%s: found %s (value: %s)",
-					__func__, info_lkp->info_value, value);
-
-			errno = 0;
-			return info_lkp->oid_value;
+	const info_lkp_t *info_lkp;
+	su_lkp_index_t *index;
+	size_t i;
+
+	if (oid2info != NULL) {
+		index = su_lkp_index_get(oid2info);
+		i = str_hash(value, 0) & (index->size - 1);
+		while ((info_lkp = index->by_name[i]) != NULL) {
+			if (!(strcmp(info_lkp->info_value, value))) {
+				upsdebugx(1, "%s: found %s (value: %s)",
+						__func__, info_lkp->info_value, value);
+
+				errno = 0;
+				return info_lkp->oid_value;
+			}
+			i = (i + 1) & (index->size - 1);
 		}
 	}
 
@@ -2348,7 +4059,9 @@ const char *su_find_strval(info_lkp_t *oid2info, void *value)
  */
 const char *su_find_infoval(info_lkp_t *oid2info, void *raw_value)
 {
-	info_lkp_t *info_lkp;
+	const info_lkp_t *info_lkp;
+	su_lkp_index_t *index;
+	size_t i;
 	long value = *((long *)raw_value);
 
 #if WITH_SNMP_LKP_FUN
@@ -2368,15 +4081,18 @@ const char *su_find_infoval(info_lkp_t *oid2info, void *raw_value)
 #endif /* WITH_SNMP_LKP_FUN */
 
 	/* Otherwise, use the simple values mapping */
-	for (info_lkp = oid2info; (info_lkp != NULL) &&
-		 (info_lkp->info_value != NULL) && (strcmp(info_lkp->info_value, "NULL")); info_lkp++) {
-
-		if (info_lkp->oid_value == value) {
-			upsdebugx(1, "%s: found %s (value: %ld)",
-					__func__, info_lkp->info_value, value);
-
-			errno = 0;
-			return info_lkp->info_value;
+	if (oid2info != NULL) {
+		index = su_lkp_index_get(oid2info);
+		i = (size_t)value & (index->size - 1);
+		while ((info_lkp = index->by_value[i]) != NULL) {
+			if (info_lkp->oid_value == value) {
+				upsdebugx(1, "%s: found %s (value: %ld)",
+						__func__, info_lkp->info_value, value);
+
+				errno = 0;
+				return info_lkp->info_value;
+			}
+			i = (i + 1) & (index->size - 1);
 		}
 	}
 
@@ -2664,6 +4380,262 @@ static int guesstimate_template_count(snmp_info_t *su_info_p)
 	return base_count;
 }
 
+/* Instantiated templates: the NUT variable name, OID and default value
+ * of each instance are expanded once per mapping entry, device and
+ * instance number, and reused by later walks */
+typedef struct su_instance_s {
+	const void	*key;	/* the mapping entry (or its OID template) */
+	int	device;
+	int	number;	/* instance number, -1 for daisy-chain only templates */
+	char	*info_type;
+	char	*OID;	/* NULL if the template has none */
+	char	*dfl;	/* NULL if the default is not a template */
+	int	skip;	/* not applicable to this device */
+	struct su_instance_s	*next;
+} su_instance_t;
+
+#define SU_INSTANCE_HASHSIZE	1024
+
+static su_instance_t	*su_instances[SU_INSTANCE_HASHSIZE];
+
+static su_instance_t **su_instance_slot(const void *key, int device, int number)
+{
+	size_t	hash = (size_t)key / sizeof(void *);
+	su_instance_t	**slot;
+
+	hash = hash * 31 + (size_t)device;
+	hash = hash * 31 + (size_t)number;
+	slot = &su_instances[hash % SU_INSTANCE_HASHSIZE];
+
+	while (*slot != NULL) {
+		if ((*slot)->key == key
+		 && (*slot)->device == device
+		 && (*slot)->number == number)
+			break;
+		slot = &(*slot)->next;
+	}
+
+	return slot;
+}
+
+static su_instance_t *su_instance_new(su_instance_t **slot,
+	const void *key, const snmp_info_t *info_template, int number)
+{
+	su_instance_t	*inst = xcalloc(1, sizeof(*inst));
+
+	inst->key = key;
+	inst->device = current_device_number;
+	inst->number = number;
+	inst->info_type = xcalloc(1, SU_INFOSIZE);
+	if (info_template->OID != NULL)
+		inst->OID = xcalloc(1, SU_INFOSIZE);
+	*slot = inst;
+
+	return inst;
+}
+
+static void su_instances_free(void)
+{
+	su_instance_t	*inst, *next;
+	size_t	i;
+
+	for (i = 0; i < SU_INSTANCE_HASHSIZE; i++) {
+		for (inst = su_instances[i]; inst != NULL; inst = next) {
+			next = inst->next;
+			free(inst->info_type);
+			free(inst->OID);
+			free(inst->dfl);
+			free(inst);
+		}
+		su_instances[i] = NULL;
+	}
+}
+
+/* Daisy-chain OID template (outside of process_template()), adapted
+ * for the current device as su_ups_get() needs it; keyed by the OID
+ * template, as su_ups_get() may be given a temporary mapping entry */
+static const char *su_daisy_OID(snmp_info_t *su_info_p)
+{
+	su_instance_t	**slot = su_instance_slot(su_info_p->OID, current_device_number, -1);
+	su_instance_t	*inst;
+
+	if (*slot != NULL)
+		return (*slot)->OID;
+
+	inst = su_instance_new(slot, su_info_p->OID, su_info_p, -1);
+	snprintf_dynamic(inst->OID, SU_INFOSIZE, su_info_p->OID,
+		"%i", current_device_number + device_template_offset);
+	upsdebugx(3, "%s: OID %s adapted into %s",
+		__func__, su_info_p->OID, inst->OID);
+
+	return inst->OID;
+}
+
+/* Instance number cur_template_number of a process_template() type
+ * (outlet, outlet.group, ambient, device) for the current device */
+static su_instance_t *su_template_instance(const char *type,
+	snmp_info_t *su_info_p, int cur_template_number)
+{
+	su_instance_t	**slot = su_instance_slot(su_info_p, current_device_number, cur_template_number);
+	su_instance_t	*inst;
+	int	cur_nut_index = 0;
+	char	tmp_buf[SU_INFOSIZE];
+
+	if (*slot != NULL)
+		return *slot;
+
+	inst = su_instance_new(slot, su_info_p, su_info_p, cur_template_number);
+
+	/* Special processing for daisychain:
+	 * append 'device.x' to the NUT variable name, except for the
+	 * whole daisychain ("device.0") */
+	if (!strncmp(type, "device", 6))
+	{
+		/* Device(s) 1-N (master + slave(s)) need to append 'device.x' */
+		if (current_device_number > 0) {
+			char *ptr = NULL;
+			/* Another special processing for daisychain
+			 * device collection needs special appending */
+			if (!strncmp(su_info_p->info_type, "device.", 7))
+				ptr = (char*)&su_info_p->info_type[7];
+			else
+				ptr = (char*)su_info_p->info_type;
+
+			snprintf(inst->info_type, SU_INFOSIZE,
+					"device.%i.%s", current_device_number, ptr);
+		}
+		else
+		{
+			/* Device 1 ("device.0", whole daisychain) needs no
+			 * special processing */
+			cur_nut_index = cur_template_number;
+			snprintf_dynamic(inst->info_type, SU_INFOSIZE,
+					su_info_p->info_type, "%i", cur_nut_index);
+		}
+	}
+	else if (!strncmp(type, "outlet", 6)) /* Outlet and outlet groups templates */
+	{
+		/* Get the index of the current template instance */
+		cur_nut_index = cur_template_number;
+
+		/* Special processing for daisychain */
+		if (daisychain_enabled == TRUE) {
+			/* Device(s) 1-N (master + slave(s)) need to append 'device.x' */
+			if ((devices_count > 1) && (current_device_number > 0)) {
+				memset(&tmp_buf[0], 0, SU_INFOSIZE);
+				strcat(&tmp_buf[0], "device.%i.");
+				strcat(&tmp_buf[0], su_info_p->info_type);
+
+				upsdebugx(4, "FORMATTING STRING = %s", &tmp_buf[0]);
+				snprintf_dynamic(inst->info_type, SU_INFOSIZE,
+					&tmp_buf[0], "%i%i",
+					current_device_number, cur_nut_index);
+			}
+			else {
+				/* FIXME: daisychain-whole, what to do? */
+				snprintf_dynamic(inst->info_type, SU_INFOSIZE,
+					su_info_p->info_type, "%i", cur_nut_index);
+			}
+		}
+		else {
+			snprintf_dynamic(inst->info_type, SU_INFOSIZE,
+				su_info_p->info_type, "%i", cur_nut_index);
+		}
+	}
+	else if (!strncmp(type, "ambient", 7))
+	{
+		/* FIXME: can be grouped with outlet* above */
+		/* Get the index of the current template instance */
+		cur_nut_index = cur_template_number;
+
+		/* Special processing for daisychain */
+		if (daisychain_enabled == TRUE) {
+			/* Only publish on the daisychain host */
+			if ( (su_info_p->flags & SU_TYPE_DAISY_MASTER_ONLY)
+				&& (current_device_number != 1) ) {
+					upsdebugx(2, "discarding variable due to daisychain master flag");
+					inst->skip = 1;
+					return inst;
+				}
+
+			/* Device(s) 1-N (master + slave(s)) need to append 'device.x' */
+			if ((devices_count > 1) && (current_device_number > 0)) {
+				memset(&tmp_buf[0], 0, SU_INFOSIZE);
+				strcat(&tmp_buf[0], "device.%i.");
+				strcat(&tmp_buf[0], su_info_p->info_type);
+
+				upsdebugx(4, "FORMATTING STRING = %s", &tmp_buf[0]);
+					snprintf_dynamic(inst->info_type, SU_INFOSIZE,
+						&tmp_buf[0], "%i%i",
+						current_device_number, cur_nut_index);
+			}
+			else {
+				/* FIXME: daisychain-whole, what to do? */
+				snprintf_dynamic(inst->info_type, SU_INFOSIZE,
+					su_info_p->info_type, "%i", cur_nut_index);
+			}
+		}
+		else {
+			snprintf_dynamic(inst->info_type, SU_INFOSIZE,
+				su_info_p->info_type, "%i", cur_nut_index);
+		}
+	}
+	else
+		upsdebugx(4, "Error: unknown template type '%s", type);
+
+	/* check if default value is also a template */
+	if ((su_info_p->dfl != NULL) &&
+		(strstr(su_info_p->dfl, "%i") != NULL)) {
+		inst->dfl = (char *)xcalloc(1, SU_INFOSIZE);
+		snprintf_dynamic(inst->dfl, SU_INFOSIZE, su_info_p->dfl, "%i", cur_nut_index);
+	}
+
+	if (inst->OID != NULL) {
+		/* Special processing for daisychain */
+		if (!strncmp(type, "device", 6)) {
+			if (current_device_number > 0) {
+				snprintf_dynamic(inst->OID, SU_INFOSIZE, su_info_p->OID, "%i", current_device_number + device_template_offset);
+			}
+			/*else
+			 * FIXME: daisychain-whole, what to do?
+			 */
+		}
+		else {
+			/* Special processing for daisychain:
+			 * these outlet | outlet groups also include formatting info,
+			 * so we have to check if the daisychain is enabled, and if
+			 * the formatting info for it are in 1rst or 2nd position */
+			if (daisychain_enabled == TRUE) {
+				if (su_info_p->flags & SU_TYPE_DAISY_1) {
+					snprintf_dynamic(inst->OID, SU_INFOSIZE,
+						su_info_p->OID, "%i%i",
+						current_device_number + device_template_offset,
+						cur_template_number);
+				}
+				else if (su_info_p->flags & SU_TYPE_DAISY_2) {
+					snprintf_dynamic(inst->OID, SU_INFOSIZE,
+						su_info_p->OID, "%i%i",
+						cur_template_number + device_template_offset,
+						current_device_number - device_template_offset);
+				}
+				else {
+					/* Note: no device daisychain templating (SU_TYPE_DAISY_MASTER_ONLY)! */
+					snprintf_dynamic(inst->OID, SU_INFOSIZE,
+						su_info_p->OID, "%i",
+						cur_template_number);
+				}
+			}
+			else {
+				snprintf_dynamic(inst->OID, SU_INFOSIZE,
+						su_info_p->OID, "%i",
+						cur_template_number);
+			}
+		}
+	}
+
+	return inst;
+}
+
 /* Process template definition, instantiate and get data or register
  * command
  * type: outlet, outlet.group, device */
@@ -2674,14 +4646,12 @@ static bool_t process_template(int mode, const char* type, snmp_info_t *su_info_
 	 * negative with server side data */
 	bool_t status = TRUE;
 	int cur_template_number = 1;
-	int cur_nut_index = 0;
 	int template_count = 0;
 	int base_snmp_index = 0;
 	snmp_info_t cur_info_p;
 	char template_count_var[SU_BUFSIZE * 2];
 	/* Needed *2 to fit a max size_t in snprintf() below,
 	 * even if that should never happen */
-	char tmp_buf[SU_INFOSIZE];
 
 	upsdebugx(1, "%s template definition found (%s)...", type, su_info_p->info_type);
 
@@ -2709,7 +4679,7 @@ static bool_t process_template(int mode, const char* type, snmp_info_t *su_info_
 	/* Only instantiate templates if needed! */
 	if (template_count > 0) {
 		/* general init of data using the template */
-		instantiate_info(su_info_p, &cur_info_p);
+		cur_info_p = *su_info_p;
 
 		base_snmp_index = base_snmp_template_index(su_info_p);
 
@@ -2717,152 +4687,18 @@ static bool_t process_template(int mode, const char* type, snmp_info_t *su_info_
 				cur_template_number < (template_count + base_snmp_index) ;
 				cur_template_number++)
 		{
-			upsdebugx(1, "Processing instance %i/%i...", cur_template_number, template_count);
-			/* Special processing for daisychain:
-			 * append 'device.x' to the NUT variable name, except for the
-			 * whole daisychain ("device.0") */
-			if (!strncmp(type, "device", 6))
-			{
-				/* Device(s) 1-N (master + slave(s)) need to append 'device.x' */
-				if (current_device_number > 0) {
-					char *ptr = NULL;
-					/* Another special processing for daisychain
-					 * device collection needs special appending */
-					if (!strncmp(su_info_p->info_type, "device.", 7))
-						ptr = (char*)&su_info_p->info_type[7];
-					else
-						ptr = (char*)su_info_p->info_type;
-
-					snprintf((char*)cur_info_p.info_type, SU_INFOSIZE,
-							"device.%i.%s", current_device_number, ptr);
-				}
-				else
-				{
-					/* Device 1 ("device.0", whole daisychain) needs no
-					 * special processing */
-					cur_nut_index = cur_template_number;
-					snprintf_dynamic((char*)cur_info_p.info_type, SU_INFOSIZE,
-							su_info_p->info_type, "%i", cur_nut_index);
-				}
-			}
-			else if (!strncmp(type, "outlet", 6)) /* Outlet and outlet groups templates */
-			{
-				/* Get the index of the current template instance */
-				cur_nut_index = cur_template_number;
-
-				/* Special processing for daisychain */
-				if (daisychain_enabled == TRUE) {
-					/* Device(s) 1-N (master + slave(s)) need to append 'device.x' */
-					if ((devices_count > 1) && (current_device_number > 0)) {
-						memset(&tmp_buf[0], 0, SU_INFOSIZE);
-						strcat(&tmp_buf[0], "device.%i.");
-						strcat(&tmp_buf[0], su_info_p->info_type);
-
-						upsdebugx(4, "FORMATTING STRING = %s", &tmp_buf[0]);
-						snprintf_dynamic((char*)cur_info_p.info_type, SU_INFOSIZE,
-							&tmp_buf[0], "%i%i",
-							current_device_number, cur_nut_index);
-					}
-					else {
-						/* FIXME: daisychain-whole, what to do? */
-						snprintf_dynamic((char*)cur_info_p.info_type, SU_INFOSIZE,
-							su_info_p->info_type, "%i", cur_nut_index);
-					}
-				}
-				else {
-					snprintf_dynamic((char*)cur_info_p.info_type, SU_INFOSIZE,
-						su_info_p->info_type, "%i", cur_nut_index);
-				}
-			}
-			else if (!strncmp(type, "ambient", 7))
-			{
-				/* FIXME: can be grouped with outlet* above */
-				/* Get the index of the current template instance */
-				cur_nut_index = cur_template_number;
-
-				/* Special processing for daisychain */
-				if (daisychain_enabled == TRUE) {
-					/* Only publish on the daisychain host */
-					if ( (su_info_p->flags & SU_TYPE_DAISY_MASTER_ONLY)
-						&& (current_device_number != 1) ) {
-							upsdebugx(2, "discarding variable due to daisychain master flag");
-							continue;
-						}
-
-					/* Device(s) 1-N (master + slave(s)) need to append 'device.x' */
-					if ((devices_count > 1) && (current_device_number > 0)) {
-						memset(&tmp_buf[0], 0, SU_INFOSIZE);
-						strcat(&tmp_buf[0], "device.%i.");
-						strcat(&tmp_buf[0], su_info_p->info_type);
+			su_instance_t	*inst;
 
-						upsdebugx(4, "FORMATTING STRING = %s", &tmp_buf[0]);
-							snprintf_dynamic((char*)cur_info_p.info_type, SU_INFOSIZE,
-								&tmp_buf[0], "%i%i",
-								current_device_number, cur_nut_index);
-					}
-					else {
-						/* FIXME: daisychain-whole, what to do? */
-						snprintf_dynamic((char*)cur_info_p.info_type, SU_INFOSIZE,
-							su_info_p->info_type, "%i", cur_nut_index);
-					}
-				}
-				else {
-					snprintf_dynamic((char*)cur_info_p.info_type, SU_INFOSIZE,
-						su_info_p->info_type, "%i", cur_nut_index);
-				}
-			}
-			else
-				upsdebugx(4, "Error: unknown template type '%s", type);
+			upsdebugx(1, "Processing instance %i/%i...", cur_template_number, template_count);
+			inst = su_template_instance(type, su_info_p, cur_template_number);
+			if (inst->skip)
+				continue;
 
-			/* check if default value is also a template */
-			if ((cur_info_p.dfl != NULL) &&
-				(strstr(su_info_p->dfl, "%i") != NULL)) {
-				cur_info_p.dfl = (char *)xmalloc(SU_INFOSIZE);
-				snprintf_dynamic((char *)cur_info_p.dfl, SU_INFOSIZE, su_info_p->dfl, "%i", cur_nut_index);
-			}
+			cur_info_p.info_type = inst->info_type;
+			cur_info_p.OID = inst->OID;
+			cur_info_p.dfl = (inst->dfl != NULL ? inst->dfl : su_info_p->dfl);
 
 			if (cur_info_p.OID != NULL) {
-				/* Special processing for daisychain */
-				if (!strncmp(type, "device", 6)) {
-					if (current_device_number > 0) {
-						snprintf_dynamic((char *)cur_info_p.OID, SU_INFOSIZE, su_info_p->OID, "%i", current_device_number + device_template_offset);
-					}
-					/*else
-					 * FIXME: daisychain-whole, what to do?
-					 */
-				}
-				else {
-					/* Special processing for daisychain:
-					 * these outlet | outlet groups also include formatting info,
-					 * so we have to check if the daisychain is enabled, and if
-					 * the formatting info for it are in 1rst or 2nd position */
-					if (daisychain_enabled == TRUE) {
-						if (su_info_p->flags & SU_TYPE_DAISY_1) {
-							snprintf_dynamic((char *)cur_info_p.OID, SU_INFOSIZE,
-								su_info_p->OID, "%i%i",
-								current_device_number + device_template_offset,
-								cur_template_number);
-						}
-						else if (su_info_p->flags & SU_TYPE_DAISY_2) {
-							snprintf_dynamic((char *)cur_info_p.OID, SU_INFOSIZE,
-								su_info_p->OID, "%i%i",
-								cur_template_number + device_template_offset,
-								current_device_number - device_template_offset);
-						}
-						else {
-							/* Note: no device daisychain templating (SU_TYPE_DAISY_MASTER_ONLY)! */
-							snprintf_dynamic((char *)cur_info_p.OID, SU_INFOSIZE,
-								su_info_p->OID, "%i",
-								cur_template_number);
-						}
-					}
-					else {
-						snprintf_dynamic((char *)cur_info_p.OID, SU_INFOSIZE,
-								su_info_p->OID, "%i",
-								cur_template_number);
-					}
-				}
-
 				/* add instant commands to the info database. */
 				if (SU_TYPE(su_info_p) == SU_TYPE_CMD) {
 					upsdebugx(1, "Adding template command %s", cur_info_p.info_type);
@@ -2879,12 +4715,6 @@ static bool_t process_template(int mode, const char* type, snmp_info_t *su_info_
 			/* set back the flag */
 			su_info_p->flags = cur_info_p.flags;
 		}
-		free((char*)cur_info_p.info_type);
-		if (cur_info_p.OID != NULL)
-			free((char*)cur_info_p.OID);
-		if ((cur_info_p.dfl != NULL) &&
-			(strstr(su_info_p->dfl, "%i") != NULL))
-			free((char*)cur_info_p.dfl);
 	}
 	else {
 		upsdebugx(1, "No %s present, discarding template definition...", type);
@@ -2976,12 +4806,21 @@ bool_t get_and_process_data(int mode, snmp_info_t *su_info_p)
 			disable_competition(su_info_p);
 			su_info_p->flags &= ~SU_FLAG_UNIQUE;
 		}
-		dstate_dataok();
+		/* a time-limited walk only tells when it is complete */
+		if (poll_deadline == 0)
+			dstate_dataok();
 	} else {
 		if (mode == SU_WALKMODE_INIT) {
 			/* handle unsupported vars */
 			upsdebugx(4, "%s: Disabling var '%s'", __func__, su_info_p->info_type);
 			su_info_p->flags &= ~SU_FLAG_OK;
+		} else if (su_poll_expired()) {
+			/* Not fetched in time (snmp_poll_timeout) */
+			upsdebugx(2, "%s: %s not fetched in time",
+				__func__, su_info_p->info_type);
+			if (su_trap_status_entry(su_info_p))
+				walk_status_missed = 1;
+			dstate_datastale();
 		} else	{
 			if (!(su_info_p->flags & SU_FLAG_STALE)) {
 				upslogx(LOG_INFO, "[%s] snmp_ups_walk: data stale for %s",
@@ -3263,6 +5102,113 @@ static int process_phase_data(const char* type, long *nb_phases, snmp_info_t *su
 
 
 /* walk ups variables and set elements of the info array. */
+/* Plan the instances of a template (outlet, outlet.group, ambient):
+ * a table column indexed by the last OID component is fetched with
+ * GETBULK (SNMPv2c/v3), other templates are added to the GET plan */
+static void su_prefetch_template(snmp_info_t *su_info_p)
+{
+	const char	*type, *count_str, *fmt;
+	char	count_var[SU_BUFSIZE * 2], buf[SU_INFOSIZE];
+	int	count, base, i;
+
+	/* Daisy-chained tables are left to separate requests */
+	if (is_multiple_template(su_info_p->OID) == TRUE)
+		return;
+
+	if (su_info_p->flags & SU_OUTLET_GROUP) {
+		type = "outlet.group";
+		base = outletgroup_template_index_base;
+	} else if (su_info_p->flags & SU_OUTLET) {
+		type = "outlet";
+		base = outlet_template_index_base;
+	} else {
+		type = "ambient";
+		base = ambient_template_index_base;
+	}
+
+	if ((devices_count > 1) && (current_device_number > 0)) {
+		snprintf(count_var, sizeof(count_var), "device.%i.%s.count", current_device_number, type);
+	} else {
+		snprintf(count_var, sizeof(count_var), "%s.count", type);
+	}
+
+	/* Not known before the first (init) walk has found them */
+	if ((count_str = dstate_getinfo(count_var)) == NULL
+	 || (count = atoi(count_str)) < 1)
+		return;
+
+	fmt = strstr(su_info_p->OID, "%i");
+	if (fmt != NULL && fmt[2] == '\0' && fmt > su_info_p->OID && fmt[-1] == '.'
+	 && g_snmp_sess_p->version != SNMP_VERSION_1
+	) {
+		size_t	len = (size_t)(fmt - su_info_p->OID) - 1;
+
+		if (len < sizeof(buf)) {
+			memcpy(buf, su_info_p->OID, len);
+			buf[len] = '\0';
+			/* Rows may be indexed from 0 or 1 */
+			su_prefetch_add_column(buf, count + (base < 0 ? 1 : base));
+			return;
+		}
+	}
+
+	if (base < 0)
+		return;
+
+	for (i = base; i < base + count; i++) {
+		su_instance_t	*inst = su_template_instance(type, su_info_p, i);
+
+		if (!inst->skip && inst->OID != NULL && *inst->OID)
+			su_prefetch_add(inst->OID);
+	}
+}
+
+/* Fetch in advance what the walk of the current device is going to get,
+ * skipping the same entries as snmp_ups_walk() does */
+static void su_prefetch_walk(int mode)
+{
+	snmp_info_t	*su_info_p;
+
+	su_prefetch_free();
+
+	if (max_varbinds < 2 || snmp_info == NULL)
+		return;
+
+	for (su_info_p = &snmp_info[0]; su_info_p->info_type != NULL; su_info_p++) {
+		if (su_info_p->OID == NULL
+		 || (SU_TYPE(su_info_p) == SU_TYPE_CMD)
+		 || (su_info_p->flags & SU_FLAG_ABSENT)
+		)
+			continue;
+
+		if (mode == SU_WALKMODE_UPDATE) {
+			if (!(su_info_p->flags & SU_FLAG_OK)
+			 || (su_info_p->flags & SU_FLAG_STATIC)
+			 || ((su_info_p->flags & SU_FLAG_SEMI_STATIC) && semistatic_countdown != 0)
+			)
+				continue;
+		}
+
+		if (su_info_p->flags & (SU_OUTLET | SU_OUTLET_GROUP | SU_AMBIENT_TEMPLATE)) {
+			su_prefetch_template(su_info_p);
+		}
+		else if (strchr(su_info_p->OID, '%') != NULL) {
+			/* Daisy-chain template, as adapted by su_ups_get() */
+			const char	*OID = su_daisy_OID(su_info_p);
+
+			if (*OID)
+				su_prefetch_add(OID);
+		}
+		else {
+			su_prefetch_add(su_info_p->OID);
+		}
+	}
+
+	su_prefetch_plan_run(0);
+
+	upsdebugx(2, "%s: got %" PRIuSIZE " values in advance", __func__, prefetch_count);
+}
+
 bool_t snmp_ups_walk(int mode)
 {
 	long *walked_input_phases, *walked_output_phases, *walked_bypass_phases;
@@ -3271,7 +5217,10 @@ bool_t snmp_ups_walk(int mode)
 	static unsigned long	iterations = 0;
 #endif
 	snmp_info_t *su_info_p;
-	bool_t status = FALSE;
+	bool_t status = FALSE, got_data = FALSE;
+
+	walk_cut_short = 0;
+	walk_status_missed = 0;
 
 	if (mode == SU_WALKMODE_UPDATE) {
 		/* Below we skip semi-static elements in update mode:
@@ -3311,6 +5260,10 @@ bool_t snmp_ups_walk(int mode)
 		if (devices_count > 1)
 			device_alarm_init();
 
+		/* batch the requests for what this device walk will get */
+		if (!(current_device_number == 0 && daisychain_enabled == TRUE))
+			su_prefetch_walk(mode);
+
 		/* better safe than sorry, check sanity on every loop cycle */
 		if (snmp_info == NULL) {
 			fatalx(EXIT_FAILURE, "%s: snmp_info is not initialized", __func__);
@@ -3355,9 +5308,23 @@ bool_t snmp_ups_walk(int mode)
 			/* Check if we are asked to stop (reactivity++) */
 			if (exit_flag != 0) {
 				upsdebugx(1, "%s: aborting because exit_flag was set", __func__);
+				su_prefetch_free();
 				return TRUE;
 			}
 
+			/* Out of time (snmp_poll_timeout): the data is stale,
+			 * see upsdrv_updateinfo() */
+			if (mode == SU_WALKMODE_UPDATE && su_poll_expired()) {
+				walk_cut_short = 1;
+				for (; su_info_p->info_type != NULL; su_info_p++) {
+					if ((su_info_p->flags & SU_FLAG_OK)
+					&&  su_trap_status_entry(su_info_p)
+					)
+						walk_status_missed = 1;
+				}
+				break;
+			}
+
 			/* Skip daisychain data count */
 			if (mode == SU_WALKMODE_INIT &&
 				(!strncmp(su_info_p->info_type, "device.count", 12)))
@@ -3503,11 +5470,18 @@ bool_t snmp_ups_walk(int mode)
 				}
 */
 			}
+
+			if (status == TRUE)
+				got_data = TRUE;
 		}	/* for (su_info_p... */
 
+		su_prefetch_free();
+
 		if (devices_count > 1) {
-			/* commit the device alarm buffer */
-			device_alarm_commit(current_device_number);
+			/* commit the device alarm buffer, unless the walk
+			 * was cut short before all of it was collected */
+			if (!walk_cut_short)
+				device_alarm_commit(current_device_number);
 
 			/* reinit the alarm buffer, after, not to pollute "device.0" */
 			device_alarm_init();
@@ -3518,6 +5492,10 @@ bool_t snmp_ups_walk(int mode)
 	iterations++;
 #endif
 
+	/* The agent answered, even if not in time for the last entry */
+	if (walk_cut_short && got_data)
+		return TRUE;
+
 	return status;
 }
 
@@ -3534,7 +5512,7 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 	int index = 0;
 	char *format_char = NULL;
 	int saved_current_device_number = -1;
-	snmp_info_t *tmp_info_p = NULL;
+	snmp_info_t daisy_info;
 
 	upsdebugx(2, "%s: %s %s", __func__, su_info_p->info_type, su_info_p->OID);
 
@@ -3542,43 +5520,10 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 	if (su_info_p->OID != NULL
 	&&  (format_char = strchr(su_info_p->OID, '%')) != NULL
 	) {
-		upsdebugx(3, "%s: calling instantiate_info() for "
-			"daisy-chain template", __func__);
-		tmp_info_p = instantiate_info(su_info_p, tmp_info_p);
-		if (tmp_info_p != NULL) {
-			upsdebugx(3, "%s: instantiate_info() returned "
-				"non-null OID: %s",
-				__func__, tmp_info_p->OID);
-			/* adapt the OID */
-			if (su_info_p->OID != NULL) {
-				snprintf_dynamic((char *)tmp_info_p->OID, SU_INFOSIZE, su_info_p->OID,
-					"%i", current_device_number + device_template_offset);
-				upsdebugx(3, "%s: OID %s adapted into %s",
-					__func__, su_info_p->OID,
-					tmp_info_p->OID);
-			}
-			else {
-				free_info(tmp_info_p);
-				return FALSE;
-			}
-
-			/* adapt info_type */
-			if (su_info_p->info_type != NULL) {
-				snprintf((char *)tmp_info_p->info_type,
-					SU_INFOSIZE, "%s",
-					su_info_p->info_type);
-			}
-			else {
-				free_info(tmp_info_p);
-				return FALSE;
-			}
-
-			su_info_p = tmp_info_p;
-		}
-		else {
-			upsdebugx(2, "%s: can't instantiate template", __func__);
-			return FALSE;
-		}
+		/* a copy with the adapted OID (and its own flags) */
+		daisy_info = *su_info_p;
+		daisy_info.OID = (char *)su_daisy_OID(su_info_p);
+		su_info_p = &daisy_info;
 	}
 	else {
 		/* Non-templated OID, still may be aimed at a
@@ -3616,6 +5561,8 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 		}
 	}
 
+	su_absent_exempt(su_info_p);
+
 	if (!strcasecmp(su_info_p->info_type, "ups.status")) {
 /* FIXME: daisychain status support! */
 		upsdebugx(2, "%s: requesting nut_snmp_get_int() for "
@@ -3630,7 +5577,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 		else
 			upsdebugx(2, "=> Failed");
 
-		free_info(tmp_info_p);
 		return status;
 	}
 
@@ -3652,7 +5598,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 		}
 		else upsdebugx(2, "=> Failed");
 
-		free_info(tmp_info_p);
 		return status;
 	}
 
@@ -3723,7 +5668,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 			upsdebugx(2, "=> Failed");
 		}
 
-		free_info(tmp_info_p);
 		return status;
 	}
 
@@ -3737,7 +5681,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 		status = nut_snmp_get_int(su_info_p->OID, &value);
 
 		if(status != TRUE) {
-			free_info(tmp_info_p);
 			return status;
 		}
 
@@ -3761,7 +5704,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 		snprintf(buf, sizeof(buf), "%.1f", temp);
 		su_setinfo(su_info_p, buf);
 
-		free_info(tmp_info_p);
 		return TRUE;
 	}
 
@@ -3808,7 +5750,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 					disable_competition(su_info_p);
 					su_info_p->flags &= ~SU_FLAG_UNIQUE;
 				}
-				free_info(tmp_info_p);
 				return FALSE;
 			}
 			/* Check if there is a value to be looked up */
@@ -3843,7 +5784,6 @@ bool_t su_ups_get(snmp_info_t *su_info_p)
 		upsdebugx(2, "=> Failed");
 	}
 
-	free_info(tmp_info_p);
 	return status;
 }
 
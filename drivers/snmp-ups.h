@@ -139,6 +139,11 @@
 #define DEFAULT_NETSNMP_RETRIES   5
 #define DEFAULT_NETSNMP_TIMEOUT   1    /* in seconds */
 #define DEFAULT_SEMISTATICFREQ    10   /* in snmpwalk update cycles */
+#define DEFAULT_MAXVARBINDS       16   /* per batched GET/GETBULK request */
+#define DEFAULT_MAXINFLIGHT       1    /* batched requests sent at once */
+#define DEFAULT_ABSENTBACKOFF     0    /* in seconds, 0 to disable */
+#define DEFAULT_MAXRATE           0    /* requests per second, 0 for no limit */
+#define DEFAULT_POLLTIMEOUT       0    /* in seconds, 0 for no limit */
 
 /* use explicit booleans */
 #ifndef FALSE
@@ -371,6 +376,12 @@ typedef struct {
 #define SU_VAR_SEMISTATICFREQ	"semistaticfreq"
 #define SU_VAR_MIBS			"mibs"
 #define SU_VAR_POLLFREQ		"pollfreq"
+#define SU_VAR_MAXVARBINDS	"snmp_max_varbinds"
+#define SU_VAR_MAXINFLIGHT	"snmp_max_inflight"
+#define SU_VAR_ABSENTBACKOFF	"snmp_absent_backoff"
+#define SU_VAR_MAXRATE		"snmp_max_rate"
+#define SU_VAR_POLLTIMEOUT	"snmp_poll_timeout"
+#define SU_VAR_TRAPLISTEN	"snmp_trap_listen"
 /* SNMP v3 related parameters */
 #define SU_VAR_SECLEVEL		"secLevel"
 #define SU_VAR_SECNAME		"secName"
@@ -492,6 +503,11 @@ extern int g_pwr_battery;
 extern int pollfreq; /* polling frequency */
 extern int input_phases, output_phases, bypass_phases;
 extern int semistaticfreq; /* semistatic entry update frequency */
+extern int max_varbinds; /* batched request size, 1 to disable batching */
+extern int max_inflight; /* batched requests sent asynchronously at once */
+extern int absent_backoff; /* seconds to skip OIDs the agent rejected, 0 to disable */
+extern int max_rate; /* requests sent per second, 0 for no limit */
+extern int poll_timeout; /* seconds allowed for an update walk, 0 for no limit */
 
 /* pointer to the Snmp2Nut lookup table */
 extern mib2nut_info_t *mib2nut_info;
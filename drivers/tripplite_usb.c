@@ -137,7 +137,7 @@
 #include "usb-common.h"
 
 #define DRIVER_NAME	"Tripp Lite OMNIVS / SMARTPRO driver"
-#define DRIVER_VERSION	"0.41"
+#define DRIVER_VERSION	"0.42"
 
 /* driver description structure */
 upsdrv_info_t	upsdrv_info = {
@@ -389,6 +389,13 @@ static int reconnect_ups(void)
 		return 1;
 	}
 
+	/* no use scanning the buses while the device is away */
+	if (!nut_libusb_reopen_due()) {
+		upslogx(LOG_INFO, "UPS not attached; will retry later...");
+		dstate_datastale();
+		return 0;
+	}
+
 	dstate_setinfo("driver.state", "reconnect.trying");
 
 	upsdebugx(2, "==================================================");
@@ -0,0 +1,375 @@
+/* usb-cache.c - short-lived cache of enumerated USB devices and their
+ * string descriptors, shared by the USB drivers and nut-scanner
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include "config.h"	/* must be first */
+#include "common.h"
+#include "usb-cache.h"
+
+#include <stdio.h>
+
+/* The file holds a header line, then a line per device with tab-separated
+ * fields: bus, device address, VendorID, ProductID, bcdDevice, the time
+ * the strings were read, then the Manufacturer, Product and Serial Number
+ * strings (empty if none), with backslash, tab and newlines escaped. */
+#define USB_CACHE_HEADER	"# NUT USB scan cache 1\n"
+#define USB_CACHE_FIELDS	9
+#define USB_CACHE_MAX_ENTRIES	256
+
+static int usb_cache_path(char *buf, size_t buflen)
+{
+	int	ret = snprintf(buf, buflen, "%s/%s",
+		dflt_statepath(), NUT_USB_SCAN_CACHE_FILE);
+
+	return (ret > 0 && (size_t)ret < buflen);
+}
+
+static int usb_cache_fresh(const nut_usb_cache_t *cache, time_t stamp, time_t now)
+{
+	/* entries from the future are suspect too */
+	return (stamp <= now && now - stamp < cache->maxage);
+}
+
+static void usb_cache_entry_free(nut_usb_cache_entry_t *entry)
+{
+	free(entry->Vendor);
+	free(entry->Product);
+	free(entry->Serial);
+	memset(entry, 0, sizeof(*entry));
+}
+
+static char *usb_cache_strdup(const char *s)
+{
+	return (s && *s) ? xstrdup(s) : NULL;
+}
+
+static void usb_cache_write_string(FILE *f, const char *s)
+{
+	fputc('\t', f);
+
+	for (; s && *s; s++) {
+		switch (*s) {
+		case '\\':
+			fputs("\\\\", f);
+			break;
+		case '\t':
+			fputs("\\t", f);
+			break;
+		case '\n':
+			fputs("\\n", f);
+			break;
+		case '\r':
+			fputs("\\r", f);
+			break;
+		default:
+			fputc(*s, f);
+		}
+	}
+}
+
+/* unescape s in place */
+static void usb_cache_read_string(char *s)
+{
+	char	*d = s;
+
+	for (; *s; s++) {
+		if (*s == '\\' && s[1]) {
+			s++;
+			switch (*s) {
+			case 't':
+				*d++ = '\t';
+				break;
+			case 'n':
+				*d++ = '\n';
+				break;
+			case 'r':
+				*d++ = '\r';
+				break;
+			default:
+				*d++ = *s;
+			}
+		} else {
+			*d++ = *s;
+		}
+	}
+
+	*d = '\0';
+}
+
+/* split line into fields at tabs, returns their count */
+static size_t usb_cache_split(char *line, char **field, size_t maxfields)
+{
+	size_t	count = 0;
+	char	*p;
+
+	line[strcspn(line, "\r\n")] = '\0';
+
+	while (count < maxfields) {
+		field[count++] = line;
+		if ((p = strchr(line, '\t')) == NULL) {
+			break;
+		}
+		*p = '\0';
+		line = p + 1;
+	}
+
+	return count;
+}
+
+void nut_usb_cache_load(nut_usb_cache_t *cache)
+{
+	char	fn[NUT_PATH_MAX + 1], line[LARGEBUF * 2];
+	char	*field[USB_CACHE_FIELDS];
+	const char	*s;
+	long	maxage = NUT_USB_SCAN_CACHE_MAXAGE;
+	time_t	now = time(NULL);
+	FILE	*f;
+
+	memset(cache, 0, sizeof(*cache));
+
+	if ((s = getenv("NUT_USB_SCAN_CACHE")) != NULL
+	 && (!str_to_long(s, &maxage, 10) || maxage < 0)
+	) {
+		upsdebugx(1, "%s: bad NUT_USB_SCAN_CACHE value '%s', using %d",
+			__func__, s, NUT_USB_SCAN_CACHE_MAXAGE);
+		maxage = NUT_USB_SCAN_CACHE_MAXAGE;
+	}
+
+	cache->maxage = (time_t)maxage;
+	if (!cache->maxage || !usb_cache_path(fn, sizeof(fn))) {
+		upsdebugx(3, "%s: USB scan cache disabled", __func__);
+		cache->maxage = 0;
+		return;
+	}
+
+	cache->use = 1;
+
+	if ((f = fopen(fn, "r")) == NULL) {
+		upsdebugx(3, "%s: no USB scan cache at %s", __func__, fn);
+		return;
+	}
+
+	if (!fgets(line, sizeof(line), f) || strcmp(line, USB_CACHE_HEADER)) {
+		upsdebugx(1, "%s: ignoring %s, not a USB scan cache", __func__, fn);
+		fclose(f);
+		return;
+	}
+
+	while (fgets(line, sizeof(line), f) && cache->count < USB_CACHE_MAX_ENTRIES) {
+		unsigned int	bus, device, vid, pid, bcd;
+		long	stamp;
+		nut_usb_cache_entry_t	*entry;
+
+		if (usb_cache_split(line, field, USB_CACHE_FIELDS) != USB_CACHE_FIELDS
+		 || !str_to_uint(field[0], &bus, 10) || bus > UINT8_MAX
+		 || !str_to_uint(field[1], &device, 10) || !device || device > UINT8_MAX
+		 || !str_to_uint(field[2], &vid, 16) || vid > UINT16_MAX
+		 || !str_to_uint(field[3], &pid, 16) || pid > UINT16_MAX
+		 || !str_to_uint(field[4], &bcd, 16) || bcd > UINT16_MAX
+		 || !str_to_long(field[5], &stamp, 10)
+		) {
+			upsdebugx(1, "%s: ignoring a malformed line of %s", __func__, fn);
+			continue;
+		}
+
+		if (!usb_cache_fresh(cache, (time_t)stamp, now)) {
+			continue;
+		}
+
+		if (cache->count == cache->size) {
+			cache->size = cache->size ? cache->size * 2 : 16;
+			cache->entries = xrealloc(cache->entries,
+				cache->size * sizeof(*cache->entries));
+		}
+
+		entry = &cache->entries[cache->count++];
+		memset(entry, 0, sizeof(*entry));
+		entry->bus = (uint8_t)bus;
+		entry->device = (uint8_t)device;
+		entry->VendorID = (uint16_t)vid;
+		entry->ProductID = (uint16_t)pid;
+		entry->bcdDevice = (uint16_t)bcd;
+		entry->stamp = (time_t)stamp;
+
+		usb_cache_read_string(field[6]);
+		usb_cache_read_string(field[7]);
+		usb_cache_read_string(field[8]);
+		entry->Vendor = usb_cache_strdup(field[6]);
+		entry->Product = usb_cache_strdup(field[7]);
+		entry->Serial = usb_cache_strdup(field[8]);
+	}
+
+	fclose(f);
+
+	upsdebugx(2, "%s: loaded %" PRIuSIZE " fresh device(s) from %s",
+		__func__, cache->count, fn);
+}
+
+static nut_usb_cache_entry_t *usb_cache_lookup(nut_usb_cache_t *cache,
+	uint8_t bus, uint8_t device)
+{
+	size_t	i;
+
+	for (i = 0; i < cache->count; i++) {
+		if (cache->entries[i].bus == bus && cache->entries[i].device == device) {
+			return &cache->entries[i];
+		}
+	}
+
+	return NULL;
+}
+
+const nut_usb_cache_entry_t *nut_usb_cache_find(nut_usb_cache_t *cache,
+	uint8_t bus, uint8_t device,
+	uint16_t VendorID, uint16_t ProductID, uint16_t bcdDevice)
+{
+	nut_usb_cache_entry_t	*entry;
+
+	if (!cache->use || !device) {
+		return NULL;
+	}
+
+	entry = usb_cache_lookup(cache, bus, device);
+	if (!entry
+	 || entry->VendorID != VendorID
+	 || entry->ProductID != ProductID
+	 || entry->bcdDevice != bcdDevice
+	 || !usb_cache_fresh(cache, entry->stamp, time(NULL))
+	) {
+		return NULL;
+	}
+
+	return entry;
+}
+
+void nut_usb_cache_update(nut_usb_cache_t *cache,
+	uint8_t bus, uint8_t device,
+	uint16_t VendorID, uint16_t ProductID, uint16_t bcdDevice,
+	const char *Vendor, const char *Product, const char *Serial)
+{
+	nut_usb_cache_entry_t	*entry;
+
+	if (!cache->maxage || !device) {
+		return;
+	}
+
+	if ((entry = usb_cache_lookup(cache, bus, device)) != NULL) {
+		usb_cache_entry_free(entry);
+	} else {
+		if (cache->count >= USB_CACHE_MAX_ENTRIES) {
+			return;
+		}
+		if (cache->count == cache->size) {
+			cache->size = cache->size ? cache->size * 2 : 16;
+			cache->entries = xrealloc(cache->entries,
+				cache->size * sizeof(*cache->entries));
+		}
+		entry = &cache->entries[cache->count++];
+	}
+
+	entry->bus = bus;
+	entry->device = device;
+	entry->VendorID = VendorID;
+	entry->ProductID = ProductID;
+	entry->bcdDevice = bcdDevice;
+	entry->stamp = time(NULL);
+	entry->Vendor = usb_cache_strdup(Vendor);
+	entry->Product = usb_cache_strdup(Product);
+	entry->Serial = usb_cache_strdup(Serial);
+
+	cache->dirty = 1;
+}
+
+void nut_usb_cache_save(nut_usb_cache_t *cache)
+{
+	char	fn[NUT_PATH_MAX + 1], tmpfn[NUT_PATH_MAX + 16];
+	time_t	now = time(NULL);
+	size_t	i;
+	FILE	*f;
+	int	ok = 1;
+
+	if (!cache->maxage || !cache->dirty || !usb_cache_path(fn, sizeof(fn))) {
+		return;
+	}
+
+	/* concurrent writers each use their own temporary file,
+	 * the last one renamed wins; readable by the drivers run
+	 * as another user than nut-scanner */
+	if ((f = fopen_tmp_sibling(fn, tmpfn, sizeof(tmpfn), 0644)) == NULL) {
+		upsdebug_with_errno(1, "%s: can't create a temporary file for %s", __func__, fn);
+		return;
+	}
+
+	fputs(USB_CACHE_HEADER, f);
+
+	for (i = 0; i < cache->count; i++) {
+		const nut_usb_cache_entry_t	*entry = &cache->entries[i];
+
+		if (!usb_cache_fresh(cache, entry->stamp, now)) {
+			continue;
+		}
+
+		fprintf(f, "%03u\t%03u\t%04x\t%04x\t%04x\t%ld",
+			(unsigned int)entry->bus, (unsigned int)entry->device,
+			(unsigned int)entry->VendorID, (unsigned int)entry->ProductID,
+			(unsigned int)entry->bcdDevice, (long)entry->stamp);
+		usb_cache_write_string(f, entry->Vendor);
+		usb_cache_write_string(f, entry->Product);
+		usb_cache_write_string(f, entry->Serial);
+		fputc('\n', f);
+	}
+
+	if (ferror(f)) {
+		ok = 0;
+	}
+
+	if (fclose(f) != 0) {
+		ok = 0;
+	}
+
+	if (!ok) {
+		upsdebug_with_errno(1, "%s: can't write %s", __func__, tmpfn);
+		unlink(tmpfn);
+		return;
+	}
+
+#ifdef WIN32
+	/* rename() does not replace an existing file here */
+	unlink(fn);
+#endif	/* WIN32 */
+
+	if (rename(tmpfn, fn) != 0) {
+		upsdebug_with_errno(1, "%s: can't rename %s to %s", __func__, tmpfn, fn);
+		unlink(tmpfn);
+		return;
+	}
+
+	cache->dirty = 0;
+	upsdebugx(2, "%s: saved %s", __func__, fn);
+}
+
+void nut_usb_cache_free(nut_usb_cache_t *cache)
+{
+	size_t	i;
+
+	for (i = 0; i < cache->count; i++) {
+		usb_cache_entry_free(&cache->entries[i]);
+	}
+
+	free(cache->entries);
+	memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,86 @@
+/* usb-cache.h - short-lived cache of enumerated USB devices and their
+ * string descriptors, shared by the USB drivers and nut-scanner
+ *
+ * Matching a USB device against the driver configuration needs its
+ * Manufacturer, Product and Serial Number strings, which can only be
+ * read by opening the device. When many drivers are started in a row
+ * (e.g. by `upsdrvctl start`), each of them would open every device on
+ * the buses to read those. Instead, the strings read by one process are
+ * kept for a little while in a file under the state path, keyed by the
+ * location and identity of the device, so the next processes can tell
+ * a device is not theirs without opening it.
+ *
+ * The cached strings are only ever used to skip a device: one which
+ * seems to match is still opened and its strings read anew.
+ *
+ * The entries are trusted for NUT_USB_SCAN_CACHE_MAXAGE seconds, or as
+ * many as the NUT_USB_SCAN_CACHE environment variable says (0 disables
+ * the cache).
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef NUT_USB_CACHE_H
+#define NUT_USB_CACHE_H
+
+#include "nut_stdint.h"	/* for uint16_t etc. */
+
+#include <time.h>
+
+#define NUT_USB_SCAN_CACHE_FILE	"usb-scan.cache"
+#define NUT_USB_SCAN_CACHE_MAXAGE	60
+
+typedef struct nut_usb_cache_entry_s {
+	uint8_t	bus;
+	uint8_t	device;	/* device address on the bus */
+	uint16_t	VendorID;
+	uint16_t	ProductID;
+	uint16_t	bcdDevice;
+	time_t	stamp;	/* when the strings were read from the device */
+	char	*Vendor;	/* string descriptors, NULL if none */
+	char	*Product;
+	char	*Serial;
+} nut_usb_cache_entry_t;
+
+typedef struct nut_usb_cache_s {
+	nut_usb_cache_entry_t	*entries;
+	size_t	count;
+	size_t	size;
+	time_t	maxage;	/* 0 if the cache is disabled */
+	int	use;	/* whether nut_usb_cache_find() may return entries */
+	int	dirty;	/* whether entries were updated since loading */
+} nut_usb_cache_t;
+
+/* Load the fresh entries of the cache file, if the cache is enabled */
+void nut_usb_cache_load(nut_usb_cache_t *cache);
+
+/* The fresh entry for the device with this location and identity, if any.
+ * The device address must be known (non-zero) for the device to be cached. */
+const nut_usb_cache_entry_t *nut_usb_cache_find(nut_usb_cache_t *cache,
+	uint8_t bus, uint8_t device,
+	uint16_t VendorID, uint16_t ProductID, uint16_t bcdDevice);
+
+/* Record the strings just read from the device */
+void nut_usb_cache_update(nut_usb_cache_t *cache,
+	uint8_t bus, uint8_t device,
+	uint16_t VendorID, uint16_t ProductID, uint16_t bcdDevice,
+	const char *Vendor, const char *Product, const char *Serial);
+
+/* Replace the cache file with the fresh entries, if any were updated */
+void nut_usb_cache_save(nut_usb_cache_t *cache);
+
+void nut_usb_cache_free(nut_usb_cache_t *cache);
+
+#endif	/* NUT_USB_CACHE_H */
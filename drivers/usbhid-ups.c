@@ -29,11 +29,14 @@
  */
 
 #define DRIVER_NAME	"Generic HID driver"
-#define DRIVER_VERSION	"0.68"
+#define DRIVER_VERSION	"0.70"
 
 #define HU_VAR_WAITBEFORERECONNECT "waitbeforereconnect"
 
 #include "main.h"	/* Must be first, includes "config.h" */
+
+#include <ctype.h>	/* for tolower() */
+
 #include "nut_stdint.h"
 #include "nut_float.h"
 #include "libhid.h"
@@ -129,6 +132,7 @@ static HIDDevice_t curDevice = { 0x0000, 0x0000, NULL, NULL, NULL, NULL, 0, NULL
 #endif
 };
 static HIDDeviceMatcher_t *subdriver_matcher = NULL;
+static uint16_t bound_bcdDevice = 0;	/* release of the device parsed by callback() */
 #if !((defined SHUT_MODE) && SHUT_MODE)
 static HIDDeviceMatcher_t *exact_matcher = NULL;
 static HIDDeviceMatcher_t *regex_matcher = NULL;
@@ -257,6 +261,12 @@ static void process_boolean_info(const char *nutvalue);
 static void ups_alarm_set(void);
 static void ups_status_set(void);
 static bool_t hid_ups_walk(walkmode_t mode);
+static bool_t hid_ups_walk_plan(walkmode_t mode);
+static void hu_plan_build(void);
+static void hu_plan_free(void);
+static void hu_indexes_build(void);
+static void hu_indexes_free(void);
+static void hu_mapping_reset(void);
 static int reconnect_ups(void);
 static int ups_infoval_set(hid_info_t *item, double value);
 static int callback(hid_dev_handle_t argudev, HIDDevice_t *arghd,
@@ -1311,6 +1321,10 @@ void upsdrv_makevartable(void)
 
 	addvar(VAR_FLAG, "pollonly", "Don't use interrupt pipe, only use polling (recommended for CPS devices)");
 
+#ifdef NUT_LIBUSB_HAVE_INTERRUPT_ASYNC
+	addvar(VAR_FLAG, "syncinterrupt", "Wait for interrupt reports during each poll, rather than keep a transfer submitted for them");
+#endif
+
 	addvar(VAR_VALUE, "interrupt_pipe_no_events_tolerance", "How many times in a row do we tolerate \"Got 0 HID objects\" from USB interrupts?");
 
 	addvar(VAR_FLAG, "onlinedischarge",
@@ -1364,14 +1378,26 @@ void upsdrv_makevartable(void)
 }
 
 #define	MAX_EVENT_NUM	32
+#define	MAX_REPORT_NUM	16	/* interrupt reports handled per update */
+
+/* Are more interrupt reports already received? (see libusb1.c) */
+static int interrupt_reports_pending(void)
+{
+#ifdef NUT_LIBUSB_HAVE_INTERRUPT_ASYNC
+	return (use_interrupt_pipe == TRUE && nut_libusb_interrupt_pending() > 0);
+#else
+	return 0;
+#endif
+}
 
 void upsdrv_updateinfo(void)
 {
 	hid_info_t	*item;
 	HIDData_t	*event[MAX_EVENT_NUM], *found_data;
-	int		i, evtCount;
+	int		i, evtCount, reports;
 	double		value;
 	time_t		now;
+	int		reopen_due;
 
 	upsdebugx(1, "upsdrv_updateinfo...");
 
@@ -1379,8 +1405,21 @@ void upsdrv_updateinfo(void)
 
 	/* check for device availability to set datastale! */
 	if (hd == NULL) {
-		/* don't flood reconnection attempts */
-		if (now < (lastpoll + poll_interval)) {
+#if !((defined SHUT_MODE) && SHUT_MODE)
+		reopen_due = nut_libusb_reopen_due();
+#else	/* SHUT_MODE */
+		reopen_due = 1;
+#endif	/* SHUT_MODE / USB */
+
+		/* reconnect as soon as the device arrived again, but
+		 * otherwise don't flood reconnection attempts: every
+		 * poll_interval, or (only while hotplug events are being
+		 * watched) when nut_libusb_reopen_due() says a rescan of
+		 * the buses is worth it. Meanwhile, the data are stale. */
+		if (reopen_due < 2
+		&& (reopen_due == 0 || now < (lastpoll + poll_interval))
+		) {
+			dstate_datastale();
 			return;
 		}
 
@@ -1403,6 +1442,7 @@ void upsdrv_updateinfo(void)
 
 		if (hid_ups_walk(HU_WALKMODE_INIT) == FALSE) {
 			hd = NULL;
+			dstate_datastale();
 			return;
 		}
 	}
@@ -1410,93 +1450,100 @@ void upsdrv_updateinfo(void)
 	interval();
 #endif
 
-	/* Get HID notifications on Interrupt pipe first */
-	if (use_interrupt_pipe == TRUE) {
-		evtCount = HIDGetEvents(udev, event, MAX_EVENT_NUM);
-		switch (evtCount)
-		{
-		case LIBUSB_ERROR_BUSY:      /* Device or resource busy */
-			upslog_with_errno(LOG_CRIT, "Got disconnected by another driver");
-			goto fallthrough_reconnect;
-		case NUT_LIBUSB_CODE_NO_EVENTS:	/* No HID Events */
-			interrupt_pipe_no_events_count++;
-			upsdebugx(1, "Got 0 HID objects (%ld times in a row, tolerance is %ld)...",
-				interrupt_pipe_no_events_count, interrupt_pipe_no_events_tolerance);
-			if (interrupt_pipe_no_events_tolerance >= 0
-			 && interrupt_pipe_no_events_tolerance < interrupt_pipe_no_events_count
-			) {
+	/* Get HID notifications on Interrupt pipe first: all the reports
+	 * queued so far (with asynchronous transfers), so that a burst of
+	 * them is followed by one walk rather than one walk per report */
+	reports = 0;
+	do {
+		if (use_interrupt_pipe == TRUE) {
+			evtCount = HIDGetEvents(udev, event, MAX_EVENT_NUM);
+			switch (evtCount)
+			{
+			case LIBUSB_ERROR_BUSY:      /* Device or resource busy */
+				upslog_with_errno(LOG_CRIT, "Got disconnected by another driver");
 				goto fallthrough_reconnect;
-			}
-			break;
+			case NUT_LIBUSB_CODE_NO_EVENTS:	/* No HID Events */
+				interrupt_pipe_no_events_count++;
+				upsdebugx(1, "Got 0 HID objects (%ld times in a row, tolerance is %ld)...",
+					interrupt_pipe_no_events_count, interrupt_pipe_no_events_tolerance);
+				if (interrupt_pipe_no_events_tolerance >= 0
+				 && interrupt_pipe_no_events_tolerance < interrupt_pipe_no_events_count
+				) {
+					goto fallthrough_reconnect;
+				}
+				break;
 #if WITH_LIBUSB_0_1 /* limit to libusb 0.1 implementation */
-		case -EPERM:		/* Operation not permitted */
+			case -EPERM:		/* Operation not permitted */
 #endif
-		case LIBUSB_ERROR_NO_DEVICE: /* No such device */
-		case LIBUSB_ERROR_ACCESS:    /* Permission denied */
+			case LIBUSB_ERROR_NO_DEVICE: /* No such device */
+			case LIBUSB_ERROR_ACCESS:    /* Permission denied */
 #if WITH_LIBUSB_0_1         /* limit to libusb 0.1 implementation */
-		case -ENXIO:		    /* No such device or address */
+			case -ENXIO:		    /* No such device or address */
 #endif
-		case LIBUSB_ERROR_NOT_FOUND: /* No such file or directory */
-		case LIBUSB_ERROR_NO_MEM:    /* Insufficient memory */
-		fallthrough_reconnect:
-			/* Uh oh, got to reconnect! */
-			dstate_setinfo("driver.state", "reconnect.trying");
-			hd = NULL;
-			return;
-		case LIBUSB_ERROR_IO:        /* I/O error */
-			/* Uh oh, got to reconnect, with a special suggestion! */
-			dstate_setinfo("driver.state", "reconnect.trying");
-			interrupt_pipe_EIO_count++;
-			hd = NULL;
-			return;
-		default:
-			upsdebugx(1, "Got %i HID objects...", (evtCount >= 0) ? evtCount : 0);
-			if (evtCount > 0)
-				interrupt_pipe_no_events_count = 0;
-			else
-				upsdebugx(1, "Got unhandled result from HIDGetEvents(): %i\n"
-					"Please report it to NUT developers, with an 'upsc' output for your device,\n"
-					"versions of NUT and libusb used, and verbose driver debug log if possible.",
-					evtCount);
-			break;
+			case LIBUSB_ERROR_NOT_FOUND: /* No such file or directory */
+			case LIBUSB_ERROR_NO_MEM:    /* Insufficient memory */
+			fallthrough_reconnect:
+				/* Uh oh, got to reconnect! */
+				dstate_setinfo("driver.state", "reconnect.trying");
+				hd = NULL;
+				dstate_datastale();
+				return;
+			case LIBUSB_ERROR_IO:        /* I/O error */
+				/* Uh oh, got to reconnect, with a special suggestion! */
+				dstate_setinfo("driver.state", "reconnect.trying");
+				interrupt_pipe_EIO_count++;
+				hd = NULL;
+				dstate_datastale();
+				return;
+			default:
+				upsdebugx(1, "Got %i HID objects...", (evtCount >= 0) ? evtCount : 0);
+				if (evtCount > 0)
+					interrupt_pipe_no_events_count = 0;
+				else
+					upsdebugx(1, "Got unhandled result from HIDGetEvents(): %i\n"
+						"Please report it to NUT developers, with an 'upsc' output for your device,\n"
+						"versions of NUT and libusb used, and verbose driver debug log if possible.",
+						evtCount);
+				break;
+			}
+		} else {
+			evtCount = 0;
+			upsdebugx(1, "Not using interrupt pipe...");
 		}
-	} else {
-		evtCount = 0;
-		upsdebugx(1, "Not using interrupt pipe...");
-	}
 
-	/* Process pending events (HID notifications on Interrupt pipe) */
-	for (i = 0; i < evtCount; i++) {
+		/* Process pending events (HID notifications on Interrupt pipe) */
+		for (i = 0; i < evtCount; i++) {
 
-		if (HIDGetDataValue(udev, event[i], &value, poll_interval) != 1)
-			continue;
+			if (HIDGetDataValue(udev, event[i], &value, poll_interval) != 1)
+				continue;
 
-		if (nut_debug_level >= 2) {
-			upsdebugx(2,
-				"Path: %s, Type: %s, ReportID: 0x%02x, "
-				"Offset: %i, Size: %i, Value: %g",
-				HIDGetDataItem(event[i], subdriver->utab),
-				HIDDataType(event[i]), event[i]->ReportID,
-				event[i]->Offset, event[i]->Size, value);
-		}
+			if (nut_debug_level >= 2) {
+				upsdebugx(2,
+					"Path: %s, Type: %s, ReportID: 0x%02x, "
+					"Offset: %i, Size: %i, Value: %g",
+					HIDGetDataItem(event[i], subdriver->utab),
+					HIDDataType(event[i]), event[i]->ReportID,
+					event[i]->Offset, event[i]->Size, value);
+			}
 
-		/* Skip Input reports, if we don't use the Feature report */
-		found_data = FindObject_with_Path(pDesc, &(event[i]->Path), interrupt_only ? ITEM_INPUT:ITEM_FEATURE);
-		if (!found_data && !interrupt_only) {
-			found_data = FindObject_with_Path(pDesc, &(event[i]->Path), ITEM_INPUT);
-		}
-		if (!found_data) {
-			upsdebugx(2, "Could not find event as either ITEM_INPUT or ITEM_FEATURE?");
-			continue;
-		}
-		item = find_hid_info(found_data);
-		if (!item) {
-			upsdebugx(3, "NUT doesn't use this HID object");
-			continue;
-		}
+			/* Skip Input reports, if we don't use the Feature report */
+			found_data = FindObject_with_Path(pDesc, &(event[i]->Path), interrupt_only ? ITEM_INPUT:ITEM_FEATURE);
+			if (!found_data && !interrupt_only) {
+				found_data = FindObject_with_Path(pDesc, &(event[i]->Path), ITEM_INPUT);
+			}
+			if (!found_data) {
+				upsdebugx(2, "Could not find event as either ITEM_INPUT or ITEM_FEATURE?");
+				continue;
+			}
+			item = find_hid_info(found_data);
+			if (!item) {
+				upsdebugx(3, "NUT doesn't use this HID object");
+				continue;
+			}
 
-		ups_infoval_set(item, value);
-	}
+			ups_infoval_set(item, value);
+		}
+	} while (++reports < MAX_REPORT_NUM && interrupt_reports_pending());
 #ifdef DEBUG
 	upsdebugx(1, "took %.3f seconds handling interrupt reports...",
 		interval());
@@ -1512,8 +1559,12 @@ void upsdrv_updateinfo(void)
 
 		alarm_init();
 
-		if (hid_ups_walk(HU_WALKMODE_FULL_UPDATE) == FALSE)
+		if (hid_ups_walk(HU_WALKMODE_FULL_UPDATE) == FALSE) {
+			/* disconnected while walking */
+			if (hd == NULL)
+				dstate_datastale();
 			return;
+		}
 
 		lastpoll = now;
 		data_has_changed = FALSE;
@@ -1524,8 +1575,11 @@ void upsdrv_updateinfo(void)
 		upsdebugx(1, "Quick update...");
 
 		/* Quick poll data only to see if the UPS is still connected */
-		if (hid_ups_walk(HU_WALKMODE_QUICK_UPDATE) == FALSE)
+		if (hid_ups_walk(HU_WALKMODE_QUICK_UPDATE) == FALSE) {
+			if (hd == NULL)
+				dstate_datastale();
 			return;
+		}
 	}
 
 	ups_status_set();
@@ -1577,6 +1631,13 @@ void upsdrv_initinfo(void)
 #endif
 	}
 
+#ifdef NUT_LIBUSB_HAVE_INTERRUPT_ASYNC
+	/* have interrupt reports handled as they arrive, see libusb1.c */
+	if (use_interrupt_pipe == TRUE && !testvar("syncinterrupt")) {
+		nut_libusb_interrupt_async(1);
+	}
+#endif
+
 	val = getval("interrupt_pipe_no_events_tolerance");
 	if (!val || !str_to_long(val, &interrupt_pipe_no_events_tolerance, 10)) {
 		interrupt_pipe_no_events_tolerance = -1;
@@ -1936,6 +1997,9 @@ void upsdrv_cleanup(void)
 	upsdebugx(1, "upsdrv_cleanup...");
 
 	comm_driver->close_dev(udev);
+	hu_plan_free();
+	hu_indexes_free();
+	HIDFreeUsageIndexes();
 	Free_ReportDesc(pDesc);
 	free_report_buffer(reportbuf);
 #if !((defined SHUT_MODE) && SHUT_MODE)
@@ -2046,6 +2110,7 @@ static int callback(
 	/* Save the global "hd" for this driver instance */
 	hd = arghd;
 	udev = argudev;
+	bound_bcdDevice = arghd->bcdDevice;
 
 	/* Parse Report Descriptor */
 	Free_ReportDesc(pDesc);
@@ -2086,6 +2151,8 @@ static int callback(
 	if (subdriver->fix_report_desc(arghd, pDesc)) {
 		upsdebugx(2, "Report Descriptor Fixed");
 	}
+	/* item decoders must follow any limits fixed up above */
+	Compile_ReportDesc(pDesc);
 	upsdebugx(1, "%s: calling HIDDumpTree(); in case of problems with device data "
 		"please note that a wrong subdriver could have been chosen above; "
 		"consider testing others with an explicit driver option",
@@ -2161,6 +2228,337 @@ int fix_report_desc(HIDDevice_t *arg_pDev, HIDDesc_t *arg_pDesc) {
 	return 0;
 }
 
+/* should the item be polled in a QUICK or FULL update walk? */
+static bool_t hu_walk_wanted(const hid_info_t *item, walkmode_t mode)
+{
+	if (mode == HU_WALKMODE_QUICK_UPDATE) {
+		/* Quick update only deals with status and alarms! */
+		return (item->hidflags & HU_FLAG_QUICK_POLL) ? TRUE : FALSE;
+	}
+
+	/* These don't need polling after initinfo() */
+	if (item->hidflags & (HU_FLAG_ABSENT | HU_TYPE_CMD))
+		return FALSE;
+
+	/* These don't need polling after initinfo() normally
+	 * However in "pollonly" mode we use these to detect "Data stale"
+	 * condition (e.g. cable disconnected) by failing the reads:
+	 */
+	if ((item->hidflags & HU_FLAG_STATIC) && use_interrupt_pipe)
+		return FALSE;
+
+	/* These need to be polled after user changes (setvar / instcmd)
+	 * or to detect "Data stale" in "pollonly" mode
+	 */
+	if (   (item->hidflags & HU_FLAG_SEMI_STATIC)
+		&& (data_has_changed == FALSE)
+		&& use_interrupt_pipe
+	)
+		return FALSE;
+
+	return TRUE;
+}
+
+/* is the report holding this item known to be broken on this device? */
+static bool_t hu_walk_skip_report(const HIDData_t *hiddata)
+{
+#if !((defined SHUT_MODE) && SHUT_MODE)
+	/* skip report 0x54 for Tripplite SU3000LCD2UHV due to firmware bug */
+	if ((curDevice.VendorID == 0x09ae) && (curDevice.ProductID == 0x1330)) {
+		if (hiddata && (hiddata->ReportID == 0x54)) {
+			return TRUE;
+		}
+	}
+#else	/* SHUT_MODE */
+	NUT_UNUSED_VARIABLE(hiddata);
+#endif	/* !SHUT_MODE => USB */
+
+	return FALSE;
+}
+
+/* sort out a HIDGetDataValue() or HIDRefreshReport() result: 1 if we
+ * got the data, 0 to skip the item for now, -1 if the device is gone
+ * (then we must reconnect) */
+static int hu_walk_retcode(int retcode)
+{
+	switch (retcode)
+	{
+	case LIBUSB_ERROR_BUSY:      /* Device or resource busy */
+		upslog_with_errno(LOG_CRIT, "Got disconnected by another driver");
+		goto fallthrough_reconnect;
+
+#if WITH_LIBUSB_0_1 /* limit to libusb 0.1 implementation */
+	case -EPERM:		/* Operation not permitted */
+#endif
+	case LIBUSB_ERROR_NO_DEVICE: /* No such device */
+	case LIBUSB_ERROR_ACCESS:    /* Permission denied */
+#if WITH_LIBUSB_0_1           /* limit to libusb 0.1 implementation */
+	case -ENXIO:		  /* No such device or address */
+#endif
+	case LIBUSB_ERROR_NOT_FOUND: /* No such file or directory */
+	case LIBUSB_ERROR_NO_MEM:    /* Insufficient memory */
+	fallthrough_reconnect:
+		/* Uh oh, got to reconnect! */
+		dstate_setinfo("driver.state", "reconnect.trying");
+		hd = NULL;
+		return -1;
+
+	case LIBUSB_ERROR_IO:        /* I/O error */
+		/* Uh oh, got to reconnect, with a special suggestion! */
+		dstate_setinfo("driver.state", "reconnect.trying");
+		interrupt_pipe_EIO_count++;
+		hd = NULL;
+		return -1;
+
+	case 1:
+		return 1;	/* Found! */
+
+	case 0:
+		return 0;
+
+	case LIBUSB_ERROR_TIMEOUT:   /* Connection timed out */
+/* libusb win32 does not know EPROTO and EOVERFLOW,
+ * it only returns EIO for any IO errors */
+#ifndef WIN32
+	case LIBUSB_ERROR_OVERFLOW:  /* Value too large for defined data type */
+# if EPROTO && WITH_LIBUSB_0_1
+	case -EPROTO:		/* Protocol error */
+# endif
+#endif	/* !WIN32 */
+	case LIBUSB_ERROR_PIPE:      /* Broken pipe */
+	default:
+		/* Don't know what happened, try again later... */
+		upsdebugx(1, "HIDGetDataValue unknown retcode '%i'", retcode);
+		return 0;
+	}
+}
+
+/* publish the value polled for an item */
+static void hu_walk_process(hid_info_t *item, double value, walkmode_t mode)
+{
+	upsdebugx(2,
+		"Path: %s, Type: %s, ReportID: 0x%02x, "
+		"Offset: %i, Size: %i, Value: %g",
+		item->hidpath, HIDDataType(item->hiddata),
+		item->hiddata->ReportID,
+		item->hiddata->Offset, item->hiddata->Size, value);
+
+	if (item->hidflags & HU_TYPE_CMD) {
+		upsdebugx(3, "Adding command '%s' using Path '%s'",
+			item->info_type, item->hidpath);
+		dstate_addcmd(item->info_type);
+		return;
+	}
+
+	/* Process the value we got back (set status bits and
+	 * set the value of other parameters) */
+	if (ups_infoval_set(item, value) != 1)
+		return;
+
+	if (mode == HU_WALKMODE_INIT || (!use_interrupt_pipe)) {
+		info_lkp_t	*info_lkp;
+
+		dstate_setflags(item->info_type, item->info_flags);
+
+		/* Set max length for strings */
+		if (item->info_flags & ST_FLAG_STRING) {
+			dstate_setaux(item->info_type, item->info_len);
+		}
+
+		/* Set enumerated values, only if the data has ST_FLAG_RW */
+		if (!(item->hidflags & HU_FLAG_ENUM) || !(item->info_flags & ST_FLAG_RW)) {
+			return;
+		}
+
+		/* Loop on all existing values */
+		for (
+			info_lkp = item->hid2info;
+			info_lkp != NULL && info_lkp->nut_value != NULL;
+			info_lkp++
+		) {
+			/* Check if this value is supported */
+			if (hu_find_infoval(item->hid2info, info_lkp->hid_value) != NULL) {
+				dstate_addenum(item->info_type, "%s", info_lkp->nut_value);
+			}
+		}
+	}
+}
+
+/* Poll plan: the items polled after init, grouped by the report they
+ * belong to. Each report that a walk needs is retrieved once, all of
+ * its items decoded in one go, then the values are published in the
+ * mapping table order (so that status bits are processed just like
+ * before). Compiled by hid_ups_walk(HU_WALKMODE_INIT). */
+typedef struct {
+	hid_info_t	*item;
+	bool_t	wanted;		/* polled in the current walk */
+	int	retcode;	/* 1 if value was decoded */
+	double	value;
+} hu_plan_item_t;
+
+typedef struct {
+	size_t	first;		/* items are plan_byreport[first..first+count-1] */
+	size_t	count;
+} hu_plan_report_t;
+
+static hu_plan_item_t	*plan_items = NULL;	/* mapping table order */
+static size_t	plan_nitems = 0;
+static size_t	*plan_byreport = NULL;		/* plan_items indexes, by report */
+static hu_plan_report_t	*plan_reports = NULL;
+static size_t	plan_nreports = 0;
+
+static void hu_plan_free(void)
+{
+	free(plan_items);
+	free(plan_byreport);
+	free(plan_reports);
+	plan_items = NULL;
+	plan_byreport = NULL;
+	plan_reports = NULL;
+	plan_nitems = 0;
+	plan_nreports = 0;
+}
+
+/* Forget the mapping resolved for the previous report descriptor,
+ * and the data published through it, before parsing a new one */
+static void hu_mapping_reset(void)
+{
+	hid_info_t	*item;
+
+	hu_plan_free();
+	hu_indexes_free();
+
+	if (!subdriver) {
+		return;
+	}
+
+	for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
+		if (item->hiddata == NULL) {
+			continue;
+		}
+
+		if (item->hidflags & HU_TYPE_CMD) {
+			dstate_delcmd(item->info_type);
+		} else if (!(item->hidflags & HU_FLAG_ABSENT)) {
+			dstate_delinfo(item->info_type);
+		}
+
+		item->hiddata = NULL;
+	}
+}
+
+static void hu_plan_build(void)
+{
+	hid_info_t	*item;
+	size_t	i, n, count[256], pos[256];
+	int	id;
+
+	hu_plan_free();
+
+	memset(count, 0, sizeof(count));
+	for (n = 0, item = subdriver->hid2nut; item->info_type != NULL; item++) {
+		if (item->hiddata == NULL || hu_walk_skip_report(item->hiddata) == TRUE)
+			continue;
+		count[item->hiddata->ReportID]++;
+		n++;
+	}
+
+	if (n == 0)
+		return;
+
+	plan_items = xcalloc(n, sizeof(*plan_items));
+	plan_byreport = xcalloc(n, sizeof(*plan_byreport));
+
+	for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
+		if (item->hiddata == NULL || hu_walk_skip_report(item->hiddata) == TRUE)
+			continue;
+		plan_items[plan_nitems++].item = item;
+	}
+
+	for (id = 0; id < 256; id++) {
+		if (count[id])
+			plan_nreports++;
+	}
+
+	plan_reports = xcalloc(plan_nreports, sizeof(*plan_reports));
+	for (i = 0, n = 0, id = 0; id < 256; id++) {
+		if (!count[id])
+			continue;
+		plan_reports[i].first = n;
+		plan_reports[i].count = count[id];
+		pos[id] = n;
+		n += count[id];
+		i++;
+	}
+
+	for (i = 0; i < plan_nitems; i++) {
+		plan_byreport[pos[plan_items[i].item->hiddata->ReportID]++] = i;
+	}
+
+	upsdebugx(2, "%s: %" PRIuSIZE " items to poll in %" PRIuSIZE " reports",
+		__func__, plan_nitems, plan_nreports);
+}
+
+/* QUICK or FULL update walk following the poll plan */
+static bool_t hid_ups_walk_plan(walkmode_t mode)
+{
+	hu_plan_report_t	*report;
+	hu_plan_item_t	*p;
+	HIDData_t	*hiddata;
+	size_t	i, j;
+	int	retcode;
+
+	HIDStartPollCycle();
+
+	for (i = 0; i < plan_nreports; i++) {
+		report = &plan_reports[i];
+		hiddata = NULL;
+
+		for (j = report->first; j < report->first + report->count; j++) {
+			p = &plan_items[plan_byreport[j]];
+			p->wanted = hu_walk_wanted(p->item, mode);
+			p->retcode = 0;
+			if (p->wanted == TRUE && hiddata == NULL)
+				hiddata = p->item->hiddata;
+		}
+
+		/* Nothing due in this report for now */
+		if (hiddata == NULL)
+			continue;
+
+		retcode = HIDRefreshReport(udev, hiddata, poll_interval);
+		if (retcode != 1) {
+			if (hu_walk_retcode(retcode) < 0) {
+				HIDEndPollCycle();
+				return FALSE;
+			}
+			continue;
+		}
+
+		for (j = report->first; j < report->first + report->count; j++) {
+			p = &plan_items[plan_byreport[j]];
+			if (p->wanted == TRUE)
+				p->retcode = HIDDecodeDataValue(p->item->hiddata, &p->value);
+		}
+	}
+
+	dstate_setinfo("driver.hid.reports", "%" PRIuSIZE, HIDEndPollCycle());
+
+	for (i = 0; i < plan_nitems; i++) {
+#if (defined SHUT_MODE) && SHUT_MODE
+		/* Check if we are asked to stop (reactivity++) in SHUT mode */
+		if (exit_flag != 0)
+			return TRUE;
+#endif	/* SHUT_MODE */
+
+		p = &plan_items[i];
+		if (p->wanted == TRUE && p->retcode == 1)
+			hu_walk_process(p->item, p->value, mode);
+	}
+
+	return TRUE;
+}
+
 /* walk ups variables and set elements of the info array. */
 static bool_t hid_ups_walk(walkmode_t mode)
 {
@@ -2168,14 +2566,20 @@ static bool_t hid_ups_walk(walkmode_t mode)
 	double		value;
 	int		retcode;
 
-#if !((defined SHUT_MODE) && SHUT_MODE)
-	/* extract the VendorId for further testing */
-	int vendorID = curDevice.VendorID;
-	int productID = curDevice.ProductID;
-#endif	/* !SHUT_MODE => USB */
+	/* After init, follow the poll plan */
+	if (mode != HU_WALKMODE_INIT && plan_nitems > 0)
+		return hid_ups_walk_plan(mode);
+
+	/* Reconnected to the same device, so the mapping resolved for it
+	 * still applies (see reconnect_ups()): only refresh all data */
+	if (mode == HU_WALKMODE_INIT && plan_nitems > 0) {
+		upsdebugx(1, "%s: reusing the mapping resolved before", __func__);
+		return hid_ups_walk_plan(HU_WALKMODE_FULL_UPDATE);
+	}
 
 	/* 3 modes: HU_WALKMODE_INIT, HU_WALKMODE_QUICK_UPDATE
 	 * and HU_WALKMODE_FULL_UPDATE */
+	HIDStartPollCycle();
 
 	/* Device data walk ----------------------------- */
 	for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
@@ -2184,8 +2588,10 @@ static bool_t hid_ups_walk(walkmode_t mode)
 		/* Check if we are asked to stop (reactivity++) in SHUT mode.
 		 * In USB mode, looping through this takes well under a second,
 		 * so any effort to improve reactivity here is wasted. */
-		if (exit_flag != 0)
+		if (exit_flag != 0) {
+			HIDEndPollCycle();
 			return TRUE;
+		}
 #endif	/* SHUT_MODE */
 
 		/* filter data according to mode */
@@ -2265,31 +2671,8 @@ static bool_t hid_ups_walk(walkmode_t mode)
 			continue;
 
 		case HU_WALKMODE_QUICK_UPDATE:
-			/* Quick update only deals with status and alarms! */
-			if (!(item->hidflags & HU_FLAG_QUICK_POLL))
-				continue;
-
-			break;
-
 		case HU_WALKMODE_FULL_UPDATE:
-			/* These don't need polling after initinfo() */
-			if (item->hidflags & (HU_FLAG_ABSENT | HU_TYPE_CMD))
-				continue;
-
-			/* These don't need polling after initinfo() normally
-			 * However in "pollonly" mode we use these to detect "Data stale"
-			 * condition (e.g. cable disconnected) by failing the reads:
-			 */
-			if ((item->hidflags & HU_FLAG_STATIC) && use_interrupt_pipe)
-				continue;
-
-			/* These need to be polled after user changes (setvar / instcmd)
-			 * or to detect "Data stale" in "pollonly" mode
-			 */
-			if (   (item->hidflags & HU_FLAG_SEMI_STATIC)
-				&& (data_has_changed == FALSE)
-				&& use_interrupt_pipe
-			)
+			if (hu_walk_wanted(item, mode) == FALSE)
 				continue;
 
 			break;
@@ -2323,119 +2706,38 @@ static bool_t hid_ups_walk(walkmode_t mode)
 # pragma GCC diagnostic pop
 #endif
 
-#if !((defined SHUT_MODE) && SHUT_MODE)
-		/* skip report 0x54 for Tripplite SU3000LCD2UHV due to firmware bug */
-		if ((vendorID == 0x09ae) && (productID == 0x1330)) {
-			if (item->hiddata && (item->hiddata->ReportID == 0x54)) {
-				continue;
-			}
-		}
-#endif	/* !SHUT_MODE => USB */
+		if (hu_walk_skip_report(item->hiddata) == TRUE)
+			continue;
 
 		retcode = HIDGetDataValue(udev, item->hiddata, &value, poll_interval);
 
-		switch (retcode)
+		switch (hu_walk_retcode(retcode))
 		{
-		case LIBUSB_ERROR_BUSY:      /* Device or resource busy */
-			upslog_with_errno(LOG_CRIT, "Got disconnected by another driver");
-			goto fallthrough_reconnect;
-
-#if WITH_LIBUSB_0_1 /* limit to libusb 0.1 implementation */
-		case -EPERM:		/* Operation not permitted */
-#endif
-		case LIBUSB_ERROR_NO_DEVICE: /* No such device */
-		case LIBUSB_ERROR_ACCESS:    /* Permission denied */
-#if WITH_LIBUSB_0_1           /* limit to libusb 0.1 implementation */
-		case -ENXIO:		  /* No such device or address */
-#endif
-		case LIBUSB_ERROR_NOT_FOUND: /* No such file or directory */
-		case LIBUSB_ERROR_NO_MEM:    /* Insufficient memory */
-		fallthrough_reconnect:
-			/* Uh oh, got to reconnect! */
-			dstate_setinfo("driver.state", "reconnect.trying");
-			hd = NULL;
-			return FALSE;
-
-		case LIBUSB_ERROR_IO:        /* I/O error */
-			/* Uh oh, got to reconnect, with a special suggestion! */
-			dstate_setinfo("driver.state", "reconnect.trying");
-			interrupt_pipe_EIO_count++;
-			hd = NULL;
-			return FALSE;
-
 		case 1:
 			break;	/* Found! */
 
 		case 0:
 			continue;
 
-		case LIBUSB_ERROR_TIMEOUT:   /* Connection timed out */
-/* libusb win32 does not know EPROTO and EOVERFLOW,
- * it only returns EIO for any IO errors */
-#ifndef WIN32
-		case LIBUSB_ERROR_OVERFLOW:  /* Value too large for defined data type */
-# if EPROTO && WITH_LIBUSB_0_1
-		case -EPROTO:		/* Protocol error */
-# endif
-#endif	/* !WIN32 */
-		case LIBUSB_ERROR_PIPE:      /* Broken pipe */
 		default:
-			/* Don't know what happened, try again later... */
-			upsdebugx(1, "HIDGetDataValue unknown retcode '%i'", retcode);
-			continue;
-		}
-
-		upsdebugx(2,
-			"Path: %s, Type: %s, ReportID: 0x%02x, "
-			"Offset: %i, Size: %i, Value: %g",
-			item->hidpath, HIDDataType(item->hiddata),
-			item->hiddata->ReportID,
-			item->hiddata->Offset, item->hiddata->Size, value);
-
-		if (item->hidflags & HU_TYPE_CMD) {
-			upsdebugx(3, "Adding command '%s' using Path '%s'",
-				item->info_type, item->hidpath);
-			dstate_addcmd(item->info_type);
-			continue;
+			HIDEndPollCycle();
+			return FALSE;
 		}
 
-		/* Process the value we got back (set status bits and
-		 * set the value of other parameters) */
-		if (ups_infoval_set(item, value) != 1)
-			continue;
-
-		if (mode == HU_WALKMODE_INIT || (!use_interrupt_pipe)) {
-			info_lkp_t	*info_lkp;
-
-			dstate_setflags(item->info_type, item->info_flags);
-
-			/* Set max length for strings */
-			if (item->info_flags & ST_FLAG_STRING) {
-				dstate_setaux(item->info_type, item->info_len);
-			}
+		hu_walk_process(item, value, mode);
+	}
 
-			/* Set enumerated values, only if the data has ST_FLAG_RW */
-			if (!(item->hidflags & HU_FLAG_ENUM) || !(item->info_flags & ST_FLAG_RW)) {
-				continue;
-			}
+	upsdebugx(2, "%s: %" PRIuSIZE " reports retrieved",
+		__func__, HIDEndPollCycle());
 
-			/* Loop on all existing values */
-			for (
-				info_lkp = item->hid2info;
-				info_lkp != NULL && info_lkp->nut_value != NULL;
-				info_lkp++
-			) {
-				/* Check if this value is supported */
-				if (hu_find_infoval(item->hid2info, info_lkp->hid_value) != NULL) {
-					dstate_addenum(item->info_type, "%s", info_lkp->nut_value);
-				}
-			}
-		}
+	/* The mapping is resolved: (re)compile the poll plan and indexes */
+	if (mode == HU_WALKMODE_INIT) {
+		hu_plan_build();
+		hu_indexes_build();
 	}
 
 	return TRUE;
 }
-
 static int reconnect_ups(void)
 {
 	int ret;
@@ -2473,7 +2775,26 @@ static int reconnect_ups(void)
 	ret = comm_driver->open_dev(&udev, &curDevice, subdriver_matcher, NULL);
 	upsdebugx(4, "Opening comm_driver returns ret=%i", ret);
 	if (ret > 0) {
-		return 1;
+		/* The same device was found again (as checked by the exact
+		 * matcher): unless its firmware changed, keep the report
+		 * descriptor parsed and the mapping resolved before */
+		if (curDevice.bcdDevice == bound_bcdDevice) {
+			return 1;
+		}
+
+		upslogx(LOG_NOTICE, "Device release number changed (%04x, was %04x), "
+			"reading its report descriptor again",
+			curDevice.bcdDevice, bound_bcdDevice);
+
+		comm_driver->close_dev(udev);
+		udev = HID_DEV_HANDLE_CLOSED;
+		hu_mapping_reset();
+
+		ret = comm_driver->open_dev(&udev, &curDevice, subdriver_matcher, &callback);
+		upsdebugx(4, "Opening comm_driver returns ret=%i", ret);
+		if (ret > 0) {
+			return 1;
+		}
 	}
 
 	dstate_setinfo("driver.state", "quiet");
@@ -2888,6 +3209,160 @@ static void ups_status_set(void)
 	}
 }
 
+/* Indexes of the mapping table, built after the init walk resolved
+ * it (see hu_indexes_build()), so that looking up items for interrupt
+ * events, instcmd() and setvar() does not scan the whole table; see
+ * hash_table_size() */
+
+/* hid2nut items with a HID mapping, by (case-insensitive) info_type:
+ * the first entry wins, as with the scan done before */
+static hid_info_t	**hu_name_index = NULL;
+static size_t	hu_name_index_size = 0;
+
+/* hid2nut items by position of their HID data in the report descriptor
+ * (server side variables are skipped, the first entry wins) */
+static hid_info_t	**hu_data_index = NULL;
+static HIDDesc_t	*hu_data_index_desc = NULL;
+static size_t	hu_data_index_size = 0;
+
+/* info_lkp_t tables by HID value and by NUT value */
+typedef struct hu_lkp_index_s {
+	const info_lkp_t	*table;
+	const info_lkp_t	**by_value;
+	const info_lkp_t	**by_name;
+	size_t	size;
+	struct hu_lkp_index_s	*next;
+} hu_lkp_index_t;
+
+#define HU_LKP_INDEX_HASHSIZE	64
+
+static hu_lkp_index_t	*hu_lkp_indexes[HU_LKP_INDEX_HASHSIZE];
+
+/* return the index of an info_lkp_t table (without conversion
+ * functions), building it when first asked for */
+static hu_lkp_index_t *hu_lkp_index_get(const info_lkp_t *table)
+{
+	hu_lkp_index_t	**slot = &hu_lkp_indexes[((size_t)table / sizeof(info_lkp_t)) % HU_LKP_INDEX_HASHSIZE];
+	hu_lkp_index_t	*index;
+	const info_lkp_t	*info_lkp;
+	size_t	count = 0, i;
+
+	for (index = *slot; index != NULL; index = index->next) {
+		if (index->table == table)
+			return index;
+	}
+
+	for (info_lkp = table; info_lkp->nut_value != NULL; info_lkp++)
+		count++;
+
+	index = xcalloc(1, sizeof(*index));
+	index->table = table;
+	index->size = hash_table_size(count);
+	index->by_value = xcalloc(index->size, sizeof(*index->by_value));
+	index->by_name = xcalloc(index->size, sizeof(*index->by_name));
+
+	for (info_lkp = table; info_lkp->nut_value != NULL; info_lkp++) {
+		i = (size_t)info_lkp->hid_value & (index->size - 1);
+		while (index->by_value[i] != NULL && index->by_value[i]->hid_value != info_lkp->hid_value)
+			i = (i + 1) & (index->size - 1);
+		if (index->by_value[i] == NULL)
+			index->by_value[i] = info_lkp;
+
+		i = str_hash(info_lkp->nut_value, 0) & (index->size - 1);
+		while (index->by_name[i] != NULL && strcmp(index->by_name[i]->nut_value, info_lkp->nut_value))
+			i = (i + 1) & (index->size - 1);
+		if (index->by_name[i] == NULL)
+			index->by_name[i] = info_lkp;
+	}
+
+	index->next = *slot;
+	*slot = index;
+
+	return index;
+}
+
+static void hu_indexes_build(void)
+{
+	hid_info_t	*item;
+	size_t	count = 0, i;
+
+	free(hu_name_index);
+	free(hu_data_index);
+	hu_name_index = NULL;
+	hu_data_index = NULL;
+	hu_data_index_desc = NULL;
+
+	for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
+		if (item->hiddata != NULL)
+			count++;
+	}
+
+	hu_name_index_size = hash_table_size(count);
+	hu_name_index = xcalloc(hu_name_index_size, sizeof(*hu_name_index));
+
+	if (pDesc != NULL && pDesc->nitems > 0) {
+		hu_data_index_size = pDesc->nitems;
+		hu_data_index = xcalloc(hu_data_index_size, sizeof(*hu_data_index));
+		hu_data_index_desc = pDesc;
+	}
+
+	for (item = subdriver->hid2nut; item->info_type != NULL; item++) {
+		if (item->hiddata == NULL)
+			continue;
+
+		i = str_hash(item->info_type, 1) & (hu_name_index_size - 1);
+		while (hu_name_index[i] != NULL
+		&&  strcasecmp(hu_name_index[i]->info_type, item->info_type)
+		)
+			i = (i + 1) & (hu_name_index_size - 1);
+		if (hu_name_index[i] == NULL)
+			hu_name_index[i] = item;
+
+		if (hu_data_index != NULL
+		&&  !(item->hidflags & HU_FLAG_ABSENT)
+		&&  item->hiddata >= pDesc->item
+		&&  item->hiddata < pDesc->item + pDesc->nitems
+		) {
+			i = (size_t)(item->hiddata - pDesc->item);
+			if (hu_data_index[i] == NULL)
+				hu_data_index[i] = item;
+		}
+
+		/* warm up the value lookup tables we will need */
+		if (item->hid2info != NULL
+		&&  item->hid2info->fun == NULL && item->hid2info->nuf == NULL
+		)
+			hu_lkp_index_get(item->hid2info);
+	}
+
+	upsdebugx(2, "%s: indexed %" PRIuSIZE " mapping entries", __func__, count);
+}
+
+static void hu_indexes_free(void)
+{
+	hu_lkp_index_t	*index, *next;
+	size_t	i;
+
+	free(hu_name_index);
+	hu_name_index = NULL;
+	hu_name_index_size = 0;
+
+	free(hu_data_index);
+	hu_data_index = NULL;
+	hu_data_index_desc = NULL;
+	hu_data_index_size = 0;
+
+	for (i = 0; i < HU_LKP_INDEX_HASHSIZE; i++) {
+		for (index = hu_lkp_indexes[i]; index != NULL; index = next) {
+			next = index->next;
+			free(index->by_value);
+			free(index->by_name);
+			free(index);
+		}
+		hu_lkp_indexes[i] = NULL;
+	}
+}
+
 /* find info element definition in info array
  * by NUT varname, or NULL if not found.
  */
@@ -2907,13 +3382,27 @@ static hid_info_t *find_nut_info(const char *varname)
 		return NULL;
 	}
 
-	for (hidups_item = subdriver->hid2nut; hidups_item->info_type != NULL ; hidups_item++) {
-		if (strcasecmp(hidups_item->info_type, varname))
-			continue;
+	if (hu_name_index != NULL) {
+		size_t	i = str_hash(varname, 1) & (hu_name_index_size - 1);
 
-		if (hidups_item->hiddata != NULL) {
-			errno = 0;
-			return hidups_item;
+		while ((hidups_item = hu_name_index[i]) != NULL) {
+			if (!strcasecmp(hidups_item->info_type, varname)
+			&&  hidups_item->hiddata != NULL
+			) {
+				errno = 0;
+				return hidups_item;
+			}
+			i = (i + 1) & (hu_name_index_size - 1);
+		}
+	} else {
+		for (hidups_item = subdriver->hid2nut; hidups_item->info_type != NULL ; hidups_item++) {
+			if (strcasecmp(hidups_item->info_type, varname))
+				continue;
+
+			if (hidups_item->hiddata != NULL) {
+				errno = 0;
+				return hidups_item;
+			}
 		}
 	}
 
@@ -2935,6 +3424,14 @@ static hid_info_t *find_hid_info(const HIDData_t *hiddata)
 		return NULL;
 	}
 
+	if (hu_data_index != NULL && hu_data_index_desc == pDesc
+	&&  hiddata >= pDesc->item && hiddata < pDesc->item + hu_data_index_size
+	) {
+		hidups_item = hu_data_index[hiddata - pDesc->item];
+		errno = hidups_item ? 0 : EINVAL;
+		return hidups_item;
+	}
+
 	for (hidups_item = subdriver->hid2nut; hidups_item->info_type != NULL ; hidups_item++) {
 		/* Skip server side vars */
 		if (hidups_item->hidflags & HU_FLAG_ABSENT)
@@ -2958,7 +3455,9 @@ static hid_info_t *find_hid_info(const HIDData_t *hiddata)
  */
 static long hu_find_valinfo(info_lkp_t *hid2info, const char* value)
 {
-	info_lkp_t	*info_lkp;
+	const info_lkp_t	*info_lkp;
+	hu_lkp_index_t	*index;
+	size_t	i;
 
 	errno = 0;
 
@@ -2973,13 +3472,16 @@ static long hu_find_valinfo(info_lkp_t *hid2info, const char* value)
 		return hid_value;
 	}
 
-	for (info_lkp = hid2info; info_lkp->nut_value != NULL; info_lkp++) {
+	index = hu_lkp_index_get(hid2info);
+	i = str_hash(value, 0) & (index->size - 1);
+	while ((info_lkp = index->by_name[i]) != NULL) {
 		if (!(strcmp(info_lkp->nut_value, value))) {
 			upsdebugx(5,
 				"hu_find_valinfo: found %s (value: %ld)",
 				info_lkp->nut_value, info_lkp->hid_value);
 			return info_lkp->hid_value;
 		}
+		i = (i + 1) & (index->size - 1);
 	}
 
 	upsdebugx(3,
@@ -2997,7 +3499,9 @@ static long hu_find_valinfo(info_lkp_t *hid2info, const char* value)
  */
 static const char *hu_find_infoval(info_lkp_t *hid2info, const double value)
 {
-	info_lkp_t	*info_lkp;
+	const info_lkp_t	*info_lkp;
+	hu_lkp_index_t	*index;
+	size_t	i;
 
 	errno = 0;
 
@@ -3007,13 +3511,16 @@ static const char *hu_find_infoval(info_lkp_t *hid2info, const double value)
 	}
 
 	/* use 'value' as an index for a lookup in an array */
-	for (info_lkp = hid2info; info_lkp->nut_value != NULL; info_lkp++) {
+	index = hu_lkp_index_get(hid2info);
+	i = (size_t)(long)value & (index->size - 1);
+	while ((info_lkp = index->by_value[i]) != NULL) {
 		if (info_lkp->hid_value == (long)value) {
 			upsdebugx(5,
 				"hu_find_infoval: found %s (value: %ld)",
 				info_lkp->nut_value, (long)value);
 			return info_lkp->nut_value;
 		}
+		i = (i + 1) & (index->size - 1);
 	}
 
 	upsdebugx(3,
@@ -3067,7 +3574,7 @@ static int ups_infoval_set(hid_info_t *item, double value)
 
 		dstate_setinfo(item->info_type, "%s", nutvalue);
 	} else {
-		dstate_setinfo_dynamic(item->info_type, item->dfl, "%f", value);
+		dstate_setinfo_double(item->info_type, item->dfl, value);
 	}
 
 	return 1;
@@ -325,6 +325,13 @@ int checkprocname_ignored(const char *caller);
 /* write a pid file - <name> is a full pathname *or* just the program name */
 void writepid(const char *name);
 
+/* create (with permissions <mode>) and open for writing a new file with
+ * an unpredictable name next to <fn>, to be renamed over <fn> once written;
+ * it is never a pre-existing file or symlink, so whoever can write into
+ * that directory can not have the caller overwrite another file. Its name
+ * is stored into <tmpfn>. Returns NULL (with errno set) on errors */
+FILE *fopen_tmp_sibling(const char *fn, char *tmpfn, size_t tmpfnlen, mode_t mode);
+
 /* parses string buffer into a pid_t if it passes
  * a few sanity checks; returns -1 on error */
 pid_t parsepid(const char *buf);
@@ -69,6 +69,7 @@ typedef struct st_tree_s {
 int state_get_timestamp(st_tree_timespec_t *now);
 int st_tree_node_compare_timestamp(const st_tree_t *node, const st_tree_timespec_t *cutoff);
 int state_setinfo(st_tree_t **nptr, const char *var, const char *val);
+int state_setinfo_node(st_tree_t *node, const char *val);
 int state_addenum(st_tree_t *root, const char *var, const char *val);
 int state_addrange(st_tree_t *root, const char *var, const int min, const int max);
 int state_setaux(st_tree_t *root, const char *var, const char *auxs);
@@ -88,6 +89,36 @@ int state_delenum(st_tree_t *root, const char *var, const char *val);
 int state_delrange(st_tree_t *root, const char *var, const int min, const int max);
 st_tree_t *state_tree_find(st_tree_t *node, const char *var);
 
+/* Bit values for the standard "ups.status" tokens (see the "Status data"
+ * chapter of docs/new-drivers.txt), so that drivers and clients can test
+ * for them without re-tokenizing the string. The text of "ups.status"
+ * remains the published form; tokens match case-insensitively. */
+#define ST_STATUS_OL		(1UL << 0)	/* On line */
+#define ST_STATUS_OB		(1UL << 1)	/* On battery */
+#define ST_STATUS_LB		(1UL << 2)	/* Low battery */
+#define ST_STATUS_HB		(1UL << 3)	/* High battery */
+#define ST_STATUS_RB		(1UL << 4)	/* Replace battery */
+#define ST_STATUS_CHRG		(1UL << 5)	/* Battery charging */
+#define ST_STATUS_DISCHRG	(1UL << 6)	/* Battery discharging */
+#define ST_STATUS_BYPASS	(1UL << 7)	/* On bypass */
+#define ST_STATUS_CAL		(1UL << 8)	/* Runtime calibration */
+#define ST_STATUS_OFF		(1UL << 9)	/* Offline, not supplying the load */
+#define ST_STATUS_OVER		(1UL << 10)	/* Overloaded */
+#define ST_STATUS_TRIM		(1UL << 11)	/* Trimming incoming voltage */
+#define ST_STATUS_BOOST		(1UL << 12)	/* Boosting incoming voltage */
+#define ST_STATUS_FSD		(1UL << 13)	/* Forced shutdown */
+#define ST_STATUS_ALARM		(1UL << 14)	/* Alarm(s) present in ups.alarm */
+#define ST_STATUS_ECO		(1UL << 15)	/* Legacy ECO mode token */
+
+/* Return the ST_STATUS_* bit for one status token, or 0 if not standard */
+unsigned long state_status_token_bit(const char *token);
+/* Return the token name for a single ST_STATUS_* bit, or NULL */
+const char *state_status_bit_token(unsigned long bit);
+/* Parse a space-separated status string into ST_STATUS_* bits; any
+ * non-standard tokens are copied (space-separated) into "other" if
+ * that is not NULL */
+unsigned long state_status_parse(const char *status, char *other, size_t othersize);
+
 #ifdef __cplusplus
 /* *INDENT-OFF* */
 }
@@ -135,6 +135,18 @@ int	str_to_double_strict(const char *string, double *number, const int base);
  */
 int	str_ends_with(const char *s, const char *suff);
 
+/* Lookup indexes of (driver mapping) tables, built once instead of
+ * scanning the tables for each lookup, use open addressing: the table
+ * size is a power of two at least twice the number of entries (as given
+ * by hash_table_size(), at least 16), and the lookup starts at the slot
+ * (hash & (size - 1)) and probes the next slots in turn until it finds
+ * the key or an empty slot.
+ * str_hash() is the djb2 hash of string s, ignoring the case of letters
+ * when nocase is non-zero (to index the names compared by strcasecmp()).
+ */
+size_t	str_hash(const char *s, int nocase);
+size_t	hash_table_size(size_t count);
+
 #ifndef HAVE_STRSEP
 /* Makefile should add the implem to libcommon(client).la */
 char *strsep(char **stringp, const char *delim);
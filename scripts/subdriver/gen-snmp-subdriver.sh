@@ -473,8 +473,9 @@ For C-style integration, do not forget to:
 * bump DRIVER_VERSION in snmp-ups.c (add "0.01")
 * copy "${HFILE}" and "${CFILE}" to "../../drivers"
 * add #include "${HFILE}" to drivers/snmp-ups.c
-* add &${LDRIVER} to drivers/snmp-ups.c:mib2nut[] list,
+* add SU_MIB2NUT(${LDRIVER}, "${LDRIVER}-mib") to drivers/snmp-ups.c:SU_MIB2NUT_LIST,
 * add ${LDRIVER}-mib.c to snmp_ups_SOURCES in drivers/Makefile.am
+  (and ${LDRIVER}-mib.la to snmpmib_LTLIBRARIES, with its LDFLAGS)
 * add ${LDRIVER}-mib.h to dist_noinst_HEADERS in drivers/Makefile.am
 * "./autogen.sh && ./configure && make" from the top level directory
 EOF
@@ -39,11 +39,57 @@
 #include <sys/un.h>
 #endif	/* !WIN32 */
 
+/* Use (if "resume") or drop the data kept from a previous connection */
+static void sstate_resume(upstype_t *ups, int resume)
+{
+	upsdebugx(2, "%s: UPS [%s]: %s the data kept from previous connection",
+		__func__, ups->name, resume ? "resuming" : "dropping");
+
+	if (resume) {
+		state_infofree(ups->inforoot);
+		state_cmdfree(ups->cmdlist);
+		ups->inforoot = ups->kept_inforoot;
+		ups->cmdlist = ups->kept_cmdlist;
+	} else {
+		state_infofree(ups->kept_inforoot);
+		state_cmdfree(ups->kept_cmdlist);
+	}
+
+	ups->kept_inforoot = NULL;
+	ups->kept_cmdlist = NULL;
+	ups->seq_resync = 0;
+}
+
 static int parse_args(upstype_t *ups, size_t numargs, char **arg)
 {
 	if (numargs < 1)
 		return 0;
 
+	/* DUMPBEGIN <epoch> <seq> <FULL|DELTA> */
+	if (!strcasecmp(arg[0], "DUMPBEGIN") && numargs > 3) {
+		snprintf(ups->seq_epoch, sizeof(ups->seq_epoch), "%s", arg[1]);
+		ups->seq = strtoul(arg[2], NULL, 10);
+		upsdebugx(3, "%s: UPS [%s]: %s dump begins at sequence %s %lu",
+			__func__, ups->name, arg[3], ups->seq_epoch, ups->seq);
+
+		if (ups->seq_resync) {
+			if (!strcasecmp(arg[3], "DELTA")) {
+				/* Only the missed updates follow (including any
+				 * we got since connecting): resume the kept data */
+				sstate_resume(ups, 1);
+			} else {
+				sstate_resume(ups, 0);
+			}
+		}
+		return 1;
+	}
+
+	/* SEQ <seq> <broadcast line...> */
+	if (!strcasecmp(arg[0], "SEQ") && numargs > 2) {
+		ups->seq = strtoul(arg[1], NULL, 10);
+		return parse_args(ups, numargs - 2, &arg[2]);
+	}
+
 	if (!strcasecmp(arg[0], "PONG")) {
 		upsdebugx(3, "%s: Got PONG from UPS [%s]", __func__, ups->name);
 		return 1;
@@ -52,6 +98,12 @@ static int parse_args(upstype_t *ups, size_t numargs, char **arg)
 	if (!strcasecmp(arg[0], "DUMPDONE")) {
 		upsdebugx(3, "%s: UPS [%s]: dump is done", __func__, ups->name);
 		ups->dumpdone = 1;
+
+		/* A driver without sequence support sent a full dump */
+		if (ups->seq_resync) {
+			sstate_resume(ups, 0);
+			ups->seq_epoch[0] = '\0';
+		}
 		return 1;
 	}
 
@@ -190,17 +242,37 @@ static void sendping(upstype_t *ups)
 	time(&ups->last_ping);
 }
 
+/* Build the initial dump request: always ask for sequence numbers of
+ * driver broadcasts (older drivers ignore the extra arguments), and if
+ * the data from a previous connection was kept - to resume from there */
+static size_t sstate_dumpcmd(upstype_t *ups, char *buf, size_t bufsize)
+{
+	if (ups->seq_resync && ups->seq_epoch[0]) {
+		snprintf(buf, bufsize, "DUMPALL SEQ %s %lu\n", ups->seq_epoch, ups->seq);
+	} else {
+		ups->seq_resync = 0;
+		snprintf(buf, bufsize, "DUMPALL SEQ\n");
+	}
+
+	upsdebugx(4, "%s: UPS [%s]: %.*s", __func__, ups->name,
+		(int)strcspn(buf, "\n"), buf);
+
+	return strlen(buf);
+}
+
 /* interface */
 
 TYPE_FD sstate_connect(upstype_t *ups)
 {
 	TYPE_FD	fd;
+	char	dumpcmd[LARGEBUF];
 #ifndef WIN32
-	const char	*dumpcmd = "DUMPALL\n";
-	size_t	dumpcmdlen = strlen(dumpcmd);
+	size_t	dumpcmdlen;
 	ssize_t	ret;
 	struct sockaddr_un	sa;
 
+	dumpcmdlen = sstate_dumpcmd(ups, dumpcmd, sizeof(dumpcmd));
+
 	upsdebugx(2, "%s: preparing UNIX socket %s", __func__, NUT_STRARG(ups->fn));
 	check_unix_socket_filename(ups->fn);
 
@@ -276,10 +348,11 @@ TYPE_FD sstate_connect(upstype_t *ups)
 
 #else	/* WIN32 */
 	char pipename[NUT_PATH_MAX];
-	const char	*dumpcmd = "DUMPALL\n";
 	BOOL  result = FALSE;
 	DWORD bytesWritten;
 
+	sstate_dumpcmd(ups, dumpcmd, sizeof(dumpcmd));
+
 	upsdebugx(2, "%s: preparing Windows pipe %s", __func__, NUT_STRARG(ups->fn));
 	snprintf(pipename, sizeof(pipename), "\\\\.\\pipe\\%s", ups->fn);
 
@@ -347,8 +420,22 @@ void sstate_disconnect(upstype_t *ups)
 		return;
 	}
 
-	sstate_infofree(ups);
-	sstate_cmdfree(ups);
+	/* Keep the data aside if the driver told us the sequence of its
+	 * updates, so on reconnection it can just replay those we missed
+	 * meanwhile (if still kept from an earlier connection, that one
+	 * is the base to resume from) */
+	if (!ups->seq_resync && ups->seq_epoch[0] && ups->dumpdone) {
+		ups->kept_inforoot = ups->inforoot;
+		ups->kept_cmdlist = ups->cmdlist;
+		ups->inforoot = NULL;
+		ups->cmdlist = NULL;
+		ups->seq_resync = 1;
+	} else {
+		state_infofree(ups->inforoot);
+		state_cmdfree(ups->cmdlist);
+		ups->inforoot = NULL;
+		ups->cmdlist = NULL;
+	}
 
 	pconf_finish(&ups->sock_ctx);
 
@@ -497,15 +584,21 @@ int sstate_dead(upstype_t *ups, int arg_maxage)
 void sstate_infofree(upstype_t *ups)
 {
 	state_infofree(ups->inforoot);
+	state_infofree(ups->kept_inforoot);
 
 	ups->inforoot = NULL;
+	ups->kept_inforoot = NULL;
+	ups->seq_resync = 0;
+	ups->seq_epoch[0] = '\0';
 }
 
 void sstate_cmdfree(upstype_t *ups)
 {
 	state_cmdfree(ups->cmdlist);
+	state_cmdfree(ups->kept_cmdlist);
 
 	ups->cmdlist = NULL;
+	ups->kept_cmdlist = NULL;
 }
 
 int sstate_sendline(upstype_t *ups, const char *buf)
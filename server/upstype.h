@@ -51,6 +51,15 @@ typedef struct upstype_s {
 	struct st_tree_s	*inforoot;
 	struct cmdlist_s	*cmdlist;
 
+	/* Sequence of the driver broadcasts seen last (if the driver
+	 * reports them), to ask for just the missed ones on reconnect;
+	 * the data from before is kept aside until the driver replies */
+	char	seq_epoch[SMALLBUF];
+	unsigned long	seq;
+	int	seq_resync;
+	struct st_tree_s	*kept_inforoot;
+	struct cmdlist_s	*kept_cmdlist;
+
 	int	numlogins;
 	int	fsd;		/* forced shutdown in effect? */
 
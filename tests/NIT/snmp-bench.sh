@@ -0,0 +1,214 @@
+#!/bin/sh
+
+# NUT snmp-ups benchmark: runs the driver built in this tree against the
+# local SNMP agent simulator (snmp-sim.py next to this script) for a few
+# representative MIB mappings, and reports per poll cycle the time taken,
+# the number of SNMP requests and varbinds, and the driver CPU time.
+#
+# The agent serves a recorded walk if one is found as
+# "${SNMP_BENCH_WALKDIR}/<mapping>.walk" (`snmpwalk -On` output) or
+# "${SNMP_BENCH_WALKDIR}/<mapping>.snmprec", otherwise data synthesized
+# from the "drivers/<mapping>-mib.c" source of the mapping table.
+#
+# WARNING: Current working directory when starting the script should be
+# the location where it may create temporary data (e.g. the BUILDDIR).
+# Caller can export envvars to impact the script behavior, e.g.:
+#	SNMP_BENCH_MIBS="eaton-pdu-marlin:eaton_epdu ietf:ietf"
+#			mapping source names and the "mibs" driver option
+#			values to benchmark, space-separated
+#	SNMP_BENCH_CYCLES=5	poll cycles measured per mapping
+#	SNMP_BENCH_LATENCY=0	agent response delay in milliseconds
+#	SNMP_BENCH_JITTER=0	random extra delay up to so many milliseconds
+#	SNMP_BENCH_LOSS=0	percentage of requests the agent ignores
+#	SNMP_BENCH_OUTLETS=24	outlets per synthesized PDU
+#	SNMP_BENCH_ARGS="-x snmp_max_inflight=4"	more driver options
+#	SNMP_BENCH_WALKDIR=...	where to look for recorded walks (none
+#			by default)
+#	SNMP_BENCH_RESULTS=bench.txt	also append machine-readable results
+#	SNMP_BENCH_PORT=16161	UDP port for the simulated agent
+#	SNMP_UPS=...	driver binary (default: from the build tree)
+#	PYTHON=python3	interpreter for the simulator
+#
+# Design note: written with dumbed-down POSIX shell syntax, like nit.sh
+#
+# License: GPLv2+
+
+TZ=UTC
+LANG=C
+LC_ALL=C
+export TZ LANG LC_ALL
+
+NUT_DEBUG_SYSLOG="stderr"
+export NUT_DEBUG_SYSLOG
+
+log_info() {
+    echo "`TZ=UTC LANG=C date` [INFO] $@" >&2
+}
+
+log_error() {
+    echo "`TZ=UTC LANG=C date` [ERROR] $@" >&2
+}
+
+die() {
+    echo "[FATAL] $@" >&2
+    exit 1
+}
+
+BUILDDIR="`pwd`"
+TOP_BUILDDIR=""
+case "${BUILDDIR}" in
+    */tests/NIT)
+        TOP_BUILDDIR="`cd "${BUILDDIR}"/../.. && pwd`" ;;
+esac
+
+SRCDIR="`dirname "$0"`"
+SRCDIR="`cd "$SRCDIR" && pwd`"
+TOP_SRCDIR="`cd "${SRCDIR}"/../.. && pwd`"
+[ -n "${TOP_BUILDDIR}" ] || TOP_BUILDDIR="${TOP_SRCDIR}"
+
+[ -n "${SNMP_BENCH_MIBS-}" ] || SNMP_BENCH_MIBS="eaton-pdu-marlin:eaton_epdu apc-pdu:apc_pdu ietf:ietf"
+[ -n "${SNMP_BENCH_CYCLES-}" ] || SNMP_BENCH_CYCLES=5
+[ -n "${SNMP_BENCH_LATENCY-}" ] || SNMP_BENCH_LATENCY=0
+[ -n "${SNMP_BENCH_JITTER-}" ] || SNMP_BENCH_JITTER=0
+[ -n "${SNMP_BENCH_LOSS-}" ] || SNMP_BENCH_LOSS=0
+[ -n "${SNMP_BENCH_OUTLETS-}" ] || SNMP_BENCH_OUTLETS=24
+[ -n "${SNMP_BENCH_PORT-}" ] || SNMP_BENCH_PORT=16161
+[ -n "${SNMP_UPS-}" ] || SNMP_UPS="${TOP_BUILDDIR}/drivers/snmp-ups"
+[ -n "${PYTHON-}" ] || PYTHON="python3"
+
+if ! [ -x "${SNMP_UPS}" ] ; then
+    log_info "SKIP: no snmp-ups driver at '${SNMP_UPS}' (was NUT configured --with-snmp?)"
+    exit 0
+fi
+
+if ! (command -v "${PYTHON}") >/dev/null 2>&1 ; then
+    log_info "SKIP: no '${PYTHON}' interpreter for the SNMP agent simulator"
+    exit 0
+fi
+
+TESTDIR="`mktemp -d "${TMPDIR:-/tmp}/nut-snmp-bench.$$.XXXXXX"`" || die "Failed to mktemp"
+NUT_STATEPATH="${TESTDIR}"
+NUT_ALTPIDPATH="${TESTDIR}"
+export NUT_STATEPATH NUT_ALTPIDPATH
+if [ "`id -u`" = 0 ]; then
+    # the driver drops privileges, and must still create its socket here
+    chmod 777 "${TESTDIR}"
+fi
+
+PID_SIM=""
+stop_sim() {
+    if [ -n "${PID_SIM}" ] ; then
+        kill -15 ${PID_SIM} 2>/dev/null
+        wait ${PID_SIM} 2>/dev/null
+        PID_SIM=""
+    fi
+}
+
+trap 'RES=$?; stop_sim; rm -rf "${TESTDIR}"; exit $RES;' 0 1 2 3 15
+
+# Start the simulated agent for mapping $1, statistics in file $2
+start_sim() {
+    SIM_SOURCE="--mib ${TOP_SRCDIR}/drivers/$1-mib.c"
+    for EXT in walk snmprec ; do
+        if [ -n "${SNMP_BENCH_WALKDIR-}" ] && [ -s "${SNMP_BENCH_WALKDIR}/$1.${EXT}" ] ; then
+            SIM_SOURCE="--walk ${SNMP_BENCH_WALKDIR}/$1.${EXT}"
+            break
+        fi
+    done
+
+    rm -f "$2" "${TESTDIR}/sim.pid"
+    "${PYTHON}" "${SRCDIR}/snmp-sim.py" ${SIM_SOURCE} \
+        --port "${SNMP_BENCH_PORT}" --outlets "${SNMP_BENCH_OUTLETS}" \
+        --latency "${SNMP_BENCH_LATENCY}" --jitter "${SNMP_BENCH_JITTER}" \
+        --loss "${SNMP_BENCH_LOSS}" \
+        --stats "$2" --pidfile "${TESTDIR}/sim.pid" &
+    PID_SIM=$!
+
+    COUNT=0
+    while ! [ -s "${TESTDIR}/sim.pid" ] ; do
+        COUNT="`expr $COUNT + 1`"
+        [ "$COUNT" -lt 50 ] || die "The SNMP agent simulator did not start"
+        sleep 0.1 2>/dev/null || sleep 1
+    done
+}
+
+# Children CPU time in the `times` report file $1, in milliseconds
+# (`times` must run in the shell which waited for the driver)
+children_cpu_ms() {
+    tail -1 "$1" | awk '{
+        ms = 0
+        for (i = 1; i <= 2; i++) {
+            v = $i; sub(/s$/, "", v)
+            n = split(v, p, "m")
+            ms += (n > 1 ? p[1] * 60 + p[2] : p[1]) * 1000
+        }
+        printf "%d\n", ms
+    }'
+}
+
+# Run the driver for mapping "mibs" value $1 during $2 update loops,
+# printing the CPU time it took
+run_driver() {
+    times > "${TESTDIR}/times.before"
+    "${SNMP_UPS}" -s snmpbench -d "$2" \
+        -x port="127.0.0.1:${SNMP_BENCH_PORT}" -x mibs="$1" \
+        -x snmp_version=v2c -x community=public \
+        -x pollfreq=1 -x pollinterval=3 \
+        ${SNMP_BENCH_ARGS-} > "${TESTDIR}/driver.out" 2> "${TESTDIR}/driver.err" \
+    || { log_error "snmp-ups failed for mibs=$1:" ; cat "${TESTDIR}/driver.err" >&2 ; }
+    times > "${TESTDIR}/times.after"
+    expr "`children_cpu_ms "${TESTDIR}/times.after"`" - "`children_cpu_ms "${TESTDIR}/times.before"`"
+}
+
+FAILED=0
+DUMP_COUNT="`expr ${SNMP_BENCH_CYCLES} + 1`"
+printf '%-20s %8s %12s %12s %12s %12s\n' "mapping" "cycles" "cycle ms" "requests" "varbinds" "CPU ms" >&2
+
+for ENTRY in ${SNMP_BENCH_MIBS} ; do
+    MAPPING="`echo "${ENTRY}" | sed 's/:.*$//'`"
+    MIBS="`echo "${ENTRY}" | sed 's/^[^:]*://'`"
+
+    # Start-up alone, then with the measured cycles: the difference of
+    # CPU time is what the cycles took
+    start_sim "${MAPPING}" "${TESTDIR}/init.stats"
+    CPU_INIT="`run_driver "${MIBS}" 1`"
+    stop_sim
+
+    start_sim "${MAPPING}" "${TESTDIR}/run.stats"
+    CPU_RUN="`run_driver "${MIBS}" "${DUMP_COUNT}"`"
+    stop_sim
+    CPU_CYCLES="`expr ${CPU_RUN} - ${CPU_INIT}`"
+
+    if ! [ -s "${TESTDIR}/run.stats" ] ; then
+        log_error "No statistics from the SNMP agent simulator for ${MAPPING}"
+        FAILED="`expr $FAILED + 1`"
+        continue
+    fi
+
+    # The first burst of requests is the detection and initial walk
+    RESULT="`awk -F'[= ]' -v cpu="${CPU_CYCLES}" -v cycles="${SNMP_BENCH_CYCLES}" '
+        /^cycle\.[0-9]+=/ {
+            split($1, name, ".")
+            if (name[2] > 0) { n++; ms += $2; req += $3; vb += $4 }
+        }
+        END {
+            if (n == 0) { printf "0 0 0 0 0\n"; exit }
+            if (cpu < 0) cpu = 0
+            printf "%d %.1f %.1f %.1f %.1f\n", n, ms / n, req / n, vb / n, cpu / cycles
+        }' "${TESTDIR}/run.stats"`"
+
+    set -- ${RESULT}
+    printf '%-20s %8s %12s %12s %12s %12s\n' "${MAPPING}" "$1" "$2" "$3" "$4" "$5" >&2
+    if [ "$1" = 0 ] ; then
+        log_error "No poll cycle was measured for ${MAPPING}, see the driver output:"
+        cat "${TESTDIR}/driver.err" >&2
+        FAILED="`expr $FAILED + 1`"
+    fi
+
+    if [ -n "${SNMP_BENCH_RESULTS-}" ] ; then
+        echo "mapping=${MAPPING} mibs=${MIBS} cycles=$1 cycle_ms=$2 requests=$3 varbinds=$4 cpu_ms=$5 latency_ms=${SNMP_BENCH_LATENCY} loss=${SNMP_BENCH_LOSS} args=\"${SNMP_BENCH_ARGS-}\"" \
+            >> "${SNMP_BENCH_RESULTS}"
+    fi
+done
+
+[ "${FAILED}" = 0 ] || die "${FAILED} benchmark(s) failed"
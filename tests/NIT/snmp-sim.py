@@ -0,0 +1,754 @@
+#!/usr/bin/env python3
+#
+# Minimal SNMPv1/v2c agent simulator for NUT snmp-ups benchmarks and tests.
+#
+# Serves a recorded walk (`snmpwalk -On` output, or an `.snmprec` file as
+# recorded by snmpsim) or data synthesized from a NUT `*-mib.c` mapping
+# table, over UDP on the local host, with configurable response latency
+# and request loss. It answers GET, GETNEXT, GETBULK and SET requests and
+# counts what it was asked, so a benchmark can tell the number of requests
+# and varbinds per driver poll cycle and how long each cycle took.
+#
+# Only the Python 3 standard library is needed. Examples:
+#	snmp-sim.py --port 16161 --walk eaton-epdu.walk --latency 20 --loss 1
+#	snmp-sim.py --port 16161 --mib drivers/ietf-mib.c --stats ietf.stats
+#	snmp-sim.py --mib drivers/apc-pdu-mib.c --outlets 24 --dump > apc.walk
+#
+# Statistics are written (as "key=value" lines) to the --stats file, or to
+# stderr, when the program ends on SIGTERM or SIGINT, and also on SIGUSR1.
+# A "cycle" is a burst of requests separated from the next one by at least
+# --cycle-gap seconds of silence.
+#
+# License: GPLv2+
+
+import argparse
+import bisect
+import heapq
+import os
+import random
+import re
+import select
+import signal
+import socket
+import sys
+import time
+
+# ASN.1 BER tags used by SNMP
+TAG_INTEGER = 0x02
+TAG_OCTET_STRING = 0x04
+TAG_NULL = 0x05
+TAG_OID = 0x06
+TAG_SEQUENCE = 0x30
+TAG_IPADDRESS = 0x40
+TAG_COUNTER32 = 0x41
+TAG_GAUGE32 = 0x42
+TAG_TIMETICKS = 0x43
+TAG_OPAQUE = 0x44
+TAG_COUNTER64 = 0x46
+TAG_NOSUCHOBJECT = 0x80
+TAG_NOSUCHINSTANCE = 0x81
+TAG_ENDOFMIBVIEW = 0x82
+
+PDU_GET = 0xA0
+PDU_GETNEXT = 0xA1
+PDU_RESPONSE = 0xA2
+PDU_SET = 0xA3
+PDU_GETBULK = 0xA5
+
+PDU_NAMES = {
+    PDU_GET: "get",
+    PDU_GETNEXT: "getnext",
+    PDU_SET: "set",
+    PDU_GETBULK: "getbulk",
+}
+
+ERR_NOERROR = 0
+ERR_TOOBIG = 1
+ERR_NOSUCHNAME = 2
+ERR_NOTWRITABLE = 17
+
+# Stay below a typical MTU, like small agents do (answer tooBig beyond it)
+MAX_RESPONSE_SIZE = 1400
+
+UNSIGNED_TAGS = (TAG_COUNTER32, TAG_GAUGE32, TAG_TIMETICKS, TAG_COUNTER64)
+
+
+class BERError(Exception):
+    pass
+
+
+def ber_length(length):
+    if length < 0x80:
+        return bytes([length])
+    out = b""
+    while length:
+        out = bytes([length & 0xFF]) + out
+        length >>= 8
+    return bytes([0x80 | len(out)]) + out
+
+
+def ber_tlv(tag, value):
+    return bytes([tag]) + ber_length(len(value)) + value
+
+
+def ber_int_value(number, unsigned=False):
+    if unsigned:
+        out = number.to_bytes(max(1, (number.bit_length() + 8) // 8), "big")
+        return out
+    size = max(1, (number + (number < 0)).bit_length() // 8 + 1)
+    return number.to_bytes(size, "big", signed=True)
+
+
+def ber_oid_value(arcs):
+    if len(arcs) < 2:
+        arcs = tuple(arcs) + (0,) * (2 - len(arcs))
+    out = bytearray([arcs[0] * 40 + arcs[1]])
+    for arc in arcs[2:]:
+        chunk = [arc & 0x7F]
+        arc >>= 7
+        while arc:
+            chunk.insert(0, 0x80 | (arc & 0x7F))
+            arc >>= 7
+        out.extend(chunk)
+    return bytes(out)
+
+
+def ber_read(data, pos):
+    """Return (tag, value, next position) of the TLV at pos"""
+    if pos + 2 > len(data):
+        raise BERError("truncated")
+    tag = data[pos]
+    length = data[pos + 1]
+    pos += 2
+    if length & 0x80:
+        count = length & 0x7F
+        if count == 0 or count > 4 or pos + count > len(data):
+            raise BERError("bad length")
+        length = int.from_bytes(data[pos:pos + count], "big")
+        pos += count
+    if pos + length > len(data):
+        raise BERError("truncated value")
+    return tag, data[pos:pos + length], pos + length
+
+
+def ber_read_int(data):
+    return int.from_bytes(data, "big", signed=True) if data else 0
+
+
+def ber_read_oid(data):
+    if not data:
+        return ()
+    arcs = [data[0] // 40, data[0] % 40]
+    arc = 0
+    for byte in data[1:]:
+        arc = (arc << 7) | (byte & 0x7F)
+        if not byte & 0x80:
+            arcs.append(arc)
+            arc = 0
+    return tuple(arcs)
+
+
+def ber_sequence_items(data):
+    items = []
+    pos = 0
+    while pos < len(data):
+        tag, value, pos = ber_read(data, pos)
+        items.append((tag, value))
+    return items
+
+
+def parse_oid(text):
+    text = text.strip().lstrip(".")
+    if not text:
+        return ()
+    return tuple(int(arc) for arc in text.split("."))
+
+
+def format_oid(arcs):
+    return "." + ".".join(str(arc) for arc in arcs)
+
+
+class MIBData:
+    """Sorted OID tree with encoded values: (tag, value bytes)"""
+
+    def __init__(self):
+        self.values = {}
+        self.order = []
+
+    def set(self, oid, tag, value):
+        if oid not in self.values:
+            bisect.insort(self.order, oid)
+        self.values[oid] = (tag, value)
+
+    def get(self, oid):
+        return self.values.get(oid)
+
+    def next(self, oid):
+        pos = bisect.bisect_right(self.order, oid)
+        if pos < len(self.order):
+            found = self.order[pos]
+            return found, self.values[found]
+        return None, None
+
+    def has_prefix(self, oid):
+        """Is there an object (a column or scalar) above this instance?"""
+        if len(oid) < 2:
+            return False
+        parent = oid[:-1]
+        pos = bisect.bisect_left(self.order, parent)
+        return pos < len(self.order) and self.order[pos][:len(parent)] == parent
+
+    def encode_value(self, tag, text):
+        if tag == TAG_INTEGER:
+            return ber_int_value(int(text))
+        if tag in UNSIGNED_TAGS:
+            return ber_int_value(int(text), unsigned=True)
+        if tag == TAG_OID:
+            return ber_oid_value(parse_oid(text))
+        if tag == TAG_IPADDRESS:
+            return bytes(int(part) for part in text.split("."))
+        if tag == TAG_NULL:
+            return b""
+        return text.encode("utf-8", "replace") if isinstance(text, str) else text
+
+    def dump(self, out):
+        for oid in self.order:
+            tag, value = self.values[oid]
+            out.write("%s = %s\n" % (format_oid(oid), describe_value(tag, value)))
+
+
+def describe_value(tag, value):
+    if tag == TAG_INTEGER:
+        return "INTEGER: %d" % ber_read_int(value)
+    if tag == TAG_COUNTER32:
+        return "Counter32: %d" % int.from_bytes(value, "big")
+    if tag == TAG_GAUGE32:
+        return "Gauge32: %d" % int.from_bytes(value, "big")
+    if tag == TAG_COUNTER64:
+        return "Counter64: %d" % int.from_bytes(value, "big")
+    if tag == TAG_TIMETICKS:
+        return "Timeticks: (%d)" % int.from_bytes(value, "big")
+    if tag == TAG_OID:
+        return "OID: %s" % format_oid(ber_read_oid(value))
+    if tag == TAG_IPADDRESS:
+        return "IpAddress: %s" % ".".join(str(byte) for byte in value)
+    try:
+        text = value.decode("ascii")
+        if all(32 <= ord(char) < 127 for char in text):
+            return 'STRING: "%s"' % text.replace('"', '\\"')
+    except UnicodeDecodeError:
+        pass
+    return "Hex-STRING: %s" % " ".join("%02X" % byte for byte in value)
+
+
+# `snmpwalk -On` value types, and `.snmprec` numeric types
+WALK_TYPES = {
+    "INTEGER": TAG_INTEGER,
+    "STRING": TAG_OCTET_STRING,
+    "Hex-STRING": TAG_OCTET_STRING,
+    "OID": TAG_OID,
+    "IpAddress": TAG_IPADDRESS,
+    "Counter32": TAG_COUNTER32,
+    "Gauge32": TAG_GAUGE32,
+    "Timeticks": TAG_TIMETICKS,
+    "Counter64": TAG_COUNTER64,
+    "Opaque": TAG_OPAQUE,
+    "NULL": TAG_NULL,
+}
+
+
+def walk_value(kind, text):
+    """Convert the text of an `snmpwalk` value to (tag, value text)"""
+    tag = WALK_TYPES.get(kind, TAG_OCTET_STRING)
+    text = text.strip()
+    if kind == "Hex-STRING":
+        return tag, bytes(int(byte, 16) for byte in text.split())
+    if kind == "STRING" or kind not in WALK_TYPES:
+        if len(text) >= 2 and text[0] == '"' and text[-1] == '"':
+            text = text[1:-1].replace('\\"', '"')
+        return TAG_OCTET_STRING, text
+    if kind == "Timeticks":
+        found = re.match(r"\((\d+)\)", text)
+        return tag, found.group(1) if found else "0"
+    if tag == TAG_INTEGER or tag in UNSIGNED_TAGS:
+        # e.g. "on(1)" for enumerations, "230 V" with units
+        found = re.search(r"\((-?\d+)\)\s*$", text) or re.match(r"(-?\d+)", text)
+        return tag, found.group(1) if found else "0"
+    return tag, text
+
+
+def load_walk(data, filename):
+    """Load `snmpwalk -On` output (or a `.snmprec` file)"""
+    last = None
+    with open(filename, "r", encoding="utf-8", errors="replace") as walk:
+        for line in walk:
+            line = line.rstrip("\r\n")
+            if "|" in line and re.match(r"^\.?[0-9.]+\|", line):
+                # snmprec: OID|type|value, with "x" type suffix for hex
+                oid, kind, value = (line.split("|", 2) + [""])[:3]
+                if kind.endswith("x"):
+                    tag = int(kind[:-1])
+                    value = bytes.fromhex(value)
+                else:
+                    tag = int(kind)
+                data.set(parse_oid(oid), tag, data.encode_value(tag, value))
+                continue
+            found = re.match(r"^(\.?[0-9][0-9.]*)\s*=\s*(?:([A-Za-z0-9-]+):\s?)?(.*)$", line)
+            if found:
+                oid = parse_oid(found.group(1))
+                kind = found.group(2) or "STRING"
+                if kind == "No more variables left in this MIB View" \
+                        or found.group(3).startswith("No Such"):
+                    last = None
+                    continue
+                tag, value = walk_value(kind, found.group(3))
+                data.set(oid, tag, data.encode_value(tag, value))
+                last = (oid, kind, found.group(3))
+            elif last is not None and last[1] == "STRING":
+                # continuation of a multi-line string value
+                text = last[2] + "\n" + line
+                last = (last[0], last[1], text)
+                tag, value = walk_value("STRING", text)
+                data.set(last[0], tag, data.encode_value(tag, value))
+
+
+def c_defines(source):
+    """The #define'd string constants of a mapping source"""
+    defines = {}
+    for found in re.finditer(r'^\s*#\s*define\s+(\w+)\s+((?:"[^"]*"\s*)+)', source, re.M):
+        defines[found.group(1)] = "".join(re.findall(r'"([^"]*)"', found.group(2)))
+    return defines
+
+
+def c_string(expression, defines):
+    """Evaluate a C string expression like `IETF_OID_UPS_MIB "1.1.0"`"""
+    expression = expression.strip()
+    if expression == "NULL":
+        return None
+    out = ""
+    for token in re.findall(r'"[^"]*"|\w+', expression):
+        if token.startswith('"'):
+            out += token[1:-1]
+        elif token in defines:
+            out += defines[token]
+        else:
+            return None
+    return out
+
+
+def c_arguments(text):
+    """Split the arguments of a macro call (given the text past its "(")"""
+    args, depth, current, quoted = [], 0, "", False
+    for char in text:
+        if quoted:
+            current += char
+            if char == '"':
+                quoted = False
+            continue
+        if char == '"':
+            quoted = True
+        elif char in "({[":
+            depth += 1
+        elif char in ")}]":
+            if depth == 0:
+                args.append(current.strip())
+                return args
+            depth -= 1
+        elif char == "," and depth == 0:
+            args.append(current.strip())
+            current = ""
+            continue
+        current += char
+    return args
+
+
+def load_mapping(data, filename, counts):
+    """Synthesize agent data from a NUT snmp-ups mapping table source:
+    every OID of the mapping exists, with the first value of its lookup
+    table (or a number, or a string), and templates are expanded for the
+    requested number of outlets, outlet groups and ambient sensors"""
+    with open(filename, "r", encoding="utf-8", errors="replace") as mapping:
+        source = mapping.read()
+    source = re.sub(r"/\*.*?\*/", "", source, flags=re.S)
+    defines = c_defines(source)
+
+    lookups = {}
+    for found in re.finditer(r"info_lkp_t\s+(\w+)\s*\[\s*\]\s*=\s*\{(.*?)\};", source, re.S):
+        first = re.search(r"(?:info_lkp_\w+\s*\(|\{)\s*(-?\d+)\s*,", found.group(2))
+        if first:
+            lookups[found.group(1)] = first.group(1)
+
+    entries = []
+    for found in re.finditer(r"\bsnmp_info_default\s*\(", source):
+        args = c_arguments(source[found.end():])
+        if len(args) < 7:
+            continue
+        info_type = c_string(args[0], defines)
+        oid = c_string(args[3], defines)
+        if not info_type or not oid or not re.match(r"^\.?[0-9][0-9.%i]*$", oid):
+            continue
+        lookup = re.sub(r"^&|\[0\]$", "", args[6].strip())
+        entries.append((info_type, args[1], oid, lookups.get(lookup)))
+
+    # Prefer the mib2nut entry named like the file (e.g. "ietf" of the
+    # ietf-mib.c, which also serves "tripplite"), else take the first one
+    sysoid, model_oid = None, None
+    base = os.path.basename(filename).replace("_", "-")
+    for found in re.finditer(r"mib2nut_info_t\s+(\w+)\s*=\s*\{", source):
+        args = c_arguments(source[found.end():])
+        if len(args) < 6:
+            continue
+        name = (c_string(args[0], defines) or "").replace("_", "-")
+        if sysoid is None or (name and base.startswith(name + "-")):
+            model_oid = c_string(args[3], defines)
+            sysoid = c_string(args[5], defines)
+    if counts.get("sysoid"):
+        sysoid = counts["sysoid"]
+
+    # Daisy-chained devices are numbered from 0 when the model OID
+    # checked at detection is the "%i = 0" instance of the device.model
+    device_base = 1
+    for info_type, flags, oid, lookup in entries:
+        if model_oid and oid.count("%i") == 1 \
+                and oid.lstrip(".").replace("%i", "0") == model_oid.lstrip("."):
+            device_base = 0
+
+    def instances(info_type, oid):
+        parts = oid.count("%i")
+        if parts == 0:
+            return [oid]
+        if info_type.startswith("outlet.group."):
+            count = counts["groups"]
+        elif info_type.startswith("outlet."):
+            count = counts["outlets"]
+        elif info_type.startswith("ambient."):
+            count = counts["ambients"]
+        else:
+            count = None
+        devices = range(device_base, device_base + counts["devices"])
+        items = range(1, (count or 0) + 1)
+        if parts >= 2:
+            return [oid.replace("%i", str(dev), 1).replace("%i", str(item), 1)
+                    for dev in devices for item in items]
+        if count is None:
+            return [oid.replace("%i", str(dev)) for dev in devices]
+        return [oid.replace("%i", str(item)) for item in items]
+
+    for info_type, flags, oid, lookup in entries:
+        for instance in instances(info_type, oid):
+            key = parse_oid(instance)
+            if not key or data.get(key):
+                continue
+            if info_type.endswith("outlet.group.count"):
+                tag, value = TAG_INTEGER, str(counts["groups"])
+            elif info_type.endswith("outlet.count"):
+                tag, value = TAG_INTEGER, str(counts["outlets"])
+            elif info_type.endswith("ambient.count"):
+                tag, value = TAG_INTEGER, str(counts["ambients"])
+            elif info_type == "device.count":
+                tag, value = TAG_INTEGER, str(counts["devices"])
+            elif lookup is not None:
+                tag, value = TAG_INTEGER, lookup
+            elif "ST_FLAG_STRING" in flags:
+                tag, value = TAG_OCTET_STRING, "sim %s" % info_type.replace("%i", "1")
+            else:
+                tag, value = TAG_INTEGER, "1"
+            data.set(key, tag, data.encode_value(tag, value))
+
+    # System group, for detection
+    if sysoid:
+        data.set(parse_oid(".1.3.6.1.2.1.1.2.0"), TAG_OID, ber_oid_value(parse_oid(sysoid)))
+    if not data.get(parse_oid(".1.3.6.1.2.1.1.1.0")):
+        data.set(parse_oid(".1.3.6.1.2.1.1.1.0"), TAG_OCTET_STRING,
+                 ("NUT SNMP simulator for %s" % os.path.basename(filename)).encode())
+
+
+class Stats:
+    def __init__(self, cycle_gap):
+        self.cycle_gap = cycle_gap
+        self.counts = {name: 0 for name in PDU_NAMES.values()}
+        self.requests = 0
+        self.varbinds = 0
+        self.dropped = 0
+        self.errors = 0
+        self.bytes_in = 0
+        self.bytes_out = 0
+        self.cycles = []	# [start, end, requests, varbinds]
+        self.last = None
+
+    def request(self, pdu_type, varbinds, size):
+        now = time.monotonic()
+        if self.last is None or now - self.last >= self.cycle_gap:
+            self.cycles.append([now, now, 0, 0])
+        cycle = self.cycles[-1]
+        cycle[1] = now
+        cycle[2] += 1
+        cycle[3] += varbinds
+        self.last = now
+        self.requests += 1
+        self.varbinds += varbinds
+        self.bytes_in += size
+        name = PDU_NAMES.get(pdu_type)
+        if name:
+            self.counts[name] += 1
+
+    def answered(self, size):
+        now = time.monotonic()
+        if self.cycles:
+            self.cycles[-1][1] = max(self.cycles[-1][1], now)
+            self.last = max(self.last, now)
+        self.bytes_out += size
+
+    def write(self, out):
+        out.write("requests=%d\n" % self.requests)
+        out.write("varbinds=%d\n" % self.varbinds)
+        for name in sorted(self.counts):
+            out.write("requests.%s=%d\n" % (name, self.counts[name]))
+        out.write("dropped=%d\n" % self.dropped)
+        out.write("errors=%d\n" % self.errors)
+        out.write("bytes.in=%d\n" % self.bytes_in)
+        out.write("bytes.out=%d\n" % self.bytes_out)
+        out.write("cycles=%d\n" % len(self.cycles))
+        for number, cycle in enumerate(self.cycles):
+            out.write("cycle.%d=%.3f %d %d\n" % (
+                number, (cycle[1] - cycle[0]) * 1000.0, cycle[2], cycle[3]))
+
+
+class Agent:
+    def __init__(self, data, options, stats):
+        self.data = data
+        self.options = options
+        self.stats = stats
+        self.random = random.Random(options.seed)
+        self.pending = []	# heap of (send time, sequence, address, message)
+        self.sequence = 0
+
+    def varbind(self, oid, tag, value):
+        return ber_tlv(TAG_SEQUENCE, ber_tlv(TAG_OID, ber_oid_value(oid)) + ber_tlv(tag, value))
+
+    def lookup(self, version, oid):
+        """GET: return (tag, value) or an error code for SNMPv1"""
+        found = self.data.get(oid)
+        if found:
+            return found
+        if version == 0:
+            return None
+        if self.data.has_prefix(oid):
+            return TAG_NOSUCHINSTANCE, b""
+        return TAG_NOSUCHOBJECT, b""
+
+    def handle(self, message):
+        tag, body, _ = ber_read(message, 0)
+        if tag != TAG_SEQUENCE:
+            raise BERError("not a sequence")
+        items = ber_sequence_items(body)
+        if len(items) < 3:
+            raise BERError("short message")
+        version = ber_read_int(items[0][1])
+        community = items[1][1]
+        pdu_type, pdu = items[2]
+        fields = ber_sequence_items(pdu)
+        if len(fields) < 4:
+            raise BERError("short PDU")
+        request_id = ber_read_int(fields[0][1])
+        param1 = ber_read_int(fields[1][1])
+        param2 = ber_read_int(fields[2][1])
+        varbinds = []
+        for _, varbind in ber_sequence_items(fields[3][1]):
+            parts = ber_sequence_items(varbind)
+            varbinds.append((ber_read_oid(parts[0][1]), parts[1] if len(parts) > 1 else (TAG_NULL, b"")))
+
+        self.stats.request(pdu_type, len(varbinds), len(message))
+
+        if community != self.options.community.encode():
+            self.stats.errors += 1
+            return None
+
+        status, index, out = ERR_NOERROR, 0, []
+        if pdu_type == PDU_GET:
+            for number, (oid, _) in enumerate(varbinds):
+                found = self.lookup(version, oid)
+                if found is None:
+                    status, index = ERR_NOSUCHNAME, number + 1
+                    break
+                out.append(self.varbind(oid, *found))
+        elif pdu_type in (PDU_GETNEXT, PDU_GETBULK):
+            if pdu_type == PDU_GETBULK and version == 0:
+                self.stats.errors += 1
+                return None
+            non_repeaters = param1 if pdu_type == PDU_GETBULK else len(varbinds)
+            repetitions = param2 if pdu_type == PDU_GETBULK else 0
+            non_repeaters = max(0, min(non_repeaters, len(varbinds)))
+            for number, (oid, _) in enumerate(varbinds[:non_repeaters]):
+                found_oid, found = self.data.next(oid)
+                if found_oid is None:
+                    if version == 0:
+                        status, index = ERR_NOSUCHNAME, number + 1
+                        break
+                    out.append(self.varbind(oid, TAG_ENDOFMIBVIEW, b""))
+                else:
+                    out.append(self.varbind(found_oid, *found))
+            current = [oid for oid, _ in varbinds[non_repeaters:]]
+            size = sum(len(item) for item in out)
+            for _ in range(max(0, repetitions)):
+                row = []
+                for number, oid in enumerate(current):
+                    found_oid, found = self.data.next(oid)
+                    if found_oid is None:
+                        row.append(self.varbind(oid, TAG_ENDOFMIBVIEW, b""))
+                    else:
+                        row.append(self.varbind(found_oid, *found))
+                        current[number] = found_oid
+                row_size = sum(len(item) for item in row)
+                if out and size + row_size > MAX_RESPONSE_SIZE:
+                    break
+                out.extend(row)
+                size += row_size
+                if all(self.data.next(oid)[0] is None for oid in current):
+                    break
+        elif pdu_type == PDU_SET:
+            for number, (oid, value) in enumerate(varbinds):
+                if self.data.get(oid) is None:
+                    status, index = (ERR_NOSUCHNAME if version == 0 else ERR_NOTWRITABLE), number + 1
+                    break
+            if status == ERR_NOERROR:
+                for oid, value in varbinds:
+                    self.data.set(oid, value[0], value[1])
+                    out.append(self.varbind(oid, value[0], value[1]))
+        else:
+            self.stats.errors += 1
+            return None
+
+        if status != ERR_NOERROR:
+            # errors return the request varbinds unchanged
+            out = [self.varbind(oid, value[0], value[1]) for oid, value in varbinds]
+
+        response = self.response(version, community, request_id, status, index, out)
+        if len(response) > MAX_RESPONSE_SIZE + 100 and len(out) > 1:
+            response = self.response(version, community, request_id, ERR_TOOBIG, 0,
+                                     [self.varbind(oid, value[0], value[1]) for oid, value in varbinds])
+        return response
+
+    def response(self, version, community, request_id, status, index, varbinds):
+        pdu = (ber_tlv(TAG_INTEGER, ber_int_value(request_id))
+               + ber_tlv(TAG_INTEGER, ber_int_value(status))
+               + ber_tlv(TAG_INTEGER, ber_int_value(index))
+               + ber_tlv(TAG_SEQUENCE, b"".join(varbinds)))
+        return ber_tlv(TAG_SEQUENCE,
+                       ber_tlv(TAG_INTEGER, ber_int_value(version))
+                       + ber_tlv(TAG_OCTET_STRING, community)
+                       + ber_tlv(PDU_RESPONSE, pdu))
+
+    def receive(self, sock):
+        message, address = sock.recvfrom(65535)
+        try:
+            response = self.handle(message)
+        except (BERError, IndexError, ValueError) as error:
+            self.stats.errors += 1
+            if self.options.verbose:
+                sys.stderr.write("snmp-sim: bad request from %s: %s\n" % (address, error))
+            return
+        if response is None:
+            return
+        if self.options.loss > 0 and self.random.uniform(0, 100) < self.options.loss:
+            self.stats.dropped += 1
+            return
+        delay = self.options.latency
+        if self.options.jitter > 0:
+            delay += self.random.uniform(0, self.options.jitter)
+        self.sequence += 1
+        heapq.heappush(self.pending, (time.monotonic() + delay / 1000.0, self.sequence, address, response))
+
+    def send_due(self, sock):
+        now = time.monotonic()
+        while self.pending and self.pending[0][0] <= now:
+            _, _, address, response = heapq.heappop(self.pending)
+            sock.sendto(response, address)
+            self.stats.answered(len(response))
+
+    def timeout(self):
+        if not self.pending:
+            return None
+        return max(0.0, self.pending[0][0] - time.monotonic())
+
+
+def main():
+    parser = argparse.ArgumentParser(description="SNMP agent simulator for NUT snmp-ups tests")
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--walk", help="serve this `snmpwalk -On` output or `.snmprec` file")
+    source.add_argument("--mib", help="synthesize data from this NUT *-mib.c mapping source")
+    parser.add_argument("--address", default="127.0.0.1", help="address to listen on (default: %(default)s)")
+    parser.add_argument("--port", type=int, default=16161, help="UDP port to listen on (default: %(default)s)")
+    parser.add_argument("--community", default="public", help="community to accept (default: %(default)s)")
+    parser.add_argument("--latency", type=float, default=0, help="delay of each response, in milliseconds")
+    parser.add_argument("--jitter", type=float, default=0, help="random extra delay up to so many milliseconds")
+    parser.add_argument("--loss", type=float, default=0, help="percentage of requests left unanswered")
+    parser.add_argument("--seed", type=int, default=1, help="random seed, for repeatable loss and jitter")
+    parser.add_argument("--outlets", type=int, default=24, help="outlets per device for --mib (default: %(default)s)")
+    parser.add_argument("--groups", type=int, default=6, help="outlet groups per device for --mib (default: %(default)s)")
+    parser.add_argument("--ambients", type=int, default=1, help="ambient sensors for --mib (default: %(default)s)")
+    parser.add_argument("--devices", type=int, default=1, help="daisy-chained devices for --mib (default: %(default)s)")
+    parser.add_argument("--sysoid", help="sysObjectID to serve for --mib (default: from the mapping)")
+    parser.add_argument("--cycle-gap", type=float, default=0.5,
+                        help="seconds of silence which end a poll cycle (default: %(default)s)")
+    parser.add_argument("--stats", help="file to write statistics to (default: stderr)")
+    parser.add_argument("--pidfile", help="file to write the PID to once listening")
+    parser.add_argument("--dump", action="store_true", help="print the served data as `snmpwalk -On` and exit")
+    parser.add_argument("--verbose", action="store_true", help="report malformed requests")
+    options = parser.parse_args()
+
+    data = MIBData()
+    if options.walk:
+        load_walk(data, options.walk)
+    else:
+        load_mapping(data, options.mib, {
+            "outlets": options.outlets, "groups": options.groups,
+            "ambients": options.ambients, "devices": options.devices,
+            "sysoid": options.sysoid,
+        })
+
+    if options.dump:
+        data.dump(sys.stdout)
+        return 0
+
+    stats = Stats(options.cycle_gap)
+    agent = Agent(data, options, stats)
+
+    def write_stats(*_):
+        if options.stats:
+            with open(options.stats, "w") as out:
+                stats.write(out)
+        else:
+            stats.write(sys.stderr)
+
+    def finish(*_):
+        write_stats()
+        sys.exit(0)
+
+    signal.signal(signal.SIGTERM, finish)
+    signal.signal(signal.SIGINT, finish)
+    if hasattr(signal, "SIGUSR1"):
+        signal.signal(signal.SIGUSR1, write_stats)
+
+    sock = socket.socket(socket.AF_INET6 if ":" in options.address else socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((options.address, options.port))
+
+    if options.pidfile:
+        with open(options.pidfile, "w") as out:
+            out.write("%d\n" % os.getpid())
+
+    if options.verbose:
+        sys.stderr.write("snmp-sim: serving %d OIDs on %s:%d\n" % (len(data.order), options.address, options.port))
+
+    while True:
+        try:
+            ready, _, _ = select.select([sock], [], [], agent.timeout())
+        except InterruptedError:
+            continue
+        if ready:
+            agent.receive(sock)
+        agent.send_due(sock)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,157 @@
+#!/bin/sh
+
+# NUT usbhid-ups benchmark: runs the usbhid-bench program built in this
+# tree (the usbhid-ups driver code with a replay of USB HID devices in
+# place of libusb, see tests/usbhid-bench.c) for a few representative
+# devices, and reports the start-up time, the time and CPU time of each
+# driver update, the feature reports read per update, and the latency
+# from an interrupt report to its publication by the driver. If valgrind
+# is available, it also counts heap allocations during start-up and per
+# update.
+#
+# A device is replayed from a driver debug log (`usbhid-ups -DDDDD`, at
+# least with the report descriptor and the reports read) if one is found
+# as "${USBHID_BENCH_LOGDIR}/<device>.log", otherwise made up from the
+# mapping table of the subdriver for one of "apc", "mge" or "cps".
+#
+# WARNING: Current working directory when starting the script should be
+# the location where it may create temporary data (e.g. the BUILDDIR).
+# Caller can export envvars to impact the script behavior, e.g.:
+#	USBHID_BENCH_DEVICES="apc mge cps"	devices to benchmark,
+#			space-separated
+#	USBHID_BENCH_CYCLES=5	poll intervals measured per device
+#	USBHID_BENCH_ARGS="-x syncinterrupt"	more driver options
+#	USBHID_BENCH_LOGDIR=...	where to look for recorded logs (none
+#			by default)
+#	USBHID_BENCH_RESULTS=bench.txt	also append machine-readable results
+#	USBHID_BENCH=...	benchmark binary (default: from the build tree)
+#	VALGRIND=valgrind	allocation counter (skipped if missing)
+#
+# Design note: written with dumbed-down POSIX shell syntax, like nit.sh
+#
+# License: GPLv2+
+
+TZ=UTC
+LANG=C
+LC_ALL=C
+export TZ LANG LC_ALL
+
+NUT_DEBUG_SYSLOG="stderr"
+export NUT_DEBUG_SYSLOG
+
+log_info() {
+    echo "`TZ=UTC LANG=C date` [INFO] $@" >&2
+}
+
+log_error() {
+    echo "`TZ=UTC LANG=C date` [ERROR] $@" >&2
+}
+
+die() {
+    echo "[FATAL] $@" >&2
+    exit 1
+}
+
+BUILDDIR="`pwd`"
+TOP_BUILDDIR=""
+case "${BUILDDIR}" in
+    */tests/NIT)
+        TOP_BUILDDIR="`cd "${BUILDDIR}"/../.. && pwd`" ;;
+esac
+
+SRCDIR="`dirname "$0"`"
+SRCDIR="`cd "$SRCDIR" && pwd`"
+TOP_SRCDIR="`cd "${SRCDIR}"/../.. && pwd`"
+[ -n "${TOP_BUILDDIR}" ] || TOP_BUILDDIR="${TOP_SRCDIR}"
+
+[ -n "${USBHID_BENCH_DEVICES-}" ] || USBHID_BENCH_DEVICES="apc mge cps"
+[ -n "${USBHID_BENCH_CYCLES-}" ] || USBHID_BENCH_CYCLES=5
+[ -n "${USBHID_BENCH-}" ] || USBHID_BENCH="${TOP_BUILDDIR}/tests/usbhid-bench"
+[ -n "${VALGRIND-}" ] || VALGRIND="valgrind"
+
+if ! [ -x "${USBHID_BENCH}" ] ; then
+    log_info "SKIP: no usbhid-bench program at '${USBHID_BENCH}' (was NUT configured --with-usb?)"
+    exit 0
+fi
+
+# Valgrind must run the real binary rather than its libtool wrapper script
+LIBTOOL_EXEC=""
+if [ -x "${TOP_BUILDDIR}/libtool" ] && [ -s "${TOP_BUILDDIR}/tests/.libs/usbhid-bench" ] ; then
+    LIBTOOL_EXEC="${TOP_BUILDDIR}/libtool --mode=execute"
+fi
+
+HAVE_VALGRIND=false
+if (command -v "${VALGRIND}") >/dev/null 2>&1 ; then
+    HAVE_VALGRIND=true
+else
+    log_info "No '${VALGRIND}' found, heap allocations will not be counted"
+fi
+
+TESTDIR="`mktemp -d "${TMPDIR:-/tmp}/nut-usbhid-bench.$$.XXXXXX"`" || die "Failed to mktemp"
+NUT_STATEPATH="${TESTDIR}"
+export NUT_STATEPATH
+
+trap 'RES=$?; rm -rf "${TESTDIR}"; exit $RES;' 0 1 2 3 15
+
+# Heap allocations by a benchmark run for device options $1 during $2
+# poll intervals, and the count of updates it made (the forked interrupt
+# scheduler allocates nothing more than its parent did, so the largest
+# count is that of the benchmark)
+count_allocs() {
+    ${LIBTOOL_EXEC} "${VALGRIND}" "${USBHID_BENCH}" $1 -c "$2" \
+        ${USBHID_BENCH_ARGS-} > "${TESTDIR}/valgrind.out" 2> "${TESTDIR}/valgrind.err" \
+    || { echo "- -" ; return ; }
+    ALLOCS="`sed -n 's/^.*total heap usage: \([0-9,]*\) allocs.*$/\1/p' "${TESTDIR}/valgrind.err" \
+        | tr -d , | sort -n | tail -1`"
+    UPDATES="`sed -n 's/^.* updates=\([0-9]*\) .*$/\1/p' "${TESTDIR}/valgrind.out"`"
+    echo "${ALLOCS:--} ${UPDATES:--}"
+}
+
+FAILED=0
+printf '%-8s %10s %8s %10s %10s %8s %8s %10s %10s %10s\n' \
+    "device" "init ms" "updates" "update ms" "CPU ms" "reports" "events" \
+    "latency ms" "init alloc" "alloc/upd" >&2
+
+for DEVICE in ${USBHID_BENCH_DEVICES} ; do
+    SOURCE="-s ${DEVICE}"
+    if [ -n "${USBHID_BENCH_LOGDIR-}" ] && [ -s "${USBHID_BENCH_LOGDIR}/${DEVICE}.log" ] ; then
+        SOURCE="-r ${USBHID_BENCH_LOGDIR}/${DEVICE}.log"
+    fi
+
+    if ! "${USBHID_BENCH}" ${SOURCE} -c "${USBHID_BENCH_CYCLES}" ${USBHID_BENCH_ARGS-} \
+        > "${TESTDIR}/bench.out" 2> "${TESTDIR}/bench.err" \
+    || ! grep '^init_ms=' "${TESTDIR}/bench.out" > /dev/null ; then
+        log_error "usbhid-bench failed for ${DEVICE}:"
+        cat "${TESTDIR}/bench.err" >&2
+        FAILED="`expr $FAILED + 1`"
+        continue
+    fi
+
+    RESULT="`tail -1 "${TESTDIR}/bench.out"`"
+    # Turn "name=value" pairs into shell variables BENCH_<name>
+    eval "`echo "${RESULT}" | sed 's/\([a-z_]*\)=/BENCH_\1=/g'`"
+
+    # Start-up with a single update, then with the measured intervals:
+    # the difference of allocations is what the extra updates made
+    ALLOC_INIT="-"
+    ALLOC_UPDATE="-"
+    if ${HAVE_VALGRIND} ; then
+        set -- `count_allocs "${SOURCE}" 0` `count_allocs "${SOURCE}" "${USBHID_BENCH_CYCLES}"`
+        if [ "$1" != "-" ] && [ "$3" != "-" ] && [ "$4" != "-" ] && [ "$4" -gt "$2" ] ; then
+            ALLOC_INIT="$1"
+            ALLOC_UPDATE="`echo "$1 $2 $3 $4" | awk '{ printf "%.1f\n", ($3 - $1) / ($4 - $2) }'`"
+        fi
+    fi
+
+    printf '%-8s %10s %8s %10s %10s %8s %8s %10s %10s %10s\n' \
+        "${DEVICE}" "${BENCH_init_ms}" "${BENCH_updates}" "${BENCH_update_ms}" \
+        "${BENCH_update_cpu_ms}" "${BENCH_reports}" "${BENCH_events}" \
+        "${BENCH_latency_ms}" "${ALLOC_INIT}" "${ALLOC_UPDATE}" >&2
+
+    if [ -n "${USBHID_BENCH_RESULTS-}" ] ; then
+        echo "device=${DEVICE} source=\"${SOURCE}\" ${RESULT} init_allocs=${ALLOC_INIT} update_allocs=${ALLOC_UPDATE} args=\"${USBHID_BENCH_ARGS-}\"" \
+            >> "${USBHID_BENCH_RESULTS}"
+    fi
+done
+
+[ "${FAILED}" = 0 ] || die "${FAILED} benchmark(s) failed"
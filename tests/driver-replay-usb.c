@@ -0,0 +1,913 @@
+/* driver-replay-usb.c - USB communication layer for usbhid-ups which
+ * replays a HID device (recorded in a driver debug log, or synthesized
+ * from a subdriver mapping table) rather than talking to real hardware.
+ * It takes the place of libusb0.c/libusb1.c when linking the driver code
+ * into a benchmark (see usbhid-bench.c and NIT/usbhid-bench.sh).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "common.h"
+#include "nut_stdint.h"
+#include "dstate.h"
+#include "driver-replay-usb.h"
+
+#include <ctype.h>
+
+#ifndef WIN32
+# include <fcntl.h>
+# include <signal.h>
+# include <sys/wait.h>
+#endif	/* !WIN32 */
+
+#define REPLAY_DRIVER_NAME	"USB communication replay (for benchmarks)"
+#define REPLAY_DRIVER_VERSION	"0.01"
+
+upsdrv_info_t comm_upsdrv_info = {
+	REPLAY_DRIVER_NAME,
+	REPLAY_DRIVER_VERSION,
+	NULL,
+	0,
+	{ NULL }
+};
+
+#define REPLAY_REPORT_SIZE	256	/* largest report kept from a log */
+#define REPLAY_GROUP_BITS	240U	/* per synthesized report (hidparser offsets are 8-bit) */
+#define REPLAY_MAX_ITEMS	400	/* keep within MAX_REPORT of hidparser */
+#define REPLAY_PENDING	64	/* reports handed out but not published */
+
+typedef struct replay_report_s {
+	unsigned char	data[REPLAY_REPORT_SIZE];
+	size_t	len;
+	double	due;	/* interrupt reports: seconds after the start */
+} replay_report_t;
+
+typedef struct replay_reports_s {
+	replay_report_t	*rep;
+	size_t	count, alloc, next;
+} replay_reports_t;
+
+/* Synthesized report layout, by report ID */
+typedef struct replay_group_s {
+	size_t	items;
+	int	status;	/* 8-bit flags (also sent as Input), else 16-bit values */
+	unsigned long	reads;
+} replay_group_t;
+
+static USBDevice_t	replay_device;
+static unsigned char	*rdesc = NULL;
+static size_t	rdesc_len = 0, rdesc_alloc = 0;
+
+static replay_reports_t	feature[256];
+static replay_reports_t	intr;
+
+static int	synthesized = 0;
+static replay_group_t	group[256];
+static int	status_id = 0;	/* first synthesized status report */
+static unsigned long	status_phase = 0;
+
+static struct timeval	start;
+static int	started = 0;
+static double	pending[REPLAY_PENDING];
+static size_t	pending_count = 0;
+static replay_stats_t	stats;
+static int	replay_handle;	/* only its address is handed out */
+
+#ifdef NUT_LIBUSB_HAVE_INTERRUPT_ASYNC
+static int	interrupt_async = 0;
+static int	wakeup_pipe[2] = { -1, -1 };
+static pid_t	wakeup_pid = -1;
+#endif
+
+static double replay_elapsed(void)
+{
+	struct timeval	now;
+
+	gettimeofday(&now, NULL);
+	return difftimeval(now, start);
+}
+
+static void replay_sleep(double seconds)
+{
+	unsigned long	usec;
+
+	if (seconds <= 0)
+		return;
+
+	usec = (unsigned long)(seconds * 1000000);
+	if (usec >= 1000000)
+		sleep((unsigned int)(usec / 1000000));
+	usleep((useconds_t)(usec % 1000000));
+}
+
+static replay_report_t *replay_add(replay_reports_t *list)
+{
+	if (list->count == list->alloc) {
+		list->alloc = list->alloc ? list->alloc * 2 : 16;
+		list->rep = xrealloc(list->rep, list->alloc * sizeof(*list->rep));
+	}
+	memset(&list->rep[list->count], 0, sizeof(*list->rep));
+	return &list->rep[list->count++];
+}
+
+static void rdesc_add(const unsigned char *bytes, size_t len)
+{
+	if (rdesc_len + len > rdesc_alloc) {
+		rdesc_alloc = rdesc_alloc ? rdesc_alloc * 2 : 1024;
+		if (rdesc_alloc < rdesc_len + len)
+			rdesc_alloc = rdesc_len + len;
+		rdesc = xrealloc(rdesc, rdesc_alloc);
+	}
+	memcpy(rdesc + rdesc_len, bytes, len);
+	rdesc_len += len;
+}
+
+static void replay_set_string(char **dst, const char *src)
+{
+	free(*dst);
+	*dst = src ? xstrdup(src) : NULL;
+}
+
+/* ---------------------------------------------------------------------- */
+/* recorded devices */
+
+/* Append the hex bytes of a debug log line to buf, up to size bytes */
+static size_t parse_hex(const char *s, unsigned char *buf, size_t len, size_t size)
+{
+	char	*end;
+	unsigned long	v;
+
+	while (len < size) {
+		while (*s == ' ')
+			s++;
+		if (!isxdigit((unsigned char)*s))
+			break;
+		v = strtoul(s, &end, 16);
+		if (end == s || v > 0xff)
+			break;
+		buf[len++] = (unsigned char)v;
+		s = end;
+	}
+
+	return len;
+}
+
+int replay_load_log(const char *filename)
+{
+	FILE	*f;
+	char	line[LARGEBUF], *content, *p;
+	unsigned char	*buf = NULL;
+	size_t	want = 0, have = 0;
+	int	what = 0;	/* 1: descriptor, 2: feature, 3: interrupt */
+	double	ts = 0, first_ts = -1;
+	replay_report_t	*rep;
+
+	f = fopen(filename, "r");
+	if (!f)
+		fatal_with_errno(EXIT_FAILURE, "Can't open %s", filename);
+
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if ((content = strstr(line, "[D")) != NULL
+		 && (p = strchr(content, ']')) != NULL
+		) {
+			content = p + 1;
+			while (*content == ' ')
+				content++;
+		} else {
+			continue;
+		}
+
+		/* hex dump continued? */
+		if (what) {
+			if (*content
+			 && strspn(content, "0123456789abcdef ") == strlen(content)
+			) {
+				have = parse_hex(content, buf, have, want);
+			} else {
+				upsdebugx(1, "%s: incomplete hex dump dropped", __func__);
+				if (what > 1)
+					free(buf);
+				buf = NULL;
+				what = 0;
+			}
+		}
+
+		if (what) {
+			/* still in a hex dump */
+		} else if (!rdesc_len && !strncmp(content, "- ", 2)) {
+			/* device identity, as long as no descriptor was seen */
+			if (!strncmp(content, "- VendorID: ", 12))
+				replay_device.VendorID = (uint16_t)strtoul(content + 12, NULL, 16);
+			else if (!strncmp(content, "- ProductID: ", 13))
+				replay_device.ProductID = (uint16_t)strtoul(content + 13, NULL, 16);
+			else if (!strncmp(content, "- Manufacturer: ", 16))
+				replay_set_string(&replay_device.Vendor, content + 16);
+			else if (!strncmp(content, "- Product: ", 11))
+				replay_set_string(&replay_device.Product, content + 11);
+			else if (!strncmp(content, "- Serial Number: ", 17))
+				replay_set_string(&replay_device.Serial, content + 17);
+			else if (!strncmp(content, "- Device release number: ", 25))
+				replay_device.bcdDevice = (uint16_t)strtoul(content + 25, NULL, 16);
+			continue;
+		} else if ((p = strstr(content, ": (")) != NULL && strstr(p, " bytes) =>")) {
+			want = strtoul(p + 3, NULL, 10);
+			ts = strtod(line, NULL);
+
+			if (!strncmp(content, "Report Descriptor:", 18)) {
+				if (rdesc_len || !want)
+					continue;
+				rdesc_alloc = want;
+				rdesc = xrealloc(rdesc, rdesc_alloc);
+				buf = rdesc;
+				what = 1;
+			} else if (!strncmp(content, "Report[get]:", 12)
+			 || !strncmp(content, "Report[int]:", 12)
+			) {
+				if (!want || want > REPLAY_REPORT_SIZE)
+					continue;
+				buf = xcalloc(1, REPLAY_REPORT_SIZE);
+				what = (content[7] == 'g') ? 2 : 3;
+			} else {
+				continue;
+			}
+
+			have = parse_hex(strstr(p, "=>") + 2, buf, 0, want);
+		} else {
+			continue;
+		}
+
+		if (!what || have < want)
+			continue;
+
+		switch (what) {
+		case 1:
+			rdesc_len = have;
+			break;
+		case 2:
+			rep = replay_add(&feature[buf[0]]);
+			goto store;
+		case 3:
+			if (first_ts < 0)
+				first_ts = ts;
+			rep = replay_add(&intr);
+			rep->due = ts - first_ts;
+		store:
+			memcpy(rep->data, buf, have);
+			rep->len = have;
+			free(buf);
+			break;
+		default:
+			break;
+		}
+		buf = NULL;
+		what = 0;
+	}
+
+	if (what > 1)
+		free(buf);
+	fclose(f);
+
+	if (!rdesc_len) {
+		upslogx(LOG_ERR, "%s: no report descriptor found", filename);
+		return -1;
+	}
+
+	upsdebugx(1, "%s: %04x:%04x, descriptor of %" PRIuSIZE " bytes, "
+		"%" PRIuSIZE " interrupt reports",
+		filename, replay_device.VendorID, replay_device.ProductID,
+		rdesc_len, intr.count);
+
+	synthesized = 0;
+	return 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* synthesized devices */
+
+typedef struct synth_node_s {
+	HIDNode_t	usage;
+	const char	*name;	/* from the usage table, if known */
+	int	index;	/* of an indexed collection, else 0 */
+	int	parent;	/* -1 on top level */
+	int	children;
+} synth_node_t;
+
+static synth_node_t	*node = NULL;
+static int	nodes = 0, nodes_alloc = 0;
+
+static int synth_lookup(usage_tables_t *utab, const char *name, HIDNode_t *usage, const char **found)
+{
+	usage_lkp_t	*u;
+	int	i;
+
+	for (i = 0; utab[i]; i++) {
+		for (u = utab[i]; u->usage_name; u++) {
+			if (!strcmp(u->usage_name, name)) {
+				*usage = (HIDNode_t)u->usage_code;
+				*found = u->usage_name;
+				return 0;
+			}
+		}
+	}
+
+	if (strlen(name) == strspn(name, "1234567890abcdefABCDEF") && strlen(name) <= 8) {
+		*usage = (HIDNode_t)strtoul(name, NULL, 16);
+		*found = NULL;
+		return 0;
+	}
+
+	return -1;
+}
+
+static int synth_node(int parent, HIDNode_t usage, const char *name, int index)
+{
+	int	i;
+
+	for (i = 0; i < nodes; i++) {
+		if (node[i].parent == parent && node[i].usage == usage && node[i].index == index)
+			return i;
+	}
+
+	if (nodes == nodes_alloc) {
+		nodes_alloc = nodes_alloc ? nodes_alloc * 2 : 256;
+		node = xrealloc(node, (size_t)nodes_alloc * sizeof(*node));
+	}
+
+	node[nodes].usage = usage;
+	node[nodes].name = name;
+	node[nodes].index = index;
+	node[nodes].parent = parent;
+	node[nodes].children = 0;
+	if (parent >= 0)
+		node[parent].children++;
+
+	return nodes++;
+}
+
+/* Add the nodes of a mapping table path, e.g. "UPS.Outlet.[1].PresentStatus.SwitchOn/Off" */
+static void synth_path(usage_tables_t *utab, const char *hidpath)
+{
+	char	buf[SMALLBUF], *token, *last, *next;
+	HIDNode_t	usage;
+	const char	*name;
+	int	parent = -1;
+
+	snprintf(buf, sizeof(buf), "%s", hidpath);
+
+	for (token = strtok_r(buf, ".", &last); token; token = next) {
+		int	index = 0;
+
+		next = strtok_r(NULL, ".", &last);
+		if (synth_lookup(utab, token, &usage, &name) < 0) {
+			upsdebugx(2, "%s: can't resolve %s in %s", __func__, token, hidpath);
+			return;
+		}
+
+		/* "[N]" is the index of the collection it follows */
+		if (next && next[0] == '[') {
+			index = atoi(next + 1) & 0x7f;
+			next = strtok_r(NULL, ".", &last);
+		}
+
+		parent = synth_node(parent, usage, name, index);
+	}
+}
+
+static void rdesc_usage(HIDNode_t usage)
+{
+	unsigned char	item[5];
+
+	/* always a 4-byte usage, with its page */
+	item[0] = 0x0b;
+	item[1] = (unsigned char)(usage & 0xff);
+	item[2] = (unsigned char)((usage >> 8) & 0xff);
+	item[3] = (unsigned char)((usage >> 16) & 0xff);
+	item[4] = (unsigned char)((usage >> 24) & 0xff);
+	rdesc_add(item, sizeof(item));
+}
+
+/* Emit report(s) for the leaf items of collection c */
+static void synth_reports(int c, int *next_id, size_t *total)
+{
+	const unsigned char	value[] = { 0x75, 0x10, 0x15, 0x00, 0x26, 0xff, 0x7f };	/* 16 bits, 0..32767 */
+	const unsigned char	flags[] = { 0x75, 0x08, 0x15, 0x00, 0x25, 0x01 };	/* 8 bits, 0..1 */
+	const unsigned char	feature_item[] = { 0xb1, 0x02 };
+	const unsigned char	input_item[] = { 0x81, 0x02 };
+	unsigned char	item[2];
+	int	status, i, from = 0;
+
+	status = (node[c].name && strstr(node[c].name, "Status"));
+
+	while (from < nodes && *next_id < 256) {
+		int	leaf[REPLAY_GROUP_BITS / 8];
+		size_t	n = 0, j, max = REPLAY_GROUP_BITS / (status ? 8U : 16U);
+
+		for (i = from; i < nodes && n < max; i++) {
+			if (node[i].parent == c && !node[i].children)
+				leaf[n++] = i;
+		}
+		from = i;
+
+		if (!n || *total + n * (status ? 2 : 1) > REPLAY_MAX_ITEMS)
+			return;
+
+		item[0] = 0x85;	/* Report ID */
+		item[1] = (unsigned char)*next_id;
+		rdesc_add(item, sizeof(item));
+		if (status)
+			rdesc_add(flags, sizeof(flags));
+		else
+			rdesc_add(value, sizeof(value));
+		item[0] = 0x95;	/* Report Count */
+		item[1] = (unsigned char)n;
+		rdesc_add(item, sizeof(item));
+
+		for (j = 0; j < n; j++)
+			rdesc_usage(node[leaf[j]].usage);
+		rdesc_add(feature_item, sizeof(feature_item));
+
+		if (status) {
+			for (j = 0; j < n; j++)
+				rdesc_usage(node[leaf[j]].usage);
+			rdesc_add(input_item, sizeof(input_item));
+			if (!status_id)
+				status_id = *next_id;
+		}
+
+		group[*next_id].items = n;
+		group[*next_id].status = status;
+		*total += n * (status ? 2 : 1);
+		(*next_id)++;
+	}
+}
+
+static void synth_collection(int c, int *next_id, size_t *total)
+{
+	const unsigned char	end_collection[] = { 0xc0 };
+	unsigned char	item[2];
+	int	i;
+
+	rdesc_usage(node[c].usage);
+	item[0] = 0xa1;	/* Collection */
+	if (node[c].index)
+		item[1] = (unsigned char)(0x80 | node[c].index);
+	else
+		item[1] = (unsigned char)((node[c].parent < 0) ? 0x01 : 0x00);
+	rdesc_add(item, sizeof(item));
+
+	synth_reports(c, next_id, total);
+
+	for (i = 0; i < nodes; i++) {
+		if (node[i].parent == c && node[i].children)
+			synth_collection(i, next_id, total);
+	}
+
+	rdesc_add(end_collection, sizeof(end_collection));
+}
+
+int replay_synthesize(subdriver_t *sub, uint16_t vendorid, uint16_t productid,
+	const char *vendor, const char *product)
+{
+	hid_info_t	*info;
+	int	i, next_id = 1;
+	size_t	total = 0;
+
+	for (info = sub->hid2nut; info->info_type; info++) {
+		if (info->hidpath)
+			synth_path(sub->utab, info->hidpath);
+	}
+
+	for (i = 0; i < nodes; i++) {
+		if (node[i].parent < 0 && node[i].children)
+			synth_collection(i, &next_id, &total);
+	}
+
+	free(node);
+	node = NULL;
+	nodes = nodes_alloc = 0;
+
+	if (!rdesc_len) {
+		upslogx(LOG_ERR, "%s: nothing to synthesize for subdriver %s",
+			__func__, sub->name);
+		return -1;
+	}
+
+	replay_device.VendorID = vendorid;
+	replay_device.ProductID = productid;
+	replay_device.bcdDevice = 0x0100;
+	replay_set_string(&replay_device.Vendor, vendor);
+	replay_set_string(&replay_device.Product, product);
+	replay_set_string(&replay_device.Serial, "REPLAY0001");
+
+	upsdebugx(1, "%s: %s device %04x:%04x, descriptor of %" PRIuSIZE
+		" bytes, %d reports, %" PRIuSIZE " items",
+		__func__, sub->name, vendorid, productid,
+		rdesc_len, next_id - 1, total);
+
+	synthesized = 1;
+	return 0;
+}
+
+/* Fill a synthesized report: a quarter of the values change between
+ * reads, and status flags follow the phase moved by interrupt reports */
+static size_t synth_report(int id, unsigned char *buf, size_t size)
+{
+	replay_group_t	*g = &group[id];
+	size_t	j, len = 1;
+
+	buf[0] = (unsigned char)id;
+	for (j = 0; j < g->items && len + 2 <= size; j++) {
+		if (g->status) {
+			buf[len++] = (unsigned char)((j + status_phase) % 3 == 0);
+		} else {
+			unsigned int	v = 50 + (unsigned int)((j * 37 + (size_t)id * 11) % 200);
+
+			if (j % 4 == 0)
+				v += (unsigned int)(g->reads % 10);
+			buf[len++] = (unsigned char)(v & 0xff);
+			buf[len++] = (unsigned char)(v >> 8);
+		}
+	}
+	g->reads++;
+
+	return len;
+}
+
+/* ---------------------------------------------------------------------- */
+/* interrupt report schedule */
+
+#ifdef NUT_LIBUSB_HAVE_INTERRUPT_ASYNC
+/* Nothing more is due: forget the wake-ups so far */
+static void wakeup_drain(void)
+{
+	char	buf[64];
+	ssize_t	ret;
+
+	if (wakeup_pipe[0] < 0)
+		return;
+
+	while ((ret = read(wakeup_pipe[0], buf, sizeof(buf))) > 0)
+		;
+
+	if (ret == 0) {
+		/* the schedule is over */
+		dstate_del_poll_fd(wakeup_pipe[0]);
+		close(wakeup_pipe[0]);
+		wakeup_pipe[0] = -1;
+	}
+}
+#endif
+
+void replay_start(double delay, double period, double duration)
+{
+	size_t	i;
+
+	if (synthesized) {
+		intr.count = 0;
+		if (status_id && period > 0) {
+			double	due;
+
+			for (due = delay; due < duration; due += period)
+				replay_add(&intr)->due = due;
+		}
+	} else {
+		for (i = 0; i < intr.count; i++)
+			intr.rep[i].due += delay;
+	}
+	intr.next = 0;
+
+	gettimeofday(&start, NULL);
+	started = 1;
+
+#ifdef NUT_LIBUSB_HAVE_INTERRUPT_ASYNC
+	/* Like libusb1.c, wake up the driver loop when a report comes in */
+	if (!interrupt_async || !intr.count)
+		return;
+
+	if (pipe(wakeup_pipe) < 0)
+		fatal_with_errno(EXIT_FAILURE, "pipe");
+
+	wakeup_pid = fork();
+	if (wakeup_pid < 0)
+		fatal_with_errno(EXIT_FAILURE, "fork");
+
+	if (wakeup_pid == 0) {
+		close(wakeup_pipe[0]);
+		for (i = 0; i < intr.count && intr.rep[i].due < duration; i++) {
+			replay_sleep(intr.rep[i].due - replay_elapsed());
+			if (write(wakeup_pipe[1], "!", 1) < 0)
+				break;
+		}
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(wakeup_pipe[1]);
+	wakeup_pipe[1] = -1;
+	fcntl(wakeup_pipe[0], F_SETFL, fcntl(wakeup_pipe[0], F_GETFL) | O_NONBLOCK);
+	dstate_add_poll_fd(wakeup_pipe[0], DSTATE_POLL_READ);
+#endif
+}
+
+void replay_stop(void)
+{
+#ifdef NUT_LIBUSB_HAVE_INTERRUPT_ASYNC
+	if (wakeup_pid > 0) {
+		kill(wakeup_pid, SIGTERM);
+		waitpid(wakeup_pid, NULL, 0);
+		wakeup_pid = -1;
+	}
+
+	if (wakeup_pipe[0] >= 0) {
+		dstate_del_poll_fd(wakeup_pipe[0]);
+		close(wakeup_pipe[0]);
+		wakeup_pipe[0] = -1;
+	}
+#endif
+	started = 0;
+}
+
+void replay_published(void)
+{
+	double	now, latency;
+	size_t	i;
+
+	if (!pending_count)
+		return;
+
+	now = replay_elapsed();
+	for (i = 0; i < pending_count; i++) {
+		latency = now - pending[i];
+		stats.latency_sum += latency;
+		if (latency > stats.latency_max)
+			stats.latency_max = latency;
+	}
+	stats.published += pending_count;
+	pending_count = 0;
+}
+
+const replay_stats_t *replay_get_stats(void)
+{
+	return &stats;
+}
+
+void replay_reset_stats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	pending_count = 0;
+}
+
+/* ---------------------------------------------------------------------- */
+/* communication subdriver methods */
+
+static int replay_open(usb_dev_handle **udevp, USBDevice_t *curDevice,
+	USBDeviceMatcher_t *matcher,
+	int (*callback)(usb_dev_handle *udev, USBDevice_t *hd,
+		usb_ctrl_charbuf rdbuf, usb_ctrl_charbufsize rdlen))
+{
+	USBDeviceMatcher_t	*m;
+	int	ret;
+
+	*udevp = NULL;
+
+	free(curDevice->Vendor);
+	free(curDevice->Product);
+	free(curDevice->Serial);
+	free(curDevice->Bus);
+	free(curDevice->Device);
+#if (defined WITH_USB_BUSPORT) && (WITH_USB_BUSPORT)
+	free(curDevice->BusPort);
+#endif
+	memset(curDevice, 0, sizeof(*curDevice));
+
+	curDevice->VendorID = replay_device.VendorID;
+	curDevice->ProductID = replay_device.ProductID;
+	curDevice->bcdDevice = replay_device.bcdDevice;
+	replay_set_string(&curDevice->Vendor, replay_device.Vendor);
+	replay_set_string(&curDevice->Product, replay_device.Product);
+	replay_set_string(&curDevice->Serial, replay_device.Serial);
+	replay_set_string(&curDevice->Bus, "001");
+	replay_set_string(&curDevice->Device, "001");
+#if (defined WITH_USB_BUSPORT) && (WITH_USB_BUSPORT)
+	replay_set_string(&curDevice->BusPort, "001");
+#endif
+
+	/* as libusb*.c log it, so that logs of replays can be replayed */
+	upsdebugx(2, "- VendorID: %04x", curDevice->VendorID);
+	upsdebugx(2, "- ProductID: %04x", curDevice->ProductID);
+	upsdebugx(2, "- Manufacturer: %s", curDevice->Vendor ? curDevice->Vendor : "unknown");
+	upsdebugx(2, "- Product: %s", curDevice->Product ? curDevice->Product : "unknown");
+	upsdebugx(2, "- Serial Number: %s", curDevice->Serial ? curDevice->Serial : "unknown");
+	upsdebugx(2, "- Device release number: %04x", curDevice->bcdDevice);
+
+	for (m = matcher; m; m = m->next) {
+		ret = m->match_function(curDevice, m->privdata);
+		if (ret < 0)
+			fatal_with_errno(EXIT_FAILURE, "matcher");
+		if (ret == 0) {
+			upsdebugx(2, "%s: device does not match", __func__);
+			return -1;
+		}
+	}
+
+	*udevp = (usb_dev_handle *)(void *)&replay_handle;
+
+	if (!callback)
+		return 1;
+
+	if (rdesc_len > USB_CTRL_CHARBUFSIZE_MAX
+	 || callback(*udevp, curDevice, (usb_ctrl_charbuf)rdesc, (usb_ctrl_charbufsize)rdesc_len) < 1
+	) {
+		*udevp = NULL;
+		return -1;
+	}
+
+	return (int)rdesc_len;
+}
+
+static void replay_close(usb_dev_handle *sdev)
+{
+	NUT_UNUSED_VARIABLE(sdev);
+}
+
+static int replay_get_report(usb_dev_handle *sdev, usb_ctrl_repindex ReportId,
+	usb_ctrl_charbuf raw_buf, usb_ctrl_charbufsize ReportSize)
+{
+	replay_reports_t	*list;
+	replay_report_t	*rep;
+	size_t	len;
+
+	NUT_UNUSED_VARIABLE(sdev);
+
+	if (ReportId > 255 || !ReportSize)
+		return LIBUSB_ERROR_INVALID_PARAM;
+
+	stats.get_report++;
+
+	if (synthesized) {
+		if (!group[ReportId].items)
+			return LIBUSB_ERROR_PIPE;
+		return (int)synth_report(ReportId, (unsigned char *)raw_buf, ReportSize);
+	}
+
+	list = &feature[ReportId];
+	if (!list->count)
+		return LIBUSB_ERROR_PIPE;
+
+	/* hand out the recorded values in turn */
+	rep = &list->rep[list->next];
+	list->next = (list->next + 1) % list->count;
+
+	len = (rep->len < ReportSize) ? rep->len : ReportSize;
+	memcpy(raw_buf, rep->data, len);
+
+	return (int)len;
+}
+
+static int replay_set_report(usb_dev_handle *sdev, usb_ctrl_repindex ReportId,
+	usb_ctrl_charbuf raw_buf, usb_ctrl_charbufsize ReportSize)
+{
+	NUT_UNUSED_VARIABLE(sdev);
+	NUT_UNUSED_VARIABLE(ReportId);
+	NUT_UNUSED_VARIABLE(raw_buf);
+
+	stats.set_report++;
+	return (int)ReportSize;
+}
+
+static int replay_get_string(usb_dev_handle *sdev,
+	usb_ctrl_strindex StringIdx, char *buf, usb_ctrl_charbufsize buflen)
+{
+	int	ret;
+
+	NUT_UNUSED_VARIABLE(sdev);
+
+	stats.get_string++;
+	ret = snprintf(buf, buflen, "Replay string %d", (int)StringIdx);
+
+	return (ret < 0 || (size_t)ret >= buflen) ? LIBUSB_ERROR_OVERFLOW : ret;
+}
+
+static int replay_get_interrupt(usb_dev_handle *sdev,
+	usb_ctrl_charbuf buf, usb_ctrl_charbufsize bufsize,
+	usb_ctrl_timeout_msec timeout)
+{
+	replay_report_t	*rep;
+	double	wait;
+	size_t	len;
+
+	NUT_UNUSED_VARIABLE(sdev);
+
+	rep = (started && intr.next < intr.count) ? &intr.rep[intr.next] : NULL;
+	wait = rep ? rep->due - replay_elapsed() : (double)timeout / 1000;
+
+#ifdef NUT_LIBUSB_HAVE_INTERRUPT_ASYNC
+	if (interrupt_async && wait > 0) {
+		wakeup_drain();
+		return 0;
+	}
+#endif
+
+	if (!rep) {
+		/* an idle endpoint times out */
+		replay_sleep(wait);
+		return 0;
+	}
+
+	if (wait > 0) {
+		if (wait > (double)timeout / 1000) {
+			replay_sleep((double)timeout / 1000);
+			return 0;
+		}
+		replay_sleep(wait);
+	}
+
+	intr.next++;
+	stats.interrupts++;
+	if (pending_count < REPLAY_PENDING)
+		pending[pending_count++] = rep->due;
+
+	if (synthesized) {
+		status_phase++;
+		return (int)synth_report(status_id, (unsigned char *)buf, bufsize);
+	}
+
+	len = (rep->len < bufsize) ? rep->len : bufsize;
+	memcpy(buf, rep->data, len);
+
+	return (int)len;
+}
+
+usb_communication_subdriver_t usb_subdriver = {
+	REPLAY_DRIVER_NAME,
+	REPLAY_DRIVER_VERSION,
+	replay_open,
+	replay_close,
+	replay_get_report,
+	replay_set_report,
+	replay_get_string,
+	replay_get_interrupt,
+	LIBUSB_DEFAULT_CONF_INDEX,
+	LIBUSB_DEFAULT_INTERFACE,
+	LIBUSB_DEFAULT_DESC_INDEX,
+	LIBUSB_DEFAULT_HID_EP_IN,
+	LIBUSB_DEFAULT_HID_EP_OUT
+};
+
+/* The device matching options of the real USB drivers */
+void nut_usb_addvars(void)
+{
+	addvar(VAR_VALUE, "vendor", "Regular expression to match UPS Manufacturer string");
+	addvar(VAR_VALUE, "product", "Regular expression to match UPS Product string");
+	addvar(VAR_VALUE, "serial", "Regular expression to match UPS Serial number");
+	addvar(VAR_VALUE, "vendorid", "Regular expression to match UPS Manufacturer numerical ID (4 digits hexadecimal)");
+	addvar(VAR_VALUE, "productid", "Regular expression to match UPS Product numerical ID (4 digits hexadecimal)");
+	addvar(VAR_VALUE, "bus", "Regular expression to match USB bus name");
+	addvar(VAR_VALUE, "device", "Regular expression to match USB device name");
+	addvar(VAR_VALUE, "busport", "Regular expression to match USB bus port name");
+
+	dstate_setinfo("driver.version.usb", "%s %s", REPLAY_DRIVER_NAME, REPLAY_DRIVER_VERSION);
+}
+
+#ifdef NUT_LIBUSB_HAVE_INTERRUPT_ASYNC
+void nut_libusb_interrupt_async(int enable)
+{
+	interrupt_async = enable;
+}
+
+/* The reports already due count as received and queued */
+int nut_libusb_interrupt_pending(void)
+{
+	size_t	i;
+	double	now;
+
+	if (!interrupt_async || !started)
+		return 0;
+
+	now = replay_elapsed();
+	for (i = intr.next; i < intr.count && intr.rep[i].due <= now; i++)
+		;
+
+	return (int)(i - intr.next);
+}
+#endif
+
+#ifndef nut_libusb_reopen_due
+int nut_libusb_reopen_due(void)
+{
+	return 1;
+}
+#endif
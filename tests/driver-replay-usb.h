@@ -0,0 +1,61 @@
+/* driver-replay-usb.h - replay of USB HID device traffic for usbhid-ups
+ * benchmarks (see driver-replay-usb.c and usbhid-bench.c)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef NUT_DRIVER_REPLAY_USB_H_SEEN
+#define NUT_DRIVER_REPLAY_USB_H_SEEN 1
+
+#include "usbhid-ups.h"
+
+/* What the simulated device saw of the driver, and how fast the
+ * driver published what the device told it on its interrupt pipe */
+typedef struct replay_stats_s {
+	unsigned long	get_report;	/* feature reports read */
+	unsigned long	set_report;	/* feature reports written */
+	unsigned long	get_string;	/* string descriptors read */
+	unsigned long	interrupts;	/* interrupt reports handed out */
+	unsigned long	published;	/* ...and accounted as published */
+	double	latency_sum;	/* seconds from due time to publication */
+	double	latency_max;
+} replay_stats_t;
+
+/* Load a device recorded in a driver debug log (`usbhid-ups -DDDDD`):
+ * identity, report descriptor, feature reports (handed out in turn for
+ * each report ID) and interrupt reports (with their recorded timing).
+ * Returns 0 on success, -1 if the log has no report descriptor. */
+int replay_load_log(const char *filename);
+
+/* Make up a device for the subdriver: a report descriptor covering
+ * the paths of its hid2nut table, with values varying between reads,
+ * and status reports on the interrupt pipe when started below.
+ * Returns 0 on success, -1 if no path of the table could be resolved. */
+int replay_synthesize(subdriver_t *sub, uint16_t vendorid, uint16_t productid,
+	const char *vendor, const char *product);
+
+/* Start the interrupt report schedule: the first one after `delay`
+ * seconds, synthesized ones every `period` seconds (none if 0), and
+ * none after `duration` seconds. */
+void replay_start(double delay, double period, double duration);
+void replay_stop(void);
+
+/* Account the interrupt reports handed out so far as published now */
+void replay_published(void);
+
+const replay_stats_t *replay_get_stats(void);
+void replay_reset_stats(void);
+
+#endif	/* NUT_DRIVER_REPLAY_USB_H_SEEN */
@@ -69,6 +69,8 @@ static int report_0_means_pass(int i) {
 
 int main(int argc, char **argv) {
 	const char	*valueStr = NULL;
+	int	ret;
+	st_tree_t	*root;
 
 	NUT_UNUSED_VARIABLE(argc);
 	NUT_UNUSED_VARIABLE(argv);
@@ -373,6 +375,167 @@ int main(int argc, char **argv) {
 	status_init();
 	status_commit();
 
+	/* Test cases #21-#26 (from scratch)
+	 * Typed numeric dstate_setinfo_*() methods with change detection.
+	 */
+	/* #21 */
+	ret = dstate_setinfo_double("input.voltage", "%.1f", 229.96);
+	valueStr = dstate_getinfo("input.voltage");
+	report_0_means_pass(ret != 1 || strcmp(valueStr, "230.0"));
+	printf(" test for dstate_setinfo_double() of a new value: '%s'; got 230.0?\n", NUT_STRARG(valueStr));
+
+	/* #22 */
+	ret = dstate_setinfo_double("input.voltage", "%.1f", 229.96);
+	report_0_means_pass(ret != 0);
+	printf(" test for dstate_setinfo_double() of the same value: returned %d; got no change?\n", ret);
+
+	/* #23: value changed behind our back, same binary value must be re-published */
+	dstate_setinfo("input.voltage", "%s", "100");
+	ret = dstate_setinfo_double("input.voltage", "%.1f", 229.96);
+	valueStr = dstate_getinfo("input.voltage");
+	report_0_means_pass(ret != 1 || strcmp(valueStr, "230.0"));
+	printf(" test for dstate_setinfo_double() after dstate_setinfo() of another value: '%s'; got 230.0?\n", NUT_STRARG(valueStr));
+
+	/* #24: the node handle must not outlive the variable */
+	dstate_delinfo("input.voltage");
+	ret = dstate_setinfo_double("input.voltage", "%.1f", 229.96);
+	valueStr = dstate_getinfo("input.voltage");
+	report_0_means_pass(ret != 1 || strcmp(valueStr, "230.0"));
+	printf(" test for dstate_setinfo_double() after dstate_delinfo(): '%s'; got 230.0?\n", NUT_STRARG(valueStr));
+
+	/* #25 */
+	ret = (dstate_setinfo_long("battery.runtime", "%ld", 1200) != 1)
+	   || (dstate_setinfo_long("battery.runtime", "%ld", 1200) != 0)
+	   || (dstate_setinfo_long("battery.runtime", "%ld", 1190) != 1);
+	valueStr = dstate_getinfo("battery.runtime");
+	report_0_means_pass(ret || strcmp(valueStr, "1190"));
+	printf(" test for dstate_setinfo_long() of new, same and changed values: '%s'; got 1190?\n", NUT_STRARG(valueStr));
+
+	/* #26 */
+	ret = dstate_setinfo_long("battery.charge", "%s", 100);
+	valueStr = dstate_getinfo("battery.charge");
+	report_0_means_pass(ret != -1 || valueStr != NULL);
+	printf(" test for dstate_setinfo_long() with unsuitable formatting string: returned %d; got rejected?\n", ret);
+
+	/* Test cases #27-#29 (from scratch)
+	 * Standard ups.status tokens tracked as ST_STATUS_* bits.
+	 */
+	/* #27 */
+	status_init();
+	status_set("OL");
+	status_set("OL CHRG");
+	status_set("OL");
+	status_set("OLX");
+	status_commit();
+	valueStr = dstate_getinfo("ups.status");
+	report_0_means_pass(strcmp(valueStr, "OL CHRG OLX")
+		|| !status_get("CHRG") || status_get("OB")
+		|| !status_get("OLX") || status_get("OLY"));
+	printf(" test for status_set()/status_get() with repeated standard tokens: '%s'; got 'OL CHRG OLX'?\n", NUT_STRARG(valueStr));
+
+	/* #28 */
+	{
+		char	other[SMALLBUF];
+		unsigned long	bits = state_status_parse("ALARM  ol LBX DISCHRG OFFLINE", other, sizeof(other));
+
+		report_0_means_pass(bits != (ST_STATUS_ALARM | ST_STATUS_OL | ST_STATUS_DISCHRG)
+			|| strcmp(other, "LBX OFFLINE"));
+		printf(" test for state_status_parse(): bits 0x%lX, other '%s'; got 0x%lX and 'LBX OFFLINE'?\n",
+			bits, other, (ST_STATUS_ALARM | ST_STATUS_OL | ST_STATUS_DISCHRG));
+	}
+
+	/* #29 */
+	report_0_means_pass(state_status_token_bit("BOOST") != ST_STATUS_BOOST
+		|| strcmp(NUT_STRARG(state_status_bit_token(ST_STATUS_BOOST)), "BOOST")
+		|| state_status_token_bit("WAIT") != 0);
+	printf(" test for state_status_token_bit()/state_status_bit_token() round-trip: got BOOST and no WAIT?\n");
+
+	/* Test cases #30-#31 (from scratch)
+	 * Warm start snapshot save (without the status), load and replacement
+	 * by live data.
+	 */
+	/* #30 */
+	{
+		const char	*fn = "driver_methods_utest.snapshot";
+
+		dstate_setinfo("driver.state", "%s", "quiet");
+		dstate_setinfo("ups.status", "%s", "OB LB");
+		dstate_setinfo("ups.alarm", "%s", "Replace battery!");
+		dstate_setinfo("ups.model", "%s", "Model \"X\"");
+		dstate_addcmd("test.battery.start");
+		ret = dstate_snapshot_save(fn);
+		dstate_free();
+
+		ret = (ret != 1) || (dstate_snapshot_load(fn, 0) != 1);
+		unlink(fn);
+
+		/* Served to clients, but not seen by the driver */
+		root = (st_tree_t *)dstate_getroot();
+		valueStr = state_getinfo(root, "ups.model");
+		report_0_means_pass(ret || !dstate_snapshot_is_warming()
+			|| !dstate_getinfo("driver.snapshot.warming")
+			|| !valueStr || strcmp(valueStr, "Model \\\"X\\\"")
+			|| state_getinfo(root, "ups.status") || state_getinfo(root, "ups.alarm")
+			|| state_getinfo(root, "driver.state"));
+		printf(" test for dstate_snapshot_save()/dstate_snapshot_load() round-trip: '%s'; got (escaped) 'Model \\\"X\\\"'?\n", NUT_STRARG(valueStr));
+	}
+
+	/* #31 */
+	ret = (dstate_getinfo("ups.model") != NULL);
+	dstate_setinfo("ups.model", "%s", "Model Y");
+	ret = ret || !dstate_getinfo("ups.model");
+	dstate_snapshot_warmed();
+	valueStr = dstate_getinfo("ups.model");
+	report_0_means_pass(ret || dstate_snapshot_is_warming()
+		|| dstate_getinfo("driver.snapshot.warming")
+		|| dstate_getinfo("ups.status") || dstate_getinfo("input.voltage")
+		|| !valueStr || strcmp(valueStr, "Model Y"));
+	printf(" test for dstate_getinfo() and dstate_snapshot_warmed() dropping data not refreshed by the driver: '%s'; got 'Model Y' only?\n", NUT_STRARG(valueStr));
+
+	/* Test case #32 (from scratch)
+	 * A standard status token rejected for lack of room is not tracked.
+	 */
+	{
+		char	filler[ST_MAX_VALUE_LEN - 2];
+
+		memset(filler, 'X', sizeof(filler) - 1);
+		filler[sizeof(filler) - 1] = '\0';
+
+		status_init();
+		status_set(filler);
+		status_set("OL");
+		report_0_means_pass(status_get("OL") != 0);
+		printf(" test for status_set() with a standard token which does not fit: got no OL?\n");
+	}
+
+	/* Test case #33 (from scratch)
+	 * A snapshot older than allowed is dropped even if still warming.
+	 */
+	{
+		const char	*fn = "driver_methods_utest.snapshot";
+
+		dstate_free();
+		dstate_setinfo("ups.model", "%s", "Model Z");
+		ret = dstate_snapshot_save(fn);
+		dstate_free();
+
+		ret = (ret != 1) || (dstate_snapshot_load(fn, 1) != 1);
+		unlink(fn);
+
+		/* not expired yet */
+		dstate_poll_pending();
+		ret = ret || !dstate_getinfo("driver.snapshot.warming");
+
+		sleep(2);
+		dstate_poll_pending();
+		root = (st_tree_t *)dstate_getroot();
+		report_0_means_pass(ret || !dstate_snapshot_is_warming()
+			|| !dstate_is_stale()
+			|| dstate_getinfo("driver.snapshot.warming")
+			|| state_getinfo(root, "ups.model"));
+		printf(" test for dstate_poll_pending() expiring a warm start snapshot: got no stale 'Model Z' served?\n");
+	}
+
 	/* Finish */
 	printf("test_rules completed. Total cases %d, passed %d, failed %d\n",
 		cases_passed+cases_failed, cases_passed, cases_failed);
@@ -33,11 +33,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "hidtypes.h"
 #include "usb-common.h"
 #include "common.h"
 
 void GetValue(const unsigned char *Buf, HIDData_t *pData, long *pValue);
+void CompileValueDecoder(HIDData_t *pData);
 
 static void Usage(char *name) {
 	printf("%s [<buf> <offset> <size> <min> <max> <expect>]\n", name);
@@ -50,6 +52,9 @@ static void Usage(char *name) {
 	printf("\n");
 	printf("%s \"0c 64 11 0d\" 8 16 0 65535 3345\n", name);
 	printf("\nIf no arguments are given a builtin set of tests are run.\n");
+	printf("\n%s -b [<count>]\n", name);
+	printf("  times <count> (default 1000000) decodings of a sample report\n");
+	printf("  with precompiled item decoders, and with per-read setup\n");
 }
 
 static void PrintBufAndData(uint8_t *buf, size_t bufSize, HIDData_t *pData) {
@@ -66,6 +71,187 @@ static void PrintBufAndData(uint8_t *buf, size_t bufSize, HIDData_t *pData) {
 		pData->LogMax, (unsigned long)pData->LogMax);
 }
 
+/* GetValue() as it was before item decoders were precompiled: work out
+ * the bit position, mask and sign of the item for every read. Used as
+ * reference for results and speed. */
+static void ReferenceGetValue(const unsigned char *Buf, const HIDData_t *pData, long *pValue)
+{
+	int	Weight, Bit;
+	unsigned long mask, signbit, magMax, magMin, top;
+	long	value = 0;
+
+	Bit = pData->Offset + 8;	/* First byte of report is report ID */
+
+	for (Weight = 0; Weight < pData->Size; Weight++, Bit++) {
+		int	State = Buf[Bit >> 3] & (1 << (Bit & 7));
+
+		if(State) {
+			value += (1L << Weight);
+		}
+	}
+
+	magMax = pData->LogMax >= 0 ? (unsigned long)(pData->LogMax) : (unsigned long)(-(pData->LogMax + 1));
+	magMin = pData->LogMin >= 0 ? (unsigned long)(pData->LogMin) : (unsigned long)(-(pData->LogMin + 1));
+
+	/* hibit() of hidparser.c */
+	top = magMax > magMin ? magMax : magMin;
+	for (Bit = 0; top; Bit++) {
+		top >>= 1;
+	}
+	signbit = 1L << Bit;
+
+	mask = (signbit - 1) | ((pData->LogMin < 0) ? signbit : 0);
+	value = (long)((unsigned long)(value) & mask);
+	if (pData->LogMin < 0 && ((unsigned long)(value) & signbit) != 0) {
+		value |= ~mask;
+	}
+
+	if (value < pData->LogMin) {
+		value = pData->LogMin;
+	} else if (value > pData->LogMax) {
+		value = pData->LogMax;
+	}
+
+	*pValue = value;
+}
+
+/* small deterministic pseudo-random sequence, same on all platforms */
+static uint32_t lcg_state = 12345;
+static uint32_t lcg_next(void) {
+	lcg_state = lcg_state * 1103515245U + 12345U;
+	return (lcg_state >> 8) & 0xffffff;
+}
+
+/* pick logical limits which fit in an item of the given size */
+static void PickLimits(HIDData_t *pData) {
+	long	top = (pData->Size >= 31) ? 2147483647L : (1L << pData->Size) - 1;
+
+	switch (lcg_next() % 4) {
+	case 0:	/* unsigned, full range */
+		pData->LogMin = 0;
+		pData->LogMax = top;
+		break;
+	case 1:	/* signed, full range */
+		pData->LogMin = (pData->Size >= 32) ? -2147483647L - 1 : -(top / 2) - 1;
+		pData->LogMax = top / 2;
+		break;
+	case 2:	/* unsigned, narrower than the field */
+		pData->LogMin = 0;
+		pData->LogMax = (long)(lcg_next() % (unsigned long)top) + 1;
+		break;
+	default:	/* like "assumed" limits of broken descriptors */
+		pData->LogMin = -1;
+		pData->LogMax = top / 2;
+		break;
+	}
+}
+
+/* compare precompiled decoders with the reference implementation */
+static int RunDecoderTests(void) {
+	int	failed = 0;
+	size_t	i, j;
+	uint8_t	reportBuf[64];
+	HIDData_t	data;
+	long	value, expected;
+
+	for (i = 0; i < 20000; i++) {
+		for (j = 0; j < sizeof(reportBuf); j++) {
+			reportBuf[j] = (uint8_t)lcg_next();
+		}
+		memset((void *)&data, 0, sizeof(data));
+		data.Offset = (uint8_t)(lcg_next() % 200);
+		data.Size = (uint8_t)(lcg_next() % 32 + 1);
+		PickLimits(&data);
+
+		CompileValueDecoder(&data);
+		GetValue(reportBuf, &data, &value);
+		ReferenceGetValue(reportBuf, &data, &expected);
+
+		if (value != expected) {
+			printf("Decoder test #%" PRIuSIZE " ", i + 1);
+			PrintBufAndData(reportBuf, (size_t)((data.Offset + data.Size + 7) / 8 + 1), &data);
+			printf(" value %ld FAIL expected %ld\n", value, expected);
+			failed++;
+		}
+	}
+
+	printf("\nPrecompiled decoders vs. reference implementation: %" PRIuSIZE " random items, %d failed",
+		i, failed);
+	return failed;
+}
+
+static int RunBenchmark(const char *arg) {
+	/* a UPS status report: flags, 8/16/32-bit values, signed ones */
+	static const struct {
+		uint8_t Offset, Size;
+		long LogMin, LogMax;
+	} items[] = {
+		{ 0, 1, 0, 1 }, { 1, 1, 0, 1 }, { 2, 1, 0, 1 }, { 3, 1, 0, 1 },
+		{ 4, 1, 0, 1 }, { 5, 1, 0, 1 }, { 6, 1, 0, 1 }, { 7, 1, 0, 1 },
+		{ 8, 8, 0, 100 }, { 16, 16, 0, 65535 }, { 32, 16, 0, 65535 },
+		{ 48, 16, -32768, 32767 }, { 64, 8, -128, 127 }, { 72, 12, 0, 4095 },
+		{ 84, 4, 0, 15 }, { 88, 32, 0, 2147483647 }
+	};
+	HIDData_t	data[SIZEOF_ARRAY(items)];
+	uint8_t	reportBuf[16];
+	unsigned long	count = 1000000, n;
+	size_t	i;
+	long	value, sum = 0, refsum = 0;
+	clock_t	start;
+	double	t_ref, t_compiled;
+
+	if (arg) {
+		count = strtoul(arg, NULL, 10);
+		if (count == 0)
+			count = 1;
+	}
+
+	for (i = 0; i < sizeof(reportBuf); i++) {
+		reportBuf[i] = (uint8_t)lcg_next();
+	}
+	memset((void *)data, 0, sizeof(data));
+	for (i = 0; i < SIZEOF_ARRAY(items); i++) {
+		data[i].Offset = items[i].Offset;
+		data[i].Size = items[i].Size;
+		data[i].LogMin = items[i].LogMin;
+		data[i].LogMax = items[i].LogMax;
+		CompileValueDecoder(&data[i]);
+	}
+
+	start = clock();
+	for (n = 0; n < count; n++) {
+		reportBuf[1] = (uint8_t)n;
+		for (i = 0; i < SIZEOF_ARRAY(items); i++) {
+			ReferenceGetValue(reportBuf, &data[i], &value);
+			refsum += value;
+		}
+	}
+	t_ref = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	start = clock();
+	for (n = 0; n < count; n++) {
+		reportBuf[1] = (uint8_t)n;
+		for (i = 0; i < SIZEOF_ARRAY(items); i++) {
+			GetValue(reportBuf, &data[i], &value);
+			sum += value;
+		}
+	}
+	t_compiled = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("%lu reports of %" PRIuSIZE " items\n", count, SIZEOF_ARRAY(items));
+	printf(" * per-read setup:      %.3f s, %.1f ns/item\n",
+		t_ref, t_ref * 1e9 / ((double)count * SIZEOF_ARRAY(items)));
+	printf(" * precompiled decoder: %.3f s, %.1f ns/item\n",
+		t_compiled, t_compiled * 1e9 / ((double)count * SIZEOF_ARRAY(items)));
+
+	if (sum != refsum) {
+		printf("FAIL: decoded values differ (checksum %ld vs %ld)\n", sum, refsum);
+		return 1;
+	}
+
+	return 0;
+}
+
 static int RunBuiltInTests(char *argv[]) {
 	int exitStatus = 0;
 	size_t i;
@@ -229,6 +415,7 @@ static int RunBuiltInTests(char *argv[]) {
 	printf(" * uint8_t casting with multiplication, unsigned char :\t%d", rdlen);
 	REPORT_VERDICT (rdlen == 425)
 
+	REPORT_VERDICT (RunDecoderTests() == 0)
 
 	return (exitStatus);
 }
@@ -274,6 +461,15 @@ int main (int argc, char *argv[]) {
 	case 1:
 		status = RunBuiltInTests(argv);
 		break;
+	case 2:
+	case 3:
+		if (!strcmp(argv[1], "-b")) {
+			status = RunBenchmark(argc > 2 ? argv[2] : NULL);
+			break;
+		}
+		Usage(argv[0]);
+		status = 2;
+		break;
 	case 7:
 		status = RunCommandLineTest(argv);
 		break;
@@ -0,0 +1,228 @@
+/* usbhid-bench.c - usbhid-ups benchmark against replayed USB HID devices
+ *
+ * Runs the usbhid-ups driver code (linked from libdummy_usbhid.la) with
+ * the replay communication layer of driver-replay-usb.c instead of libusb,
+ * through start-up and then a driver main loop like that of main.c for
+ * a few poll intervals, and prints one line of measurements:
+ *	init_ms, init_cpu_ms	wall clock and CPU time of upsdrv_initups()
+ *				and upsdrv_initinfo()
+ *	updates			upsdrv_updateinfo() calls done by the loop
+ *	update_ms, update_cpu_ms	wall clock and CPU time per such call
+ *	reports			feature reports read per such call
+ *	events			interrupt reports handed to the driver
+ *	latency_ms, latency_max_ms	from the time an interrupt report was
+ *				due to the end of the call which published it
+ * See also NIT/usbhid-bench.sh which also counts heap allocations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include "config.h"
+#include "main.h"
+#include "dstate.h"
+#include "nut_stdint.h"
+#include "usbhid-ups.h"
+#include "apc-hid.h"
+#include "mge-hid.h"
+#include "cps-hid.h"
+#include "driver-replay-usb.h"
+
+#include <time.h>
+
+#define BENCH_MAX_VARS	32
+
+/* Devices which can be synthesized, with IDs their subdrivers claim */
+static const struct {
+	const char	*name;
+	subdriver_t	*sub;
+	uint16_t	vendorid, productid;
+	const char	*vendor, *product;
+} devices[] = {
+	{ "apc", &apc_subdriver, 0x051d, 0x0002, "American Power Conversion", "Back-UPS XS 1400U" },
+	{ "mge", &mge_subdriver, 0x0463, 0xffff, "EATON", "Eaton 5E" },
+	{ "cps", &cps_subdriver, 0x0764, 0x0501, "CPS", "CP1500PFCLCD" },
+	{ NULL, NULL, 0, 0, NULL, NULL }
+};
+
+static void help(void)
+{
+	printf("usbhid-ups benchmark against a replayed USB HID device\n\n");
+	printf("usage: usbhid-bench [OPTIONS]\n\n");
+	printf("  -s <device>	synthesize a device: apc, mge or cps (default: apc)\n");
+	printf("  -r <file>	replay the device recorded in a driver debug log\n");
+	printf("		(usbhid-ups -DDDDD) instead\n");
+	printf("  -c <count>	poll intervals to run the driver loop for (default: 5;\n");
+	printf("		0: just the first update)\n");
+	printf("  -i <seconds>	poll interval (default: 1)\n");
+	printf("  -e <seconds>	period of synthesized interrupt reports\n");
+	printf("		(default: 1.5 poll intervals, 0: none)\n");
+	printf("  -x <var>=<val>	driver option (default: pollfreq as poll interval)\n");
+	printf("  -D		raise debugging level\n");
+	printf("\nThe driver socket is created in NUT_STATEPATH.\n");
+}
+
+static double cpu_ms(clock_t from, clock_t to)
+{
+	return (double)(to - from) * 1000 / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv)
+{
+	const char	*logfile = NULL, *synth = "apc";
+	char	*var[BENCH_MAX_VARS], *val;
+	char	buf[SMALLBUF];
+	int	i, vars = 0, cycles = 5, interval = 1;
+	unsigned long	updates = 0, init_reports;
+	double	events = -1, duration, init_ms, update_ms = 0, update_cpu = 0;
+	struct timeval	t0, t1, timeout;
+	clock_t	c0, c1, init_cpu;
+	const replay_stats_t	*stats;
+
+	while ((i = getopt(argc, argv, "+hDs:r:c:i:e:x:")) != -1) {
+		switch (i) {
+		case 'D':
+			nut_debug_level++;
+			break;
+		case 's':
+			synth = optarg;
+			break;
+		case 'r':
+			logfile = optarg;
+			break;
+		case 'c':
+			cycles = atoi(optarg);
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'e':
+			events = atof(optarg);
+			break;
+		case 'x':
+			if (vars >= BENCH_MAX_VARS)
+				fatalx(EXIT_FAILURE, "Too many driver options");
+			var[vars++] = optarg;
+			break;
+		case 'h':
+		default:
+			help();
+			exit(i == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	if (cycles < 0 || interval < 1)
+		fatalx(EXIT_FAILURE, "Bad count of poll intervals or poll interval");
+	if (events < 0)
+		events = 1.5 * interval;
+
+	progname = "usbhid-bench";
+	upsname = "bench";
+	device_path = xstrdup("auto");
+	poll_interval = (time_t)interval;
+
+	if (logfile) {
+		if (replay_load_log(logfile) < 0)
+			exit(EXIT_FAILURE);
+	} else {
+		for (i = 0; devices[i].name && strcmp(devices[i].name, synth); i++)
+			;
+		if (!devices[i].name)
+			fatalx(EXIT_FAILURE, "Unknown device to synthesize: %s", synth);
+		if (replay_synthesize(devices[i].sub,
+			devices[i].vendorid, devices[i].productid,
+			devices[i].vendor, devices[i].product) < 0
+		)
+			exit(EXIT_FAILURE);
+	}
+
+	upsdrv_makevartable();
+
+	snprintf(buf, sizeof(buf), "%d", interval);
+	storeval("pollfreq", buf);
+	for (i = 0; i < vars; i++) {
+		if ((val = strchr(var[i], '=')) != NULL)
+			*val++ = '\0';
+		storeval(var[i], val);
+	}
+
+	/* Start-up, as main.c goes about it */
+	gettimeofday(&t0, NULL);
+	c0 = clock();
+	upsdrv_initups();
+	gettimeofday(&t1, NULL);
+	c1 = clock();
+	init_ms = difftimeval(t1, t0) * 1000;
+	init_cpu = c1 - c0;
+
+	dstate_init(progname, upsname);
+
+	gettimeofday(&t0, NULL);
+	c0 = clock();
+	upsdrv_initinfo();
+	gettimeofday(&t1, NULL);
+	c1 = clock();
+	init_ms += difftimeval(t1, t0) * 1000;
+	init_cpu += c1 - c0;
+
+	stats = replay_get_stats();
+	init_reports = stats->get_report;
+
+	/* The driver loop, for so many poll intervals */
+	duration = (double)cycles * interval;
+	replay_start((double)interval / 2, events, duration);
+	gettimeofday(&t0, NULL);
+
+	while (!exit_flag) {
+		struct timeval	u0, u1;
+		clock_t	uc0;
+
+		gettimeofday(&timeout, NULL);
+		timeout.tv_sec += poll_interval;
+
+		gettimeofday(&u0, NULL);
+		uc0 = clock();
+		upsdrv_updateinfo();
+		replay_published();
+		gettimeofday(&u1, NULL);
+		update_cpu += cpu_ms(uc0, clock());
+		update_ms += difftimeval(u1, u0) * 1000;
+		updates++;
+
+		if (difftimeval(u1, t0) >= duration)
+			break;
+
+		while (!dstate_poll_fds(timeout, extrafd) && !exit_flag)
+			;
+	}
+
+	replay_stop();
+
+	printf("init_ms=%.1f init_cpu_ms=%.1f updates=%lu update_ms=%.2f update_cpu_ms=%.2f"
+		" reports=%.1f events=%lu latency_ms=%.1f latency_max_ms=%.1f\n",
+		init_ms, cpu_ms(0, init_cpu), updates,
+		update_ms / (double)updates, update_cpu / (double)updates,
+		(double)(stats->get_report - init_reports) / (double)updates,
+		stats->published,
+		stats->published ? stats->latency_sum * 1000 / (double)stats->published : 0,
+		stats->latency_max * 1000);
+
+	upsdrv_cleanup();
+	dstate_free();
+	vartab_free();
+	free(device_path);
+	device_path = NULL;
+
+	exit(EXIT_SUCCESS);
+}
@@ -33,6 +33,7 @@ int nutscan_unload_usb_library(void);
 
 #include "upsclient.h"
 #include "nutscan-usb.h"
+#include "usb-cache.h"
 #include <stdio.h>
 #include <string.h>
 #include <ltdl.h>
@@ -403,6 +404,27 @@ static int nut_usb_get_string(
 	return len;
 }
 
+/* Like nut_usb_get_string(), or the string from the USB scan cache
+ * entry when the device was not opened (udev is NULL) */
+static int nut_usb_get_string_or_cached(
+	libusb_device_handle *udev,
+	const char *cached,
+	int StringIdx,
+	char *buf,
+	size_t buflen)
+{
+	if (udev) {
+		return nut_usb_get_string(udev, StringIdx, buf, buflen);
+	}
+
+	if (!cached) {
+		return -1;
+	}
+
+	snprintf(buf, buflen, "%s", cached);
+	return (int)strlen(buf);
+}
+
 /* return NULL if error */
 nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 {
@@ -442,10 +464,19 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 
 	nutscan_usb_t	default_scanopts;
 
+	/* Strings of the device from the USB scan cache, if it was not opened */
+	const nut_usb_cache_entry_t	*cached = NULL;
+	int strings_read;
+
 #if WITH_LIBUSB_1_0
+	/* Devices whose strings were read recently (e.g. by drivers)
+	 * need not be opened again; only with libusb-1.0 can they be
+	 * told apart by their numeric bus and device address */
+	nut_usb_cache_t	scan_cache;
 	libusb_device *dev;
 	libusb_device **devlist;
 	uint8_t bus_num;
+	uint8_t device_addr;
 	/* Sort of like device_port above, but different (should be
 	 * more closely about physical port number than logical device
 	 * enumeration results). Uses libusb_get_port_number() where
@@ -504,6 +535,8 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 		return NULL;
 	}
 
+	nut_usb_cache_load(&scan_cache);
+
 	for (i = 0; i < devcount; i++) {
 
 		dev = devlist[i];
@@ -521,6 +554,7 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 		if (busname == NULL) {
 			(*nut_usb_free_device_list)(devlist, 1);
 			(*nut_usb_exit)(NULL);
+			nut_usb_cache_free(&scan_cache);
 			upsdebug_with_errno(0, "%s: Out of memory", __func__);
 			/* nutscan_avail_usb = 0; */
 			return NULL;
@@ -531,11 +565,12 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 		if (device_port == NULL) {
 			(*nut_usb_free_device_list)(devlist, 1);
 			(*nut_usb_exit)(NULL);
+			nut_usb_cache_free(&scan_cache);
 			upsdebug_with_errno(0, "%s: Out of memory", __func__);
 			/* nutscan_avail_usb = 0; */
 			return NULL;
 		} else {
-			uint8_t device_addr = (*nut_usb_get_device_address)(dev);
+			device_addr = (*nut_usb_get_device_address)(dev);
 			if (device_addr > 0) {
 				snprintf(device_port, 4, "%03d", device_addr);
 			} else {
@@ -548,6 +583,7 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 			if (bus_port == NULL) {
 				(*nut_usb_free_device_list)(devlist, 1);
 				(*nut_usb_exit)(NULL);
+				nut_usb_cache_free(&scan_cache);
 				upsdebug_with_errno(0, "%s: Out of memory", __func__);
 				/* nutscan_avail_usb = 0; */
 				return NULL;
@@ -584,10 +620,17 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 				is_usb_device_supported(usb_device_table,
 					VendorID, ProductID, &alt_driver_names)) != NULL) {
 
-				/* open the device */
+				/* open the device, unless its strings are cached */
 #if WITH_LIBUSB_1_0
-				ret = (*nut_usb_open)(dev, &udev);
-				if (!udev || ret != LIBUSB_SUCCESS) {
+				udev = NULL;
+				cached = nut_usb_cache_find(&scan_cache, bus_num, device_addr,
+					VendorID, ProductID, bcdDevice);
+				if (cached) {
+					upsdebugx(2, "%s: using the cached strings of device "
+						"bus '%s' device/port '%s'",
+						__func__, busname, device_port);
+				} else
+				if ((ret = (*nut_usb_open)(dev, &udev)) != LIBUSB_SUCCESS || !udev) {
 					upsdebugx(0, "WARNING: %s: "
 						"Failed to open device "
 						"bus '%s' device/port '%s' "
@@ -624,12 +667,15 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 				}
 #endif
 
+				strings_read = 1;
+
 				/* get serial number */
 				if (iSerialNumber) {
-					ret = nut_usb_get_string(udev,
+					ret = nut_usb_get_string_or_cached(udev,
+						cached ? cached->Serial : NULL,
 						iSerialNumber, string, sizeof(string));
 					if (ret > 0) {
-						serialnumber = strdup(str_rtrim(string, ' '));
+						serialnumber = strdup(string);
 						if (serialnumber == NULL) {
 							(*nut_usb_close)(udev);
 #if WITH_LIBUSB_1_0
@@ -641,20 +687,24 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 							}
 							(*nut_usb_free_device_list)(devlist, 1);
 							(*nut_usb_exit)(NULL);
+							nut_usb_cache_free(&scan_cache);
 #endif	/* WITH_LIBUSB_1_0 */
 							upsdebug_with_errno(0, "%s: Out of memory", __func__);
 							/* nutscan_avail_usb = 0; */
 							return NULL;
 						}
+					} else {
+						strings_read = 0;
 					}
 				}
 
 				/* get product name */
 				if (iProduct) {
-					ret = nut_usb_get_string(udev,
+					ret = nut_usb_get_string_or_cached(udev,
+						cached ? cached->Product : NULL,
 						iProduct, string, sizeof(string));
 					if (ret > 0) {
-						device_name = strdup(str_rtrim(string, ' '));
+						device_name = strdup(string);
 						if (device_name == NULL) {
 							free(serialnumber);
 							(*nut_usb_close)(udev);
@@ -667,20 +717,24 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 							}
 							(*nut_usb_free_device_list)(devlist, 1);
 							(*nut_usb_exit)(NULL);
+							nut_usb_cache_free(&scan_cache);
 #endif	/* WITH_LIBUSB_1_0 */
 							upsdebug_with_errno(0, "%s: Out of memory", __func__);
 							/* nutscan_avail_usb = 0; */
 							return NULL;
 						}
+					} else {
+						strings_read = 0;
 					}
 				}
 
 				/* get vendor name */
 				if (iManufacturer) {
-					ret = nut_usb_get_string(udev,
+					ret = nut_usb_get_string_or_cached(udev,
+						cached ? cached->Vendor : NULL,
 						iManufacturer, string, sizeof(string));
 					if (ret > 0) {
-						vendor_name = strdup(str_rtrim(string, ' '));
+						vendor_name = strdup(string);
 						if (vendor_name == NULL) {
 							free(serialnumber);
 							free(device_name);
@@ -694,14 +748,38 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 							}
 							(*nut_usb_free_device_list)(devlist, 1);
 							(*nut_usb_exit)(NULL);
+							nut_usb_cache_free(&scan_cache);
 #endif	/* WITH_LIBUSB_1_0 */
 							upsdebug_with_errno(0, "%s: Out of memory", __func__);
 							/* nutscan_avail_usb = 0; */
 							return NULL;
 						}
+					} else {
+						strings_read = 0;
 					}
 				}
 
+#if WITH_LIBUSB_1_0
+				/* not caching what may be a transient failure */
+				if (udev && strings_read) {
+					nut_usb_cache_update(&scan_cache, bus_num, device_addr,
+						VendorID, ProductID, bcdDevice,
+						vendor_name, device_name, serialnumber);
+				}
+#else	/* => WITH_LIBUSB_0_1 */
+				NUT_UNUSED_VARIABLE(strings_read);
+#endif	/* WITH_LIBUSB_1_0 */
+
+				if (serialnumber) {
+					str_rtrim(serialnumber, ' ');
+				}
+				if (device_name) {
+					str_rtrim(device_name, ' ');
+				}
+				if (vendor_name) {
+					str_rtrim(vendor_name, ' ');
+				}
+
 				nut_dev = nutscan_new_device();
 				if (nut_dev == NULL) {
 					upsdebugx(0, "%s: Memory allocation error", __func__);
@@ -719,6 +797,7 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 					}
 					(*nut_usb_free_device_list)(devlist, 1);
 					(*nut_usb_exit)(NULL);
+					nut_usb_cache_free(&scan_cache);
 #endif	/* WITH_LIBUSB_1_0 */
 					return NULL;
 				}
@@ -856,7 +935,9 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 
 				memset (string, 0, sizeof(string));
 
-				(*nut_usb_close)(udev);
+				if (udev) {
+					(*nut_usb_close)(udev);
+				}
 			}
 #if WITH_LIBUSB_0_1
 		}
@@ -872,6 +953,9 @@ nutscan_device_t * nutscan_scan_usb(nutscan_usb_t * scanopts)
 
 	(*nut_usb_free_device_list)(devlist, 1);
 	(*nut_usb_exit)(NULL);
+
+	nut_usb_cache_save(&scan_cache);
+	nut_usb_cache_free(&scan_cache);
 #endif	/* WITH_LIBUSB_0_1 */
 
 	return nutscan_rewind_device(current_nut_dev);